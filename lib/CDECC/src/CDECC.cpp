@@ -0,0 +1,151 @@
+/*
+ * EDC and ECC generation for CD-ROM data sectors.
+ *
+ *  Copyright (c) 2024 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CDECC.h"
+#include <string.h>
+
+// EDC polynomial P(x) = (x^16 + x^15 + x^2 + 1) (x^16 + x^2 + x + 1),
+// processed least significant bit first.
+#define EDC_POLY_REFLECTED 0xD8018001
+
+// GF(2^8) primitive polynomial P(x) = x^8 + x^4 + x^3 + x^2 + 1
+#define GF_POLY 0x11D
+
+// P parity: 86 columns of 24 bytes, stride 86 bytes
+#define P_COLUMNS 86
+#define P_ROWS 24
+
+// Q parity: 52 diagonals of 43 bytes, stride 88 bytes
+// wrapping around the 2236 bytes of header, data and P parity.
+#define Q_DIAGONALS 52
+#define Q_LENGTH 43
+#define Q_STRIDE 88
+#define Q_SIZE 2236
+
+static bool g_tables_ready;
+static uint32_t g_edc_table[256];
+static uint8_t g_ecc_f[256]; // Multiplication by alpha
+static uint8_t g_ecc_b[256]; // Division by (1 + alpha)
+
+static void build_tables()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint32_t edc = i;
+        for (int j = 0; j < 8; j++)
+        {
+            edc = (edc >> 1) ^ ((edc & 1) ? EDC_POLY_REFLECTED : 0);
+        }
+        g_edc_table[i] = edc;
+
+        uint8_t f = (uint8_t)((i << 1) ^ ((i & 0x80) ? GF_POLY : 0));
+        g_ecc_f[i] = f;
+        g_ecc_b[i ^ f] = i;
+    }
+
+    g_tables_ready = true;
+}
+
+uint32_t cdecc_edc(uint32_t edc, const uint8_t *data, size_t length)
+{
+    if (!g_tables_ready) build_tables();
+
+    const uint32_t *table = g_edc_table;
+    while (length--)
+    {
+        edc = (edc >> 8) ^ table[(edc ^ *data++) & 0xFF];
+    }
+    return edc;
+}
+
+// Each parity vector is evaluated with Horner's rule while the bytes are read.
+// At the end a holds sum(alpha^k * v_k) and b holds sum(v_k), from which
+// the two parity bytes follow directly.
+static inline void ecc_finish(uint8_t a, uint8_t b, uint8_t *dest, int count)
+{
+    a = g_ecc_b[g_ecc_f[a] ^ b];
+    dest[0] = a;
+    dest[count] = a ^ b;
+}
+
+// Compute P parity of the 2064 bytes at src into dest[0..171]
+static void ecc_compute_p(const uint8_t *src, uint8_t *dest)
+{
+    const uint8_t *f = g_ecc_f;
+    for (int column = 0; column < P_COLUMNS; column++)
+    {
+        const uint8_t *p = src + column;
+        uint8_t a = 0, b = 0;
+        for (int row = 0; row < P_ROWS; row++)
+        {
+            uint8_t v = *p;
+            p += P_COLUMNS;
+            a = f[a ^ v];
+            b ^= v;
+        }
+        ecc_finish(a, b, dest + column, P_COLUMNS);
+    }
+}
+
+// Compute Q parity of the 2236 bytes at src into dest[0..103]
+static void ecc_compute_q(const uint8_t *src, uint8_t *dest)
+{
+    const uint8_t *f = g_ecc_f;
+    for (int diagonal = 0; diagonal < Q_DIAGONALS; diagonal++)
+    {
+        int index = (diagonal >> 1) * P_COLUMNS + (diagonal & 1);
+        uint8_t a = 0, b = 0;
+        for (int i = 0; i < Q_LENGTH; i++)
+        {
+            uint8_t v = src[index];
+            index += Q_STRIDE;
+            if (index >= Q_SIZE) index -= Q_SIZE;
+            a = f[a ^ v];
+            b ^= v;
+        }
+        ecc_finish(a, b, dest + diagonal, Q_DIAGONALS);
+    }
+}
+
+void cdecc_encode_mode1(uint8_t *sector)
+{
+    uint32_t edc = cdecc_edc(0, sector, CDECC_EDC_OFFSET);
+    uint8_t *p = sector + CDECC_EDC_OFFSET;
+    p[0] = (uint8_t)(edc >> 0);
+    p[1] = (uint8_t)(edc >> 8);
+    p[2] = (uint8_t)(edc >> 16);
+    p[3] = (uint8_t)(edc >> 24);
+    memset(p + 4, 0, CDECC_P_OFFSET - CDECC_EDC_OFFSET - 4);
+
+    ecc_compute_p(sector + CDECC_HEADER_OFFSET, sector + CDECC_P_OFFSET);
+    ecc_compute_q(sector + CDECC_HEADER_OFFSET, sector + CDECC_Q_OFFSET);
+}
+
+bool cdecc_check_mode1(const uint8_t *sector)
+{
+    uint32_t edc = cdecc_edc(0, sector, CDECC_EDC_OFFSET);
+    const uint8_t *p = sector + CDECC_EDC_OFFSET;
+    uint32_t stored = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    if (edc != stored) return false;
+
+    uint8_t parity[CDECC_SECTOR_SIZE - CDECC_P_OFFSET];
+    ecc_compute_p(sector + CDECC_HEADER_OFFSET, parity);
+    ecc_compute_q(sector + CDECC_HEADER_OFFSET, parity + (CDECC_Q_OFFSET - CDECC_P_OFFSET));
+    return memcmp(parity, sector + CDECC_P_OFFSET, sizeof(parity)) == 0;
+}
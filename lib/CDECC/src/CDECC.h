@@ -0,0 +1,52 @@
+/*
+ * EDC and ECC generation for CD-ROM data sectors.
+ *
+ *  Copyright (c) 2024 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Generates the error detection and correction fields of MODE1 sectors
+// as specified in ECMA-130 section 14 and annex A. This allows raw 2352 byte
+// sectors to be reconstructed from the 2048 byte user data in ISO images.
+//
+// EDC is a 32-bit CRC computed with a 256-entry table.
+// ECC consists of Reed-Solomon product code P (RS(26,24)) and Q (RS(45,43))
+// parity over GF(2^8), computed with two 256-byte tables.
+// The tables are built in RAM on first use.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Layout of a 2352 byte MODE1 sector
+#define CDECC_SECTOR_SIZE   2352
+#define CDECC_HEADER_OFFSET 12
+#define CDECC_DATA_OFFSET   16
+#define CDECC_EDC_OFFSET    2064
+#define CDECC_P_OFFSET      2076
+#define CDECC_Q_OFFSET      2248
+
+// Update EDC value over data bytes.
+// Initial value for a sector is 0.
+uint32_t cdecc_edc(uint32_t edc, const uint8_t *data, size_t length);
+
+// Fill in the EDC, zero padding, P parity and Q parity of a MODE1 sector.
+// The sync pattern, header and user data must already be filled in.
+void cdecc_encode_mode1(uint8_t *sector);
+
+// Check the EDC and ECC fields of a MODE1 sector.
+// Returns true if they match the sector contents.
+bool cdecc_check_mode1(const uint8_t *sector);
@@ -0,0 +1,236 @@
+#include "CDECC.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Reference implementation written directly from the ECMA-130
+ * definitions, without lookup tables, to verify the optimized code. */
+
+// Bit-serial EDC, ECMA-130 14.3
+static uint32_t ref_edc(const uint8_t *data, size_t length)
+{
+    uint32_t edc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            uint32_t in = ((data[i] >> bit) ^ edc) & 1;
+            edc >>= 1;
+            if (in) edc ^= 0xD8018001;
+        }
+    }
+    return edc;
+}
+
+// Multiplication in GF(2^8) with P(x) = x^8 + x^4 + x^3 + x^2 + 1
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    uint8_t result = 0;
+    while (b)
+    {
+        if (b & 1) result ^= a;
+        a = (a << 1) ^ ((a & 0x80) ? 0x1D : 0);
+        b >>= 1;
+    }
+    return result;
+}
+
+// Byte of word n (0..1169) in the part of the sector covered by ECC.
+// Plane 0 and 1 are coded separately.
+static uint8_t ecc_byte(const uint8_t *sector, int n, int plane)
+{
+    return sector[12 + 2 * n + plane];
+}
+
+// Syndromes of a codeword with check matrix
+// H = | 1        1        ... 1 |
+//     | a^(n-1)  a^(n-2)  ... 1 |
+// are both zero for a valid codeword.
+static bool syndromes_zero(const uint8_t *v, int n)
+{
+    uint8_t s0 = 0, s1 = 0;
+    for (int i = 0; i < n; i++)
+    {
+        uint8_t alpha_pow = 1;
+        for (int k = 0; k < n - 1 - i; k++) alpha_pow = gf_mul(alpha_pow, 2);
+        s0 ^= v[i];
+        s1 ^= gf_mul(alpha_pow, v[i]);
+    }
+    return s0 == 0 && s1 == 0;
+}
+
+// ECMA-130 annex A: P vectors are columns, Q vectors are diagonals
+static bool ref_ecc_valid(const uint8_t *sector)
+{
+    for (int plane = 0; plane < 2; plane++)
+    {
+        for (int np = 0; np < 43; np++)
+        {
+            uint8_t v[26];
+            for (int mp = 0; mp < 26; mp++)
+            {
+                v[mp] = ecc_byte(sector, 43 * mp + np, plane);
+            }
+            if (!syndromes_zero(v, 26)) return false;
+        }
+
+        for (int nq = 0; nq < 26; nq++)
+        {
+            uint8_t v[45];
+            for (int mq = 0; mq < 43; mq++)
+            {
+                v[mq] = ecc_byte(sector, (44 * mq + 43 * nq) % 1118, plane);
+            }
+            v[43] = ecc_byte(sector, 43 * 26 + nq, plane);
+            v[44] = ecc_byte(sector, 44 * 26 + nq, plane);
+            if (!syndromes_zero(v, 45)) return false;
+        }
+    }
+    return true;
+}
+
+static int to_bcd(int value)
+{
+    return ((value / 10) << 4) | (value % 10);
+}
+
+// Build sync, header and user data of a MODE1 sector.
+// Remaining bytes are filled with garbage to check they get overwritten.
+static void make_sector(uint8_t *sector, uint32_t lba, uint32_t seed)
+{
+    memset(sector, 0xA5, CDECC_SECTOR_SIZE);
+    sector[0] = 0x00;
+    memset(sector + 1, 0xFF, 10);
+    sector[11] = 0x00;
+
+    uint32_t frames = lba + 150;
+    sector[12] = to_bcd(frames / (75 * 60));
+    sector[13] = to_bcd((frames / 75) % 60);
+    sector[14] = to_bcd(frames % 75);
+    sector[15] = 0x01;
+
+    for (int i = 0; i < 2048; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        sector[16 + i] = (seed == 0) ? 0 : (uint8_t)(seed >> 16);
+    }
+}
+
+bool test_edc()
+{
+    bool status = true;
+    COMMENT("test_edc()");
+
+    uint8_t sector[CDECC_SECTOR_SIZE];
+    make_sector(sector, 1234, 1);
+    TEST(cdecc_edc(0, sector, CDECC_EDC_OFFSET) == ref_edc(sector, CDECC_EDC_OFFSET));
+
+    // Incremental computation gives the same result
+    uint32_t edc = cdecc_edc(0, sector, 1000);
+    edc = cdecc_edc(edc, sector + 1000, CDECC_EDC_OFFSET - 1000);
+    TEST(edc == ref_edc(sector, CDECC_EDC_OFFSET));
+
+    // Single byte of the polynomial, table entry 0x80 equals polynomial itself
+    uint8_t byte = 0x80;
+    TEST(cdecc_edc(0, &byte, 1) == 0xD8018001);
+
+    return status;
+}
+
+bool test_encode()
+{
+    bool status = true;
+    COMMENT("test_encode()");
+
+    uint8_t sector[CDECC_SECTOR_SIZE];
+    uint8_t orig[CDECC_SECTOR_SIZE];
+
+    // All-zero user data
+    make_sector(sector, 0, 0);
+    memset(sector + CDECC_DATA_OFFSET, 0, 2048);
+    memcpy(orig, sector, sizeof(sector));
+    cdecc_encode_mode1(sector);
+    TEST(memcmp(sector, orig, CDECC_EDC_OFFSET) == 0);
+    uint32_t edc = ref_edc(sector, CDECC_EDC_OFFSET);
+    TEST(sector[2064] == (uint8_t)edc && sector[2065] == (uint8_t)(edc >> 8) &&
+         sector[2066] == (uint8_t)(edc >> 16) && sector[2067] == (uint8_t)(edc >> 24));
+    bool zeros = true;
+    for (int i = 2068; i < 2076; i++) if (sector[i] != 0) zeros = false;
+    TEST(zeros);
+    TEST(ref_ecc_valid(sector));
+    TEST(cdecc_check_mode1(sector));
+
+    // Random user data at a range of addresses
+    bool all_valid = true;
+    bool all_checked = true;
+    for (uint32_t i = 0; i < 64; i++)
+    {
+        uint32_t lba = i * 5113;
+        make_sector(sector, lba, i + 1);
+        cdecc_encode_mode1(sector);
+        if (!ref_ecc_valid(sector)) all_valid = false;
+        if (!cdecc_check_mode1(sector)) all_checked = false;
+    }
+    TEST(all_valid);
+    TEST(all_checked);
+
+    return status;
+}
+
+bool test_corruption()
+{
+    bool status = true;
+    COMMENT("test_corruption()");
+
+    uint8_t sector[CDECC_SECTOR_SIZE];
+    make_sector(sector, 4567, 99);
+    cdecc_encode_mode1(sector);
+    TEST(cdecc_check_mode1(sector));
+
+    // Any changed byte after the sync pattern must be detected
+    bool all_detected = true;
+    for (int i = 12; i < CDECC_SECTOR_SIZE; i += 7)
+    {
+        if (i >= 2068 && i < 2076) continue; // Zero padding is not covered
+        sector[i] ^= 0x10;
+        if (cdecc_check_mode1(sector)) all_detected = false;
+        sector[i] ^= 0x10;
+    }
+    TEST(all_detected);
+
+    sector[100] ^= 0x01;
+    TEST(!ref_ecc_valid(sector));
+    sector[100] ^= 0x01;
+
+    // Header is covered by ECC in MODE1
+    make_sector(sector, 4568, 99);
+    cdecc_encode_mode1(sector);
+    uint8_t other[CDECC_SECTOR_SIZE];
+    make_sector(other, 4567, 99);
+    cdecc_encode_mode1(other);
+    TEST(memcmp(sector + CDECC_P_OFFSET, other + CDECC_P_OFFSET, 4) != 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_edc() && test_encode() && test_corruption())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
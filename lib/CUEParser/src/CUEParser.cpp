@@ -43,7 +43,7 @@ CUEParser::CUEParser(): CUEParser("")
 }
 
 CUEParser::CUEParser(const char *cue_sheet):
-    m_cue_sheet(cue_sheet)
+    m_cue_sheet(cue_sheet), m_file_size_func(nullptr), m_file_size_context(nullptr)
 {
     restart();
 }
@@ -51,9 +51,16 @@ CUEParser::CUEParser(const char *cue_sheet):
 void CUEParser::restart()
 {
     m_parse_pos = m_cue_sheet;
+    m_file_count = 0;
     memset(&m_track_info, 0, sizeof(m_track_info));
 }
 
+void CUEParser::set_file_size_callback(CUEFileSizeFunc func, void *context)
+{
+    m_file_size_func = func;
+    m_file_size_context = context;
+}
+
 const CUETrackInfo *CUEParser::next_track()
 {
     // Previous track info is needed to track file offset
@@ -67,11 +74,23 @@ const CUETrackInfo *CUEParser::next_track()
     {
         if (strncasecmp(m_parse_pos, "FILE ", 5) == 0)
         {
+            if (m_file_count > 0 && m_track_info.track_number != 0 && m_file_size_func)
+            {
+                // Next file begins after the last track of the previous file
+                uint64_t size = m_file_size_func(m_file_size_context, m_track_info.file_index, m_track_info.filename);
+                if (size > m_track_info.file_offset && m_track_info.sector_length > 0)
+                {
+                    m_track_info.file_start = m_track_info.track_start
+                        + (size - m_track_info.file_offset) / m_track_info.sector_length;
+                }
+            }
+
             const char *p = read_quoted(m_parse_pos + 5, m_track_info.filename, sizeof(m_track_info.filename));
             m_track_info.file_mode = parse_file_mode(skip_space(p));
             m_track_info.file_offset = 0;
+            m_track_info.file_index = m_file_count++;
             m_track_info.track_mode = CUETrack_AUDIO;
-            prev_track_start = 0;
+            prev_track_start = m_track_info.file_start;
             prev_sector_length = get_sector_length(m_track_info.file_mode, m_track_info.track_mode);
         }
         else if (strncasecmp(m_parse_pos, "TRACK ", 6) == 0)
@@ -100,7 +119,7 @@ const CUETrackInfo *CUEParser::next_track()
             int index = strtoul(index_str, &endptr, 10);
 
             const char *time_str = skip_space(endptr);
-            uint32_t time = parse_time(time_str);
+            uint32_t time = m_track_info.file_start + parse_time(time_str);
 
             if (index == 0)
             {
@@ -226,6 +245,8 @@ CUEFileMode CUEParser::parse_file_mode(const char *src)
         return CUEFile_WAVE;
     else if (strncasecmp(src, "AIFF", 4) == 0)
         return CUEFile_AIFF;
+    else if (strncasecmp(src, "FLAC", 4) == 0)
+        return CUEFile_FLAC;
     else
         return CUEFile_BINARY; // Default to binary mode
 }
@@ -275,6 +296,11 @@ uint32_t CUEParser::get_sector_length(CUEFileMode filemode, CUETrackMode trackmo
             default:                    return 2048;
         }
     }
+    else if (filemode == CUEFile_WAVE || filemode == CUEFile_FLAC)
+    {
+        // Decoded audio is accessed in raw CD audio sectors
+        return 2352;
+    }
     else
     {
         return 0;
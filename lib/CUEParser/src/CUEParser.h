@@ -32,6 +32,7 @@ enum CUEFileMode
     CUEFile_MP3,
     CUEFile_WAVE,
     CUEFile_AIFF,
+    CUEFile_FLAC,
 };
 
 enum CUETrackMode
@@ -55,6 +56,11 @@ struct CUETrackInfo
     CUEFileMode file_mode;
     uint64_t file_offset; // corresponds to track_start below
 
+    // Index of the FILE entry in the cue sheet, starting from 0,
+    // and the LBA where the data of that file begins.
+    int file_index;
+    uint32_t file_start;
+
     // Track number and mode in CD format
     int track_number;
     CUETrackMode track_mode;
@@ -74,6 +80,10 @@ struct CUETrackInfo
     uint32_t track_start;
 };
 
+// Callback for getting the size of the data in a file, in bytes.
+// Returns 0 if the size is not known.
+typedef uint64_t (*CUEFileSizeFunc)(void *context, int file_index, const char *filename);
+
 class CUEParser
 {
 public:
@@ -86,6 +96,13 @@ public:
     // Restart parsing from beginning of file
     void restart();
 
+    // Set callback for getting file sizes.
+    // When a cue sheet has multiple FILE entries, the INDEX times are relative
+    // to the start of each file. The size of the previous file is needed to
+    // find where the next one begins on the disc. Without the callback the
+    // times are taken to be absolute.
+    void set_file_size_callback(CUEFileSizeFunc func, void *context);
+
     // Get information for next track.
     // Returns nullptr when there are no more tracks.
     // The returned pointer remains valid until next call to next_track()
@@ -96,6 +113,9 @@ protected:
     const char *m_cue_sheet;
     const char *m_parse_pos;
     CUETrackInfo m_track_info;
+    int m_file_count;
+    CUEFileSizeFunc m_file_size_func;
+    void *m_file_size_context;
 
     // Skip any whitespace at beginning of line.
     // Returns false if at end of string.
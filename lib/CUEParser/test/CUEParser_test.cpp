@@ -92,7 +92,7 @@ FILE "Sound.wav" WAVE
         TEST(track->file_offset == 0);
         TEST(track->track_number == 11);
         TEST(track->track_mode == CUETrack_AUDIO);
-        TEST(track->sector_length == 0);
+        TEST(track->sector_length == 2352);
         TEST(track->track_start == 0);
         TEST(track->data_start == 2 * 75);
     }
@@ -178,9 +178,140 @@ TRACK 03 MODE1/2352
 }
 
 
+bool test_flac()
+{
+    bool status = true;
+    const char *cue_sheet = R"(
+FILE "Album.flac" FLAC
+  TRACK 01 AUDIO
+    INDEX 01 00:00:00
+  TRACK 02 AUDIO
+    INDEX 00 03:10:40
+    INDEX 01 03:12:40
+    )";
+
+    CUEParser parser(cue_sheet);
+
+    COMMENT("test_flac()");
+    COMMENT("Test TRACK 01");
+    const CUETrackInfo *track = parser.next_track();
+    TEST(track != NULL);
+    if (track)
+    {
+        TEST(strcmp(track->filename, "Album.flac") == 0);
+        TEST(track->file_mode == CUEFile_FLAC);
+        TEST(track->file_offset == 0);
+        TEST(track->track_mode == CUETrack_AUDIO);
+        TEST(track->sector_length == 2352);
+    }
+
+    COMMENT("Test TRACK 02");
+    track = parser.next_track();
+    TEST(track != NULL);
+    uint32_t start2 = ((3 * 60) + 10) * 75 + 40;
+    if (track)
+    {
+        TEST(track->file_mode == CUEFile_FLAC);
+        TEST(track->file_offset == 2352 * start2);
+        TEST(track->track_start == start2);
+        TEST(track->data_start == start2 + 2 * 75);
+    }
+
+    return status;
+}
+
+static uint64_t test_file_size(void *context, int file_index, const char *)
+{
+    const uint64_t *sizes = (const uint64_t*)context;
+    return sizes[file_index];
+}
+
+bool test_multifile()
+{
+    bool status = true;
+    const char *cue_sheet = R"(
+FILE "Game (Track 1).bin" BINARY
+  TRACK 01 MODE1/2352
+    INDEX 01 00:00:00
+FILE "Game (Track 2).bin" BINARY
+  TRACK 02 AUDIO
+    INDEX 00 00:00:00
+    INDEX 01 00:02:00
+FILE "Game (Track 3).bin" BINARY
+  TRACK 03 AUDIO
+    INDEX 00 00:00:00
+    INDEX 01 00:02:00
+  TRACK 04 AUDIO
+    INDEX 01 01:00:00
+    )";
+
+    uint64_t sizes[3] = {2352 * 1000, 2352 * 500, 2352 * 9000};
+    CUEParser parser(cue_sheet);
+    parser.set_file_size_callback(test_file_size, sizes);
+
+    COMMENT("test_multifile()");
+    COMMENT("Test TRACK 01");
+    const CUETrackInfo *track = parser.next_track();
+    TEST(track != NULL);
+    if (track)
+    {
+        TEST(track->file_index == 0);
+        TEST(track->file_start == 0);
+        TEST(track->file_offset == 0);
+        TEST(track->track_start == 0);
+        TEST(track->data_start == 0);
+    }
+
+    COMMENT("Test TRACK 02");
+    track = parser.next_track();
+    TEST(track != NULL);
+    if (track)
+    {
+        TEST(strcmp(track->filename, "Game (Track 2).bin") == 0);
+        TEST(track->file_index == 1);
+        TEST(track->file_start == 1000);
+        TEST(track->file_offset == 0);
+        TEST(track->track_start == 1000);
+        TEST(track->data_start == 1150);
+    }
+
+    COMMENT("Test TRACK 03");
+    track = parser.next_track();
+    TEST(track != NULL);
+    if (track)
+    {
+        TEST(track->file_index == 2);
+        TEST(track->file_start == 1500);
+        TEST(track->file_offset == 0);
+        TEST(track->track_start == 1500);
+        TEST(track->data_start == 1650);
+    }
+
+    COMMENT("Test TRACK 04");
+    track = parser.next_track();
+    TEST(track != NULL);
+    if (track)
+    {
+        TEST(track->file_index == 2);
+        TEST(track->file_start == 1500);
+        TEST(track->file_offset == 2352 * 4500);
+        TEST(track->track_start == 1500 + 4500);
+        TEST(track->data_start == 1500 + 4500);
+    }
+
+    COMMENT("Test restart");
+    parser.restart();
+    track = parser.next_track();
+    TEST(track != NULL && track->file_start == 0);
+    track = parser.next_track();
+    TEST(track != NULL && track->file_start == 1000);
+
+    return status;
+}
+
 int main()
 {
-    if (test_basics() && test_datatracks())
+    if (test_basics() && test_datatracks() && test_flac() && test_multifile())
     {
         return 0;
     }
@@ -0,0 +1,854 @@
+/*
+ * Streaming FLAC decoder for CD audio, suitable for embedded systems.
+ *
+ *  Copyright (c) 2024 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Refer to https://xiph.org/flac/format.html for the format description.
+//
+// Restrictions compared to full FLAC format:
+// - Only 44.1 kHz 16-bit stereo streams are accepted
+// - Frame footer CRC-16 is not verified, header CRC-8 is
+
+#include "FLACDecoder.h"
+#include <string.h>
+
+// Bisection stops when the target frame is known to be within this
+// many bytes, the rest is found by walking the frame headers.
+#define FLAC_SEEK_LINEAR_BYTES 32768
+
+// Longest distance to search for a frame header
+#define FLAC_MAX_FRAME_BYTES 65536
+
+FLACDecoder::FLACDecoder()
+{
+    m_input = nullptr;
+    m_file_id = 0;
+    m_file_size = 0;
+    m_min_blocksize = m_max_blocksize = 0;
+    m_total_samples = 0;
+    m_first_frame = 0;
+    m_index_count = 0;
+    m_block_first = 0;
+    m_block_size = m_block_pos = 0;
+    m_buf_offset = 0;
+    m_buf_len = m_buf_pos = 0;
+    m_cache = 0;
+    m_cache_bits = 0;
+    m_eof = false;
+}
+
+bool FLACDecoder::open(FLACInput *input, uint64_t file_size, uint32_t file_id)
+{
+    m_input = input;
+    m_buf_len = m_buf_pos = 0;
+    m_block_first = 0;
+    m_block_size = m_block_pos = 0;
+
+    if (file_id == 0 || file_id != m_file_id || file_size != m_file_size)
+    {
+        m_file_id = 0;
+        m_file_size = file_size;
+        if (!readMetadata())
+        {
+            return false;
+        }
+
+        buildIndex();
+        m_file_id = file_id;
+    }
+
+    m_buf_len = 0;
+    setPosition(m_first_frame);
+    return true;
+}
+
+bool FLACDecoder::seek(uint64_t sample)
+{
+    if (sample > m_total_samples)
+    {
+        return false;
+    }
+
+    // Check if the sample is in the current or start of the next frame
+    if (m_block_size > 0 && sample >= m_block_first && sample <= m_block_first + m_block_size)
+    {
+        m_block_pos = sample - m_block_first;
+        return true;
+    }
+
+    // Find the index points around the sample
+    int idx = 0;
+    while (idx + 1 < m_index_count && m_index[idx + 1].sample <= sample)
+    {
+        idx++;
+    }
+
+    uint64_t lo = m_index[idx].offset;
+    uint64_t hi = (idx + 1 < m_index_count) ? m_index[idx + 1].offset : m_file_size;
+
+    // Bisect on frame headers
+    uint64_t offset, first;
+    while (hi - lo > FLAC_SEEK_LINEAR_BYTES)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (findFrame(mid, hi, &offset, &first) && first <= sample)
+        {
+            lo = offset;
+        }
+        else
+        {
+            // Frame containing the sample starts before mid
+            hi = mid;
+        }
+    }
+
+    // Walk the frame headers up to the frame containing the sample
+    while (findFrame(lo + 1, hi, &offset, &first) && first <= sample)
+    {
+        lo = offset;
+    }
+
+    // Decode frames until the sample is reached
+    m_block_size = 0;
+    setPosition(lo);
+    while (decodeFrame())
+    {
+        if (sample < m_block_first)
+        {
+            return false;
+        }
+        else if (sample < m_block_first + m_block_size)
+        {
+            m_block_pos = sample - m_block_first;
+            return true;
+        }
+    }
+
+    if (sample == m_total_samples && m_block_size > 0)
+    {
+        // Positioned at end of file
+        m_block_pos = m_block_size;
+        return true;
+    }
+
+    return false;
+}
+
+uint32_t FLACDecoder::read(uint8_t *dst, uint32_t count)
+{
+    uint32_t done = 0;
+    while (done < count)
+    {
+        if (m_block_pos >= m_block_size)
+        {
+            if (!decodeFrame())
+            {
+                break;
+            }
+        }
+
+        uint32_t n = m_block_size - m_block_pos;
+        if (n > count - done) n = count - done;
+
+        const int32_t *left = &m_samples[0][m_block_pos];
+        const int32_t *right = &m_samples[1][m_block_pos];
+        for (uint32_t i = 0; i < n; i++)
+        {
+            int32_t l = left[i];
+            int32_t r = right[i];
+            dst[0] = (uint8_t)l;
+            dst[1] = (uint8_t)(l >> 8);
+            dst[2] = (uint8_t)r;
+            dst[3] = (uint8_t)(r >> 8);
+            dst += 4;
+        }
+
+        m_block_pos += n;
+        done += n;
+    }
+
+    return done;
+}
+
+/**************/
+/* Bit reader */
+/**************/
+
+void FLACDecoder::setPosition(uint64_t offset)
+{
+    m_cache = 0;
+    m_cache_bits = 0;
+    m_eof = false;
+
+    if (offset >= m_buf_offset && offset < m_buf_offset + m_buf_len)
+    {
+        // Still in buffer
+        m_buf_pos = offset - m_buf_offset;
+    }
+    else
+    {
+        m_input->seek(offset);
+        m_buf_offset = offset;
+        m_buf_len = m_buf_pos = 0;
+    }
+}
+
+uint64_t FLACDecoder::bytePosition() const
+{
+    return m_buf_offset + m_buf_pos - m_cache_bits / 8;
+}
+
+uint8_t FLACDecoder::nextByte()
+{
+    if (m_buf_pos >= m_buf_len)
+    {
+        m_buf_offset += m_buf_len;
+        m_buf_pos = 0;
+        m_buf_len = m_input->read(m_buf, sizeof(m_buf));
+        if (m_buf_len <= 0)
+        {
+            m_buf_len = 0;
+            m_eof = true;
+            return 0;
+        }
+    }
+
+    return m_buf[m_buf_pos++];
+}
+
+uint32_t FLACDecoder::readBits(int count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    else if (count > 24)
+    {
+        uint32_t high = readBits(count - 16);
+        return (high << 16) | readBits(16);
+    }
+
+    while (m_cache_bits < count)
+    {
+        m_cache |= (uint32_t)nextByte() << (24 - m_cache_bits);
+        m_cache_bits += 8;
+    }
+
+    uint32_t result = m_cache >> (32 - count);
+    m_cache <<= count;
+    m_cache_bits -= count;
+    return result;
+}
+
+int32_t FLACDecoder::readSignedBits(int count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint32_t value = readBits(count);
+    return (int32_t)(value << (32 - count)) >> (32 - count);
+}
+
+uint32_t FLACDecoder::readUnary()
+{
+    // Counts zero bits before the next one bit.
+    // Unused bits in the cache are always zero.
+    uint32_t result = 0;
+    while (m_cache == 0)
+    {
+        result += m_cache_bits;
+        m_cache = (uint32_t)nextByte() << 24;
+        m_cache_bits = 8;
+
+        if (m_eof)
+        {
+            return result;
+        }
+    }
+
+    int zeros = __builtin_clz(m_cache);
+    m_cache <<= zeros;
+    m_cache <<= 1;
+    m_cache_bits -= zeros + 1;
+    return result + zeros;
+}
+
+void FLACDecoder::alignToByte()
+{
+    int drop = m_cache_bits & 7;
+    m_cache <<= drop;
+    m_cache_bits -= drop;
+}
+
+/********************/
+/* Metadata parsing */
+/********************/
+
+bool FLACDecoder::readMetadata()
+{
+    m_buf_len = 0;
+    setPosition(0);
+    if (readBits(32) != 0x664C6143) // "fLaC"
+    {
+        return false;
+    }
+
+    // Offsets in the seek table are relative to first frame,
+    // they get adjusted at the end.
+    m_index_count = 0;
+    addSeekPoint(0, 0);
+
+    bool got_streaminfo = false;
+    bool last = false;
+    while (!last)
+    {
+        last = readBits(1);
+        uint32_t type = readBits(7);
+        uint32_t length = readBits(24);
+        uint64_t next = bytePosition() + length;
+
+        if (m_eof)
+        {
+            return false;
+        }
+
+        if (type == 0)
+        {
+            // STREAMINFO
+            m_min_blocksize = readBits(16);
+            m_max_blocksize = readBits(16);
+            readBits(24); // Minimum frame size
+            readBits(24); // Maximum frame size
+            uint32_t samplerate = readBits(20);
+            uint32_t channels = readBits(3) + 1;
+            uint32_t bps = readBits(5) + 1;
+            m_total_samples = (uint64_t)readBits(4) << 32;
+            m_total_samples |= readBits(32);
+
+            if (samplerate != 44100 || channels != 2 || bps != 16 ||
+                m_max_blocksize > FLAC_MAX_BLOCKSIZE || m_min_blocksize < 16 ||
+                m_total_samples == 0)
+            {
+                return false;
+            }
+
+            got_streaminfo = true;
+        }
+        else if (type == 3)
+        {
+            // SEEKTABLE
+            for (uint32_t i = 0; i < length / 18; i++)
+            {
+                uint64_t sample = (uint64_t)readBits(32) << 32;
+                sample |= readBits(32);
+                uint64_t offset = (uint64_t)readBits(32) << 32;
+                offset |= readBits(32);
+                readBits(16); // Samples in frame
+
+                if (sample != UINT64_MAX)
+                {
+                    addSeekPoint(sample, offset);
+                }
+            }
+        }
+
+        setPosition(next);
+    }
+
+    m_first_frame = bytePosition();
+    for (int i = 0; i < m_index_count; i++)
+    {
+        m_index[i].offset += m_first_frame;
+    }
+
+    return got_streaminfo;
+}
+
+void FLACDecoder::addSeekPoint(uint64_t sample, uint64_t offset)
+{
+    if (m_index_count > 0 && sample <= m_index[m_index_count - 1].sample)
+    {
+        // Index must stay sorted
+        return;
+    }
+
+    if (m_index_count == FLAC_INDEX_SIZE)
+    {
+        // Drop every other point to make space
+        for (int i = 1; i < FLAC_INDEX_SIZE / 2; i++)
+        {
+            m_index[i] = m_index[i * 2];
+        }
+        m_index_count = FLAC_INDEX_SIZE / 2;
+    }
+
+    m_index[m_index_count].sample = sample;
+    m_index[m_index_count].offset = offset;
+    m_index_count++;
+}
+
+void FLACDecoder::buildIndex()
+{
+    if (m_index_count > 1)
+    {
+        // File has a seek table
+        return;
+    }
+
+    // Probe frame headers at evenly spaced positions
+    uint64_t length = m_file_size - m_first_frame;
+    for (int i = 1; i < FLAC_INDEX_SIZE; i++)
+    {
+        uint64_t pos = m_first_frame + length * i / FLAC_INDEX_SIZE;
+        uint64_t offset, first;
+        if (findFrame(pos, pos + FLAC_MAX_FRAME_BYTES, &offset, &first))
+        {
+            addSeekPoint(first, offset);
+        }
+    }
+}
+
+/*****************/
+/* Frame parsing */
+/*****************/
+
+// CRC-8 with polynomial x^8 + x^2 + x^1 + x^0, as used in frame header
+static uint8_t crc8_update(uint8_t crc, uint8_t byte)
+{
+    crc ^= byte;
+    for (int i = 0; i < 8; i++)
+    {
+        crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+    return crc;
+}
+
+bool FLACDecoder::readFrameHeader(uint32_t *blocksize, uint32_t *assignment, uint64_t *first_sample)
+{
+    uint8_t header[16];
+    int len = 0;
+
+    header[len++] = readBits(8);
+    header[len++] = readBits(8);
+    if (header[0] != 0xFF || (header[1] & 0xFE) != 0xF8)
+    {
+        return false;
+    }
+    bool variable_blocksize = (header[1] & 1);
+
+    header[len++] = readBits(8);
+    uint32_t blocksize_code = header[2] >> 4;
+    uint32_t samplerate_code = header[2] & 0x0F;
+
+    header[len++] = readBits(8);
+    uint32_t channels = header[3] >> 4;
+    uint32_t samplesize_code = (header[3] >> 1) & 7;
+
+    if ((header[3] & 1) || blocksize_code == 0 || samplerate_code == 15 ||
+        (samplesize_code != 0 && samplesize_code != 4) ||
+        (channels != 1 && channels != 8 && channels != 9 && channels != 10))
+    {
+        // Reserved bits set or not CD audio
+        return false;
+    }
+
+    // Frame or sample number in UTF-8 style coding
+    uint8_t first = readBits(8);
+    header[len++] = first;
+    uint64_t number;
+    int extra;
+    if (first < 0x80)      { number = first;        extra = 0; }
+    else if (first < 0xC0) { return false; }
+    else if (first < 0xE0) { number = first & 0x1F; extra = 1; }
+    else if (first < 0xF0) { number = first & 0x0F; extra = 2; }
+    else if (first < 0xF8) { number = first & 0x07; extra = 3; }
+    else if (first < 0xFC) { number = first & 0x03; extra = 4; }
+    else if (first < 0xFE) { number = first & 0x01; extra = 5; }
+    else if (first == 0xFE) { number = 0;           extra = 6; }
+    else { return false; }
+
+    for (int i = 0; i < extra; i++)
+    {
+        uint8_t byte = readBits(8);
+        header[len++] = byte;
+        if ((byte & 0xC0) != 0x80)
+        {
+            return false;
+        }
+        number = (number << 6) | (byte & 0x3F);
+    }
+
+    if (blocksize_code == 1)
+    {
+        *blocksize = 192;
+    }
+    else if (blocksize_code <= 5)
+    {
+        *blocksize = 576 << (blocksize_code - 2);
+    }
+    else if (blocksize_code == 6)
+    {
+        header[len++] = readBits(8);
+        *blocksize = header[len - 1] + 1;
+    }
+    else if (blocksize_code == 7)
+    {
+        header[len++] = readBits(8);
+        header[len++] = readBits(8);
+        *blocksize = ((header[len - 2] << 8) | header[len - 1]) + 1;
+    }
+    else
+    {
+        *blocksize = 256 << (blocksize_code - 8);
+    }
+
+    uint32_t samplerate = 44100;
+    if (samplerate_code == 12)
+    {
+        header[len++] = readBits(8);
+        samplerate = header[len - 1] * 1000;
+    }
+    else if (samplerate_code == 13 || samplerate_code == 14)
+    {
+        header[len++] = readBits(8);
+        header[len++] = readBits(8);
+        samplerate = (header[len - 2] << 8) | header[len - 1];
+        if (samplerate_code == 14) samplerate *= 10;
+    }
+    else if (samplerate_code != 0 && samplerate_code != 9)
+    {
+        return false;
+    }
+
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++)
+    {
+        crc = crc8_update(crc, header[i]);
+    }
+
+    if (m_eof || readBits(8) != crc || samplerate != 44100 ||
+        *blocksize > FLAC_MAX_BLOCKSIZE)
+    {
+        return false;
+    }
+
+    *assignment = channels;
+    *first_sample = variable_blocksize ? number : number * m_max_blocksize;
+    return true;
+}
+
+bool FLACDecoder::findFrame(uint64_t offset, uint64_t limit, uint64_t *frame_offset, uint64_t *first_sample)
+{
+    if (limit > m_file_size) limit = m_file_size;
+
+    setPosition(offset);
+    uint64_t pos = offset;
+    while (pos < limit)
+    {
+        uint8_t byte = nextByte();
+        if (m_eof)
+        {
+            return false;
+        }
+        pos++;
+
+        if (byte == 0xFF)
+        {
+            // Possible frame sync code, check header
+            setPosition(pos - 1);
+            uint32_t blocksize, assignment;
+            if (readFrameHeader(&blocksize, &assignment, first_sample) &&
+                *first_sample < m_total_samples)
+            {
+                *frame_offset = pos - 1;
+                setPosition(pos - 1);
+                return true;
+            }
+            setPosition(pos);
+        }
+    }
+
+    return false;
+}
+
+/******************/
+/* Frame decoding */
+/******************/
+
+bool FLACDecoder::decodeFrame()
+{
+    m_block_size = 0;
+    m_block_pos = 0;
+
+    uint32_t blocksize, assignment;
+    uint64_t first;
+    if (!readFrameHeader(&blocksize, &assignment, &first))
+    {
+        return false;
+    }
+
+    // Side channel has one extra bit
+    int32_t *ch0 = m_samples[0];
+    int32_t *ch1 = m_samples[1];
+    int bps0 = (assignment == 9) ? 17 : 16;
+    int bps1 = (assignment == 8 || assignment == 10) ? 17 : 16;
+    if (!decodeSubframe(ch0, blocksize, bps0) ||
+        !decodeSubframe(ch1, blocksize, bps1))
+    {
+        return false;
+    }
+
+    alignToByte();
+    readBits(16); // Frame CRC-16
+    if (m_eof)
+    {
+        return false;
+    }
+
+    if (assignment == 8)
+    {
+        // Left + side
+        for (uint32_t i = 0; i < blocksize; i++)
+        {
+            ch1[i] = ch0[i] - ch1[i];
+        }
+    }
+    else if (assignment == 9)
+    {
+        // Side + right
+        for (uint32_t i = 0; i < blocksize; i++)
+        {
+            ch0[i] += ch1[i];
+        }
+    }
+    else if (assignment == 10)
+    {
+        // Mid + side
+        for (uint32_t i = 0; i < blocksize; i++)
+        {
+            int32_t side = ch1[i];
+            int32_t mid = ch0[i] * 2 + (side & 1);
+            ch0[i] = (mid + side) >> 1;
+            ch1[i] = (mid - side) >> 1;
+        }
+    }
+
+    m_block_first = first;
+    m_block_size = blocksize;
+    return true;
+}
+
+bool FLACDecoder::decodeSubframe(int32_t *dst, uint32_t blocksize, int bps)
+{
+    if (readBits(1) != 0)
+    {
+        return false;
+    }
+
+    uint32_t type = readBits(6);
+
+    int wasted = 0;
+    if (readBits(1))
+    {
+        wasted = readUnary() + 1;
+        bps -= wasted;
+        if (bps <= 0) return false;
+    }
+
+    if (type == 0)
+    {
+        // CONSTANT
+        int32_t value = readSignedBits(bps);
+        for (uint32_t i = 0; i < blocksize; i++)
+        {
+            dst[i] = value;
+        }
+    }
+    else if (type == 1)
+    {
+        // VERBATIM
+        for (uint32_t i = 0; i < blocksize; i++)
+        {
+            dst[i] = readSignedBits(bps);
+        }
+    }
+    else if (type >= 8 && type <= 12)
+    {
+        // FIXED predictor
+        uint32_t order = type - 8;
+        if (order > blocksize) return false;
+
+        for (uint32_t i = 0; i < order; i++)
+        {
+            dst[i] = readSignedBits(bps);
+        }
+
+        if (!decodeResidual(dst, blocksize, order))
+        {
+            return false;
+        }
+
+        switch (order)
+        {
+            case 1:
+                for (uint32_t i = 1; i < blocksize; i++)
+                    dst[i] += dst[i - 1];
+                break;
+            case 2:
+                for (uint32_t i = 2; i < blocksize; i++)
+                    dst[i] += 2 * dst[i - 1] - dst[i - 2];
+                break;
+            case 3:
+                for (uint32_t i = 3; i < blocksize; i++)
+                    dst[i] += 3 * (dst[i - 1] - dst[i - 2]) + dst[i - 3];
+                break;
+            case 4:
+                for (uint32_t i = 4; i < blocksize; i++)
+                    dst[i] += 4 * (dst[i - 1] + dst[i - 3]) - 6 * dst[i - 2] - dst[i - 4];
+                break;
+        }
+    }
+    else if (type >= 32)
+    {
+        // LPC predictor
+        uint32_t order = (type & 31) + 1;
+        if (order > blocksize) return false;
+
+        for (uint32_t i = 0; i < order; i++)
+        {
+            dst[i] = readSignedBits(bps);
+        }
+
+        int precision = readBits(4) + 1;
+        int shift = readSignedBits(5);
+        if (precision == 16 || shift < 0)
+        {
+            return false;
+        }
+
+        int32_t coefs[32];
+        for (uint32_t i = 0; i < order; i++)
+        {
+            coefs[i] = readSignedBits(precision);
+        }
+
+        if (!decodeResidual(dst, blocksize, order))
+        {
+            return false;
+        }
+
+        int guard = 0;
+        while ((1U << guard) < order) guard++;
+
+        if (bps + precision + guard <= 32)
+        {
+            // Sum fits in 32 bits
+            for (uint32_t i = order; i < blocksize; i++)
+            {
+                int32_t sum = 0;
+                const int32_t *hist = &dst[i - 1];
+                for (uint32_t j = 0; j < order; j++)
+                {
+                    sum += coefs[j] * hist[-(int32_t)j];
+                }
+                dst[i] += sum >> shift;
+            }
+        }
+        else
+        {
+            for (uint32_t i = order; i < blocksize; i++)
+            {
+                int64_t sum = 0;
+                const int32_t *hist = &dst[i - 1];
+                for (uint32_t j = 0; j < order; j++)
+                {
+                    sum += (int64_t)coefs[j] * hist[-(int32_t)j];
+                }
+                dst[i] += (int32_t)(sum >> shift);
+            }
+        }
+    }
+    else
+    {
+        // Reserved subframe type
+        return false;
+    }
+
+    if (wasted)
+    {
+        for (uint32_t i = 0; i < blocksize; i++)
+        {
+            dst[i] = (int32_t)((uint32_t)dst[i] << wasted);
+        }
+    }
+
+    return !m_eof;
+}
+
+bool FLACDecoder::decodeResidual(int32_t *dst, uint32_t blocksize, int order)
+{
+    uint32_t method = readBits(2);
+    if (method > 1)
+    {
+        return false;
+    }
+
+    int parambits = (method == 0) ? 4 : 5;
+    uint32_t escape = (method == 0) ? 15 : 31;
+    uint32_t partition_order = readBits(4);
+    uint32_t partition_size = blocksize >> partition_order;
+    if ((partition_size << partition_order) != blocksize ||
+        partition_size < (uint32_t)order)
+    {
+        return false;
+    }
+
+    uint32_t pos = order;
+    for (uint32_t p = 0; p < (1U << partition_order); p++)
+    {
+        uint32_t count = (p == 0) ? partition_size - order : partition_size;
+        uint32_t param = readBits(parambits);
+
+        if (param == escape)
+        {
+            // Unencoded residual
+            int bits = readBits(5);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                dst[pos++] = readSignedBits(bits);
+            }
+        }
+        else
+        {
+            // Rice coded residual
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint32_t value = (readUnary() << param) | readBits(param);
+                dst[pos++] = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+            }
+        }
+
+        if (m_eof)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
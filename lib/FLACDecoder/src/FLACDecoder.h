@@ -0,0 +1,143 @@
+/*
+ * Streaming FLAC decoder for CD audio, suitable for embedded systems.
+ *
+ *  Copyright (c) 2024 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Decodes FLAC files containing CD audio (44.1 kHz, 16-bit, stereo)
+// into the same byte format as raw audio tracks in BIN files.
+//
+// Only one frame is kept in memory at a time. Random access uses an
+// index of frame positions, taken from the SEEKTABLE metadata block if
+// present, or built by probing the file when it is opened. Between index
+// points the frame is located by bisection on the frame headers.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Largest supported block size in samples.
+// Decoder memory use is 8 bytes per sample.
+#ifndef FLAC_MAX_BLOCKSIZE
+#define FLAC_MAX_BLOCKSIZE 4096
+#endif
+
+// Number of entries in the seek index
+#ifndef FLAC_INDEX_SIZE
+#define FLAC_INDEX_SIZE 64
+#endif
+
+// Size of the input buffer in bytes
+#ifndef FLAC_INPUT_BUFFER
+#define FLAC_INPUT_BUFFER 512
+#endif
+
+// Interface for reading the underlying file
+class FLACInput
+{
+public:
+    virtual bool seek(uint64_t pos) = 0;
+
+    // Returns number of bytes read, less than count at end of file.
+    virtual int read(uint8_t *buf, int count) = 0;
+};
+
+class FLACDecoder
+{
+public:
+    FLACDecoder();
+
+    // Parse the metadata and prepare for decoding from the start.
+    // If file_id is nonzero and matches the previously opened file,
+    // the metadata and seek index are reused without reading them again.
+    // Returns false if the file is not a supported FLAC file.
+    bool open(FLACInput *input, uint64_t file_size, uint32_t file_id);
+
+    // Number of samples per channel in the file
+    uint64_t totalSamples() const { return m_total_samples; }
+
+    // Move to the given sample number.
+    bool seek(uint64_t sample);
+
+    // Current sample number
+    uint64_t position() const { return m_block_first + m_block_pos; }
+
+    // Decode stereo samples as 16-bit little-endian bytes, 4 bytes per sample.
+    // Returns number of samples decoded, less than count at end of file or on error.
+    uint32_t read(uint8_t *dst, uint32_t count);
+
+protected:
+    FLACInput *m_input;
+    uint32_t m_file_id;
+    uint64_t m_file_size;
+
+    // Stream parameters from STREAMINFO
+    uint32_t m_min_blocksize;
+    uint32_t m_max_blocksize;
+    uint64_t m_total_samples;
+    uint64_t m_first_frame; // File offset of first frame
+
+    // Seek index, sorted by sample number
+    struct seekpoint_t {
+        uint64_t sample;
+        uint64_t offset;
+    };
+    seekpoint_t m_index[FLAC_INDEX_SIZE];
+    int m_index_count;
+
+    // Currently decoded frame
+    int32_t m_samples[2][FLAC_MAX_BLOCKSIZE];
+    uint64_t m_block_first;
+    uint32_t m_block_size;
+    uint32_t m_block_pos;
+
+    // Input buffer and bit reader state
+    uint8_t m_buf[FLAC_INPUT_BUFFER];
+    uint64_t m_buf_offset; // File offset of m_buf[0]
+    int m_buf_len;
+    int m_buf_pos;
+    uint32_t m_cache; // Bits not yet consumed, left-aligned
+    int m_cache_bits;
+    bool m_eof;
+
+    // Bit reader
+    void setPosition(uint64_t offset);
+    uint64_t bytePosition() const;
+    uint8_t nextByte();
+    uint32_t readBits(int count);
+    int32_t readSignedBits(int count);
+    uint32_t readUnary();
+    void alignToByte();
+
+    // Metadata parsing
+    bool readMetadata();
+    void addSeekPoint(uint64_t sample, uint64_t offset);
+    void buildIndex();
+
+    // Parse frame header at current position.
+    // Returns false if it is not a valid frame header.
+    bool readFrameHeader(uint32_t *blocksize, uint32_t *assignment, uint64_t *first_sample);
+
+    // Search for next valid frame header starting from offset, up to limit.
+    // Leaves position at the start of the frame.
+    bool findFrame(uint64_t offset, uint64_t limit, uint64_t *frame_offset, uint64_t *first_sample);
+
+    // Decode frame at current position into m_samples
+    bool decodeFrame();
+    bool decodeSubframe(int32_t *dst, uint32_t blocksize, int bps);
+    bool decodeResidual(int32_t *dst, uint32_t blocksize, int order);
+};
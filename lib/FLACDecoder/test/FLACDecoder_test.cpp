@@ -0,0 +1,493 @@
+#include "FLACDecoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Minimal FLAC encoder for generating test streams.
+ * It exercises every subframe type and channel assignment,
+ * but does not try to compress well. */
+
+class BitWriter
+{
+public:
+    std::vector<uint8_t> data;
+    int bitpos = 0;
+
+    void bits(uint32_t value, int count)
+    {
+        for (int i = count - 1; i >= 0; i--)
+        {
+            if (bitpos == 0) data.push_back(0);
+            if ((value >> i) & 1) data.back() |= 0x80 >> bitpos;
+            bitpos = (bitpos + 1) & 7;
+        }
+    }
+
+    void sbits(int32_t value, int count) { bits((uint32_t)value & ((count == 32) ? 0xFFFFFFFF : ((1U << count) - 1)), count); }
+    void unary(uint32_t zeros) { for (uint32_t i = 0; i < zeros; i++) bits(0, 1); bits(1, 1); }
+    void align() { if (bitpos != 0) bits(0, 8 - bitpos); }
+};
+
+enum SubframeKind { SF_CONSTANT, SF_VERBATIM, SF_FIXED, SF_LPC, SF_LPC_LOWPREC, SF_ESCAPED };
+
+static void write_residual(BitWriter &w, const std::vector<int32_t> &res, int order, bool escaped)
+{
+    int blocksize = res.size();
+    int partition_order = (blocksize % 4 == 0 && blocksize / 4 > order) ? 2 : 0;
+    int psize = blocksize >> partition_order;
+    w.bits(1, 2); // 5-bit parameters
+    w.bits(partition_order, 4);
+
+    int pos = order;
+    for (int p = 0; p < (1 << partition_order); p++)
+    {
+        int count = (p == 0) ? psize - order : psize;
+        if (escaped)
+        {
+            w.bits(31, 5);
+            w.bits(18, 5);
+            for (int i = 0; i < count; i++) w.sbits(res[pos++], 18);
+        }
+        else
+        {
+            // Pick parameter from mean magnitude
+            uint64_t sum = 0;
+            for (int i = 0; i < count; i++) sum += (res[pos + i] < 0) ? -2 * (int64_t)res[pos + i] : 2 * (int64_t)res[pos + i];
+            int k = 0;
+            while (count > 0 && ((uint64_t)count << (k + 1)) < sum && k < 30) k++;
+            w.bits(k, 5);
+            for (int i = 0; i < count; i++)
+            {
+                int32_t v = res[pos++];
+                uint32_t u = (v < 0) ? ((uint32_t)(-v) * 2 - 1) : (uint32_t)v * 2;
+                w.unary(u >> k);
+                w.bits(u & ((1U << k) - 1), k);
+            }
+        }
+    }
+}
+
+static void write_subframe(BitWriter &w, const int32_t *samples, int blocksize, int bps, SubframeKind kind, int order, int wasted)
+{
+    std::vector<int32_t> s(samples, samples + blocksize);
+    if (wasted)
+    {
+        for (auto &v : s) v >>= wasted;
+        bps -= wasted;
+    }
+
+    w.bits(0, 1);
+    int type = (kind == SF_CONSTANT) ? 0 : (kind == SF_VERBATIM) ? 1 :
+               (kind == SF_LPC || kind == SF_LPC_LOWPREC) ? (32 + order - 1) : (8 + order);
+    w.bits(type, 6);
+    if (wasted)
+    {
+        w.bits(1, 1);
+        w.unary(wasted - 1);
+    }
+    else
+    {
+        w.bits(0, 1);
+    }
+
+    if (kind == SF_CONSTANT)
+    {
+        w.sbits(s[0], bps);
+        return;
+    }
+    else if (kind == SF_VERBATIM)
+    {
+        for (int i = 0; i < blocksize; i++) w.sbits(s[i], bps);
+        return;
+    }
+
+    for (int i = 0; i < order; i++) w.sbits(s[i], bps);
+
+    std::vector<int32_t> res(blocksize, 0);
+    if (kind == SF_LPC || kind == SF_LPC_LOWPREC)
+    {
+        // Third order predictor with fractional coefficients.
+        // Low precision variant covers the 32-bit prediction sum path.
+        bool low = (kind == SF_LPC_LOWPREC);
+        const int precision = low ? 12 : 14;
+        const int shift = low ? 8 : 10;
+        const int32_t coefs[3] = {low ? 725 : 2900, low ? -600 : -2400, low ? 130 : 520};
+        w.bits(precision - 1, 4);
+        w.sbits(shift, 5);
+        for (int i = 0; i < order; i++) w.sbits(coefs[i], precision);
+        for (int i = order; i < blocksize; i++)
+        {
+            int64_t sum = 0;
+            for (int j = 0; j < order; j++) sum += (int64_t)coefs[j] * s[i - 1 - j];
+            res[i] = s[i] - (int32_t)(sum >> shift);
+        }
+    }
+    else
+    {
+        for (int i = order; i < blocksize; i++)
+        {
+            int32_t pred = 0;
+            if (order == 1) pred = s[i - 1];
+            if (order == 2) pred = 2 * s[i - 1] - s[i - 2];
+            if (order == 3) pred = 3 * s[i - 1] - 3 * s[i - 2] + s[i - 3];
+            if (order == 4) pred = 4 * s[i - 1] - 6 * s[i - 2] + 4 * s[i - 3] - s[i - 4];
+            res[i] = s[i] - pred;
+        }
+    }
+
+    write_residual(w, res, order, kind == SF_ESCAPED);
+}
+
+static uint8_t crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i] << 8;
+        for (int j = 0; j < 8; j++) crc = (crc & 0x8000) ? ((crc << 1) ^ 0x8005) : (crc << 1);
+    }
+    return crc;
+}
+
+static void write_utf8(BitWriter &w, uint32_t value)
+{
+    if (value < 0x80) { w.bits(value, 8); }
+    else if (value < 0x800) { w.bits(0xC0 | (value >> 6), 8); w.bits(0x80 | (value & 0x3F), 8); }
+    else { w.bits(0xE0 | (value >> 12), 8); w.bits(0x80 | ((value >> 6) & 0x3F), 8); w.bits(0x80 | (value & 0x3F), 8); }
+}
+
+struct EncodedFile
+{
+    std::vector<uint8_t> data;
+    std::vector<int16_t> pcm; // Interleaved reference samples
+};
+
+// Encode stereo samples with fixed blocksize, cycling through coding options.
+static EncodedFile encode(const std::vector<int16_t> &pcm, int blocksize, bool seektable)
+{
+    EncodedFile result;
+    result.pcm = pcm;
+    uint32_t total = pcm.size() / 2;
+
+    BitWriter w;
+    w.bits(0x664C6143, 32);
+
+    // Padding block to test skipping of unknown metadata
+    w.bits(0, 1); w.bits(1, 7); w.bits(10, 24);
+    for (int i = 0; i < 10; i++) w.bits(0, 8);
+
+    // STREAMINFO
+    w.bits(seektable ? 0 : 1, 1); w.bits(0, 7); w.bits(34, 24);
+    w.bits(blocksize, 16); w.bits(blocksize, 16);
+    w.bits(0, 24); w.bits(0, 24);
+    w.bits(44100, 20); w.bits(1, 3); w.bits(15, 5);
+    w.bits(0, 4); w.bits(total, 32);
+    for (int i = 0; i < 16; i++) w.bits(0, 8);
+
+    size_t seektable_pos = 0;
+    int nframes = (total + blocksize - 1) / blocksize;
+    int npoints = nframes / 3 + 1;
+    if (seektable)
+    {
+        w.bits(1, 1); w.bits(3, 7); w.bits(npoints * 18, 24);
+        seektable_pos = w.data.size();
+        for (int i = 0; i < npoints * 18; i++) w.bits(0, 8);
+    }
+
+    size_t first_frame = w.data.size();
+    for (int frame = 0; frame < nframes; frame++)
+    {
+        if (seektable && frame % 3 == 0)
+        {
+            // Fill in seek point
+            size_t pos = seektable_pos + (frame / 3) * 18;
+            uint64_t sample = (uint64_t)frame * blocksize;
+            uint64_t offset = w.data.size() - first_frame;
+            for (int i = 0; i < 8; i++) w.data[pos + i] = sample >> (56 - 8 * i);
+            for (int i = 0; i < 8; i++) w.data[pos + 8 + i] = offset >> (56 - 8 * i);
+            w.data[pos + 16] = blocksize >> 8;
+            w.data[pos + 17] = blocksize & 0xFF;
+        }
+
+        int bs = blocksize;
+        if ((uint32_t)(frame + 1) * blocksize > total) bs = total - frame * blocksize;
+
+        std::vector<int32_t> left(bs), right(bs);
+        for (int i = 0; i < bs; i++)
+        {
+            left[i] = pcm[(frame * blocksize + i) * 2];
+            right[i] = pcm[(frame * blocksize + i) * 2 + 1];
+        }
+
+        // Channel assignment
+        static const int assignments[4] = {1, 8, 9, 10};
+        int assignment = assignments[frame % 4];
+        std::vector<int32_t> ch0(bs), ch1(bs);
+        int bps0 = 16, bps1 = 16;
+        for (int i = 0; i < bs; i++)
+        {
+            if (assignment == 1) { ch0[i] = left[i]; ch1[i] = right[i]; }
+            if (assignment == 8) { ch0[i] = left[i]; ch1[i] = left[i] - right[i]; bps1 = 17; }
+            if (assignment == 9) { ch0[i] = left[i] - right[i]; ch1[i] = right[i]; bps0 = 17; }
+            if (assignment == 10) { ch0[i] = (left[i] + right[i]) >> 1; ch1[i] = left[i] - right[i]; bps1 = 17; }
+        }
+
+        // Frame header
+        size_t frame_start = w.data.size();
+        w.bits(0xFFF8, 16);
+        int bscode = (bs == blocksize && blocksize == 4096) ? 12 : 7;
+        w.bits(bscode, 4);
+        w.bits((frame & 1) ? 9 : 0, 4); // Sample rate as code or from STREAMINFO
+        w.bits(assignment, 4);
+        w.bits((frame & 2) ? 4 : 0, 3); // Sample size as code or from STREAMINFO
+        w.bits(0, 1);
+        write_utf8(w, frame);
+        if (bscode == 7) w.bits(bs - 1, 16);
+        w.bits(crc8(&w.data[frame_start], w.data.size() - frame_start), 8);
+
+        // Subframes, coding selected by frame number
+        int32_t *chans[2] = {ch0.data(), ch1.data()};
+        int bpss[2] = {bps0, bps1};
+        for (int c = 0; c < 2; c++)
+        {
+            bool constant = true;
+            for (int i = 1; i < bs; i++) if (chans[c][i] != chans[c][0]) constant = false;
+            bool even = true;
+            for (int i = 0; i < bs; i++) if (chans[c][i] & 3) even = false;
+
+            int sel = (frame + c) % 8;
+            if (constant)
+                write_subframe(w, chans[c], bs, bpss[c], SF_CONSTANT, 0, 0);
+            else if (sel == 0)
+                write_subframe(w, chans[c], bs, bpss[c], SF_VERBATIM, 0, even ? 2 : 0);
+            else if (sel <= 5)
+                write_subframe(w, chans[c], bs, bpss[c], SF_FIXED, sel - 1, even ? 2 : 0);
+            else if (sel == 6)
+                write_subframe(w, chans[c], bs, bpss[c], (frame & 1) ? SF_LPC_LOWPREC : SF_LPC, 3, 0);
+            else
+                write_subframe(w, chans[c], bs, bpss[c], SF_ESCAPED, 2, 0);
+        }
+
+        w.align();
+        uint16_t crc = crc16(&w.data[frame_start], w.data.size() - frame_start);
+        w.bits(crc, 16);
+    }
+
+    result.data = w.data;
+    return result;
+}
+
+static std::vector<int16_t> make_signal(uint32_t samples)
+{
+    std::vector<int16_t> pcm(samples * 2);
+    uint32_t seed = 1234;
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int noise = (int)((seed >> 16) & 0xFF) - 128;
+        double t = i / 44100.0;
+        int l = (int)(20000 * sin(2 * M_PI * 440 * t)) + noise;
+        int r = (int)(30000 * sin(2 * M_PI * 660 * t + 1.0)) - noise;
+
+        if (i >= 4096 * 5 && i < 4096 * 6)
+        {
+            // Silence for constant subframes
+            l = r = 0;
+        }
+        else if (i >= 4096 * 8 && i < 4096 * 9)
+        {
+            // Multiples of 4 for wasted bits
+            l &= ~3;
+            r &= ~3;
+        }
+        else if (i >= 4096 * 11 && i < 4096 * 12)
+        {
+            // Full scale for side channel overflow
+            l = (i & 1) ? 32767 : -32768;
+            r = -l - 1;
+        }
+
+        if (l > 32767) l = 32767;
+        if (l < -32768) l = -32768;
+        if (r > 32767) r = 32767;
+        if (r < -32768) r = -32768;
+        pcm[i * 2] = l;
+        pcm[i * 2 + 1] = r;
+    }
+    return pcm;
+}
+
+class MemoryInput: public FLACInput
+{
+public:
+    const std::vector<uint8_t> *data;
+    uint64_t pos = 0;
+    int seeks = 0;
+
+    virtual bool seek(uint64_t p) { pos = p; seeks++; return p <= data->size(); }
+
+    virtual int read(uint8_t *buf, int count)
+    {
+        if (pos >= data->size()) return 0;
+        if ((uint64_t)count > data->size() - pos) count = data->size() - pos;
+        memcpy(buf, &(*data)[pos], count);
+        pos += count;
+        return count;
+    }
+};
+
+static FLACDecoder g_decoder;
+
+static bool compare(const EncodedFile &file, const uint8_t *buf, uint32_t first, uint32_t count)
+{
+    for (uint32_t i = 0; i < count * 2; i++)
+    {
+        int16_t expected = file.pcm[first * 2 + i];
+        int16_t actual = (int16_t)(buf[i * 2] | (buf[i * 2 + 1] << 8));
+        if (expected != actual)
+        {
+            fprintf(stderr, "Mismatch at sample %d channel %d: %d vs. %d\n",
+                    (int)(first + i / 2), (int)(i & 1), expected, actual);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool test_sequential(bool seektable)
+{
+    bool status = true;
+    COMMENT("test_sequential()");
+
+    uint32_t total = 4096 * 40 + 1000;
+    EncodedFile file = encode(make_signal(total), 4096, seektable);
+    MemoryInput input;
+    input.data = &file.data;
+
+    TEST(g_decoder.open(&input, file.data.size(), 1));
+    TEST(g_decoder.totalSamples() == total);
+
+    std::vector<uint8_t> buf(total * 4 + 100);
+    uint32_t count = g_decoder.read(buf.data(), total + 25);
+    TEST(count == total);
+    TEST(compare(file, buf.data(), 0, total));
+
+    return status;
+}
+
+bool test_seek(bool seektable)
+{
+    bool status = true;
+    COMMENT("test_seek()");
+
+    uint32_t total = 4096 * 200;
+    EncodedFile file = encode(make_signal(total), 4096, seektable);
+    MemoryInput input;
+    input.data = &file.data;
+
+    TEST(g_decoder.open(&input, file.data.size(), 2));
+
+    // CD sectors are 588 samples
+    std::vector<uint8_t> buf(588 * 4);
+    uint32_t seed = 42;
+    bool all_ok = true;
+    for (int i = 0; i < 200; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t sector = (seed >> 8) % (total / 588);
+        if (!g_decoder.seek(sector * 588) ||
+            g_decoder.read(buf.data(), 588) != 588 ||
+            !compare(file, buf.data(), sector * 588, 588))
+        {
+            fprintf(stderr, "Seek to sector %d failed\n", (int)sector);
+            all_ok = false;
+        }
+    }
+    TEST(all_ok);
+
+    COMMENT("Sequential sector reads through seek()");
+    all_ok = true;
+    for (uint32_t sector = 100; sector < 200; sector++)
+    {
+        if (!g_decoder.seek(sector * 588) ||
+            g_decoder.read(buf.data(), 588) != 588 ||
+            !compare(file, buf.data(), sector * 588, 588))
+        {
+            all_ok = false;
+        }
+    }
+    TEST(all_ok);
+
+    COMMENT("Seek to end of file");
+    TEST(g_decoder.seek(total - 10));
+    TEST(g_decoder.read(buf.data(), 588) == 10);
+    TEST(!g_decoder.seek(total + 1));
+
+    COMMENT("Reopen with same file id reuses index");
+    MemoryInput input2;
+    input2.data = &file.data;
+    TEST(g_decoder.open(&input2, file.data.size(), 2));
+    TEST(input2.seeks == 1);
+    TEST(g_decoder.seek(12345 * 4));
+    TEST(g_decoder.read(buf.data(), 588) == 588);
+    TEST(compare(file, buf.data(), 12345 * 4, 588));
+
+    return status;
+}
+
+bool test_invalid()
+{
+    bool status = true;
+    COMMENT("test_invalid()");
+
+    std::vector<uint8_t> data(1000, 0);
+    memcpy(data.data(), "RIFF", 4);
+    MemoryInput input;
+    input.data = &data;
+    TEST(!g_decoder.open(&input, data.size(), 3));
+
+    // Mono file is not CD audio
+    EncodedFile file = encode(make_signal(10000), 4096, false);
+    file.data[4 + 4 + 10 + 4 + 12] &= ~0x0E;
+    input.data = &file.data;
+    TEST(!g_decoder.open(&input, file.data.size(), 4));
+
+    return status;
+}
+
+int main()
+{
+    if (test_sequential(false) && test_sequential(true) &&
+        test_seek(false) && test_seek(true) && test_invalid())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -41,8 +41,16 @@ extern "C" {
 # define NETWORK_PACKET_QUEUE_SIZE   20		// must be <= 255
 #endif
 
+// Frames written by the host are queued and sent to Wi-Fi from the main loop
+#ifndef NETWORK_OUTBOUND_QUEUE_SIZE
+# define NETWORK_OUTBOUND_QUEUE_SIZE 4		// must be <= 255
+#endif
+
 #define NETWORK_PACKET_MAX_SIZE     1520
 
+// READ(6) cdb[5] value used by drivers that accept several packets per command
+#define SCSI_NETWORK_READ_MULTI_PACKET	0xC0
+
 struct __attribute__((packed)) wifi_network_entry {
 	char ssid[64];
 	char bssid[6];
@@ -537,10 +537,16 @@ static void process_Command()
 			scsiDev.data[0] = 0xF0;
 			scsiDev.data[2] = scsiDev.target->sense.code & 0x0F;
 
-			scsiDev.data[3] = transfer.lba >> 24;
-			scsiDev.data[4] = transfer.lba >> 16;
-			scsiDev.data[5] = transfer.lba >> 8;
-			scsiDev.data[6] = transfer.lba;
+			uint32_t info = transfer.lba;
+			if (scsiDev.target->sense.flags)
+			{
+				scsiDev.data[2] |= scsiDev.target->sense.flags & SENSE_FLAG_MASK;
+				info = scsiDev.target->sense.info;
+			}
+			scsiDev.data[3] = info >> 24;
+			scsiDev.data[4] = info >> 16;
+			scsiDev.data[5] = info >> 8;
+			scsiDev.data[6] = info;
 
 			// Additional bytes if there are errors to report
 			scsiDev.data[7] = 10; // additional length
@@ -560,6 +566,7 @@ static void process_Command()
 		// This is a good time to clear out old sense information.
 		scsiDev.target->sense.code = NO_SENSE;
 		scsiDev.target->sense.asc = NO_ADDITIONAL_SENSE_INFORMATION;
+		scsiDev.target->sense.flags = 0;
 	}
 	// Some old SCSI drivers do NOT properly support
 	// unitAttention. eg. the Mac Plus would trigger a SCSI reset
@@ -753,6 +760,7 @@ static void scsiReset()
 		scsiDev.target->reserverId = -1;
 		scsiDev.target->sense.code = NO_SENSE;
 		scsiDev.target->sense.asc = NO_ADDITIONAL_SENSE_INFORMATION;
+		scsiDev.target->sense.flags = 0;
 	}
 	scsiDev.target = NULL;
 
@@ -1341,6 +1349,7 @@ void scsiInit()
 		}
 		scsiDev.targets[i].sense.code = NO_SENSE;
 		scsiDev.targets[i].sense.asc = NO_ADDITIONAL_SENSE_INFORMATION;
+		scsiDev.targets[i].sense.flags = 0;
 
 		scsiDev.targets[i].syncOffset = 0;
 		scsiDev.targets[i].syncPeriod = 0;
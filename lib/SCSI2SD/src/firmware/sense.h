@@ -45,6 +45,7 @@ typedef enum
 {
 	ADDRESS_MARK_NOT_FOUND_FOR_DATA_FIELD                  = 0x1300,
 	ADDRESS_MARK_NOT_FOUND_FOR_ID_FIELD                    = 0x1200,
+	BEGINNING_OF_PARTITION_MEDIUM_DETECTED                 = 0x0004,
 	CANNOT_READ_MEDIUM_INCOMPATIBLE_FORMAT                 = 0x3002,
 	CANNOT_READ_MEDIUM_UNKNOWN_FORMAT                      = 0x3001,
 	CHANGED_OPERATING_DEFINITION                           = 0x3F02,
@@ -61,8 +62,11 @@ typedef enum
 	DEFECT_LIST_NOT_AVAILABLE                              = 0x1901,
 	DEFECT_LIST_NOT_FOUND                                  = 0x1C00,
 	DEFECT_LIST_UPDATE_FAILURE                             = 0x3201,
+	END_OF_DATA_DETECTED                                   = 0x0005,
+	END_OF_PARTITION_MEDIUM_DETECTED                       = 0x0002,
 	ERROR_LOG_OVERFLOW                                     = 0x0A00,
 	ERROR_TOO_LONG_TO_CORRECT                              = 0x1102,
+	FILEMARK_DETECTED                                      = 0x0001,
 	FORMAT_COMMAND_FAILED                                  = 0x3101,
 	GROWN_DEFECT_LIST_NOT_FOUND                            = 0x1C02,
 	IO_PROCESS_TERMINATED                                  = 0x0006,
@@ -169,10 +173,23 @@ typedef enum
 	WRITE_PROTECTED                                        = 0x2700
 } SCSI_ASC_ASCQ;
 
+// Sequential-access bits in byte 2 of extended sense data
+#define SENSE_FLAG_FILEMARK 0x80
+#define SENSE_FLAG_EOM 0x40
+#define SENSE_FLAG_ILI 0x20
+#define SENSE_FLAG_MASK 0xE0
+// Information field is valid, not sent in byte 2
+#define SENSE_FLAG_INFO 0x01
+
 typedef struct
 {
 	uint8_t code;
 	uint16_t asc;
+
+	// SENSE_FLAG_* bits. If any is set, info replaces the
+	// logical block address in the information field.
+	uint8_t flags;
+	uint32_t info;
 } ScsiSense;
 
 #endif
@@ -185,7 +185,7 @@ void scsiVendorCommandSetLen(uint8_t command, uint8_t* command_length)
 	{
 		// Conflicts with Apple CD-ROM audio over SCSI bus and Plextor CD-ROM D8 extension
 		// Will override those commands if enabled
-		if (0xD0 <= command && command <= 0xDA)
+		if (0xD0 <= command && command <= 0xDF)
 		{
 			*command_length = 10;
 		}
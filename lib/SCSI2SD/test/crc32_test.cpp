@@ -0,0 +1,109 @@
+#include "crc32.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+bool test_known_values()
+{
+    bool status = true;
+
+    COMMENT("test_known_values()");
+    TEST(crc32("", 0) == 0);
+    TEST(crc32("123456789", 9) == 0xCBF43926);
+    TEST(crc32("The quick brown fox jumps over the lazy dog", 43) == 0x414FA339);
+    TEST(crc32_update_bytewise(0, "123456789", 9) == 0xCBF43926);
+
+    return status;
+}
+
+bool test_against_bytewise()
+{
+    bool status = true;
+    static uint8_t buf[2048];
+    srand(1234);
+    for (size_t i = 0; i < sizeof(buf); i++)
+    {
+        buf[i] = rand();
+    }
+
+    COMMENT("test_against_bytewise()");
+
+    // All lengths and start alignments, covering the head and tail loops
+    bool all_match = true;
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t len = 0; len < 64; len++)
+        {
+            if (crc32(buf + offset, len) != crc32_update_bytewise(0, buf + offset, len))
+            {
+                printf("Mismatch at offset %d len %d\n", (int)offset, (int)len);
+                all_match = false;
+            }
+        }
+    }
+    TEST(all_match);
+
+    // Ethernet frame sizes
+    TEST(crc32(buf, 60) == crc32_update_bytewise(0, buf, 60));
+    TEST(crc32(buf + 1, 1514) == crc32_update_bytewise(0, buf + 1, 1514));
+
+    // Chained computation
+    uint32_t crc = crc32_update(0, buf, 100);
+    crc = crc32_update(crc, buf + 100, 1413);
+    TEST(crc == crc32(buf, 1513));
+
+    return status;
+}
+
+typedef uint32_t (*crc_func_t)(uint32_t crc, const void *buf, size_t size);
+
+static double benchmark(crc_func_t func, const uint8_t *buf, size_t len, int rounds)
+{
+    volatile uint32_t result = 0;
+    clock_t start = clock();
+    for (int i = 0; i < rounds; i++)
+    {
+        result = result + func(0, buf, len);
+    }
+    clock_t end = clock();
+    double seconds = (double)(end - start) / CLOCKS_PER_SEC;
+    return (double)len * rounds / (seconds + 1e-9) / (1024 * 1024);
+}
+
+void benchmark_implementations()
+{
+    static uint8_t buf[1514];
+    memset(buf, 0x55, sizeof(buf));
+
+    COMMENT("benchmark_implementations()");
+    printf("Bytewise table:  %8.1f MB/s\n", benchmark(crc32_update_bytewise, buf, sizeof(buf), 20000));
+    printf("Slice-by-8:      %8.1f MB/s\n", benchmark(crc32_update, buf, sizeof(buf), 20000));
+}
+
+int main()
+{
+    bool ok = test_known_values();
+    ok = test_against_bytewise() && ok;
+    benchmark_implementations();
+
+    if (ok)
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -73,6 +73,13 @@ extern bool g_moved_select_in;
 #define PLATFORM_VDD_WARNING_LIMIT_mV 2800
 #endif
 
+// Smaller feature buffers than the defaults in ZuluSCSI_config.h, to fit in 128 kB of RAM
+#define TOOLBOX_INDEX_MAX_FILES 256
+#define TAPE_INDEX_SLOTS 1
+#define TAPE_STREAM_BUFFER_SIZE 4096
+#define TRACE_RING_ENTRIES 0
+#define CDROM_MAX_TRACK_FILES 16
+
 // Debug logging functions
 void platform_log(const char *s);
 
@@ -99,6 +106,13 @@ static inline void delay_100ns()
     asm volatile ("nop \n nop \n nop \n nop \n nop");
 }
 
+// Free running counter for binary trace timestamps
+#define PLATFORM_TRACE_TICKS_PER_SEC SystemCoreClock
+static inline uint32_t platform_trace_ticks()
+{
+    return DWT->CYCCNT;
+}
+
 // Initialize SPI and GPIO configuration
 void platform_init();
 
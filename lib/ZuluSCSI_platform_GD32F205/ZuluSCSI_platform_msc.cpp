@@ -84,8 +84,13 @@ bool platform_sense_msc() {
 
   // kill usb serial.
   usbd_disconnect (&cdc_acm);
-  // set the MSC storage size
-  usbd_mem_fops->mem_block_len[0] = SD.card()->sectorCount();
+  // set the MSC storage size of the SD card and each image drive
+  for (uint8_t lun = 0; lun < msc_lun_count(); lun++)
+  {
+    usbd_mem_fops->mem_inquiry_data[lun] = (uint8_t *)storageInquiryData;
+    usbd_mem_fops->mem_block_size[lun] = SD_SECTOR_SIZE;
+    usbd_mem_fops->mem_block_len[lun] = msc_lun_sectors(lun);
+  }
   unitReady = true;
   
   // init the MSC class, uses ISR and other global routines from usb_serial.cpp
@@ -177,7 +182,7 @@ static int8_t storageIsReady(uint8_t Lun)
 */
 static int8_t storageIsWriteProtected(uint8_t Lun)
 {
-    return ! unitReady; // 0 = read/write
+    return ! (unitReady && msc_lun_writable(Lun)); // 0 = read/write
 }
 
 /*!
@@ -194,14 +199,17 @@ static int8_t storageRead(uint8_t Lun,
                            uint32_t BlkAddr,
                            uint16_t BlkLen)
 {
+    usbd_msc_handler *msc = (usbd_msc_handler *)cdc_acm.dev.class_data[USBD_MSC_INTERFACE];
+
     // divide by sector size to convert address to LBA
-    bool rc = SD.card()->readSectors(BlkAddr/SD_SECTOR_SIZE, buf, BlkLen);
+    // remaining length of the command is known, read it ahead in one go
+    int32_t rc = msc_lun_read(Lun, BlkAddr/SD_SECTOR_SIZE, buf, BlkLen, msc->scsi_blk_len/SD_SECTOR_SIZE);
 
     // only blink fast on reads; writes will override this
     if (MSC_LEDMode == LED_SOLIDON)
       MSC_LEDMode = LED_BLINK_FAST;
       
-    return !rc;
+    return (rc > 0) ? 0 : -1;
 }
 
 /*!
@@ -218,13 +226,23 @@ static int8_t storageWrite(uint8_t Lun,
                             uint32_t BlkAddr,
                             uint16_t BlkLen)
 {
+    usbd_msc_handler *msc = (usbd_msc_handler *)cdc_acm.dev.class_data[USBD_MSC_INTERFACE];
+
     // divide by sector size to convert address to LBA
-    bool rc = SD.card()->writeSectors(BlkAddr/SD_SECTOR_SIZE, buf, BlkLen);
+    // packets of one command are collected into multi-sector SD card writes
+    int32_t rc = msc_lun_write(Lun, BlkAddr/SD_SECTOR_SIZE, buf, BlkLen);
+
+    // callbacks run in USB interrupt and cannot be retried later,
+    // so the data is stored before status of the last packet is sent.
+    if (rc > 0 && msc->scsi_blk_len <= (uint32_t)BlkLen * SD_SECTOR_SIZE)
+    {
+        if (!msc_cache_flush()) rc = -1;
+    }
 
     // always slow blink
     MSC_LEDMode = LED_BLINK_SLOW;
 
-    return !rc;
+    return (rc > 0) ? 0 : -1;
 }
 
 /*!
@@ -235,7 +253,7 @@ static int8_t storageWrite(uint8_t Lun,
 */
 static int8_t storageGetMaxLun(void)
 {
-    return 0; // number of LUNs supported - 1
+    return msc_lun_count() - 1; // number of LUNs supported - 1
 }
 
 #endif // PLATFORM_MASS_STORAGE
\ No newline at end of file
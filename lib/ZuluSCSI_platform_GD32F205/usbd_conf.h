@@ -72,7 +72,8 @@ OF SUCH DAMAGE.
     /* recommend 4096 as a minimum - SD real sector size */
     #define MSC_MEDIA_PACKET_SIZE           4096U
 
-    #define MEM_LUN_NUM                     1U
+    /* SD card and one drive per SCSI image, see ZuluSCSI_msc.cpp */
+    #define MEM_LUN_NUM                     9U
 
 #else
     /* minimums to compile but not allocate storage */
@@ -80,6 +80,13 @@ static inline void delay_100ns()
    asm volatile ("nop \n nop \n nop \n nop \n nop");
 }
 
+// Free running counter for binary trace timestamps
+#define PLATFORM_TRACE_TICKS_PER_SEC SystemCoreClock
+static inline uint32_t platform_trace_ticks()
+{
+    return DWT->CYCCNT;
+}
+
 // Initialize SPI and GPIO configuration
 void platform_init();
 
@@ -73,7 +73,8 @@ OF SUCH DAMAGE.
 
 #define MSC_MEDIA_PACKET_SIZE           4096U
 
-#define MEM_LUN_NUM                     1U
+/* SD card and one drive per SCSI image, see ZuluSCSI_msc.cpp */
+#define MEM_LUN_NUM                     9U
 
 /* CDC endpoints parameters: you can fine tune these values depending on the needed baud rate and performance */
 #ifdef USE_USB_HS
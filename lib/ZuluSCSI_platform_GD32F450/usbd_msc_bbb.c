@@ -216,7 +216,7 @@ static void msc_bbb_cbw_decode (usb_core_driver *udev)
 
     if((BBB_CBW_LENGTH != usbd_rxcount_get(udev, MSC_OUT_EP)) ||
             (BBB_CBW_SIGNATURE != msc->bbb_cbw.dCBWSignature) ||
-            (msc->bbb_cbw.bCBWLUN > 1U) ||
+            (msc->bbb_cbw.bCBWLUN >= MEM_LUN_NUM) ||
             (msc->bbb_cbw.bCBWCBLength < 1U) ||
             (msc->bbb_cbw.bCBWCBLength > 16U)) {
         /* illegal command handler */
@@ -703,12 +703,38 @@ void platform_poll()
 {
     usb_log_poll();
     adc_poll();
+    platform_sd_poll();
     
 #ifdef ENABLE_AUDIO_OUTPUT
     audio_poll();
 #endif // ENABLE_AUDIO_OUTPUT
 }
 
+#ifdef PLATFORM_HAS_SD_WORKER
+static void (*g_sd_worker_func)();
+static bool g_sd_worker_running;
+
+static void core1_sd_worker()
+{
+    // Allows core0 to pause this core while it writes to flash
+    multicore_lockout_victim_init();
+
+    // The SDIO driver runs from core1 from now on, so handle
+    // its DMA completion interrupt here as well.
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    g_sd_worker_func();
+}
+
+void platform_start_sd_worker(void (*func)())
+{
+    g_sd_worker_func = func;
+    g_sd_worker_running = true;
+    irq_set_enabled(DMA_IRQ_1, false);
+    multicore_launch_core1(core1_sd_worker);
+}
+#endif // PLATFORM_HAS_SD_WORKER
+
 uint8_t platform_get_buttons()
 {
     uint8_t buttons = 0;
@@ -796,15 +822,63 @@ bool platform_read_romdrive(uint8_t *dest, uint32_t start, uint32_t count)
     return true;
 }
 
+// Flash cannot be read while it is being written,
+// so interrupts and the other core must be paused.
+static void romdrive_flash_op_start()
+{
+#ifdef PLATFORM_HAS_SD_WORKER
+    if (g_sd_worker_running) multicore_lockout_start_blocking();
+#endif
+    __disable_irq();
+}
+
+static void romdrive_flash_op_end()
+{
+    __enable_irq();
+#ifdef PLATFORM_HAS_SD_WORKER
+    if (g_sd_worker_running) multicore_lockout_end_blocking();
+#endif
+}
+
 bool platform_write_romdrive(const uint8_t *data, uint32_t start, uint32_t count)
 {
     assert(start < platform_get_romdrive_maxsize());
     assert((count % PLATFORM_ROMDRIVE_PAGE_SIZE) == 0);
 
-    __disable_irq();
+    romdrive_flash_op_start();
     flash_range_erase(start + ROMDRIVE_OFFSET, count);
     flash_range_program(start + ROMDRIVE_OFFSET, data, count);
-    __enable_irq();
+    romdrive_flash_op_end();
+    return true;
+}
+
+// Offset of ROM drive start from the previous flash block boundary
+uint32_t platform_get_romdrive_block_offset()
+{
+    return ROMDRIVE_OFFSET % PLATFORM_ROMDRIVE_BLOCK_SIZE;
+}
+
+bool platform_erase_romdrive(uint32_t start, uint32_t count)
+{
+    assert(start + count <= platform_get_romdrive_maxsize());
+    assert((start % PLATFORM_ROMDRIVE_PAGE_SIZE) == 0);
+    assert((count % PLATFORM_ROMDRIVE_PAGE_SIZE) == 0);
+
+    // Boot ROM erase routine uses block erase command where alignment allows
+    romdrive_flash_op_start();
+    flash_range_erase(start + ROMDRIVE_OFFSET, count);
+    romdrive_flash_op_end();
+    return true;
+}
+
+bool platform_program_romdrive(const uint8_t *data, uint32_t start, uint32_t count)
+{
+    assert(start + count <= platform_get_romdrive_maxsize());
+    assert((count % FLASH_PAGE_SIZE) == 0);
+
+    romdrive_flash_op_start();
+    flash_range_program(start + ROMDRIVE_OFFSET, data, count);
+    romdrive_flash_op_end();
     return true;
 }
 
@@ -25,6 +25,7 @@
 
 #include <stdint.h>
 #include <Arduino.h>
+#include <hardware/structs/timer.h>
 #include "ZuluSCSI_platform_network.h"
 
 #ifdef ZULUSCSI_PICO
@@ -73,6 +74,21 @@ extern const char *g_platform_name;
 #define SD_USE_SDIO 1
 #define PLATFORM_HAS_PARITY_CHECK 1
 
+// FLAC audio tracks for CD-ROM images, decoder uses about 34 kB of RAM
+#ifndef ZULUSCSI_NETWORK
+#define PLATFORM_HAS_FLAC_DECODER 1
+#endif
+
+// Network packet queues use most of the RAM on DaynaPORT builds,
+// so the feature buffers sized in ZuluSCSI_config.h are made smaller.
+#ifdef ZULUSCSI_NETWORK
+#define TOOLBOX_INDEX_MAX_FILES 256
+#define TAPE_INDEX_SLOTS 1
+#define TAPE_STREAM_BUFFER_SIZE 4096
+#define TRACE_RING_ENTRIES 0
+#define CDROM_MAX_TRACK_FILES 16
+#endif
+
 #ifndef PLATFORM_VDD_WARNING_LIMIT_mV
 #define PLATFORM_VDD_WARNING_LIMIT_mV 2800
 #endif
@@ -103,6 +119,13 @@ static inline void delay_100ns()
     asm volatile ("nop \n nop \n nop \n nop \n nop \n nop \n nop \n nop \n nop \n nop \n nop");
 }
 
+// Free running counter for binary trace timestamps
+#define PLATFORM_TRACE_TICKS_PER_SEC 1000000
+static inline uint32_t platform_trace_ticks()
+{
+    return timer_hw->timerawl;
+}
+
 // Initialize SD card and GPIO configuration
 void platform_init();
 
@@ -138,6 +161,27 @@ uint8_t platform_get_buttons();
 typedef void (*sd_callback_t)(uint32_t bytes_complete);
 void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer);
 
+// Lock for SD card access from core1. Card operations lock it internally,
+// core1 uses platform_sd_try_lock() to avoid waiting for core0 accesses.
+bool platform_sd_try_lock();
+void platform_sd_unlock();
+
+// Logs SD card errors from core1 accesses and applies the bus speed
+// fallback that core1 cannot do itself. Called from platform_poll().
+void platform_sd_poll();
+
+// Second core can run SD card transfers while core0 handles the SCSI bus.
+// Not available when core1 is used for audio output.
+#ifndef ENABLE_AUDIO_OUTPUT
+#define PLATFORM_HAS_SD_WORKER 1
+// Start func on core1, it should never return.
+// SDIO write completion interrupt is moved to core1 as well.
+void platform_start_sd_worker(void (*func)());
+#else
+// With DualCoreSD, core1 reads CD audio samples of contiguous images itself
+#define PLATFORM_SD_AUDIO_CORE1 1
+#endif
+
 // Reprogram firmware in main program area.
 #ifndef RP2040_DISABLE_BOOTLOADER
 #define PLATFORM_BOOTLOADER_SIZE (128 * 1024)
@@ -159,6 +203,14 @@ bool platform_read_romdrive(uint8_t *dest, uint32_t start, uint32_t count);
 // Reprogram ROM drive area
 #define PLATFORM_ROMDRIVE_PAGE_SIZE 4096
 bool platform_write_romdrive(const uint8_t *data, uint32_t start, uint32_t count);
+
+// Separate erase and program steps for loading large images.
+// Erase uses the faster 64 kB block erase for any aligned blocks in the range.
+// Program requires the area to be erased first.
+#define PLATFORM_ROMDRIVE_BLOCK_SIZE 65536
+uint32_t platform_get_romdrive_block_offset();
+bool platform_erase_romdrive(uint32_t start, uint32_t count);
+bool platform_program_romdrive(const uint8_t *data, uint32_t start, uint32_t count);
 #endif
 
 // Parity lookup tables for write and read from SCSI bus.
@@ -95,7 +95,7 @@ extern "C" void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
 
   // TODO: We could/should use strings from the platform, but they are too long
   const char vid[] = "ZuluSCSI";
-  const char pid[] = "Pico"; 
+  const char *pid = (lun == 0) ? "Pico" : msc_lun_name(lun); // image drives show filename
   const char rev[] = "1.0";
 
   memcpy(vendor_id, vid, tu_min32(strlen(vid), 8));
@@ -104,9 +104,9 @@ extern "C" void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
 }
 
 // max LUN supported
-// we only have the one SD card
+// the SD card and optionally each image file
 extern "C" uint8_t tud_msc_get_maxlun_cb(void) {
-  return 1; // number of LUNs supported
+  return msc_lun_count(); // number of LUNs supported
 }
 
 // return writable status
@@ -114,14 +114,12 @@ extern "C" uint8_t tud_msc_get_maxlun_cb(void) {
 // otherwise this is not actually needed
 extern "C" bool tud_msc_is_writable_cb (uint8_t lun)
 {
-  (void) lun;
-  return unitReady;
+  return unitReady && msc_lun_writable(lun);
 }
 
 // see https://www.seagate.com/files/staticfiles/support/docs/manual/Interface%20manuals/100293068j.pdf pg 221
 extern "C" bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject)
 {
-  (void) lun;
   (void) power_condition;
 
   if (load_eject)  {
@@ -129,6 +127,11 @@ extern "C" bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool
       // load disk storage
       // do nothing as we started "loaded"
     } else {
+      // store buffered writes before the host considers the media removed
+      if (!msc_cache_flush()) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+        return false;
+      }
       unitReady = false;
     }
   }
@@ -146,9 +149,7 @@ extern "C" bool tud_msc_test_unit_ready_cb(uint8_t lun) {
 // return size in blocks and block size
 extern "C" void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count,
                          uint16_t *block_size) {
-  (void) lun;
-
-  *block_count = unitReady ? (SD.card()->sectorCount()) : 0;
+  *block_count = unitReady ? msc_lun_sectors(lun) : 0;
   *block_size = SD_SECTOR_SIZE;
 }
 
@@ -166,6 +167,14 @@ extern "C" int32_t tud_msc_scsi_cb(uint8_t lun, const uint8_t scsi_cmd[16], void
     resplen = 0;
     break;
 
+  case 0x35: // SYNCHRONIZE CACHE (10)
+    if (!msc_cache_flush()) {
+      // Medium error, write error
+      tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+      resplen = -1;
+    }
+    break;
+
   default:
     // Set Sense = Invalid Command Operation
     tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
@@ -193,29 +202,41 @@ extern "C" int32_t tud_msc_scsi_cb(uint8_t lun, const uint8_t scsi_cmd[16], void
 extern "C" int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, 
                             void* buffer, uint32_t bufsize)
 {
-  (void) lun;
-
-  bool rc = SD.card()->readSectors(lba, (uint8_t*) buffer, bufsize/SD_SECTOR_SIZE);
+  // Sequential reads are served from read-ahead buffer.
+  // Returning 0 while the buffer is being flushed makes TinyUSB retry later.
+  int32_t rc = msc_lun_read(lun, lba, (uint8_t*) buffer, bufsize/SD_SECTOR_SIZE, 0);
 
   // only blink fast on reads; writes will override this
   if (MSC_LEDMode == LED_SOLIDON)
     MSC_LEDMode = LED_BLINK_FAST;
-  
-  return rc ? bufsize : -1;
+
+  if (rc < 0) {
+    // Medium error, unrecovered read error or failed buffered write
+    tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
+  }
+
+  return (rc > 0) ? (int32_t)bufsize : rc;
 }
 
 // Callback invoked when receive WRITE10 command.
 // Process data in buffer to disk's storage and return number of written bytes (must be multiple of block size)
 extern "C" int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
                            uint8_t *buffer, uint32_t bufsize) {
-  (void) lun;
-
-  bool rc = SD.card()->writeSectors(lba, buffer, bufsize/SD_SECTOR_SIZE);
+  // Consecutive writes are collected into multi-sector SD card writes.
+  // They are stored at latest when the main loop sees the bus idle.
+  // If that fails, the next command returns MEDIUM ERROR.
+  int32_t rc = msc_lun_write(lun, lba, buffer, bufsize/SD_SECTOR_SIZE);
 
   // always slow blink
   MSC_LEDMode = LED_BLINK_SLOW;
 
-  return rc ? bufsize : -1;
+  if (rc < 0) {
+    // Medium error, write error. Also reported for an earlier
+    // buffered write that failed after GOOD status was sent.
+    tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+  }
+
+  return (rc > 0) ? (int32_t)bufsize : rc;
 }
 
 // Callback invoked when WRITE10 command is completed (status received and accepted by host).
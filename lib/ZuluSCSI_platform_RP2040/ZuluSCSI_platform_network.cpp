@@ -19,11 +19,13 @@
 #include "ZuluSCSI_config.h"
 #include <scsi.h>
 #include <network.h>
+#include <hardware/dma.h>
 
 extern "C" {
 
 #include <cyw43.h>
 #include <pico/cyw43_arch.h>
+#include <crc32.h>
 
 #ifndef CYW43_IOCTL_GET_RSSI
 #define CYW43_IOCTL_GET_RSSI (0xfe)
@@ -40,6 +42,9 @@ static const char defaultMAC[] = { 0x00, 0x80, 0x19, 0xc0, 0xff, 0xee };
 
 static bool network_in_use = false;
 
+// DMA channel used for copying inbound frames with CRC calculation, -1 if not available
+static int network_crc_dma_ch = -1;
+
 bool platform_network_supported()
 {
 	/* from cores/rp2040/RP2040Support.h */
@@ -108,6 +113,10 @@ int platform_network_init(char *mac)
 
 	network_in_use = true;
 
+	// The DMA channels used by other drivers are claimed by now
+	if (network_crc_dma_ch < 0)
+		network_crc_dma_ch = dma_claim_unused_channel(false);
+
 	return 0;
 }
 
@@ -172,6 +181,35 @@ int platform_network_send(uint8_t *buf, size_t len)
 	return ret;
 }
 
+uint32_t platform_network_copy_crc32(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	int ch = network_crc_dma_ch;
+	if (ch < 0)
+	{
+		memcpy(dst, src, len);
+		return crc32(src, len);
+	}
+
+	dma_channel_config cfg = dma_channel_get_default_config(ch);
+	channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+	channel_config_set_read_increment(&cfg, true);
+	channel_config_set_write_increment(&cfg, true);
+	channel_config_set_sniff_enable(&cfg, true);
+
+	// CRC32R mode feeds the bytes LSB first, as in the Ethernet FCS.
+	// Reversing and inverting the accumulator on readback gives the standard CRC-32 value.
+	dma_sniffer_enable(ch, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+	hw_set_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS | DMA_SNIFF_CTRL_OUT_INV_BITS);
+	dma_hw->sniff_data = 0xFFFFFFFF;
+
+	dma_channel_configure(ch, &cfg, dst, src, len, true);
+	dma_channel_wait_for_finish_blocking(ch);
+
+	uint32_t crc = dma_hw->sniff_data;
+	dma_sniffer_disable();
+	return crc;
+}
+
 static int platform_network_wifi_scan_result(void *env, const cyw43_ev_scan_result_t *result)
 {
 	struct wifi_network_entry *entry = NULL;
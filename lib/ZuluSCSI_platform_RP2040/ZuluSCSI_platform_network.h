@@ -38,6 +38,10 @@ char * platform_network_wifi_bssid();
 int platform_network_wifi_channel();
 int platform_network_send(uint8_t *buf, size_t len);
 
+// Copy an inbound frame and compute its CRC-32 in the same pass using the DMA sniffer
+#define PLATFORM_NETWORK_HAS_COPY_CRC32
+uint32_t platform_network_copy_crc32(uint8_t *dst, const uint8_t *src, size_t len);
+
 # ifdef __cplusplus
 }
 # endif
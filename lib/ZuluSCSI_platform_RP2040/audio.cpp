@@ -19,6 +19,7 @@
 
 #include <SdFat.h>
 #include <stdbool.h>
+#include <string.h>
 #include <hardware/dma.h>
 #include <hardware/irq.h>
 #include <hardware/spi.h>
@@ -28,6 +29,8 @@
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_platform.h"
+#include "ZuluSCSI_settings.h"
+#include <scsi.h>
 
 extern SdFs SD;
 
@@ -111,16 +114,17 @@ const uint16_t z_preamble = 0xE8CC;
 static dma_channel_config snd_dma_a_cfg;
 static dma_channel_config snd_dma_b_cfg;
 
-// some chonky buffers to store audio samples
-static uint8_t sample_buf_a[AUDIO_BUFFER_SIZE];
-static uint8_t sample_buf_b[AUDIO_BUFFER_SIZE];
+// ring of chonky buffers to store audio samples
+// one extra sector each allows reading whole sectors at unaligned positions
+static uint8_t sample_buf[AUDIO_BUFFER_COUNT][AUDIO_BUFFER_SIZE + SD_SECTOR_SIZE] __attribute__((aligned(4)));
 
 // tracking for the state of the above buffers
+// buffers are filled by the reader and played by core1 in ring order
 enum bufstate { STALE, FILLING, READY };
-static volatile bufstate sbufst_a = STALE;
-static volatile bufstate sbufst_b = STALE;
-enum bufselect { A, B };
-static bufselect sbufsel = A;
+static volatile bufstate sbufst[AUDIO_BUFFER_COUNT];
+static uint16_t sbufoff[AUDIO_BUFFER_COUNT]; // offset of first sample in buffer
+static uint8_t sbufsel = 0; // next buffer to play, core1 only
+static uint8_t sbuffill = 0; // next buffer to fill, reader only
 static uint16_t sbufpos = 0;
 static uint8_t sbufswap = 0;
 
@@ -135,7 +139,24 @@ static uint8_t audio_owner; // SCSI ID or 0xFF when idle
 static volatile bool audio_paused = false;
 static ImageBackingStore* audio_file;
 static uint64_t fpos;
-static uint32_t fleft;
+static volatile uint32_t fleft;
+
+// When the image is contiguous on the SD card, core1 reads the samples
+// directly from the card sectors whenever core0 is not using the card.
+// Otherwise samples are read through the file by audio_poll() on core0.
+static bool snd_sd_direct;
+static uint32_t snd_sd_sector; // first sector of the image
+static volatile bool snd_reading; // core1 is in snd_fill()
+static volatile uint32_t snd_read_errors;
+static uint32_t snd_read_errors_reported;
+
+// playback position tracking, updated by core1 as samples are encoded
+static uint64_t pstart; // file position where playback began
+static volatile uint32_t pplayed; // bytes played since then
+
+// count of sample chunks replaced by silence due to data not being ready
+static volatile uint32_t underruns;
+static uint32_t underruns_total;
 
 // historical playback status information
 static audio_status_code audio_last_status[8] = {ASC_NO_STATUS, ASC_NO_STATUS, ASC_NO_STATUS, ASC_NO_STATUS,
@@ -248,63 +269,101 @@ static void snd_encode(uint8_t* samples, uint16_t* wire_patterns, uint16_t len,
     }
 }
 
-// functions for passing to Core1
-static void snd_process_a() {
-    if (sbufsel == A) {
-        if (sbufst_a == READY) {
-            snd_encode(sample_buf_a + sbufpos, wire_buf_a, SAMPLE_CHUNK_SIZE, sbufswap);
-            sbufpos += SAMPLE_CHUNK_SIZE;
-            if (sbufpos >= AUDIO_BUFFER_SIZE) {
-                sbufsel = B;
-                sbufpos = 0;
-                sbufst_a = STALE;
-            }
-        } else {
-            snd_encode(NULL, wire_buf_a, SAMPLE_CHUNK_SIZE, sbufswap);
+// reads samples through the image file, only on core0
+static bool snd_read_file(uint8_t idx, uint16_t toRead) {
+    platform_set_sd_callback(NULL, NULL);
+    if (audio_file->position() != fpos) {
+        // should be uncommon due to SCSI command restrictions on devices
+        // playing audio; if this is showing up in logs a different approach
+        // will be needed to avoid seek performance issues on FAT32 vols
+        dbgmsg("------ Audio seek required on ", audio_owner);
+        if (!audio_file->seek(fpos)) {
+            logmsg("Audio error, unable to seek to ", fpos, ", ID:", audio_owner);
         }
-    } else {
-        if (sbufst_b == READY) {
-            snd_encode(sample_buf_b + sbufpos, wire_buf_a, SAMPLE_CHUNK_SIZE, sbufswap);
-            sbufpos += SAMPLE_CHUNK_SIZE;
-            if (sbufpos >= AUDIO_BUFFER_SIZE) {
-                sbufsel = A;
-                sbufpos = 0;
-                sbufst_b = STALE;
+    }
+    sbufoff[idx] = 0;
+    return audio_file->read(sample_buf[idx], toRead) == toRead;
+}
+
+// reads samples as whole sectors from the SD card, safe to call from core1
+static bool snd_read_direct(uint8_t idx, uint16_t toRead) {
+    uint32_t offset = fpos % SD_SECTOR_SIZE;
+    uint32_t sector = snd_sd_sector + (uint32_t)(fpos / SD_SECTOR_SIZE);
+    uint32_t count = (offset + toRead + SD_SECTOR_SIZE - 1) / SD_SECTOR_SIZE;
+    sbufoff[idx] = offset;
+    return SD.card()->readSectors(sector, sample_buf[idx], count);
+}
+
+// reads the next sample buffer from the memory card, if one is free
+static bool audio_fill_buffer() {
+    uint8_t idx = sbuffill;
+    if (fleft == 0 || sbufst[idx] != STALE) return false;
+    sbufst[idx] = FILLING;
+
+    uint16_t toRead = AUDIO_BUFFER_SIZE;
+    if (fleft < toRead) toRead = fleft;
+    bool ok = snd_sd_direct ? snd_read_direct(idx, toRead) : snd_read_file(idx, toRead);
+    if (!ok) snd_read_errors++;
+    if (toRead < AUDIO_BUFFER_SIZE) {
+        // end of playback, pad with silence
+        memset(sample_buf[idx] + sbufoff[idx] + toRead, 0, AUDIO_BUFFER_SIZE - toRead);
+    }
+    fpos += toRead;
+    fleft -= toRead;
+
+    sbufst[idx] = READY;
+    sbuffill = (idx + 1) % AUDIO_BUFFER_COUNT;
+    return true;
+}
+
+// reads one sample buffer on core1, if the SD card is not in use by core0
+static void snd_fill() {
+    snd_reading = true;
+    if (snd_sd_direct && audio_owner != 0xFF && !audio_stopping && !audio_paused) {
+        // a blocking wait here could miss the encoding deadline,
+        // so retry after the next chunk instead. The same applies
+        // when the card is still programming data written by core0.
+        if (platform_sd_try_lock()) {
+            if (!SD.card()->isBusy()) {
+                audio_fill_buffer();
             }
-        } else {
-            snd_encode(NULL, wire_buf_a, SAMPLE_CHUNK_SIZE, sbufswap);
+            platform_sd_unlock();
         }
     }
+    snd_reading = false;
 }
-static void snd_process_b() {
-    // clone of above for the other wire buffer
-    if (sbufsel == A) {
-        if (sbufst_a == READY) {
-            snd_encode(sample_buf_a + sbufpos, wire_buf_b, SAMPLE_CHUNK_SIZE, sbufswap);
-            sbufpos += SAMPLE_CHUNK_SIZE;
-            if (sbufpos >= AUDIO_BUFFER_SIZE) {
-                sbufsel = B;
-                sbufpos = 0;
-                sbufst_a = STALE;
-            }
-        } else {
-            snd_encode(NULL, wire_buf_b, SAMPLE_CHUNK_SIZE, sbufswap);
+
+// encodes next chunk of samples, or silence if none are available
+static void snd_process(uint16_t* wire_patterns) {
+    if (audio_paused) {
+        snd_encode(NULL, wire_patterns, SAMPLE_CHUNK_SIZE, sbufswap);
+    } else if (sbufst[sbufsel] == READY) {
+        snd_encode(sample_buf[sbufsel] + sbufoff[sbufsel] + sbufpos, wire_patterns, SAMPLE_CHUNK_SIZE, sbufswap);
+        sbufpos += SAMPLE_CHUNK_SIZE;
+        pplayed += SAMPLE_CHUNK_SIZE;
+        if (sbufpos >= AUDIO_BUFFER_SIZE) {
+            sbufst[sbufsel] = STALE;
+            sbufsel = (sbufsel + 1) % AUDIO_BUFFER_COUNT;
+            sbufpos = 0;
         }
     } else {
-        if (sbufst_b == READY) {
-            snd_encode(sample_buf_b + sbufpos, wire_buf_b, SAMPLE_CHUNK_SIZE, sbufswap);
-            sbufpos += SAMPLE_CHUNK_SIZE;
-            if (sbufpos >= AUDIO_BUFFER_SIZE) {
-                sbufsel = A;
-                sbufpos = 0;
-                sbufst_b = STALE;
-            }
-        } else {
-            snd_encode(NULL, wire_buf_b, SAMPLE_CHUNK_SIZE, sbufswap);
-        }
+        // sample data did not arrive in time, unless playback is ending
+        if (fleft > 0 && !audio_stopping) underruns++;
+        snd_encode(NULL, wire_patterns, SAMPLE_CHUNK_SIZE, sbufswap);
     }
 }
 
+// functions for passing to Core1
+// samples are read after encoding, while the other wire buffer is playing
+static void snd_process_a() {
+    snd_process(wire_buf_a);
+    snd_fill();
+}
+static void snd_process_b() {
+    snd_process(wire_buf_b);
+    snd_fill();
+}
+
 // Allows execution on Core1 via function pointers. Each function can take
 // no parameters and should return nothing, operating via side-effects only.
 static void core1_handler() {
@@ -373,7 +432,18 @@ void audio_setup() {
 void audio_poll() {
     if (!audio_is_active()) return;
     if (audio_paused) return;
-    if (fleft == 0 && sbufst_a == STALE && sbufst_b == STALE) {
+
+    uint8_t ready = 0;
+    for (uint8_t i = 0; i < AUDIO_BUFFER_COUNT; i++) {
+        if (sbufst[i] == READY) ready++;
+    }
+
+    if (snd_read_errors != snd_read_errors_reported) {
+        snd_read_errors_reported = snd_read_errors;
+        logmsg("Audio sample data underrun, SD card read failed");
+    }
+
+    if (fleft == 0 && ready == 0) {
         // out of data and ready to stop
         audio_stop(audio_owner);
         return;
@@ -387,41 +457,16 @@ void audio_poll() {
         return;
     }
 
-    // are new audio samples needed from the memory card?
-    uint8_t* audiobuf;
-    if (sbufst_a == STALE) {
-        sbufst_a = FILLING;
-        audiobuf = sample_buf_a;
-    } else if (sbufst_b == STALE) {
-        sbufst_b = FILLING;
-        audiobuf = sample_buf_b;
-    } else {
-        // no data needed this time
+    if (snd_sd_direct) {
+        // core1 reads the samples
         return;
-    }
-
-    platform_set_sd_callback(NULL, NULL);
-    uint16_t toRead = AUDIO_BUFFER_SIZE;
-    if (fleft < toRead) toRead = fleft;
-    if (audio_file->position() != fpos) {
-        // should be uncommon due to SCSI command restrictions on devices
-        // playing audio; if this is showing up in logs a different approach
-        // will be needed to avoid seek performance issues on FAT32 vols
-        dbgmsg("------ Audio seek required on ", audio_owner);
-        if (!audio_file->seek(fpos)) {
-            logmsg("Audio error, unable to seek to ", fpos, ", ID:", audio_owner);
-        }
-    }
-    if (audio_file->read(audiobuf, toRead) != toRead) {
-        logmsg("Audio sample data underrun");
-    }
-    fpos += toRead;
-    fleft -= toRead;
-
-    if (sbufst_a == FILLING) {
-        sbufst_a = READY;
-    } else if (sbufst_b == FILLING) {
-        sbufst_b = READY;
+    } else if (scsiDev.phase == BUS_FREE) {
+        // bus is idle, read ahead as far as the buffers allow
+        while (audio_fill_buffer());
+    } else if (ready < AUDIO_BUFFER_LOW_WATER) {
+        // command in progress, read only one buffer per poll so that
+        // the SCSI transfer is not held up for long
+        audio_fill_buffer();
     }
 }
 
@@ -463,28 +508,42 @@ bool audio_play(uint8_t owner, ImageBackingStore* img, uint64_t start, uint64_t
         return false;
     }
 
-    // read in initial sample buffers
-    if (!audio_file->seek(start)) {
+    // check if core1 can read the samples directly from the card,
+    // off by default until the effect on disk throughput is measured
+#ifdef SD_USE_SDIO
+    uint32_t endsector;
+    snd_sd_direct = g_scsi_settings.getSystem()->enableDualCoreSD
+        && !audio_file->isRom() && audio_file->contiguousRange(&snd_sd_sector, &endsector);
+#else
+    snd_sd_direct = false;
+#endif
+
+    // read in initial sample buffers, the rest are filled during playback
+    if (!snd_sd_direct && !audio_file->seek(start)) {
         logmsg("Sample file failed start seek to ", start);
         return false;
     }
-    if (audio_file->read(sample_buf_a, AUDIO_BUFFER_SIZE) != AUDIO_BUFFER_SIZE) {
-        logmsg("File playback start returned fewer bytes than allowed");
-        return false;
+    fpos = start;
+    sbuffill = 0;
+    for (uint8_t i = 0; i < AUDIO_BUFFER_COUNT; i++) {
+        sbufst[i] = STALE;
+    }
+    snd_read_errors = snd_read_errors_reported = 0;
+    for (uint8_t i = 0; i < 2; i++) {
+        audio_fill_buffer();
     }
-    if (audio_file->read(sample_buf_b, AUDIO_BUFFER_SIZE) != AUDIO_BUFFER_SIZE) {
+    if (snd_read_errors) {
         logmsg("File playback start returned fewer bytes than allowed");
         return false;
     }
 
     // prepare initial tracking state
-    fpos = audio_file->position();
-    fleft -= AUDIO_BUFFER_SIZE * 2;
-    sbufsel = A;
+    pstart = start;
+    pplayed = 0;
+    underruns = 0;
+    sbufsel = 0;
     sbufpos = 0;
     sbufswap = swap;
-    sbufst_a = READY;
-    sbufst_b = READY;
     audio_owner = owner & 7;
     audio_last_status[audio_owner] = ASC_PLAYING;
     audio_paused = false;
@@ -544,17 +603,28 @@ void audio_stop(uint8_t id) {
     // to help mute external hardware, send a bunch of '0' samples prior to
     // halting the datastream; easiest way to do this is invalidating the
     // sample buffers, same as if there was a sample data underrun
-    sbufst_a = STALE;
-    sbufst_b = STALE;
+    audio_stopping = true;
+    for (uint8_t i = 0; i < AUDIO_BUFFER_COUNT; i++) {
+        sbufst[i] = STALE;
+    }
 
     // then indicate that the streams should no longer chain to one another
     // and wait for them to shut down naturally
-    audio_stopping = true;
     while (dma_channel_is_busy(SOUND_DMA_CHA)) tight_loop_contents();
     while (dma_channel_is_busy(SOUND_DMA_CHB)) tight_loop_contents();
     while (spi_is_busy(AUDIO_SPI)) tight_loop_contents();
+    while (snd_reading) tight_loop_contents();
     audio_stopping = false;
 
+    // report position actually played, not how far ahead data was read
+    fpos = pstart + pplayed;
+    if (underruns > 0) {
+        underruns_total += underruns;
+        logmsg("Audio playback had ", (int)underruns, " sample underruns (~",
+               (int)(underruns * SAMPLE_CHUNK_SIZE / 176), " ms of silence), ",
+               (int)underruns_total, " since boot");
+    }
+
     // idle the subsystem
     audio_last_status[audio_owner] = ASC_COMPLETED;
     audio_paused = false;
@@ -587,6 +657,10 @@ void audio_set_channel(uint8_t id, uint16_t chn) {
 
 uint64_t audio_get_file_position()
 {
+    if (audio_is_active())
+    {
+        return pstart + pplayed;
+    }
     return fpos;
 }
 
@@ -24,11 +24,23 @@
 #define SOUND_DMA_CHA 6
 #define SOUND_DMA_CHB 7
 
-// size of the two audio sample buffers, in bytes
+// size of each audio sample buffer, in bytes
 // these must be divisible by 1024
 // #define AUDIO_BUFFER_SIZE 8192 // ~46.44ms
 #define AUDIO_BUFFER_SIZE 4096 // reduce memory usage
 
+// number of sample buffers in the playback ring
+// more buffers allow riding out longer SD card stalls, at 4 kB of RAM each
+#ifndef AUDIO_BUFFER_COUNT
+#define AUDIO_BUFFER_COUNT 6 // ~139ms
+#endif
+
+// when samples are read on core0 and a SCSI command is being processed,
+// buffers are refilled only when fewer than this many are ready
+#ifndef AUDIO_BUFFER_LOW_WATER
+#define AUDIO_BUFFER_LOW_WATER (AUDIO_BUFFER_COUNT / 2)
+#endif
+
 /**
  * Handler for DMA interrupts
  *
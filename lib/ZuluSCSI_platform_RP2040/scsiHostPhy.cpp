@@ -39,6 +39,8 @@ volatile int g_scsiHostPhyReset;
 // SCSI initiator mode.
 void scsiHostPhyReset(void) {}
 bool scsiHostPhySelect(int target_id) { return false; }
+void scsiHostPhySetATN(bool state) {}
+int scsiHostPhyReselect(uint8_t initiator_id) { return -1; }
 int scsiHostPhyGetPhase() { return 0; }
 bool scsiHostRequestWaiting() { return false; }
 uint32_t scsiHostWrite(const uint8_t *data, uint32_t count) { return 0; }
@@ -64,7 +66,7 @@ void scsiHostPhyReset(void)
 
 // Select a device and an initiator, ids 0-7.
 // Returns true if the target answers to selection request.
-bool scsiHostPhySelect(int target_id, uint8_t initiator_id)
+bool scsiHostPhySelect(int target_id, uint8_t initiator_id, bool atn)
 {
     SCSI_RELEASE_OUTPUTS();
 
@@ -93,6 +95,12 @@ bool scsiHostPhySelect(int target_id, uint8_t initiator_id)
     delayMicroseconds(5);
     SCSI_OUT_DATA((1 << target_id) | (1 << initiator_id));
     delayMicroseconds(5);
+    if (atn)
+    {
+        // ATN must be asserted before releasing BSY so that
+        // target goes to MESSAGE_OUT phase after selection.
+        SCSI_OUT(ATN, 1);
+    }
     SCSI_OUT(BSY, 0);
 
     // Wait for target to respond
@@ -108,6 +116,7 @@ bool scsiHostPhySelect(int target_id, uint8_t initiator_id)
     if (!SCSI_IN(BSY))
     {
         // No response
+        SCSI_OUT(ATN, 0);
         SCSI_RELEASE_OUTPUTS();
         return false;
     }
@@ -119,6 +128,58 @@ bool scsiHostPhySelect(int target_id, uint8_t initiator_id)
     return true;
 }
 
+void scsiHostPhySetATN(bool state)
+{
+    SCSI_OUT(ATN, state);
+}
+
+// Reselection is signaled by target asserting SEL and I/O and putting both
+// its own and our ID on the data bus. The SEL and BSY inputs are only visible
+// while OUT_BSY is deasserted, so this must be called while the bus is released.
+int scsiHostPhyReselect(uint8_t initiator_id)
+{
+    if (!SCSI_IN(SEL) || !SCSI_IN(IO))
+    {
+        return -1;
+    }
+
+    uint8_t ids = SCSI_IN_DATA() & 0xFF;
+    if (!(ids & (1 << initiator_id)))
+    {
+        // Reselection for some other initiator
+        return -1;
+    }
+
+    ids &= ~(1 << initiator_id);
+    if (ids == 0 || (ids & (ids - 1)) != 0)
+    {
+        // There should be exactly one target ID bit set
+        return -1;
+    }
+
+    int target_id = 0;
+    while (!(ids & (1 << target_id))) target_id++;
+
+    // Respond by asserting BSY. The target then releases SEL and
+    // starts MESSAGE_IN phase with IDENTIFY message.
+    scsiLogInitiatorPhaseChange(RESELECTION);
+    dbgmsg("------ RESELECTED by ", target_id);
+    SCSI_OUT(BSY, 1);
+
+    for (int wait = 0; wait < 2500; wait++)
+    {
+        if (SCSI_IN(REQ))
+        {
+            return target_id;
+        }
+        delayMicroseconds(100);
+    }
+
+    logmsg("scsiHostPhyReselect: target ", target_id, " did not continue after reselection");
+    SCSI_RELEASE_OUTPUTS();
+    return -1;
+}
+
 // Read the current communication phase as signaled by the target
 int scsiHostPhyGetPhase()
 {
@@ -225,6 +286,17 @@ uint32_t scsiHostWrite(const uint8_t *data, uint32_t count)
 {
     scsiLogDataOut(data, count);
 
+    if (count > 1)
+    {
+        // Use accelerated routine for everything except single byte messages
+        uint32_t sent = scsi_accel_host_write(data, count, &g_scsiHostPhyReset);
+        if (sent < count)
+        {
+            logmsg("scsiHostWrite: sent ", (int)sent, " bytes, expected ", (int)count);
+        }
+        return sent;
+    }
+
     int cd_start = SCSI_IN(CD);
     int msg_start = SCSI_IN(MSG);
 
@@ -254,26 +326,39 @@ uint32_t scsiHostRead(uint8_t *data, uint32_t count)
     int cd_start = SCSI_IN(CD);
     int msg_start = SCSI_IN(MSG);
 
-    if ((count & 1) == 0 && ((uint32_t)data & 1) == 0)
+    uint32_t i = 0;
+    if (count >= 2)
     {
-        // Even number of bytes, use accelerated routine
-        count = scsi_accel_host_read(data, count, &parityError, &g_scsiHostPhyReset);
+        // Use accelerated routine for even number of bytes.
+        // The last byte of odd length transfer is read below.
+        uint32_t evencount = count & ~1;
+        i = scsi_accel_host_read(data, evencount, &parityError, &g_scsiHostPhyReset);
+        if (i < evencount)
+        {
+            count = i;
+        }
     }
-    else
+
+    for (; i < count; i++)
     {
-        for (uint32_t i = 0; i < count; i++)
+        bool phase_changed = false;
+        while (!SCSI_IN(REQ))
         {
-            while (!SCSI_IN(REQ))
+            if (g_scsiHostPhyReset || !SCSI_IN(IO) || SCSI_IN(CD) != cd_start || SCSI_IN(MSG) != msg_start)
             {
-                if (g_scsiHostPhyReset || !SCSI_IN(IO) || SCSI_IN(CD) != cd_start || SCSI_IN(MSG) != msg_start)
-                {
-                    // Target switched out of DATA_IN mode
-                    count = i;
-                }
+                // Target switched out of DATA_IN mode
+                phase_changed = true;
+                break;
             }
+        }
 
-            data[i] = scsiHostReadOneByte(&parityError);
+        if (phase_changed)
+        {
+            count = i;
+            break;
         }
+
+        data[i] = scsiHostReadOneByte(&parityError);
     }
 
     scsiLogDataIn(data, count);
@@ -297,6 +382,7 @@ uint32_t scsiHostRead(uint8_t *data, uint32_t count)
 void scsiHostPhyRelease()
 {
     scsiLogInitiatorPhaseChange(BUS_FREE);
+    SCSI_OUT(ATN, 0);
     SCSI_RELEASE_OUTPUTS();
 }
 
@@ -36,8 +36,17 @@ void scsiHostPhyReset(void);
 // Select a device, id 0-7.
 // target_id - target device id 0-7
 // initiator_id - host device id 0-7
+// atn - assert ATN during selection to send IDENTIFY message
 // Returns true if the target answers to selection request.
-bool scsiHostPhySelect(int target_id, uint8_t initiator_id);
+bool scsiHostPhySelect(int target_id, uint8_t initiator_id, bool atn);
+
+// Set the ATN signal state, used to release ATN before last message byte
+void scsiHostPhySetATN(bool state);
+
+// Check if a target that has disconnected is trying to reselect us.
+// If yes, responds to the reselection and returns the target id.
+// Returns -1 if there is no reselection going on.
+int scsiHostPhyReselect(uint8_t initiator_id);
 
 // Read the current communication phase as signaled by the target
 // Matches SCSI_PHASE enumeration from scsi.h.
@@ -44,10 +44,13 @@ static struct {
     // PIO configurations
     uint32_t pio_offset_async_read;
     pio_sm_config pio_cfg_async_read;
+    uint32_t pio_offset_async_write;
+    pio_sm_config pio_cfg_async_write;
 } g_scsi_host;
 
 enum scsidma_state_t { SCSIHOST_IDLE = 0,
-                       SCSIHOST_READ };
+                       SCSIHOST_READ,
+                       SCSIHOST_WRITE };
 static volatile scsidma_state_t g_scsi_host_state;
 
 static void scsi_accel_host_config_gpio()
@@ -86,6 +89,26 @@ static void scsi_accel_host_config_gpio()
         iobank0_hw->io[SCSI_IN_REQ].ctrl  = GPIO_FUNC_SIO;
         iobank0_hw->io[SCSI_OUT_ACK].ctrl = GPIO_FUNC_PIO0;
     }
+    else if (g_scsi_host_state == SCSIHOST_WRITE)
+    {
+        // Data bus and ACK pin as output, REQ as input
+        pio_sm_set_pins(SCSI_PIO, SCSI_SM, SCSI_IO_DATA_MASK | 1 << SCSI_IN_REQ | 1 << SCSI_OUT_ACK);
+        pio_sm_set_consecutive_pindirs(SCSI_PIO, SCSI_SM, SCSI_IO_DB0, 9, true);
+        pio_sm_set_consecutive_pindirs(SCSI_PIO, SCSI_SM, SCSI_IN_REQ, 1, false);
+        pio_sm_set_consecutive_pindirs(SCSI_PIO, SCSI_SM, SCSI_OUT_ACK, 1, true);
+
+        iobank0_hw->io[SCSI_IO_DB0].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DB1].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DB2].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DB3].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DB4].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DB5].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DB6].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DB7].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IO_DBP].ctrl  = GPIO_FUNC_PIO0;
+        iobank0_hw->io[SCSI_IN_REQ].ctrl  = GPIO_FUNC_SIO;
+        iobank0_hw->io[SCSI_OUT_ACK].ctrl = GPIO_FUNC_PIO0;
+    }
 }
 
 uint32_t scsi_accel_host_read(uint8_t *buf, uint32_t count, int *parityError, volatile int *resetFlag)
@@ -152,6 +175,56 @@ uint32_t scsi_accel_host_read(uint8_t *buf, uint32_t count, int *parityError, vo
     return count;
 }
 
+uint32_t scsi_accel_host_write(const uint8_t *buf, uint32_t count, volatile int *resetFlag)
+{
+    // Like the read function, this feeds the PIO TX fifo directly in software loop.
+    // Parity is added using the same lookup table as for SCSI_OUT_DATA().
+    g_scsi_host_state = SCSIHOST_WRITE;
+
+    int cd_start = SCSI_IN(CD);
+    int msg_start = SCSI_IN(MSG);
+
+    pio_sm_init(SCSI_PIO, SCSI_SM, g_scsi_host.pio_offset_async_write, &g_scsi_host.pio_cfg_async_write);
+    scsi_accel_host_config_gpio();
+    SCSI_ENABLE_DATA_OUT();
+    pio_sm_set_enabled(SCSI_PIO, SCSI_SM, true);
+
+    const uint8_t *src = buf;
+    const uint8_t *end = buf + count;
+    uint32_t idle_pc = g_scsi_host.pio_offset_async_write;
+    bool phase_changed = false;
+    while (src < end || !pio_sm_is_tx_fifo_empty(SCSI_PIO, SCSI_SM) || pio_sm_get_pc(SCSI_PIO, SCSI_SM) != idle_pc)
+    {
+        if (src < end && !pio_sm_is_tx_fifo_full(SCSI_PIO, SCSI_SM))
+        {
+            pio_sm_put(SCSI_PIO, SCSI_SM, g_scsi_parity_lookup[*src++]);
+        }
+        else if (*resetFlag || SCSI_IN(IO) || SCSI_IN(CD) != cd_start || SCSI_IN(MSG) != msg_start)
+        {
+            // Target switched out of DATA_OUT mode
+            phase_changed = true;
+            break;
+        }
+    }
+
+    if (phase_changed)
+    {
+        // Bytes still in the fifo were not sent.
+        // State machine has sent the current byte once it has asserted ACK.
+        uint32_t pc = pio_sm_get_pc(SCSI_PIO, SCSI_SM);
+        uint32_t unsent = pio_sm_get_tx_fifo_level(SCSI_PIO, SCSI_SM);
+        if (pc != idle_pc && pc != idle_pc + 6) unsent++;
+        count = (src - buf) - unsent;
+    }
+
+    g_scsi_host_state = SCSIHOST_IDLE;
+    pio_sm_set_enabled(SCSI_PIO, SCSI_SM, false);
+    SCSI_RELEASE_DATA_REQ();
+    scsi_accel_host_config_gpio();
+    SCSI_OUT(ACK, 0);
+
+    return count;
+}
 
 void scsi_accel_host_init()
 {
@@ -168,6 +241,14 @@ void scsi_accel_host_init()
     sm_config_set_sideset_pins(&g_scsi_host.pio_cfg_async_read, SCSI_OUT_ACK);
     sm_config_set_out_shift(&g_scsi_host.pio_cfg_async_read, true, false, 32);
     sm_config_set_in_shift(&g_scsi_host.pio_cfg_async_read, true, true, 32);
+
+    // Asynchronous SCSI write
+    g_scsi_host.pio_offset_async_write = pio_add_program(SCSI_PIO, &scsi_host_async_write_program);
+    g_scsi_host.pio_cfg_async_write = scsi_host_async_write_program_get_default_config(g_scsi_host.pio_offset_async_write);
+    sm_config_set_out_pins(&g_scsi_host.pio_cfg_async_write, SCSI_IO_DB0, 9);
+    sm_config_set_sideset_pins(&g_scsi_host.pio_cfg_async_write, SCSI_OUT_ACK);
+    sm_config_set_jmp_pin(&g_scsi_host.pio_cfg_async_write, SCSI_IN_IO);
+    sm_config_set_out_shift(&g_scsi_host.pio_cfg_async_write, true, false, 32);
 }
 
 #endif
\ No newline at end of file
@@ -42,3 +42,37 @@ static inline pio_sm_config scsi_host_async_read_program_get_default_config(uint
 }
 #endif
 
+// --------------------- //
+// scsi_host_async_write //
+// --------------------- //
+
+#define scsi_host_async_write_wrap_target 0
+#define scsi_host_async_write_wrap 6
+
+static const uint16_t scsi_host_async_write_program_instructions[] = {
+            //     .wrap_target
+    0x90a0, //  0: pull   block           side 1     
+    0x7009, //  1: out    pins, 9         side 1     
+    0x7777, //  2: out    null, 23        side 1 [7] 
+    0x3009, //  3: wait   0 gpio, 9       side 1     
+    0x10c6, //  4: jmp    pin, 6          side 1     
+    0x1005, //  5: jmp    5               side 1     
+    0x2089, //  6: wait   1 gpio, 9       side 0     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program scsi_host_async_write_program = {
+    .instructions = scsi_host_async_write_program_instructions,
+    .length = 7,
+    .origin = -1,
+};
+
+static inline pio_sm_config scsi_host_async_write_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + scsi_host_async_write_wrap_target, offset + scsi_host_async_write_wrap);
+    sm_config_set_sideset(&c, 1, false, false);
+    return c;
+}
+#endif
+
@@ -28,6 +28,8 @@
 #include "ZuluSCSI_log.h"
 #include "sdio.h"
 #include <hardware/gpio.h>
+#include <hardware/clocks.h>
+#include <pico/mutex.h>
 #include <SdFat.h>
 #include <SdCard/SdCardInfo.h>
 
@@ -40,22 +42,124 @@ static sdio_status_t g_sdio_error;
 static uint32_t g_sdio_dma_buf[128];
 static uint32_t g_sdio_sector_count;
 
+// Try faster bus timings when the card supports high speed mode
+#ifndef SDIO_CLOCK_TUNING
+#define SDIO_CLOCK_TUNING 1
+#endif
+
+// Number of sectors read to test each bus timing
+#ifndef SDIO_TUNING_TEST_SECTORS
+#define SDIO_TUNING_TEST_SECTORS 32
+#endif
+
+// Number of CRC errors after which the bus returns to default speed
+#ifndef SDIO_FALLBACK_CRC_ERRORS
+#define SDIO_FALLBACK_CRC_ERRORS 4
+#endif
+
+// Bus timing selected at card initialization
+static int g_sdio_clkdiv = SDIO_PIO_CLKDIV_DEFAULT;
+static int g_sdio_rx_delay;
+static bool g_sdio_high_speed;
+static uint32_t g_sdio_crc_errors; // CRC errors with the current timing
+
+static void countCRCError(sdio_status_t status)
+{
+    if (status == SDIO_ERR_RESPONSE_CRC || status == SDIO_ERR_DATA_CRC || status == SDIO_ERR_WRITE_CRC)
+    {
+        g_sdio_crc_errors++;
+    }
+}
+
+// The log buffer must only be written from core0. Errors in card accesses
+// made on core1 are stored here and logged from platform_sd_poll().
+static struct {
+    volatile uint32_t count; // Incremented by core1
+    uint32_t reported; // Count already logged by core0
+    const char *func; // NULL for errors from checkReturnOk()
+    int line;
+    uint32_t sector;
+    uint32_t n;
+    sdio_status_t status;
+} g_sdio_core1_error;
+
+static void sdioDeferError(const char *func, int line, uint32_t sector, uint32_t n, sdio_status_t status)
+{
+    g_sdio_core1_error.func = func;
+    g_sdio_core1_error.line = line;
+    g_sdio_core1_error.sector = sector;
+    g_sdio_core1_error.n = n;
+    g_sdio_core1_error.status = status;
+    __sync_synchronize();
+    g_sdio_core1_error.count++;
+}
+
+// Log failure of a sector access, n is 0 for single sector functions
+static void sdioLogError(const char *func, uint32_t sector, uint32_t n, sdio_status_t status)
+{
+    if (get_core_num() != 0)
+    {
+        sdioDeferError(func, 0, sector, n, status);
+    }
+    else if (n > 0)
+    {
+        logmsg("SdioCard::", func, "(", sector, ",...,", (int)n, ") failed: ", (int)status);
+    }
+    else
+    {
+        logmsg("SdioCard::", func, "(", sector, ") failed: ", (int)status);
+    }
+}
+
 #define checkReturnOk(call) ((g_sdio_error = (call)) == SDIO_OK ? true : logSDError(__LINE__))
 static bool logSDError(int line)
 {
     g_sdio_error_line = line;
-    logmsg("SDIO SD card error on line ", line, ", error code ", (int)g_sdio_error);
+    countCRCError(g_sdio_error);
+    if (get_core_num() != 0)
+    {
+        sdioDeferError(NULL, line, 0, 0, g_sdio_error);
+    }
+    else
+    {
+        logmsg("SDIO SD card error on line ", line, ", error code ", (int)g_sdio_error);
+    }
     return false;
 }
 
+// Card access lock, allows core1 to read audio samples in between
+// the accesses done by core0. Recursive because the multi-sector
+// functions call the single-sector functions.
+auto_init_recursive_mutex(g_sdio_lock);
+
+class SdioLock
+{
+public:
+    SdioLock() { recursive_mutex_enter_blocking(&g_sdio_lock); }
+    ~SdioLock() { recursive_mutex_exit(&g_sdio_lock); }
+};
+
+bool platform_sd_try_lock()
+{
+    uint32_t owner;
+    return recursive_mutex_try_enter(&g_sdio_lock, &owner);
+}
+
+void platform_sd_unlock()
+{
+    recursive_mutex_exit(&g_sdio_lock);
+}
+
 // Callback used by SCSI code for simultaneous processing
 static sd_callback_t m_stream_callback;
 static const uint8_t *m_stream_buffer;
 static uint32_t m_stream_count;
 static uint32_t m_stream_count_start;
+static uint m_stream_core;
 
 void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer)
 {
+    m_stream_core = get_core_num();
     m_stream_callback = func;
     m_stream_buffer = buffer;
     m_stream_count = 0;
@@ -64,6 +168,12 @@ void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer)
 
 static sd_callback_t get_stream_callback(const uint8_t *buf, uint32_t count, const char *accesstype, uint32_t sector)
 {
+    if (get_core_num() != m_stream_core)
+    {
+        // Callback belongs to the code running on the other core
+        return NULL;
+    }
+
     m_stream_count_start = m_stream_count;
 
     if (m_stream_callback)
@@ -75,8 +185,11 @@ static sd_callback_t get_stream_callback(const uint8_t *buf, uint32_t count, con
         }
         else
         {
-            dbgmsg("SD card ", accesstype, "(", (int)sector,
-                  ") slow transfer, buffer", (uint32_t)buf, " vs. ", (uint32_t)(m_stream_buffer + m_stream_count));
+            if (get_core_num() == 0)
+            {
+                dbgmsg("SD card ", accesstype, "(", (int)sector,
+                      ") slow transfer, buffer", (uint32_t)buf, " vs. ", (uint32_t)(m_stream_buffer + m_stream_count));
+            }
             return NULL;
         }
     }
@@ -84,6 +197,202 @@ static sd_callback_t get_stream_callback(const uint8_t *buf, uint32_t count, con
     return NULL;
 }
 
+static sdio_status_t sdioWaitRx()
+{
+    sdio_status_t status;
+    do {
+        status = rp2040_sdio_rx_poll();
+    } while (status == SDIO_BUSY);
+    return status;
+}
+
+// Switch card between default speed and high speed bus modes with CMD6.
+// Returns true if the card accepted the switch.
+static bool sdioSwitchSpeed(bool high_speed)
+{
+    // The 64-byte switch status is returned as data block
+    uint8_t *switch_status = (uint8_t*)g_sdio_dma_buf;
+    uint32_t reply;
+    uint32_t arg = 0x80FFFFF0 | (high_speed ? 1 : 0); // Set access mode in function group 1
+    if (rp2040_sdio_rx_start(switch_status, 1, 64) != SDIO_OK ||
+        rp2040_sdio_command_R1(CMD6, arg, &reply) != SDIO_OK)
+    {
+        rp2040_sdio_stop();
+        return false;
+    }
+
+    if (sdioWaitRx() != SDIO_OK)
+    {
+        return false;
+    }
+
+    // Selected function of group 1 is in bits 379:376
+    return (switch_status[16] & 0x0F) == (high_speed ? 1 : 0);
+}
+
+// Read test sectors from the start of the card with the current timing.
+// Returns true if all commands and data blocks had correct checksums.
+static bool sdioTestReads()
+{
+    uint32_t reply;
+    for (uint32_t sector = 0; sector < SDIO_TUNING_TEST_SECTORS; sector++)
+    {
+        // Cards up to 2GB use byte addressing, SDHC cards use sector addressing
+        uint32_t address = (g_sdio_ocr & (1 << 30)) ? sector : (sector * 512);
+
+        if (rp2040_sdio_command_R1(16, 512, &reply) != SDIO_OK || // SET_BLOCKLEN
+            rp2040_sdio_rx_start((uint8_t*)g_sdio_dma_buf, 1) != SDIO_OK ||
+            rp2040_sdio_command_R1(CMD17, address, &reply) != SDIO_OK ||
+            sdioWaitRx() != SDIO_OK)
+        {
+            rp2040_sdio_stop();
+
+            // Let the card finish sending any data block before next command
+            busy_wait_us_32(1000);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Select the fastest bus timing that reads reliably.
+// For each clock rate, the data sampling delay is swept and the middle of
+// the working range is used, so that there is margin in both directions.
+static void sdioTuneTiming()
+{
+    g_sdio_clkdiv = SDIO_PIO_CLKDIV_DEFAULT;
+    g_sdio_rx_delay = 0;
+    g_sdio_high_speed = false;
+    g_sdio_crc_errors = 0;
+    rp2040_sdio_init(1);
+
+#if SDIO_CLOCK_TUNING
+    if (!sdioSwitchSpeed(true))
+    {
+        dbgmsg("SDIO card does not support high speed mode");
+        return;
+    }
+
+    const int min_delay = -2;
+    const int max_delay = 2;
+    rp2040_sdio_set_quiet(true);
+    for (int clkdiv = 3; clkdiv < SDIO_PIO_CLKDIV_DEFAULT; clkdiv++)
+    {
+        // Find the longest run of working delays
+        int run_start = 0, run_length = 0;
+        int best_start = 0, best_length = 0;
+        for (int delay = min_delay; delay <= max_delay; delay++)
+        {
+            rp2040_sdio_init(1, clkdiv, delay);
+            if (sdioTestReads())
+            {
+                if (run_length == 0) run_start = delay;
+                run_length++;
+                if (run_length > best_length)
+                {
+                    best_start = run_start;
+                    best_length = run_length;
+                }
+            }
+            else
+            {
+                run_length = 0;
+            }
+        }
+
+        dbgmsg("SDIO timing test at ", (int)(clock_get_hz(clk_sys) / clkdiv / 1000), " kHz: ",
+               best_length, " working sample delays starting at ", best_start);
+
+        if (best_length >= 3)
+        {
+            g_sdio_clkdiv = clkdiv;
+            g_sdio_rx_delay = best_start + best_length / 2;
+            g_sdio_high_speed = true;
+            break;
+        }
+    }
+    rp2040_sdio_set_quiet(false);
+
+    rp2040_sdio_init(1, g_sdio_clkdiv, g_sdio_rx_delay);
+    if (!g_sdio_high_speed)
+    {
+        // No faster timing had enough margin, stay in default speed mode
+        sdioSwitchSpeed(false);
+    }
+#endif
+
+    logmsg("SDIO bus clock ", (int)(clock_get_hz(clk_sys) / g_sdio_clkdiv / 1000), " kHz",
+           g_sdio_high_speed ? ", high speed mode" : "",
+           ", sample delay ", g_sdio_rx_delay);
+}
+
+// Return to default speed timing if the selected timing has had repeated
+// CRC errors. Called between transfers when the bus is idle.
+// Only core0 reinitializes the bus, transfers on core1 keep using
+// the current timing until core0 next accesses the card or polls.
+static void sdioCheckFallback()
+{
+    if (get_core_num() != 0)
+    {
+        return;
+    }
+
+    if (g_sdio_high_speed && g_sdio_crc_errors >= SDIO_FALLBACK_CRC_ERRORS)
+    {
+        logmsg("SDIO had ", (int)g_sdio_crc_errors, " CRC errors, falling back to default speed");
+        g_sdio_clkdiv = SDIO_PIO_CLKDIV_DEFAULT;
+        g_sdio_rx_delay = 0;
+        g_sdio_high_speed = false;
+        g_sdio_crc_errors = 0;
+        rp2040_sdio_init(1);
+        sdioSwitchSpeed(false);
+    }
+}
+
+void platform_sd_poll()
+{
+    uint32_t count = g_sdio_core1_error.count;
+    if (count != g_sdio_core1_error.reported)
+    {
+        // Read the error details only after the counter
+        __sync_synchronize();
+        uint32_t missed = count - g_sdio_core1_error.reported - 1;
+        g_sdio_core1_error.reported = count;
+
+        if (g_sdio_core1_error.func)
+        {
+            logmsg("SdioCard::", g_sdio_core1_error.func, "(", g_sdio_core1_error.sector,
+                   ") failed on core1, sector count ", (int)g_sdio_core1_error.n,
+                   ", error code ", (int)g_sdio_core1_error.status);
+        }
+        else
+        {
+            logmsg("SDIO SD card error on core1 on line ", g_sdio_core1_error.line,
+                   ", error code ", (int)g_sdio_core1_error.status);
+        }
+
+        if (missed > 0)
+        {
+            logmsg("SDIO had ", (int)missed, " more SD card errors on core1");
+        }
+    }
+
+    if (g_sdio_high_speed && g_sdio_crc_errors >= SDIO_FALLBACK_CRC_ERRORS)
+    {
+        // Reinitialize only if the card is not in use by core1, and this
+        // is not called from within a card access of core0 itself.
+        uint32_t owner;
+        if (recursive_mutex_try_enter(&g_sdio_lock, &owner))
+        {
+            if (g_sdio_lock.enter_count == 1)
+            {
+                sdioCheckFallback();
+            }
+            recursive_mutex_exit(&g_sdio_lock);
+        }
+    }
+}
+
 bool SdioCard::begin(SdioConfig sdioConfig)
 {
     uint32_t reply;
@@ -170,8 +479,8 @@ bool SdioCard::begin(SdioConfig sdioConfig)
         return false;
     }
 
-    // Increase to 25 MHz clock rate
-    rp2040_sdio_init(1);
+    // Increase to 25 MHz clock rate or faster
+    sdioTuneTiming();
 
     return true;
 }
@@ -193,12 +502,13 @@ uint32_t SdioCard::errorLine() const
 
 bool SdioCard::isBusy() 
 {
+    SdioLock lock;
     return (sio_hw->gpio_in & (1 << SDIO_D0)) == 0;
 }
 
 uint32_t SdioCard::kHzSdClk()
 {
-    return 0;
+    return clock_get_hz(clk_sys) / g_sdio_clkdiv / 1000;
 }
 
 bool SdioCard::readCID(cid_t* cid)
@@ -217,6 +527,7 @@ bool SdioCard::readOCR(uint32_t* ocr)
 {
     // SDIO mode does not have CMD58, but main program uses this to
     // poll for card presence. Return status register instead.
+    SdioLock lock;
     return checkReturnOk(rp2040_sdio_command_R1(CMD13, g_sdio_rca, ocr));
 }
 
@@ -245,6 +556,7 @@ uint32_t SdioCard::sectorCount()
 
 uint32_t SdioCard::status()
 {
+    SdioLock lock;
     uint32_t reply;
     if (checkReturnOk(rp2040_sdio_command_R1(CMD13, g_sdio_rca, &reply)))
         return reply;
@@ -254,6 +566,7 @@ uint32_t SdioCard::status()
 
 bool SdioCard::stopTransmission(bool blocking)
 {
+    SdioLock lock;
     uint32_t reply;
     if (!checkReturnOk(rp2040_sdio_command_R1(CMD12, 0, &reply)))
     {
@@ -269,14 +582,17 @@ bool SdioCard::stopTransmission(bool blocking)
         uint32_t start = millis();
         while ((uint32_t)(millis() - start) < 5000 && isBusy())
         {
-            if (m_stream_callback)
+            if (m_stream_callback && get_core_num() == m_stream_core)
             {
                 m_stream_callback(m_stream_count);
             }
         }
         if (isBusy())
         {
-            logmsg("SdioCard::stopTransmission() timeout");
+            if (get_core_num() == 0)
+                logmsg("SdioCard::stopTransmission() timeout");
+            else
+                sdioDeferError("stopTransmission", __LINE__, 0, 0, SDIO_ERR_DATA_TIMEOUT);
             return false;
         }
         else
@@ -337,6 +653,8 @@ bool SdioCard::readSCR(scr_t* scr) {
 
 bool SdioCard::writeSector(uint32_t sector, const uint8_t* src)
 {
+    SdioLock lock;
+    sdioCheckFallback();
     if (((uint32_t)src & 3) != 0)
     {
         // Buffer is not aligned, need to memcpy() the data to a temporary buffer.
@@ -370,7 +688,8 @@ bool SdioCard::writeSector(uint32_t sector, const uint8_t* src)
 
     if (g_sdio_error != SDIO_OK)
     {
-        logmsg("SdioCard::writeSector(", sector, ") failed: ", (int)g_sdio_error);
+        sdioLogError("writeSector", sector, 0, g_sdio_error);
+        countCRCError(g_sdio_error);
     }
 
     return g_sdio_error == SDIO_OK;
@@ -378,6 +697,8 @@ bool SdioCard::writeSector(uint32_t sector, const uint8_t* src)
 
 bool SdioCard::writeSectors(uint32_t sector, const uint8_t* src, size_t n)
 {
+    SdioLock lock;
+    sdioCheckFallback();
     if (((uint32_t)src & 3) != 0)
     {
         // Unaligned write, execute sector-by-sector
@@ -418,7 +739,8 @@ bool SdioCard::writeSectors(uint32_t sector, const uint8_t* src, size_t n)
 
     if (g_sdio_error != SDIO_OK)
     {
-        logmsg("SdioCard::writeSectors(", sector, ",...,", (int)n, ") failed: ", (int)g_sdio_error);
+        sdioLogError("writeSectors", sector, n, g_sdio_error);
+        countCRCError(g_sdio_error);
         stopTransmission(true);
         return false;
     }
@@ -432,6 +754,8 @@ bool SdioCard::writeSectors(uint32_t sector, const uint8_t* src, size_t n)
 
 bool SdioCard::readSector(uint32_t sector, uint8_t* dst)
 {
+    SdioLock lock;
+    sdioCheckFallback();
     uint8_t *real_dst = dst;
     if (((uint32_t)dst & 3) != 0)
     {
@@ -464,7 +788,8 @@ bool SdioCard::readSector(uint32_t sector, uint8_t* dst)
 
     if (g_sdio_error != SDIO_OK)
     {
-        logmsg("SdioCard::readSector(", sector, ") failed: ", (int)g_sdio_error);
+        sdioLogError("readSector", sector, 0, g_sdio_error);
+        countCRCError(g_sdio_error);
     }
 
     if (dst != real_dst)
@@ -477,6 +802,8 @@ bool SdioCard::readSector(uint32_t sector, uint8_t* dst)
 
 bool SdioCard::readSectors(uint32_t sector, uint8_t* dst, size_t n)
 {
+    SdioLock lock;
+    sdioCheckFallback();
     if (((uint32_t)dst & 3) != 0 || sector + n >= g_sdio_sector_count)
     {
         // Unaligned read or end-of-drive read, execute sector-by-sector
@@ -515,7 +842,8 @@ bool SdioCard::readSectors(uint32_t sector, uint8_t* dst, size_t n)
 
     if (g_sdio_error != SDIO_OK)
     {
-        logmsg("SdioCard::readSectors(", sector, ",...,", (int)n, ") failed: ", (int)g_sdio_error);
+        sdioLogError("readSectors", sector, n, g_sdio_error);
+        countCRCError(g_sdio_error);
         stopTransmission(true);
         return false;
     }
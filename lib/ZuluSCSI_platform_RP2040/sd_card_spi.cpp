@@ -100,4 +100,8 @@ void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer)
 {
 }
 
+void platform_sd_poll()
+{
+}
+
 #endif
\ No newline at end of file
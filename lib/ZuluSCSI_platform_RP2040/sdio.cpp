@@ -35,6 +35,13 @@
 #include <hardware/gpio.h>
 #include <ZuluSCSI_platform.h>
 #include <ZuluSCSI_log.h>
+#include <pico/platform.h>
+
+// With DualCoreSD the transfers and the IRQ handler run on core1, but the
+// log buffer is only written from core0. Failures are still returned as
+// status codes and reported by sd_card_sdio.cpp from core0.
+#define sdio_logmsg(...) do { if (get_core_num() == 0) logmsg(__VA_ARGS__); } while (0)
+#define sdio_dbgmsg(...) do { if (get_core_num() == 0) dbgmsg(__VA_ARGS__); } while (0)
 
 #if defined(ZULUSCSI_PICO) || defined(ZULUSCSI_BS2)
 #include "sdio_Pico.pio.h"
@@ -42,6 +49,11 @@
 #include "sdio_RP2040.pio.h"
 #endif
 
+#ifdef SDIO_CRC_BENCHMARK
+#include <hardware/clocks.h>
+#include <hardware/timer.h>
+#endif
+
 #define SDIO_PIO pio1
 #define SDIO_CMD_SM 0
 #define SDIO_DATA_SM 1
@@ -63,6 +75,7 @@ static struct {
     sdio_transfer_state_t transfer_state;
     uint32_t transfer_start_time;
     uint32_t *data_buf;
+    uint32_t block_size; // Size of each received block in bytes
     uint32_t blocks_done; // Number of blocks transferred so far
     uint32_t total_blocks; // Total number of blocks to transfer
     uint32_t blocks_checksumed; // Number of blocks that have had CRC calculated
@@ -86,6 +99,9 @@ static struct {
     } received_checksums[SDIO_MAX_BLOCKS];
 } g_sdio;
 
+// Suppresses logging of expected errors while tuning the bus timing
+static bool g_sdio_quiet;
+
 void rp2040_sdio_dma_irq();
 
 /*******************************************************
@@ -120,10 +136,22 @@ static const uint8_t crc7_table[256] = {
 // When the SDIO bus operates in 4-bit mode, the CRC16 algorithm
 // is applied to each line separately and generates total of
 // 4 x 16 = 64 bits of checksum.
-__attribute__((optimize("O3")))
+//
+// Each line carries a plain CRC-16-CCITT, which the DMA sniffer could
+// compute after a PIO state machine splits the nibble stream into the four
+// line bit streams. That would take one more state machine, a DMA channel
+// and four sniffer passes per block, and the single sniffer is already used
+// for the DaynaPORT frame CRC, so the checksum is calculated in software.
+// Processing all four lines at once is equal to a 64-bit CRC with
+// polynomial x^64 + x^48 + x^20 + 1 over the nibble stream.
+// The 64-bit state is kept as two 32-bit halves because Cortex-M0+
+// has no 64-bit shifts, and the function runs from RAM to avoid
+// flash cache misses.
+__attribute__((optimize("O3"), section(".time_critical.sdio_crc16_4bit_checksum")))
 uint64_t sdio_crc16_4bit_checksum(uint32_t *data, uint32_t num_words)
 {
-    uint64_t crc = 0;
+    uint32_t crc_hi = 0;
+    uint32_t crc_lo = 0;
     uint32_t *end = data + num_words;
     while (data < end)
     {
@@ -133,27 +161,67 @@ uint64_t sdio_crc16_4bit_checksum(uint32_t *data, uint32_t num_words)
             // Reverse the bytes because SDIO protocol is big-endian.
             uint32_t data_in = __builtin_bswap32(*data++);
 
-            // Shift out 8 bits for each line
-            uint32_t data_out = crc >> 32;
-            crc <<= 32;
-
-            // XOR outgoing data to itself with 4 bit delay
-            data_out ^= (data_out >> 16);
-
-            // XOR incoming data to outgoing data with 4 bit delay
-            data_out ^= (data_in >> 16);
+            // Shift out 8 bits for each line, XOR outgoing data to itself
+            // and to incoming data with 4 bit delay and then XOR incoming data.
+            uint32_t xorred = crc_hi ^ (crc_hi >> 16) ^ (data_in >> 16) ^ data_in;
 
-            // XOR outgoing and incoming data to accumulator at each tap
-            uint64_t xorred = data_out ^ data_in;
-            crc ^= xorred;
-            crc ^= xorred << (5 * 4);
-            crc ^= xorred << (12 * 4);
+            // Shift the accumulator by 32 bits and XOR at each tap
+            // (bit positions 0, 5 * 4 and 12 * 4 of the 64-bit value).
+            crc_hi = crc_lo ^ (xorred >> 12) ^ (xorred << 16);
+            crc_lo = xorred ^ (xorred << 20);
         }
     }
 
+    return ((uint64_t)crc_hi << 32) | crc_lo;
+}
+
+#ifdef SDIO_CRC_BENCHMARK
+// Previous implementation using 64-bit arithmetic, for comparison
+__attribute__((optimize("O3")))
+static uint64_t sdio_crc16_4bit_checksum_u64(uint32_t *data, uint32_t num_words)
+{
+    uint64_t crc = 0;
+    uint32_t *end = data + num_words;
+    while (data < end)
+    {
+        uint32_t data_in = __builtin_bswap32(*data++);
+        uint32_t data_out = crc >> 32;
+        crc <<= 32;
+        data_out ^= (data_out >> 16);
+        data_out ^= (data_in >> 16);
+        uint64_t xorred = data_out ^ data_in;
+        crc ^= xorred;
+        crc ^= xorred << (5 * 4);
+        crc ^= xorred << (12 * 4);
+    }
     return crc;
 }
 
+// Log the CPU cycles taken per 512 byte block by both implementations
+static void sdio_crc_benchmark()
+{
+    static uint32_t buf[SDIO_WORDS_PER_BLOCK];
+    for (int i = 0; i < SDIO_WORDS_PER_BLOCK; i++) buf[i] = i * 2654435761u;
+
+    const int rounds = 64;
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    uint64_t result_u64 = 0;
+    uint64_t result_u32 = 0;
+
+    uint32_t start = time_us_32();
+    for (int i = 0; i < rounds; i++) result_u64 += sdio_crc16_4bit_checksum_u64(buf, SDIO_WORDS_PER_BLOCK);
+    uint32_t time_u64 = time_us_32() - start;
+
+    start = time_us_32();
+    for (int i = 0; i < rounds; i++) result_u32 += sdio_crc16_4bit_checksum(buf, SDIO_WORDS_PER_BLOCK);
+    uint32_t time_u32 = time_us_32() - start;
+
+    sdio_logmsg("SDIO CRC16 cycles per block: ", (int)(time_u64 * cycles_per_us / rounds), " before, ",
+           (int)(time_u32 * cycles_per_us / rounds), " after",
+           (result_u64 == result_u32) ? ", results match" : ", RESULTS DIFFER");
+}
+#endif
+
 /*******************************************************
  * Basic SDIO command execution
  *******************************************************/
@@ -209,7 +277,7 @@ sdio_status_t rp2040_sdio_command_R1(uint8_t command, uint32_t arg, uint32_t *re
         {
             if (command != 8) // Don't log for missing SD card
             {
-                dbgmsg("Timeout waiting for response in rp2040_sdio_command_R1(", (int)command, "), ",
+                sdio_dbgmsg("Timeout waiting for response in rp2040_sdio_command_R1(", (int)command, "), ",
                     "PIO PC: ", (int)pio_sm_get_pc(SDIO_PIO, SDIO_CMD_SM) - (int)g_sdio.pio_cmd_clk_offset,
                     " RXF: ", (int)pio_sm_get_rx_fifo_level(SDIO_PIO, SDIO_CMD_SM),
                     " TXF: ", (int)pio_sm_get_tx_fifo_level(SDIO_PIO, SDIO_CMD_SM));
@@ -240,14 +308,14 @@ sdio_status_t rp2040_sdio_command_R1(uint8_t command, uint32_t arg, uint32_t *re
         uint8_t actual_crc = ((resp1 >> 0) & 0xFE);
         if (crc != actual_crc)
         {
-            dbgmsg("rp2040_sdio_command_R1(", (int)command, "): CRC error, calculated ", crc, " packet has ", actual_crc);
+            sdio_dbgmsg("rp2040_sdio_command_R1(", (int)command, "): CRC error, calculated ", crc, " packet has ", actual_crc);
             return SDIO_ERR_RESPONSE_CRC;
         }
 
         uint8_t response_cmd = ((resp0 >> 24) & 0xFF);
         if (response_cmd != command && command != 41)
         {
-            dbgmsg("rp2040_sdio_command_R1(", (int)command, "): received reply for ", (int)response_cmd);
+            sdio_dbgmsg("rp2040_sdio_command_R1(", (int)command, "): received reply for ", (int)response_cmd);
             return SDIO_ERR_RESPONSE_CODE;
         }
 
@@ -281,7 +349,7 @@ sdio_status_t rp2040_sdio_command_R2(uint8_t command, uint32_t arg, uint8_t resp
     {
         if ((uint32_t)(millis() - start) > 2)
         {
-            dbgmsg("Timeout waiting for response in rp2040_sdio_command_R2(", (int)command, "), ",
+            sdio_dbgmsg("Timeout waiting for response in rp2040_sdio_command_R2(", (int)command, "), ",
                   "PIO PC: ", (int)pio_sm_get_pc(SDIO_PIO, SDIO_CMD_SM) - (int)g_sdio.pio_cmd_clk_offset,
                   " RXF: ", (int)pio_sm_get_rx_fifo_level(SDIO_PIO, SDIO_CMD_SM),
                   " TXF: ", (int)pio_sm_get_tx_fifo_level(SDIO_PIO, SDIO_CMD_SM));
@@ -324,14 +392,14 @@ sdio_status_t rp2040_sdio_command_R2(uint8_t command, uint32_t arg, uint8_t resp
     uint8_t actual_crc = response[15] & 0xFE;
     if (crc != actual_crc)
     {
-        dbgmsg("rp2040_sdio_command_R2(", (int)command, "): CRC error, calculated ", crc, " packet has ", actual_crc);
+        sdio_dbgmsg("rp2040_sdio_command_R2(", (int)command, "): CRC error, calculated ", crc, " packet has ", actual_crc);
         return SDIO_ERR_RESPONSE_CRC;
     }
 
     uint8_t response_cmd = ((response_buf[0] >> 24) & 0xFF);
     if (response_cmd != 0x3F)
     {
-        dbgmsg("rp2040_sdio_command_R2(", (int)command, "): Expected reply code 0x3F");
+        sdio_dbgmsg("rp2040_sdio_command_R2(", (int)command, "): Expected reply code 0x3F");
         return SDIO_ERR_RESPONSE_CODE;
     }
 
@@ -349,7 +417,7 @@ sdio_status_t rp2040_sdio_command_R3(uint8_t command, uint32_t arg, uint32_t *re
     {
         if ((uint32_t)(millis() - start) > 2)
         {
-            dbgmsg("Timeout waiting for response in rp2040_sdio_command_R3(", (int)command, "), ",
+            sdio_dbgmsg("Timeout waiting for response in rp2040_sdio_command_R3(", (int)command, "), ",
                   "PIO PC: ", (int)pio_sm_get_pc(SDIO_PIO, SDIO_CMD_SM) - (int)g_sdio.pio_cmd_clk_offset,
                   " RXF: ", (int)pio_sm_get_rx_fifo_level(SDIO_PIO, SDIO_CMD_SM),
                   " TXF: ", (int)pio_sm_get_tx_fifo_level(SDIO_PIO, SDIO_CMD_SM));
@@ -374,25 +442,27 @@ sdio_status_t rp2040_sdio_command_R3(uint8_t command, uint32_t arg, uint32_t *re
  * Data reception from SD card
  *******************************************************/
 
-sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks)
+sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks, uint32_t block_size)
 {
-    // Buffer must be aligned
+    // Buffer must be aligned, and the checksum is computed 16 bytes at a time
     assert(((uint32_t)buffer & 3) == 0 && num_blocks <= SDIO_MAX_BLOCKS);
+    assert(block_size <= SDIO_BLOCK_SIZE && (block_size & 15) == 0);
 
     g_sdio.transfer_state = SDIO_RX;
     g_sdio.transfer_start_time = millis();
     g_sdio.data_buf = (uint32_t*)buffer;
+    g_sdio.block_size = block_size;
     g_sdio.blocks_done = 0;
     g_sdio.total_blocks = num_blocks;
     g_sdio.blocks_checksumed = 0;
     g_sdio.checksum_errors = 0;
 
-    // Create DMA block descriptors to store each block of 512 bytes of data to buffer
+    // Create DMA block descriptors to store each block of data to buffer
     // and then 8 bytes to g_sdio.received_checksums.
     for (int i = 0; i < num_blocks; i++)
     {
-        g_sdio.dma_blocks[i * 2].write_addr = buffer + i * SDIO_BLOCK_SIZE;
-        g_sdio.dma_blocks[i * 2].transfer_count = SDIO_BLOCK_SIZE / sizeof(uint32_t);
+        g_sdio.dma_blocks[i * 2].write_addr = buffer + i * block_size;
+        g_sdio.dma_blocks[i * 2].transfer_count = block_size / sizeof(uint32_t);
 
         g_sdio.dma_blocks[i * 2 + 1].write_addr = &g_sdio.received_checksums[i];
         g_sdio.dma_blocks[i * 2 + 1].transfer_count = 2;
@@ -424,7 +494,7 @@ sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks)
     pio_sm_set_consecutive_pindirs(SDIO_PIO, SDIO_DATA_SM, SDIO_D0, 4, false);
 
     // Write number of nibbles to receive to Y register
-    pio_sm_put(SDIO_PIO, SDIO_DATA_SM, SDIO_BLOCK_SIZE * 2 + 16 - 1);
+    pio_sm_put(SDIO_PIO, SDIO_DATA_SM, block_size * 2 + 16 - 1);
     pio_sm_exec(SDIO_PIO, SDIO_DATA_SM, pio_encode_out(pio_y, 32));
 
     // Enable RX FIFO join because we don't need the TX FIFO during transfer.
@@ -445,8 +515,9 @@ static void sdio_verify_rx_checksums(uint32_t maxcount)
     {
         // Calculate checksum from received data
         int blockidx = g_sdio.blocks_checksumed++;
-        uint64_t checksum = sdio_crc16_4bit_checksum(g_sdio.data_buf + blockidx * SDIO_WORDS_PER_BLOCK,
-                                                     SDIO_WORDS_PER_BLOCK);
+        uint32_t block_words = g_sdio.block_size / sizeof(uint32_t);
+        uint64_t checksum = sdio_crc16_4bit_checksum(g_sdio.data_buf + blockidx * block_words,
+                                                     block_words);
 
         // Convert received checksum to little-endian format
         uint32_t top = __builtin_bswap32(g_sdio.received_checksums[blockidx].top);
@@ -456,9 +527,9 @@ static void sdio_verify_rx_checksums(uint32_t maxcount)
         if (checksum != expected)
         {
             g_sdio.checksum_errors++;
-            if (g_sdio.checksum_errors == 1)
+            if (g_sdio.checksum_errors == 1 && !g_sdio_quiet)
             {
-                logmsg("SDIO checksum error in reception: block ", blockidx,
+                sdio_logmsg("SDIO checksum error in reception: block ", blockidx,
                       " calculated ", checksum, " expected ", expected);
             }
         }
@@ -481,7 +552,7 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
         uint32_t dma_ctrl_block_count = (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&g_sdio.dma_blocks);
         dma_ctrl_block_count /= sizeof(g_sdio.dma_blocks[0]);
 
-        // Compute how many complete 512 byte SDIO blocks have been transferred
+        // Compute how many complete SDIO blocks have been transferred
         // When transfer ends, dma_ctrl_block_count == g_sdio.total_blocks * 2 + 1
         g_sdio.blocks_done = (dma_ctrl_block_count - 1) / 2;
 
@@ -493,7 +564,7 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
 
     if (bytes_complete)
     {
-        *bytes_complete = g_sdio.blocks_done * SDIO_BLOCK_SIZE;
+        *bytes_complete = g_sdio.blocks_done * g_sdio.block_size;
     }
 
     if (g_sdio.transfer_state == SDIO_IDLE)
@@ -508,7 +579,7 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
     }
     else if ((uint32_t)(millis() - g_sdio.transfer_start_time) > 1000)
     {
-        dbgmsg("rp2040_sdio_rx_poll() timeout, "
+        sdio_dbgmsg("rp2040_sdio_rx_poll() timeout, "
             "PIO PC: ", (int)pio_sm_get_pc(SDIO_PIO, SDIO_DATA_SM) - (int)g_sdio.pio_data_rx_offset,
             " RXF: ", (int)pio_sm_get_rx_fifo_level(SDIO_PIO, SDIO_DATA_SM),
             " TXF: ", (int)pio_sm_get_tx_fifo_level(SDIO_PIO, SDIO_DATA_SM),
@@ -630,17 +701,17 @@ sdio_status_t check_sdio_write_response(uint32_t card_response)
     }
     else if (wr_status == 5)
     {
-        logmsg("SDIO card reports write CRC error, status ", card_response);
+        sdio_logmsg("SDIO card reports write CRC error, status ", card_response);
         return SDIO_ERR_WRITE_CRC;    
     }
     else if (wr_status == 6)
     {
-        logmsg("SDIO card reports write failure, status ", card_response);
+        sdio_logmsg("SDIO card reports write failure, status ", card_response);
         return SDIO_ERR_WRITE_FAIL;    
     }
     else
     {
-        logmsg("SDIO card reports unknown write status ", card_response);
+        sdio_logmsg("SDIO card reports unknown write status ", card_response);
         return SDIO_ERR_WRITE_FAIL;    
     }
 }
@@ -730,7 +801,7 @@ sdio_status_t rp2040_sdio_tx_poll(uint32_t *bytes_complete)
     }
     else if ((uint32_t)(millis() - g_sdio.transfer_start_time) > 1000)
     {
-        dbgmsg("rp2040_sdio_tx_poll() timeout, "
+        sdio_dbgmsg("rp2040_sdio_tx_poll() timeout, "
             "PIO PC: ", (int)pio_sm_get_pc(SDIO_PIO, SDIO_DATA_SM) - (int)g_sdio.pio_data_tx_offset,
             " RXF: ", (int)pio_sm_get_rx_fifo_level(SDIO_PIO, SDIO_DATA_SM),
             " TXF: ", (int)pio_sm_get_tx_fifo_level(SDIO_PIO, SDIO_DATA_SM),
@@ -754,7 +825,21 @@ sdio_status_t rp2040_sdio_stop()
     return SDIO_OK;
 }
 
-void rp2040_sdio_init(int clock_divider)
+// Replace the delay field of a PIO instruction.
+// The field is 5 bits, minus the number of side-set bits.
+static uint16_t sdio_set_delay(uint16_t instr, int delay, int sideset_bits)
+{
+    uint16_t mask = ((1 << (5 - sideset_bits)) - 1) << 8;
+    assert(delay >= 0 && (delay << 8) <= mask);
+    return (instr & ~mask) | (delay << 8);
+}
+
+void rp2040_sdio_set_quiet(bool quiet)
+{
+    g_sdio_quiet = quiet;
+}
+
+void rp2040_sdio_init(int clock_divider, int pio_clkdiv, int rx_delay)
 {
     // Mark resources as being in use, unless it has been done already.
     static bool resources_claimed = false;
@@ -765,6 +850,15 @@ void rp2040_sdio_init(int clock_divider)
         dma_channel_claim(SDIO_DMA_CH);
         dma_channel_claim(SDIO_DMA_CHB);
         resources_claimed = true;
+
+        // Set up IRQ handler when DMA completes.
+        // Enabled only once, platform_start_sd_worker() can move it to core1.
+        irq_set_exclusive_handler(DMA_IRQ_1, rp2040_sdio_tx_irq);
+        irq_set_enabled(DMA_IRQ_1, true);
+
+#ifdef SDIO_CRC_BENCHMARK
+        sdio_crc_benchmark();
+#endif
     }
 
     memset(&g_sdio, 0, sizeof(g_sdio));
@@ -774,11 +868,50 @@ void rp2040_sdio_init(int clock_divider)
     pio_sm_set_enabled(SDIO_PIO, SDIO_CMD_SM, false);
     pio_sm_set_enabled(SDIO_PIO, SDIO_DATA_SM, false);
 
+    // The instruction delays in the PIO programs depend on the number of
+    // PIO cycles per SDIO clock cycle, CLKDIV in the .pio file.
+    // The assembled programs are for SDIO_PIO_CLKDIV_DEFAULT, other values
+    // are patched in here. The clock low time D0 is kept longer than or
+    // equal to the clock high time D1.
+    assert(pio_clkdiv >= 3 && pio_clkdiv <= 5);
+    int d0 = (pio_clkdiv + 1) / 2 - 1;
+    int d1 = pio_clkdiv / 2 - 1;
+
+    uint16_t cmd_clk_instr[count_of(sdio_cmd_clk_program_instructions)];
+    for (int i = 0; i < (int)count_of(cmd_clk_instr); i++)
+    {
+        // Every instruction has either side 0 [D0] or side 1 [D1]
+        uint16_t instr = sdio_cmd_clk_program_instructions[i];
+        cmd_clk_instr[i] = sdio_set_delay(instr, (instr & 0x1000) ? d1 : d0, 1);
+    }
+    pio_program_t cmd_clk_program = sdio_cmd_clk_program;
+    cmd_clk_program.instructions = cmd_clk_instr;
+
+    // Reception samples the data lines CLKDIV cycles after the rising edge,
+    // adjusted by rx_delay to compensate for card output delay.
+    uint16_t data_rx_instr[count_of(sdio_data_rx_program_instructions)];
+    memcpy(data_rx_instr, sdio_data_rx_program_instructions, sizeof(data_rx_instr));
+    data_rx_instr[2] = sdio_set_delay(data_rx_instr[2], pio_clkdiv - 1 + rx_delay, 0);
+    data_rx_instr[3] = sdio_set_delay(data_rx_instr[3], pio_clkdiv - 2, 0);
+    pio_program_t data_rx_program = sdio_data_rx_program;
+    data_rx_program.instructions = data_rx_instr;
+
+    uint16_t data_tx_instr[count_of(sdio_data_tx_program_instructions)];
+    memcpy(data_tx_instr, sdio_data_tx_program_instructions, sizeof(data_tx_instr));
+    data_tx_instr[1] = sdio_set_delay(data_tx_instr[1], pio_clkdiv + d1 - 1, 0);
+    for (int i = 2; i < (int)count_of(data_tx_instr); i++)
+    {
+        // Remaining instructions alternate between [D0] and [D1]
+        data_tx_instr[i] = sdio_set_delay(data_tx_instr[i], (i & 1) ? d1 : d0, 0);
+    }
+    pio_program_t data_tx_program = sdio_data_tx_program;
+    data_tx_program.instructions = data_tx_instr;
+
     // Load PIO programs
     pio_clear_instruction_memory(SDIO_PIO);
 
     // Command & clock state machine
-    g_sdio.pio_cmd_clk_offset = pio_add_program(SDIO_PIO, &sdio_cmd_clk_program);
+    g_sdio.pio_cmd_clk_offset = pio_add_program(SDIO_PIO, &cmd_clk_program);
     pio_sm_config cfg = sdio_cmd_clk_program_get_default_config(g_sdio.pio_cmd_clk_offset);
     sm_config_set_out_pins(&cfg, SDIO_CMD, 1);
     sm_config_set_in_pins(&cfg, SDIO_CMD);
@@ -795,7 +928,7 @@ void rp2040_sdio_init(int clock_divider)
     pio_sm_set_enabled(SDIO_PIO, SDIO_CMD_SM, true);
 
     // Data reception program
-    g_sdio.pio_data_rx_offset = pio_add_program(SDIO_PIO, &sdio_data_rx_program);
+    g_sdio.pio_data_rx_offset = pio_add_program(SDIO_PIO, &data_rx_program);
     g_sdio.pio_cfg_data_rx = sdio_data_rx_program_get_default_config(g_sdio.pio_data_rx_offset);
     sm_config_set_in_pins(&g_sdio.pio_cfg_data_rx, SDIO_D0);
     sm_config_set_in_shift(&g_sdio.pio_cfg_data_rx, false, true, 32);
@@ -803,7 +936,7 @@ void rp2040_sdio_init(int clock_divider)
     sm_config_set_clkdiv_int_frac(&g_sdio.pio_cfg_data_rx, clock_divider, 0);
 
     // Data transmission program
-    g_sdio.pio_data_tx_offset = pio_add_program(SDIO_PIO, &sdio_data_tx_program);
+    g_sdio.pio_data_tx_offset = pio_add_program(SDIO_PIO, &data_tx_program);
     g_sdio.pio_cfg_data_tx = sdio_data_tx_program_get_default_config(g_sdio.pio_data_tx_offset);
     sm_config_set_in_pins(&g_sdio.pio_cfg_data_tx, SDIO_D0);
     sm_config_set_set_pins(&g_sdio.pio_cfg_data_tx, SDIO_D0, 4);
@@ -827,9 +960,6 @@ void rp2040_sdio_init(int clock_divider)
     gpio_set_function(SDIO_D2, GPIO_FUNC_PIO1);
     gpio_set_function(SDIO_D3, GPIO_FUNC_PIO1);
 
-    // Set up IRQ handler when DMA completes.
-    irq_set_exclusive_handler(DMA_IRQ_1, rp2040_sdio_tx_irq);
-    irq_set_enabled(DMA_IRQ_1, true);
 #if 0
 #ifndef ENABLE_AUDIO_OUTPUT
     irq_set_exclusive_handler(DMA_IRQ_1, rp2040_sdio_tx_irq);
@@ -41,6 +41,10 @@ enum sdio_status_t {
 #define SDIO_BLOCK_SIZE 512
 #define SDIO_WORDS_PER_BLOCK 128
 
+// Number of PIO clock cycles per SDIO clock cycle in the assembled PIO programs.
+// Other values between 3 and 5 are patched in by rp2040_sdio_init().
+#define SDIO_PIO_CLKDIV_DEFAULT 5
+
 // Execute a command that has 48-bit reply (response types R1, R6, R7)
 // If response is NULL, does not wait for reply.
 sdio_status_t rp2040_sdio_command_R1(uint8_t command, uint32_t arg, uint32_t *response);
@@ -53,8 +57,8 @@ sdio_status_t rp2040_sdio_command_R2(uint8_t command, uint32_t arg, uint8_t *res
 sdio_status_t rp2040_sdio_command_R3(uint8_t command, uint32_t arg, uint32_t *response);
 
 // Start transferring data from SD card to memory buffer
-// Transfer block size is always 512 bytes.
-sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks);
+// Block size must be a multiple of 16 bytes, up to 512 bytes.
+sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks, uint32_t block_size = SDIO_BLOCK_SIZE);
 
 // Check if reception is complete
 // Returns SDIO_BUSY while transferring, SDIO_OK when done and error on failure.
@@ -69,5 +73,10 @@ sdio_status_t rp2040_sdio_tx_poll(uint32_t *bytes_complete = nullptr);
 // Force everything to idle state
 sdio_status_t rp2040_sdio_stop();
 
+// Suppress logging of data checksum errors, used while testing bus timing
+void rp2040_sdio_set_quiet(bool quiet);
+
 // (Re)initialize the SDIO interface
-void rp2040_sdio_init(int clock_divider = 1);
+// The SDIO clock frequency is clk_sys / clock_divider / pio_clkdiv.
+// rx_delay shifts the sampling point of received data by PIO clock cycles.
+void rp2040_sdio_init(int clock_divider = 1, int pio_clkdiv = SDIO_PIO_CLKDIV_DEFAULT, int rx_delay = 0);
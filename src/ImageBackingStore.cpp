@@ -26,11 +26,42 @@
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_settings.h"
+#include "ZuluSCSI_dirindex.h"
 #include <minIni.h>
 #include <strings.h>
 #include <string.h>
 #include <assert.h>
 
+#ifdef PLATFORM_HAS_FLAC_DECODER
+#include <FLACDecoder.h>
+
+// Adapter for reading FLAC data through SdFat
+class FLACFileInput: public FLACInput
+{
+public:
+    FsFile *file;
+
+    virtual bool seek(uint64_t pos)
+    {
+        return file->seek(pos);
+    }
+
+    virtual int read(uint8_t *buf, int count)
+    {
+        return file->read(buf, count);
+    }
+};
+
+// The decoder needs a lot of RAM for the sample buffer, so it is shared
+// between all images. It is reopened when another image is accessed.
+// The owner is identified by both the FsFile object, whose file position
+// the decoder continues from, and the first sector of the file, so that
+// a new object at the address of a released one is not mistaken for it.
+static FLACDecoder g_flac_decoder;
+static FLACFileInput g_flac_input;
+static uint32_t g_flac_file_sector;
+#endif
+
 ImageBackingStore::ImageBackingStore()
 {
     m_israw = false;
@@ -38,6 +69,21 @@ ImageBackingStore::ImageBackingStore()
     m_isreadonly_attr = false;
     m_blockdev = nullptr;
     m_bgnsector = m_endsector = m_cursector = 0;
+    m_iscontiguous = false;
+    m_contigbgn = m_contigend = 0;
+    m_iswav = false;
+    m_isflac = false;
+    m_dataoffset = m_datasize = m_flacpos = 0;
+}
+
+ImageBackingStore::~ImageBackingStore()
+{
+#ifdef PLATFORM_HAS_FLAC_DECODER
+    if (g_flac_input.file == &m_fsfile)
+    {
+        g_flac_input.file = nullptr;
+    }
+#endif
 }
 
 ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_size): ImageBackingStore()
@@ -83,6 +129,11 @@ ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_s
     }
     else
     {
+        if (openAudioFile(filename))
+        {
+            return;
+        }
+
         m_isreadonly_attr = !!(FS_ATTRIB_READ_ONLY & SD.attrib(filename));
         if (m_isreadonly_attr)
         {
@@ -94,36 +145,184 @@ ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_s
             m_fsfile = SD.open(filename, O_RDWR);
         }
 
-        uint32_t sectorcount = m_fsfile.size() / SD_SECTOR_SIZE;
         uint32_t begin = 0, end = 0;
-        if (m_fsfile.contiguousRange(&begin, &end) && end >= begin + sectorcount
-            && (scsi_block_size % SD_SECTOR_SIZE) == 0)
+        bool contiguous;
+        if (!dirIndexGetRange(filename, m_fsfile.size(), &contiguous, &begin, &end))
+        {
+            // Walking the FAT chain can take a long time for large files,
+            // result is cached in the directory index.
+            contiguous = m_fsfile.contiguousRange(&begin, &end);
+            dirIndexSetRange(filename, m_fsfile.size(), contiguous, begin, end);
+        }
+        mapContiguous(contiguous, begin, end, scsi_block_size);
+    }
+}
+
+ImageBackingStore::ImageBackingStore(const FsFile &file, const char *filename, uint32_t scsi_block_size,
+                                     bool contiguous, uint32_t begin, uint32_t end): ImageBackingStore()
+{
+    m_fsfile = file;
+    m_isreadonly_attr = true;
+    m_fsfile.seekSet(0);
+
+    if (!openAudioFile(filename))
+    {
+        mapContiguous(contiguous, begin, end, scsi_block_size);
+    }
+}
+
+void ImageBackingStore::mapContiguous(bool contiguous, uint32_t begin, uint32_t end, uint32_t scsi_block_size)
+{
+    uint32_t sectorcount = m_fsfile.size() / SD_SECTOR_SIZE;
+    m_iscontiguous = contiguous;
+    m_contigbgn = begin;
+    m_contigend = end;
+
+    if (contiguous && end >= begin + sectorcount
+        && (scsi_block_size % SD_SECTOR_SIZE) == 0)
+    {
+        // Convert to raw mapping, this avoids some unnecessary
+        // access overhead in SdFat library.
+        // If non-aligned offsets are later requested, it automatically falls
+        // back to SdFat access mode.
+        m_israw = true;
+        m_blockdev = SD.card();
+        m_bgnsector = begin;
+
+        if (end != begin + sectorcount)
         {
-            // Convert to raw mapping, this avoids some unnecessary
-            // access overhead in SdFat library.
-            // If non-aligned offsets are later requested, it automatically falls
-            // back to SdFat access mode.
-            m_israw = true;
-            m_blockdev = SD.card();
-            m_bgnsector = begin;
-
-            if (end != begin + sectorcount)
+            uint32_t allocsize = end - begin + 1;
+            // Due to issue #80 in ZuluSCSI version 1.0.8 and 1.0.9 the allocated size was mistakenly reported to SCSI controller.
+            // If the drive was formatted using those versions, you may have problems accessing it with newer firmware.
+            // The old behavior can be restored with setting  [SCSI] UseFATAllocSize = 1 in config file.
+
+            if (g_scsi_settings.getSystem()->useFATAllocSize)
             {
-                uint32_t allocsize = end - begin + 1;
-                // Due to issue #80 in ZuluSCSI version 1.0.8 and 1.0.9 the allocated size was mistakenly reported to SCSI controller.
-                // If the drive was formatted using those versions, you may have problems accessing it with newer firmware.
-                // The old behavior can be restored with setting  [SCSI] UseFATAllocSize = 1 in config file.
-
-                if (g_scsi_settings.getSystem()->useFATAllocSize)
-                {
-                    sectorcount = allocsize;
-                }
+                sectorcount = allocsize;
             }
+        }
+
+        m_endsector = begin + sectorcount - 1;
+        m_fsfile.flush(); // Note: m_fsfile is also kept open as a fallback.
+    }
+}
 
-            m_endsector = begin + sectorcount - 1;
-            m_fsfile.flush(); // Note: m_fsfile is also kept open as a fallback.
+bool ImageBackingStore::openAudioFile(const char *filename)
+{
+    const char *extension = strrchr(filename, '.');
+    if (extension && strcasecmp(extension, ".wav") == 0)
+    {
+        m_iswav = true;
+        if (!m_fsfile.isOpen()) m_fsfile = SD.open(filename, O_RDONLY);
+        if (!openWav()) m_fsfile.close();
+        return true;
+    }
+    else if (extension && strcasecmp(extension, ".flac") == 0)
+    {
+        m_isflac = true;
+        if (!m_fsfile.isOpen()) m_fsfile = SD.open(filename, O_RDONLY);
+        if (!openFlac()) m_fsfile.close();
+        return true;
+    }
+
+    return false;
+}
+
+bool ImageBackingStore::openWav()
+{
+    uint8_t hdr[12];
+    if (m_fsfile.read(hdr, 12) != 12 ||
+        memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0)
+    {
+        logmsg("---- Not a valid WAV file");
+        return false;
+    }
+
+    bool have_format = false;
+    while (m_fsfile.read(hdr, 8) == 8)
+    {
+        uint32_t chunksize = hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+        uint64_t chunkstart = m_fsfile.curPosition();
+
+        if (memcmp(hdr, "fmt ", 4) == 0)
+        {
+            uint8_t fmt[16];
+            if (chunksize < 16 || m_fsfile.read(fmt, 16) != 16) break;
+
+            uint16_t format = fmt[0] | (fmt[1] << 8);
+            uint16_t channels = fmt[2] | (fmt[3] << 8);
+            uint32_t samplerate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t)fmt[7] << 24);
+            uint16_t bits = fmt[14] | (fmt[15] << 8);
+            if ((format != 1 && format != 0xFFFE) || channels != 2 || samplerate != 44100 || bits != 16)
+            {
+                logmsg("---- WAV file format is not supported: ", (int)channels, " channels, ",
+                       (int)samplerate, " Hz, ", (int)bits, " bits, format ", (int)format,
+                       ". Only 44100 Hz 16-bit stereo PCM can be used for CD audio.");
+                return false;
+            }
+            have_format = true;
+        }
+        else if (memcmp(hdr, "data", 4) == 0)
+        {
+            if (!have_format) break;
+
+            m_dataoffset = chunkstart;
+            m_datasize = m_fsfile.size() - chunkstart;
+            if (chunksize < m_datasize) m_datasize = chunksize;
+            m_fsfile.seek(m_dataoffset);
+            logmsg("---- Using WAV file with ", (int)(m_datasize / 2352), " CD audio sectors");
+            return true;
         }
+
+        // Chunks are padded to even length
+        if (!m_fsfile.seek(chunkstart + chunksize + (chunksize & 1))) break;
     }
+
+    logmsg("---- WAV file has no audio data");
+    return false;
+}
+
+bool ImageBackingStore::openFlac()
+{
+#ifdef PLATFORM_HAS_FLAC_DECODER
+    if (!acquireFlacDecoder())
+    {
+        logmsg("---- FLAC file format is not supported. Only 44100 Hz 16-bit stereo can be used for CD audio.");
+        return false;
+    }
+
+    m_datasize = g_flac_decoder.totalSamples() * 4;
+    logmsg("---- Using FLAC file with ", (int)(m_datasize / 2352), " CD audio sectors");
+    return true;
+#else
+    logmsg("---- FLAC files are not supported on this platform");
+    return false;
+#endif
+}
+
+bool ImageBackingStore::acquireFlacDecoder()
+{
+#ifdef PLATFORM_HAS_FLAC_DECODER
+    uint32_t sector = m_fsfile.firstSector();
+    if (g_flac_input.file == &m_fsfile && g_flac_file_sector == sector)
+    {
+        return true;
+    }
+
+    // The first sector identifies the file so that the seek index
+    // can be reused when switching back to the same file.
+    g_flac_input.file = &m_fsfile;
+    g_flac_file_sector = sector;
+    if (!g_flac_decoder.open(&g_flac_input, m_fsfile.size(), sector))
+    {
+        g_flac_input.file = nullptr;
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
 }
 
 bool ImageBackingStore::isOpen()
@@ -138,7 +337,7 @@ bool ImageBackingStore::isOpen()
 
 bool ImageBackingStore::isWritable()
 {
-    return !m_isrom && !m_isreadonly_attr;
+    return !m_isrom && !m_isreadonly_attr && !m_iswav && !m_isflac;
 }
 
 bool ImageBackingStore::isRom()
@@ -166,6 +365,12 @@ bool ImageBackingStore::close()
     }
     else
     {
+#ifdef PLATFORM_HAS_FLAC_DECODER
+        if (g_flac_input.file == &m_fsfile)
+        {
+            g_flac_input.file = nullptr;
+        }
+#endif
         return m_fsfile.close();
     }
 }
@@ -180,6 +385,10 @@ uint64_t ImageBackingStore::size()
     {
         return m_romhdr.imagesize;
     }
+    else if (m_iswav || m_isflac)
+    {
+        return m_datasize;
+    }
     else
     {
         return m_fsfile.size();
@@ -200,6 +409,17 @@ bool ImageBackingStore::contiguousRange(uint32_t* bgnSector, uint32_t* endSector
         *endSector = 0;
         return true;
     }
+    else if (m_iswav || m_isflac)
+    {
+        // Sector data does not map directly to the file
+        return false;
+    }
+    else if (m_iscontiguous)
+    {
+        *bgnSector = m_contigbgn;
+        *endSector = m_contigend;
+        return true;
+    }
     else
     {
         return m_fsfile.contiguousRange(bgnSector, endSector);
@@ -228,6 +448,16 @@ bool ImageBackingStore::seek(uint64_t pos)
         m_cursector = sectornum;
         return m_cursector * SD_SECTOR_SIZE < m_romhdr.imagesize;
     }
+    else if (m_iswav)
+    {
+        return pos <= m_datasize && m_fsfile.seek(m_dataoffset + pos);
+    }
+    else if (m_isflac)
+    {
+        // Decoder only seeks to whole samples
+        m_flacpos = pos & ~(uint64_t)3;
+        return pos <= m_datasize;
+    }
     else
     {
         return m_fsfile.seek(pos);
@@ -270,6 +500,34 @@ ssize_t ImageBackingStore::read(void* buf, size_t count)
             return -1;
         }
     }
+    else if (m_iswav)
+    {
+        uint64_t pos = m_fsfile.curPosition() - m_dataoffset;
+        if (pos >= m_datasize) return 0;
+        if (count > m_datasize - pos) count = m_datasize - pos;
+        return m_fsfile.read(buf, count);
+    }
+    else if (m_isflac)
+    {
+#ifdef PLATFORM_HAS_FLAC_DECODER
+        if (!acquireFlacDecoder())
+        {
+            return -1;
+        }
+
+        uint64_t sample = m_flacpos / 4;
+        if (g_flac_decoder.position() != sample && !g_flac_decoder.seek(sample))
+        {
+            return -1;
+        }
+
+        uint32_t samples = g_flac_decoder.read((uint8_t*)buf, count / 4);
+        m_flacpos += samples * 4;
+        return samples * 4;
+#else
+        return -1;
+#endif
+    }
     else
     {
         return m_fsfile.read(buf, count);
@@ -302,6 +560,11 @@ ssize_t ImageBackingStore::write(const void* buf, size_t count)
         logmsg("ERROR: attempted to write to ROM drive");
         return 0;
     }
+    else if (m_iswav || m_isflac)
+    {
+        logmsg("ERROR: attempted to write to an audio file");
+        return 0;
+    }
     else  if (m_isreadonly_attr)
     {
         logmsg("ERROR: attempted to write to a read only image");
@@ -315,7 +578,7 @@ ssize_t ImageBackingStore::write(const void* buf, size_t count)
 
 void ImageBackingStore::flush()
 {
-    if (!m_israw && !m_isrom && !m_isreadonly_attr)
+    if (!m_israw && !m_isrom && !m_isreadonly_attr && !m_iswav && !m_isflac)
     {
         m_fsfile.flush();
     }
@@ -323,7 +586,15 @@ void ImageBackingStore::flush()
 
 uint64_t ImageBackingStore::position()
 {
-    if (!m_israw && !m_isrom)
+    if (m_iswav)
+    {
+        return m_fsfile.curPosition() - m_dataoffset;
+    }
+    else if (m_isflac)
+    {
+        return m_flacpos;
+    }
+    else if (!m_israw && !m_isrom)
     {
         return m_fsfile.curPosition();
     }
@@ -26,6 +26,7 @@
  * - Files on SD card
  * - Raw SD card partitions
  * - Microcontroller flash ROM drive
+ * - WAV and FLAC audio files, accessed as raw CD audio data
  */
 
 #pragma once
@@ -50,6 +51,10 @@ extern SdFs SD;
 //
 // If the platform supports a ROM drive, it is activated by using
 // filename "ROM:".
+//
+// Files ending in .wav or .flac are decoded to 16-bit stereo samples,
+// so that they can be accessed the same way as audio tracks in .bin files.
+// Audio files are always read-only.
 class ImageBackingStore
 {
 public:
@@ -62,6 +67,16 @@ public:
     //    ROM:
     ImageBackingStore(const char *filename, uint32_t scsi_block_size);
 
+    // Access a file that is already open, using the result of an earlier
+    // contiguity check. The file is accessed read-only.
+    // This avoids the file open and FAT walk when switching between
+    // CD-ROM track files.
+    ImageBackingStore(const FsFile &file, const char *filename, uint32_t scsi_block_size,
+                      bool contiguous, uint32_t begin, uint32_t end);
+
+    // Releases the shared FLAC decoder if this object is using it
+    ~ImageBackingStore();
+
     // Can the image be read?
     bool isOpen();
 
@@ -112,4 +127,26 @@ protected:
     uint32_t m_bgnsector;
     uint32_t m_endsector;
     uint32_t m_cursector;
+
+    // Result of the contiguity check done when the file was opened
+    bool m_iscontiguous;
+    uint32_t m_contigbgn;
+    uint32_t m_contigend;
+
+    // Use raw sector access if the file is contiguous
+    void mapContiguous(bool contiguous, uint32_t begin, uint32_t end, uint32_t scsi_block_size);
+
+    // Audio file access
+    bool m_iswav;
+    bool m_isflac;
+    uint64_t m_dataoffset; // Start of sample data in WAV file
+    uint64_t m_datasize; // Size of decoded sample data in bytes
+    uint64_t m_flacpos; // Current position in decoded FLAC data
+
+    // Check for audio file extension and parse its header.
+    // Returns false if this is not an audio file.
+    bool openAudioFile(const char *filename);
+    bool openWav();
+    bool openFlac();
+    bool acquireFlacDecoder();
 };
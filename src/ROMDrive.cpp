@@ -100,6 +100,161 @@ bool romDriveClear()
     return true;
 }
 
+// Image is loaded in chunks that use half of scsiDev.data each.
+// The next chunk is read from SD card while the previous one is programmed.
+// Chunks are split at flash block boundaries, so that a whole block can be
+// erased when the first chunk in it is prepared.
+#define ROMDRIVE_CHUNK_SIZE ((sizeof(scsiDev.data) / 2) & ~(PLATFORM_ROMDRIVE_PAGE_SIZE - 1))
+#define ROMDRIVE_CHUNK_SECTORS (ROMDRIVE_CHUNK_SIZE / PLATFORM_ROMDRIVE_PAGE_SIZE)
+
+// Block erase takes about as long as erasing this many sectors separately
+#define ROMDRIVE_BLOCK_ERASE_MIN_SECTORS 4
+
+// Time spent programming from SD card callback is limited
+// so that the SD card transfer does not time out.
+#define ROMDRIVE_CALLBACK_TIME_MS 200
+
+enum romdrive_sector_state_t {
+    SECTOR_MATCH,   // Flash already contains the data
+    SECTOR_PROGRAM, // Can be programmed without erase
+    SECTOR_ERASE    // Needs erase and program
+};
+
+static struct {
+    uint8_t *buf; // Chunk being programmed, NULL if none
+    uint32_t start; // ROM drive address of chunk
+    uint32_t sectors;
+    uint32_t next; // Next sector to program
+    uint8_t state[ROMDRIVE_CHUNK_SECTORS];
+    uint32_t callback_start;
+    uint32_t bytes_programmed;
+    uint32_t bytes_skipped;
+    bool failed;
+} g_romdrive_prog;
+
+// Compare data with flash contents.
+// Flash programming can only clear bits, anything else needs erase.
+static romdrive_sector_state_t romdrive_sector_state(const uint8_t *data, uint32_t start)
+{
+    uint32_t flash[128];
+    const uint32_t *src = (const uint32_t*)data;
+    bool match = true;
+
+    for (uint32_t pos = 0; pos < PLATFORM_ROMDRIVE_PAGE_SIZE; pos += sizeof(flash))
+    {
+        if (!platform_read_romdrive((uint8_t*)flash, start + pos, sizeof(flash)))
+        {
+            return SECTOR_ERASE;
+        }
+
+        for (uint32_t i = 0; i < sizeof(flash) / 4; i++)
+        {
+            uint32_t word = *src++;
+            if (flash[i] != word)
+            {
+                if ((flash[i] & word) != word) return SECTOR_ERASE;
+                match = false;
+            }
+        }
+    }
+
+    return match ? SECTOR_MATCH : SECTOR_PROGRAM;
+}
+
+// Check which sectors of a new chunk need programming.
+// Erases the whole flash block if the chunk starts one and enough of it differs.
+static bool romdrive_prepare_chunk(uint8_t *buf, uint32_t start, uint32_t count)
+{
+    g_romdrive_prog.buf = buf;
+    g_romdrive_prog.start = start;
+    g_romdrive_prog.sectors = count / PLATFORM_ROMDRIVE_PAGE_SIZE;
+    g_romdrive_prog.next = 0;
+
+    uint32_t erase_count = 0;
+    for (uint32_t i = 0; i < g_romdrive_prog.sectors; i++)
+    {
+        uint32_t offset = i * PLATFORM_ROMDRIVE_PAGE_SIZE;
+        g_romdrive_prog.state[i] = romdrive_sector_state(buf + offset, start + offset);
+        if (g_romdrive_prog.state[i] == SECTOR_ERASE) erase_count++;
+    }
+
+    bool block_start = ((start + platform_get_romdrive_block_offset()) % PLATFORM_ROMDRIVE_BLOCK_SIZE) == 0;
+    if (block_start && erase_count >= ROMDRIVE_BLOCK_ERASE_MIN_SECTORS &&
+        start + PLATFORM_ROMDRIVE_BLOCK_SIZE <= platform_get_romdrive_maxsize())
+    {
+        // Rest of the block belongs to the following chunks,
+        // which will see it as erased.
+        if (!platform_erase_romdrive(start, PLATFORM_ROMDRIVE_BLOCK_SIZE))
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < g_romdrive_prog.sectors; i++)
+        {
+            uint32_t offset = i * PLATFORM_ROMDRIVE_PAGE_SIZE;
+            g_romdrive_prog.state[i] = romdrive_sector_state(buf + offset, start + offset);
+        }
+    }
+
+    return true;
+}
+
+// Program the next run of sectors that have the same state,
+// using a single erase and program call for the whole run.
+// Returns false when the chunk is done or programming failed.
+static bool romdrive_program_run(uint32_t max_sectors)
+{
+    if (!g_romdrive_prog.buf || g_romdrive_prog.failed)
+    {
+        return false;
+    }
+
+    while (g_romdrive_prog.next < g_romdrive_prog.sectors &&
+           g_romdrive_prog.state[g_romdrive_prog.next] == SECTOR_MATCH)
+    {
+        g_romdrive_prog.bytes_skipped += PLATFORM_ROMDRIVE_PAGE_SIZE;
+        g_romdrive_prog.next++;
+    }
+
+    if (g_romdrive_prog.next >= g_romdrive_prog.sectors)
+    {
+        return false;
+    }
+
+    uint32_t first = g_romdrive_prog.next;
+    uint8_t state = g_romdrive_prog.state[first];
+    uint32_t count = 1;
+    while (count < max_sectors && first + count < g_romdrive_prog.sectors &&
+           g_romdrive_prog.state[first + count] == state)
+    {
+        count++;
+    }
+
+    uint32_t offset = first * PLATFORM_ROMDRIVE_PAGE_SIZE;
+    uint32_t bytes = count * PLATFORM_ROMDRIVE_PAGE_SIZE;
+    uint32_t start = g_romdrive_prog.start + offset;
+    if ((state == SECTOR_ERASE && !platform_erase_romdrive(start, bytes)) ||
+        !platform_program_romdrive(g_romdrive_prog.buf + offset, start, bytes))
+    {
+        logmsg("---- Failed to program ROM drive at ", start);
+        g_romdrive_prog.failed = true;
+        return false;
+    }
+
+    g_romdrive_prog.bytes_programmed += bytes;
+    g_romdrive_prog.next += count;
+    return true;
+}
+
+// Called by SD card driver while the next chunk is being read
+static void romdrive_program_callback(uint32_t bytes_complete)
+{
+    if ((uint32_t)(millis() - g_romdrive_prog.callback_start) < ROMDRIVE_CALLBACK_TIME_MS)
+    {
+        romdrive_program_run(1);
+    }
+}
+
 // Load an image file to romdrive
 bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S2S_CFG_TYPE type)
 {
@@ -140,25 +295,80 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
     }
 
     // Program the drive contents
-    uint32_t pages = (filesize + PLATFORM_ROMDRIVE_PAGE_SIZE - 1) / PLATFORM_ROMDRIVE_PAGE_SIZE;
-    for (uint32_t i = 0; i < pages; i++)
+    memset(&g_romdrive_prog, 0, sizeof(g_romdrive_prog));
+    uint32_t start_time = millis();
+    uint32_t block_offset = platform_get_romdrive_block_offset();
+    uint32_t pos = 0;
+    int half = 0;
+    int reported_percent = 0;
+    while (pos < filesize || g_romdrive_prog.buf)
     {
-        if (i % 2)
-            LED_ON();
-        else
-            LED_OFF();
+        uint8_t *buf = NULL;
+        uint32_t start = PLATFORM_ROMDRIVE_PAGE_SIZE + pos;
+        uint32_t len = 0;
+        uint32_t padded_len = 0;
+
+        if (pos < filesize)
+        {
+            if (half)
+                LED_ON();
+            else
+                LED_OFF();
+
+            buf = &scsiDev.data[half * ROMDRIVE_CHUNK_SIZE];
+            half ^= 1;
+
+            uint32_t block_remain = PLATFORM_ROMDRIVE_BLOCK_SIZE - (start + block_offset) % PLATFORM_ROMDRIVE_BLOCK_SIZE;
+            len = ROMDRIVE_CHUNK_SIZE;
+            if (len > block_remain) len = block_remain;
+            if (len > filesize - pos) len = filesize - pos;
+
+            // Previous chunk gets programmed from the callback while SD card is busy
+            g_romdrive_prog.callback_start = millis();
+            platform_set_sd_callback(&romdrive_program_callback, buf);
+            int status = file.read(buf, len);
+            platform_set_sd_callback(NULL, NULL);
 
-        if (file.read(scsiDev.data, PLATFORM_ROMDRIVE_PAGE_SIZE) <= 0 ||
-            !platform_write_romdrive(scsiDev.data, (i + 1) * PLATFORM_ROMDRIVE_PAGE_SIZE, PLATFORM_ROMDRIVE_PAGE_SIZE))
+            if (status != (int)len)
+            {
+                logmsg("---- Failed to read image file at offset ", pos);
+                file.close();
+                return false;
+            }
+
+            // Last sector is padded with erased flash value
+            padded_len = (len + PLATFORM_ROMDRIVE_PAGE_SIZE - 1) & ~(PLATFORM_ROMDRIVE_PAGE_SIZE - 1);
+            memset(buf + len, 0xFF, padded_len - len);
+        }
+
+        // Finish programming the previous chunk
+        while (romdrive_program_run(ROMDRIVE_CHUNK_SECTORS));
+        g_romdrive_prog.buf = NULL;
+
+        if (g_romdrive_prog.failed ||
+            (buf && !romdrive_prepare_chunk(buf, start, padded_len)))
         {
-            logmsg("---- Failed to program ROM drive page ", (int)i);
+            logmsg("---- Failed to program ROM drive");
             file.close();
             return false;
         }
+
+        pos += len;
+
+        int percent = (int)((uint64_t)pos * 100 / filesize);
+        if (percent >= reported_percent + 10)
+        {
+            reported_percent = percent - percent % 10;
+            logmsg("---- ROM drive programming ", reported_percent, "%");
+        }
     }
 
     LED_OFF();
 
+    logmsg("---- Programmed ", (int)(g_romdrive_prog.bytes_programmed / 1024), " kB, skipped ",
+           (int)(g_romdrive_prog.bytes_skipped / 1024), " kB already up to date, in ",
+           (int)(millis() - start_time), " ms");
+
     file.close();
 
     char newname[MAX_FILE_PATH * 2] = "";
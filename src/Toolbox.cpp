@@ -32,6 +32,10 @@ extern "C" {
 
 const uint8_t MAX_FILE_LISTING_FILES = 100;
 
+// Block writes are received from SCSI bus in parts of this size,
+// so that writing to SD card can start before the whole block has arrived.
+const uint32_t TOOLBOX_SCSI_READ_CHUNK = 8192;
+
 
 extern "C" int8_t scsiToolboxEnabled()
 {
@@ -59,63 +63,213 @@ static bool toolboxFilenameValid(const char* name, bool isCD = false)
     return true;
 }
 
-static void doCountFiles(const char * dir_name, bool isCD = false)
+// Index of valid files in the most recently accessed directory.
+// Stores the directory entry position of each file, so that file N can be opened
+// directly instead of iterating through the directory each time.
+// Files beyond TOOLBOX_INDEX_MAX_FILES are counted but found by a directory scan.
+static struct {
+    bool valid;
+    bool isCD;
+    char dir_name[MAX_FILE_PATH];
+    uint16_t count;
+    uint16_t indexed;
+    uint32_t dir_index[TOOLBOX_INDEX_MAX_FILES];
+} g_toolbox_index;
+
+// State of the block transfer commands.
+// The file stays open in gFile between commands so that sequential block reads
+// continue from the current position without seeking or reopening the file.
+static struct {
+    bool reading;
+    uint16_t index;
+    uint8_t *buffer;
+    uint32_t bytes_sd; // Number of bytes scheduled for transfer on SD card side
+    uint32_t bytes_scsi; // Number of bytes scheduled for transfer on SCSI side
+    uint32_t bytes_scsi_started;
+    int parityError;
+} g_toolbox_transfer;
+
+void toolboxInvalidateIndex()
+{
+    g_toolbox_index.valid = false;
+    g_toolbox_transfer.reading = false;
+}
+
+// Open the next file in dir that is shown in Toolbox listings.
+// Returns false at the end of the directory.
+static bool toolboxOpenNextValid(FsFile &dir, FsFile &file, bool isCD)
 {
-    FsFile dir;
-    FsFile file;
     char name[MAX_FILE_PATH] = {0};
-    dir.open(dir_name);
-    dir.rewindDirectory();
-    uint8_t file_count = 0;
     while (file.openNext(&dir, O_RDONLY))
     {
         if(file.getError() > 0)
         {
             file.close();
-            break;
+            return false;
         }
         bool isDir = file.isDirectory();
         size_t len = file.getName(name, MAX_FILE_PATH);
-        file.close();
+        // no directories in CD image listing
         if (isCD && isDir)
+        {
+            file.close();
             continue;
+        }
         // truncate filename the same way listing does, before validating name
         if (len > MAX_MAC_PATH)
             name[MAX_MAC_PATH] = 0x0;
-        dbgmsg("TOOLBOX COUNT FILES: truncated filename is '", name, "'");
-        // only count valid files.
-        if(toolboxFilenameValid(name, isCD))
+        if (!toolboxFilenameValid(name, isCD))
         {
-            file_count = file_count + 1;
-            if(file_count > MAX_FILE_LISTING_FILES) {
-                scsiDev.status = CHECK_CONDITION;
-                scsiDev.target->sense.code = ILLEGAL_REQUEST;
-                scsiDev.target->sense.asc = OPEN_RETRO_SCSI_TOO_MANY_FILES;
-                scsiDev.phase = STATUS;
-                dir.close();
-                return;
-            }
+            file.close();
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+static void toolboxBuildIndex(const char * dir_name, bool isCD)
+{
+    if (g_toolbox_index.valid && g_toolbox_index.isCD == isCD &&
+        strcmp(g_toolbox_index.dir_name, dir_name) == 0)
+    {
+        return;
+    }
+
+    FsFile dir;
+    FsFile file;
+    g_toolbox_index.count = 0;
+    g_toolbox_index.indexed = 0;
+    g_toolbox_index.isCD = isCD;
+    strncpy(g_toolbox_index.dir_name, dir_name, sizeof(g_toolbox_index.dir_name) - 1);
+    g_toolbox_index.dir_name[sizeof(g_toolbox_index.dir_name) - 1] = '\0';
+
+    dir.open(dir_name);
+    dir.rewindDirectory();
+    while (g_toolbox_index.count < 0xFFFF && toolboxOpenNextValid(dir, file, isCD))
+    {
+        if (g_toolbox_index.indexed < TOOLBOX_INDEX_MAX_FILES)
+        {
+            g_toolbox_index.dir_index[g_toolbox_index.indexed++] = file.dirIndex();
         }
-  }
-  scsiDev.data[0] = file_count;
-  scsiDev.dataLen = sizeof(file_count);
-  scsiDev.phase = DATA_IN;
+        g_toolbox_index.count++;
+        file.close();
+    }
+    dir.close();
+
+    if (g_toolbox_index.count > g_toolbox_index.indexed)
+    {
+        dbgmsg("TOOLBOX: ", (int)g_toolbox_index.count, " files in ", dir_name,
+               ", files after ", (int)TOOLBOX_INDEX_MAX_FILES, " are found by scanning");
+    }
+
+    g_toolbox_index.valid = true;
+    dbgmsg("TOOLBOX: indexed ", (int)g_toolbox_index.indexed, " files in ", dir_name);
+}
+
+// Open file number file_number in dir, which must be the directory of the current index.
+// For file numbers beyond the index, scans forward from the last indexed file.
+static bool toolboxOpenIndexed(FsFile &dir, FsFile &file, uint16_t file_number)
+{
+    if (file_number >= g_toolbox_index.count)
+    {
+        return false;
+    }
+    if (file_number < g_toolbox_index.indexed)
+    {
+        return file.open(&dir, g_toolbox_index.dir_index[file_number], O_RDONLY);
+    }
+
+    uint16_t n = 0;
+    dir.rewindDirectory();
+    if (g_toolbox_index.indexed > 0)
+    {
+        // Continue directory iteration after the last indexed entry
+        if (!file.open(&dir, g_toolbox_index.dir_index[g_toolbox_index.indexed - 1], O_RDONLY))
+        {
+            return false;
+        }
+        file.close();
+        n = g_toolbox_index.indexed;
+    }
+
+    while (toolboxOpenNextValid(dir, file, g_toolbox_index.isCD))
+    {
+        if (n++ == file_number)
+        {
+            return true;
+        }
+        file.close();
+    }
+    return false;
+}
+
+static void doCountFiles(const char * dir_name, bool isCD = false)
+{
+    toolboxBuildIndex(dir_name, isCD);
+    if (g_toolbox_index.count > MAX_FILE_LISTING_FILES)
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = OPEN_RETRO_SCSI_TOO_MANY_FILES;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    uint8_t file_count = g_toolbox_index.count;
+    scsiDev.data[0] = file_count;
+    scsiDev.dataLen = sizeof(file_count);
+    scsiDev.phase = DATA_IN;
+}
+
+// Count files without the 100 file limit, for use with paged listing
+static void doCountFiles16(const char * dir_name, bool isCD)
+{
+    toolboxBuildIndex(dir_name, isCD);
+    scsiDev.data[0] = (g_toolbox_index.count >> 8) & 0xff;
+    scsiDev.data[1] = g_toolbox_index.count & 0xff;
+    scsiDev.dataLen = 2;
+    scsiDev.phase = DATA_IN;
 }
 
-static void onListFiles(const char * dir_name, bool isCD = false) {
+// List up to max_count files starting from file number first.
+// The index byte of each entry contains the low 8 bits of the file number.
+static void onListFiles(const char * dir_name, bool isCD = false,
+                        uint16_t first = 0, uint16_t max_count = MAX_FILE_LISTING_FILES) {
     FsFile dir;
     FsFile file;
     const size_t ENTRY_SIZE = 40;
 
     memset(scsiDev.data, 0, ENTRY_SIZE * (MAX_FILE_LISTING_FILES + 1));
     char name[MAX_FILE_PATH] = {0};
-    uint8_t index = 0;
+    uint16_t index = 0;
     uint8_t file_entry[ENTRY_SIZE] = {0};
 
+    if (max_count > MAX_FILE_LISTING_FILES)
+        max_count = MAX_FILE_LISTING_FILES;
+
+    toolboxBuildIndex(dir_name, isCD);
     dir.open(dir_name);
-    dir.rewindDirectory();
-    while (file.openNext(&dir, O_RDONLY))
-    {   
+    while (index < max_count && first + index < g_toolbox_index.count)
+    {
+        uint16_t file_number = first + index;
+        bool opened;
+        if (index > 0 && file_number >= g_toolbox_index.indexed)
+        {
+            // Beyond the index, continue from the previous file's directory position
+            opened = toolboxOpenNextValid(dir, file, isCD);
+        }
+        else
+        {
+            opened = toolboxOpenIndexed(dir, file, file_number);
+        }
+
+        if (!opened)
+        {
+            logmsg("TOOLBOX LIST FILES: failed to open file ", (int)file_number, " in ", dir_name);
+            break;
+        }
+
         memset(name, 0, sizeof(name));
         // get base information
         uint8_t isDir = file.isDirectory() ? 0x00 : 0x01;
@@ -126,13 +280,8 @@ static void onListFiles(const char * dir_name, bool isCD = false) {
         if (len > MAX_MAC_PATH)
             name[MAX_MAC_PATH] = 0x0;
         dbgmsg("TOOLBOX LIST FILES: truncated filename is '", name, "'");
-        // validate file is allowed for this listing
-        if (!toolboxFilenameValid(name, isCD))
-            continue;
-        if (isCD && isDir == 0x00)
-            continue;
         // fill output buffer
-        file_entry[0] = index;
+        file_entry[0] = (uint8_t)file_number;
         file_entry[1] = isDir;
         for(int i = 0; i < MAX_MAC_PATH + 1 ; i++) {
             file_entry[i + 2] = name[i];   // bytes 2 - 34
@@ -146,7 +295,6 @@ static void onListFiles(const char * dir_name, bool isCD = false) {
         memcpy(&(scsiDev.data[ENTRY_SIZE * index]), file_entry, ENTRY_SIZE);
         // increment index
         index = index + 1;
-        if (index >= MAX_FILE_LISTING_FILES) break;
     }
     dir.close();
 
@@ -155,53 +303,19 @@ static void onListFiles(const char * dir_name, bool isCD = false) {
     dbgmsg("TOOLBOX LIST FILES: returning ", index, " files for size ", scsiDev.dataLen);
 }
 
-static FsFile get_file_from_index(uint8_t index, const char * dir_name, bool isCD = false)
+static FsFile get_file_from_index(uint16_t index, const char * dir_name, bool isCD = false)
 {
     FsFile dir;
-    FsFile file_test;
-    char name[MAX_FILE_PATH] = {0};
+    FsFile file;
 
-    dir.open(dir_name);
-    dir.rewindDirectory(); // Back to the top
-    int count = 0;
-    while (file_test.openNext(&dir, O_RDONLY))
+    toolboxBuildIndex(dir_name, isCD);
+    if (index < g_toolbox_index.count)
     {
-        // If error there is no next file to open.
-        if(file_test.getError() > 0) {
-            file_test.close();
-            break;
-        }
-        // no directories in CD image listing
-        if (isCD && file_test.isDirectory())
-        {
-            file_test.close();
-            continue;
-        }
-        // truncate filename the same way listing does, before validating name
-        size_t len = file_test.getName(name, MAX_FILE_PATH);
-        if (len > MAX_MAC_PATH)
-            name[MAX_MAC_PATH] = 0x0;
-        // validate filename
-        if(!toolboxFilenameValid(name, isCD))
-        {
-            file_test.close();
-            continue;
-        }
-        // found file?
-        if (count == index)
-        {
-            dir.close();
-            return file_test;
-        }
-        else
-        {
-            file_test.close();
-        }
-        count++;
+        dir.open(dir_name);
+        toolboxOpenIndexed(dir, file, index);
+        dir.close();
     }
-    file_test.close();
-    dir.close();
-    return file_test;
+    return file;
 }
 
 // Devices that are active on this SCSI device.
@@ -243,6 +357,7 @@ void onGetFile10(char * dir_name) {
 
     if (offset == 0) // first time, open the file.
     {
+        g_toolbox_transfer.reading = false;
         gFile = get_file_from_index(index, dir_name);
         if(!gFile.isDirectory() && !gFile.isReadable())
         {
@@ -281,6 +396,7 @@ static void onSendFilePrep(char * dir_name)
     SD.chdir(dir_name);
     gFile.open(file_name, FILE_WRITE);
     SD.chdir("/");
+    toolboxInvalidateIndex();
     if(gFile.isOpen() && gFile.isWritable())
     {
         gFile.rewind();
@@ -300,6 +416,7 @@ static void onSendFileEnd(void)
 {
     gFile.sync();
     gFile.close();
+    toolboxInvalidateIndex();
     scsiDev.phase = STATUS;
 }
 
@@ -339,6 +456,270 @@ static void onSendFile10(void)
     }
     //scsiDev.phase = STATUS;
 }
+
+// Maximum number of bytes transferred by one block command.
+// Half of the buffer is read from SD card while the other half is sent to SCSI bus.
+static uint32_t toolboxBlockMaxBytes()
+{
+    uint32_t max_bytes = sizeof(scsiDev.data);
+    if (max_bytes > TOOLBOX_BLOCK_MAX_BYTES) max_bytes = TOOLBOX_BLOCK_MAX_BYTES;
+    return max_bytes & ~(2 * SD_SECTOR_SIZE - 1);
+}
+
+static void onGetBlockSize()
+{
+    uint32_t max_bytes = toolboxBlockMaxBytes();
+    scsiDev.data[0] = (uint8_t)(max_bytes >> 24);
+    scsiDev.data[1] = (uint8_t)(max_bytes >> 16);
+    scsiDev.data[2] = (uint8_t)(max_bytes >> 8);
+    scsiDev.data[3] = (uint8_t)(max_bytes);
+    scsiDev.dataLen = 4;
+    scsiDev.phase = DATA_IN;
+}
+
+// Called from SD card driver while reading, sends the completed part to SCSI bus.
+static void toolboxDataIn_callback(uint32_t bytes_complete)
+{
+    // Send in whole 512 byte blocks, except at the end of transfer
+    if (bytes_complete < g_toolbox_transfer.bytes_sd)
+    {
+        bytes_complete -= bytes_complete % SD_SECTOR_SIZE;
+    }
+
+    if (bytes_complete > g_toolbox_transfer.bytes_scsi)
+    {
+        uint32_t len = bytes_complete - g_toolbox_transfer.bytes_scsi;
+        scsiStartWrite(g_toolbox_transfer.buffer + g_toolbox_transfer.bytes_scsi, len);
+        g_toolbox_transfer.bytes_scsi += len;
+    }
+
+    // Provide a chance for polling request processing
+    scsiIsWriteFinished(NULL);
+}
+
+/*
+  Reads a block of up to toolboxBlockMaxBytes() from a file in the shared directory.
+  cdb[2..3] is the file index, cdb[4..7] the offset in 512 byte units and
+  cdb[8] the length in 512 byte units, 0 selects the maximum.
+  Returns fewer bytes at the end of the file.
+*/
+static void onGetFileBlock(const char * dir_name)
+{
+    uint16_t index = ((uint16_t)scsiDev.cdb[2] << 8) | scsiDev.cdb[3];
+    uint32_t offset_blocks = ((uint32_t)scsiDev.cdb[4] << 24) | ((uint32_t)scsiDev.cdb[5] << 16) |
+                             ((uint32_t)scsiDev.cdb[6] << 8) | scsiDev.cdb[7];
+    uint64_t offset = (uint64_t)offset_blocks * SD_SECTOR_SIZE;
+    uint32_t max_bytes = toolboxBlockMaxBytes();
+    uint32_t len = (uint32_t)scsiDev.cdb[8] * SD_SECTOR_SIZE;
+    if (len == 0 || len > max_bytes) len = max_bytes;
+
+    if (!g_toolbox_transfer.reading || g_toolbox_transfer.index != index || !gFile.isOpen())
+    {
+        gFile.close();
+        gFile = get_file_from_index(index, dir_name);
+        if (!gFile.isOpen() || gFile.isDirectory())
+        {
+            gFile.close();
+            g_toolbox_transfer.reading = false;
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = ILLEGAL_REQUEST;
+            scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+            scsiDev.phase = STATUS;
+            return;
+        }
+        g_toolbox_transfer.reading = true;
+        g_toolbox_transfer.index = index;
+    }
+
+    uint64_t file_total = gFile.size();
+    if (offset >= file_total)
+    {
+        // Transfer done, close the file.
+        gFile.close();
+        g_toolbox_transfer.reading = false;
+        scsiDev.phase = STATUS;
+        return;
+    }
+    if (file_total - offset < len)
+    {
+        len = (uint32_t)(file_total - offset);
+    }
+
+    // Sequential reads continue from the previous position without seeking
+    if (gFile.curPosition() != offset && !gFile.seekSet(offset))
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = MEDIUM_ERROR;
+        scsiDev.target->sense.asc = NO_SEEK_COMPLETE;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    // Double buffering: SD card reads into one half of the buffer while the
+    // previous half is still being sent to SCSI bus.
+    scsiEnterPhase(DATA_IN);
+    uint32_t half = max_bytes / 2;
+    uint32_t bytes_done = 0;
+    int bufidx = 0;
+    while (bytes_done < len && scsiDev.phase == DATA_IN && !scsiDev.resetFlag)
+    {
+        uint32_t count = len - bytes_done;
+        if (count > half) count = half;
+        uint8_t *buf = &scsiDev.data[bufidx * half];
+
+        // Wait for previous transfer using this half to finish
+        while (!scsiIsWriteFinished(buf + count - 1) && !scsiDev.resetFlag)
+        {
+            platform_poll();
+        }
+        if (scsiDev.resetFlag) break;
+
+        g_toolbox_transfer.buffer = buf;
+        g_toolbox_transfer.bytes_sd = count;
+        g_toolbox_transfer.bytes_scsi = 0;
+        platform_set_sd_callback(&toolboxDataIn_callback, buf);
+        if (gFile.read(buf, count) != (int)count)
+        {
+            logmsg("Toolbox: SD card read failed: ", SD.sdErrorCode());
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = MEDIUM_ERROR;
+            scsiDev.target->sense.asc = UNRECOVERED_READ_ERROR;
+            scsiDev.phase = STATUS;
+        }
+        else
+        {
+            toolboxDataIn_callback(count);
+        }
+        platform_set_sd_callback(NULL, NULL);
+
+        bytes_done += count;
+        bufidx ^= 1;
+    }
+
+    while (!scsiIsWriteFinished(NULL) && !scsiDev.resetFlag)
+    {
+        platform_poll();
+    }
+    scsiFinishWrite();
+
+    if (scsiDev.phase == DATA_IN)
+    {
+        scsiDev.phase = STATUS;
+    }
+}
+
+// Called from SD card driver while writing, starts receiving more data from SCSI bus.
+static void toolboxDataOut_callback(uint32_t bytes_complete)
+{
+    if (g_toolbox_transfer.bytes_scsi_started < g_toolbox_transfer.bytes_scsi)
+    {
+        uint32_t len = g_toolbox_transfer.bytes_scsi - g_toolbox_transfer.bytes_scsi_started;
+        if (len > TOOLBOX_SCSI_READ_CHUNK)
+        {
+            len = TOOLBOX_SCSI_READ_CHUNK;
+        }
+
+        scsiStartRead(&scsiDev.data[g_toolbox_transfer.bytes_scsi_started], len, &g_toolbox_transfer.parityError);
+        g_toolbox_transfer.bytes_scsi_started += len;
+    }
+}
+
+/*
+  Writes a block of up to toolboxBlockMaxBytes() to the file opened by TOOLBOX_SEND_FILE_PREP.
+  cdb[2..5] is the offset in 512 byte units and cdb[6..8] the number of bytes.
+*/
+static void onSendFileBlock(void)
+{
+    uint32_t offset_blocks = ((uint32_t)scsiDev.cdb[2] << 24) | ((uint32_t)scsiDev.cdb[3] << 16) |
+                             ((uint32_t)scsiDev.cdb[4] << 8) | scsiDev.cdb[5];
+    uint64_t offset = (uint64_t)offset_blocks * SD_SECTOR_SIZE;
+    uint32_t len = ((uint32_t)scsiDev.cdb[6] << 16) | ((uint32_t)scsiDev.cdb[7] << 8) | scsiDev.cdb[8];
+
+    if (!gFile.isOpen() || !gFile.isWritable() || len > toolboxBlockMaxBytes())
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    if (gFile.curPosition() != offset && !gFile.seekSet(offset))
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = MEDIUM_ERROR;
+        scsiDev.target->sense.asc = NO_SEEK_COMPLETE;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    scsiEnterPhase(DATA_OUT);
+    g_toolbox_transfer.bytes_scsi = len;
+    g_toolbox_transfer.bytes_sd = 0;
+    g_toolbox_transfer.bytes_scsi_started = 0;
+    g_toolbox_transfer.parityError = 0;
+
+    while (g_toolbox_transfer.bytes_sd < len && scsiDev.phase == DATA_OUT && !scsiDev.resetFlag)
+    {
+        platform_poll();
+
+        // Count number of bytes received from SCSI bus and not yet written to SD card
+        uint32_t start = g_toolbox_transfer.bytes_sd;
+        uint32_t available = g_toolbox_transfer.bytes_scsi_started - start;
+        uint32_t count = 0;
+        if (available > 0 && scsiIsReadFinished(&scsiDev.data[start + available - 1]))
+        {
+            count = available;
+        }
+        else
+        {
+            while (count + SD_SECTOR_SIZE <= available && scsiIsReadFinished(&scsiDev.data[start + count + SD_SECTOR_SIZE - 1]))
+            {
+                count += SD_SECTOR_SIZE;
+            }
+        }
+
+        if (count == 0)
+        {
+            // Nothing ready to write, check if we can read more from SCSI bus
+            toolboxDataOut_callback(0);
+            continue;
+        }
+
+        scsiFinishRead(&scsiDev.data[start], count, &g_toolbox_transfer.parityError);
+        if (g_toolbox_transfer.parityError)
+        {
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = ABORTED_COMMAND;
+            scsiDev.target->sense.asc = SCSI_PARITY_ERROR;
+            scsiDev.phase = STATUS;
+            break;
+        }
+
+        // Write to SD card and simultaneously receive more data from SCSI bus
+        platform_set_sd_callback(&toolboxDataOut_callback, &scsiDev.data[start]);
+        if (gFile.write(&scsiDev.data[start], count) != count)
+        {
+            logmsg("Toolbox: SD card write failed: ", SD.sdErrorCode());
+            gFile.clearWriteError();
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = MEDIUM_ERROR;
+            scsiDev.target->sense.asc = WRITE_ERROR_AUTO_REALLOCATION_FAILED;
+            scsiDev.phase = STATUS;
+        }
+        platform_set_sd_callback(NULL, NULL);
+        g_toolbox_transfer.bytes_sd += count;
+    }
+
+    // Release SCSI bus
+    scsiFinishRead(NULL, 0, &g_toolbox_transfer.parityError);
+
+    if (scsiDev.phase == DATA_OUT)
+    {
+        scsiDev.phase = STATUS;
+    }
+}
+
 static void onToggleDebug()
 {
     if(scsiDev.cdb[1] == 0) // 0 == Set Debug, 1 == Get Debug State
@@ -436,6 +817,46 @@ extern "C" int scsiToolboxCommand()
         snprintf(img_dir, sizeof(img_dir), CD_IMG_DIR, (int)img.scsiId & S2S_CFG_TARGET_ID_BITS);
         doCountFiles(img_dir, true);
     }
+    else if (unlikely(command == TOOLBOX_GET_FILE_BLOCK))
+    {
+        char img_dir[MAX_FILE_PATH];
+        dbgmsg("TOOLBOX_GET_FILE_BLOCK");
+        getToolBoxSharedDir(img_dir);
+        onGetFileBlock(img_dir);
+    }
+    else if (unlikely(command == TOOLBOX_SEND_FILE_BLOCK))
+    {
+        dbgmsg("TOOLBOX_SEND_FILE_BLOCK");
+        onSendFileBlock();
+    }
+    else if (unlikely(command == TOOLBOX_GET_BLOCK_SIZE))
+    {
+        dbgmsg("TOOLBOX_GET_BLOCK_SIZE");
+        onGetBlockSize();
+    }
+    else if (unlikely(command == TOOLBOX_LIST_FILES_PAGED || command == TOOLBOX_COUNT_FILES_16))
+    {
+        // cdb[1] selects the folder, cdb[2..3] is first file number and cdb[4] is number of entries
+        char img_dir[MAX_FILE_PATH];
+        bool isCD = scsiDev.cdb[1] & TOOLBOX_PAGED_FLAG_CD;
+        if (isCD)
+            snprintf(img_dir, sizeof(img_dir), CD_IMG_DIR, (int)img.scsiId & S2S_CFG_TARGET_ID_BITS);
+        else
+            getToolBoxSharedDir(img_dir);
+
+        if (command == TOOLBOX_COUNT_FILES_16)
+        {
+            dbgmsg("TOOLBOX_COUNT_FILES_16");
+            doCountFiles16(img_dir, isCD);
+        }
+        else
+        {
+            uint16_t first = ((uint16_t)scsiDev.cdb[2] << 8) | scsiDev.cdb[3];
+            uint16_t count = scsiDev.cdb[4] ? scsiDev.cdb[4] : MAX_FILE_LISTING_FILES;
+            dbgmsg("TOOLBOX_LIST_FILES_PAGED, first ", (int)first, " count ", (int)count);
+            onListFiles(img_dir, isCD, first, count);
+        }
+    }
     else
     {
         commandHandled = 0;
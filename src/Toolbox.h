@@ -34,4 +34,20 @@
 #define TOOLBOX_SET_NEXT_CD    0xD8
 #define TOOLBOX_LIST_DEVICES   0xD9
 #define TOOLBOX_COUNT_CDS      0xDA
-#define OPEN_RETRO_SCSI_TOO_MANY_FILES 0x0001
\ No newline at end of file
+#define TOOLBOX_LIST_FILES_PAGED 0xDB
+#define TOOLBOX_COUNT_FILES_16 0xDC
+#define TOOLBOX_GET_FILE_BLOCK 0xDD
+#define TOOLBOX_SEND_FILE_BLOCK 0xDE
+#define TOOLBOX_GET_BLOCK_SIZE 0xDF
+#define OPEN_RETRO_SCSI_TOO_MANY_FILES 0x0001
+
+// Flag in cdb[1] of paged commands, selects CD image folder instead of shared folder
+#define TOOLBOX_PAGED_FLAG_CD  0x01
+
+// Largest transfer size of the block commands, further limited by scsiDev.data size
+#ifndef TOOLBOX_BLOCK_MAX_BYTES
+#define TOOLBOX_BLOCK_MAX_BYTES 65536
+#endif
+
+// Forget cached directory listing, called when SD card contents may have changed
+void toolboxInvalidateIndex();
@@ -56,9 +56,14 @@
 #include "ZuluSCSI_log_trace.h"
 #include "ZuluSCSI_settings.h"
 #include "ZuluSCSI_disk.h"
+#include "ZuluSCSI_tape.h"
+#include "ZuluSCSI_cdrom.h"
+#include "ZuluSCSI_dirindex.h"
+#include "ZuluSCSI_sdworker.h"
 #include "ZuluSCSI_initiator.h"
 #include "ZuluSCSI_msc.h"
 #include "ROMDrive.h"
+#include "Toolbox.h"
 
 SdFs SD;
 FsFile g_logfile;
@@ -103,6 +108,8 @@ extern "C" void s2s_ledOff()
 /* Log saving */
 /**************/
 
+static uint32_t g_log_saved_len = 0;
+
 void save_logfile(bool always = false)
 {
 #ifdef ZULUSCSI_HARDWARE_CONFIG
@@ -112,25 +119,30 @@ void save_logfile(bool always = false)
 #endif
 
   static uint32_t prev_log_pos = 0;
-  static uint32_t prev_log_len = 0;
   static uint32_t prev_log_save = 0;
   uint32_t loglen = log_get_buffer_len();
 
-  if (loglen != prev_log_len && g_sdcard_present)
+  if (loglen != g_log_saved_len && g_sdcard_present)
   {
     // When debug is off, save log at most every LOG_SAVE_INTERVAL_MS
-    // When debug is on, save after every SCSI command.
+    // When debug is on, save whenever called.
     if (always || g_log_debug || (LOG_SAVE_INTERVAL_MS > 0 && (uint32_t)(millis() - prev_log_save) > LOG_SAVE_INTERVAL_MS))
     {
       g_logfile.write(log_get_buffer(&prev_log_pos));
       g_logfile.flush();
       
-      prev_log_len = loglen;
+      g_log_saved_len = loglen;
       prev_log_save = millis();
     }
   }
 }
 
+// Check if unsaved log data is close to being overwritten in the ring buffer
+static bool log_buffer_filling()
+{
+  return log_get_buffer_len() - g_log_saved_len > LOGBUFSIZE / 2;
+}
+
 void init_logfile()
 {
 #ifdef ZULUSCSI_HARDWARE_CONFIG
@@ -148,9 +160,17 @@ void init_logfile()
   {
     logmsg("Failed to open log file: ", SD.sdErrorCode());
   }
+  else if (truncate && LOG_PREALLOCATE_SIZE > 0 && SD.fatType() == FAT_TYPE_EXFAT)
+  {
+    // Contiguous preallocated space lets appends skip cluster allocation.
+    // Only done on exFAT, where the file length still follows written data.
+    // On FAT the preallocated area would show up as garbage after the log.
+    g_logfile.preAllocate(LOG_PREALLOCATE_SIZE);
+  }
   save_logfile(true);
 
   first_open_after_boot = false;
+  scsiTraceInit();
 }
 
 void print_sd_info()
@@ -341,14 +361,16 @@ bool findHDDImages()
 
   logmsg("Finding images in directory ", imgdir, ":");
 
+  dirIndexBegin();
+
   SdFile root;
   root.open(imgdir);
   if (!root.isOpen())
   {
     logmsg("Could not open directory: ", imgdir);
   }
+  dirIndexOpenDir(imgdir, root);
 
-  SdFile file;
   bool imageReady;
   bool foundImage = false;
   int usedDefaultId = 0;
@@ -357,7 +379,8 @@ bool findHDDImages()
   uint8_t last_removable_device = 255;
   while (1)
   {
-    if (!file.openNext(&root, O_READ))
+    char name[MAX_FILE_PATH+1];
+    if (!dirIndexNextFile(root, name, sizeof(name)))
     {
       // Check for additional directories with ini keys Dir1..Dir9
       while (dirindex < 10)
@@ -379,6 +402,7 @@ bool findHDDImages()
         {
           logmsg("-- Could not open directory: ", imgdir);
         }
+        dirIndexOpenDir(imgdir, root);
         continue;
       }
       else
@@ -387,160 +411,158 @@ bool findHDDImages()
       }
     }
 
-    char name[MAX_FILE_PATH+1];
-    if(!file.isDir()) {
-      file.getName(name, MAX_FILE_PATH+1);
-      file.close();
+    // Special filename for clearing any previously programmed ROM drive
+    if(strcasecmp(name, "CLEAR_ROM") == 0)
+    {
+      logmsg("-- Special filename: '", name, "'");
+      romDriveClear();
+      dirIndexInvalidateDir();
+      continue;
+    }
 
-      // Special filename for clearing any previously programmed ROM drive
-      if(strcasecmp(name, "CLEAR_ROM") == 0)
+    // Special filename for creating new empty image files
+    if (strncasecmp(name, CREATEFILE, strlen(CREATEFILE)) == 0)
+    {
+      logmsg("-- Special filename: '", name, "'");
+      dirIndexInvalidateDir();
+      char imgname[MAX_FILE_PATH+1];
+      if (createImage(name, imgname))
       {
-        logmsg("-- Special filename: '", name, "'");
-        romDriveClear();
-        continue;
+        // Created new image file, use its name instead of the name of the command file
+        strncpy(name, imgname, MAX_FILE_PATH);
+        name[MAX_FILE_PATH] = '\0';
       }
-
-      // Special filename for creating new empty image files
-      if (strncasecmp(name, CREATEFILE, strlen(CREATEFILE)) == 0)
-      {
-        logmsg("-- Special filename: '", name, "'");
-        char imgname[MAX_FILE_PATH+1];
-        if (createImage(name, imgname))
-        {
-          // Created new image file, use its name instead of the name of the command file
-          strncpy(name, imgname, MAX_FILE_PATH);
-          name[MAX_FILE_PATH] = '\0';
-        }
-      }
-      bool use_prefix = false;
-      bool is_hd = (tolower(name[0]) == 'h' && tolower(name[1]) == 'd');
-      bool is_cd = (tolower(name[0]) == 'c' && tolower(name[1]) == 'd');
-      bool is_fd = (tolower(name[0]) == 'f' && tolower(name[1]) == 'd');
-      bool is_mo = (tolower(name[0]) == 'm' && tolower(name[1]) == 'o');
-      bool is_re = (tolower(name[0]) == 'r' && tolower(name[1]) == 'e');
-      bool is_tp = (tolower(name[0]) == 't' && tolower(name[1]) == 'p');
-      bool is_zp = (tolower(name[0]) == 'z' && tolower(name[1]) == 'p');
+    }
+    bool use_prefix = false;
+    bool is_hd = (tolower(name[0]) == 'h' && tolower(name[1]) == 'd');
+    bool is_cd = (tolower(name[0]) == 'c' && tolower(name[1]) == 'd');
+    bool is_fd = (tolower(name[0]) == 'f' && tolower(name[1]) == 'd');
+    bool is_mo = (tolower(name[0]) == 'm' && tolower(name[1]) == 'o');
+    bool is_re = (tolower(name[0]) == 'r' && tolower(name[1]) == 'e');
+    bool is_tp = (tolower(name[0]) == 't' && tolower(name[1]) == 'p');
+    bool is_zp = (tolower(name[0]) == 'z' && tolower(name[1]) == 'p');
 #ifdef ZULUSCSI_NETWORK
-      bool is_ne = (tolower(name[0]) == 'n' && tolower(name[1]) == 'e');
+    bool is_ne = (tolower(name[0]) == 'n' && tolower(name[1]) == 'e');
 #endif // ZULUSCSI_NETWORK
 
-      if (is_hd || is_cd || is_fd || is_mo || is_re || is_tp || is_zp
+    if (is_hd || is_cd || is_fd || is_mo || is_re || is_tp || is_zp
 #ifdef ZULUSCSI_NETWORK
-        || is_ne
+      || is_ne
 #endif // ZULUSCSI_NETWORK
-      )
+    )
+    {
+      // Check if the image should be loaded to microcontroller flash ROM drive
+      bool is_romdrive = false;
+      const char *extension = strrchr(name, '.');
+      if (extension && strcasecmp(extension, ".rom") == 0)
       {
-        // Check if the image should be loaded to microcontroller flash ROM drive
-        bool is_romdrive = false;
-        const char *extension = strrchr(name, '.');
-        if (extension && strcasecmp(extension, ".rom") == 0)
-        {
-          is_romdrive = true;
-        }
+        is_romdrive = true;
+      }
 
-        // skip file if the name indicates it is not a valid image container
-        if (!is_romdrive && !scsiDiskFilenameValid(name)) continue;
+      // skip file if the name indicates it is not a valid image container
+      if (!is_romdrive && !scsiDiskFilenameValid(name)) continue;
 
-        // Defaults for Hard Disks
-        int id  = 1; // 0 and 3 are common in Macs for physical HD and CD, so avoid them.
-        int lun = 0;
+      // Defaults for Hard Disks
+      int id  = 1; // 0 and 3 are common in Macs for physical HD and CD, so avoid them.
+      int lun = 0;
 
-        // Parse SCSI device ID
-        int file_name_length = strlen(name);
-        if(file_name_length > 2) { // HD[N]
-          int tmp_id = name[HDIMG_ID_POS] - '0';
+      // Parse SCSI device ID
+      int file_name_length = strlen(name);
+      if(file_name_length > 2) { // HD[N]
+        int tmp_id = name[HDIMG_ID_POS] - '0';
 
-          if(tmp_id > -1 && tmp_id < 8)
-          {
-            id = tmp_id; // If valid id, set it, else use default
-            use_prefix = true;
-          }
-          else
-          {
-            id = usedDefaultId++;
-          }
+        if(tmp_id > -1 && tmp_id < 8)
+        {
+          id = tmp_id; // If valid id, set it, else use default
+          use_prefix = true;
+        }
+        else
+        {
+          id = usedDefaultId++;
         }
+      }
 
-        // Parse SCSI LUN number
-        if(file_name_length > 3) { // HD0[N]
-          int tmp_lun = name[HDIMG_LUN_POS] - '0';
+      // Parse SCSI LUN number
+      if(file_name_length > 3) { // HD0[N]
+        int tmp_lun = name[HDIMG_LUN_POS] - '0';
 
-          if(tmp_lun > -1 && tmp_lun < NUM_SCSILUN) {
-            lun = tmp_lun; // If valid id, set it, else use default
-          }
+        if(tmp_lun > -1 && tmp_lun < NUM_SCSILUN) {
+          lun = tmp_lun; // If valid id, set it, else use default
         }
+      }
 
-        // Add the directory name to get the full file path
-        char fullname[MAX_FILE_PATH * 2 + 2] = {0};
-        strncpy(fullname, imgdir, MAX_FILE_PATH);
-        if (fullname[strlen(fullname) - 1] != '/') strcat(fullname, "/");
-        strcat(fullname, name);
+      // Add the directory name to get the full file path
+      char fullname[MAX_FILE_PATH * 2 + 2] = {0};
+      strncpy(fullname, imgdir, MAX_FILE_PATH);
+      if (fullname[strlen(fullname) - 1] != '/') strcat(fullname, "/");
+      strcat(fullname, name);
 
-        // Check whether this SCSI ID has been configured yet
-        if (s2s_getConfigById(id))
-        {
-          logmsg("-- Ignoring ", fullname, ", SCSI ID ", id, " is already in use!");
-          continue;
-        }
+      // Check whether this SCSI ID has been configured yet
+      if (s2s_getConfigById(id))
+      {
+        logmsg("-- Ignoring ", fullname, ", SCSI ID ", id, " is already in use!");
+        continue;
+      }
 
-        // set the default block size now that we know the device type
-        if (g_scsi_settings.getDevice(id)->blockSize == 0)
-        {
-          g_scsi_settings.getDevice(id)->blockSize = is_cd ?  DEFAULT_BLOCKSIZE_OPTICAL : DEFAULT_BLOCKSIZE;
-        }
-        int blk = getBlockSize(name, id);
+      // set the default block size now that we know the device type
+      if (g_scsi_settings.getDevice(id)->blockSize == 0)
+      {
+        g_scsi_settings.getDevice(id)->blockSize = is_cd ?  DEFAULT_BLOCKSIZE_OPTICAL : DEFAULT_BLOCKSIZE;
+      }
+      int blk = getBlockSize(name, id);
 
 #ifdef ZULUSCSI_NETWORK
-        if (is_ne && !platform_network_supported())
-        {
-          logmsg("-- Ignoring ", fullname, ", networking is not supported on this hardware");
-          continue;
-        }
+      if (is_ne && !platform_network_supported())
+      {
+        logmsg("-- Ignoring ", fullname, ", networking is not supported on this hardware");
+        continue;
+      }
 #endif // ZULUSCSI_NETWORK
-        // Type mapping based on filename.
-        // If type is FIXED, the type can still be overridden in .ini file.
-        S2S_CFG_TYPE type = S2S_CFG_FIXED;
-        if (is_cd) type = S2S_CFG_OPTICAL;
-        if (is_fd) type = S2S_CFG_FLOPPY_14MB;
-        if (is_mo) type = S2S_CFG_MO;
+      // Type mapping based on filename.
+      // If type is FIXED, the type can still be overridden in .ini file.
+      S2S_CFG_TYPE type = S2S_CFG_FIXED;
+      if (is_cd) type = S2S_CFG_OPTICAL;
+      if (is_fd) type = S2S_CFG_FLOPPY_14MB;
+      if (is_mo) type = S2S_CFG_MO;
 #ifdef ZULUSCSI_NETWORK
-        if (is_ne) type = S2S_CFG_NETWORK;
+      if (is_ne) type = S2S_CFG_NETWORK;
 #endif // ZULUSCSI_NETWORK
-        if (is_re) type = S2S_CFG_REMOVABLE;
-        if (is_tp) type = S2S_CFG_SEQUENTIAL;
-        if (is_zp) type = S2S_CFG_ZIP100;
+      if (is_re) type = S2S_CFG_REMOVABLE;
+      if (is_tp) type = S2S_CFG_SEQUENTIAL;
+      if (is_zp) type = S2S_CFG_ZIP100;
 
-        g_scsi_settings.initDevice(id & 7, type);
-        // Open the image file
-        if (id < NUM_SCSIID && is_romdrive)
+      g_scsi_settings.initDevice(id & 7, type);
+      // Open the image file
+      if (id < NUM_SCSIID && is_romdrive)
+      {
+        logmsg("-- Loading ROM drive from ", fullname, " for id:", id);
+        imageReady = scsiDiskProgramRomDrive(fullname, id, blk, type);
+        // Programming renames the image file to .rom_loaded
+        dirIndexInvalidateDir();
+        if (imageReady)
         {
-          logmsg("-- Loading ROM drive from ", fullname, " for id:", id);
-          imageReady = scsiDiskProgramRomDrive(fullname, id, blk, type);
-          if (imageReady)
-          {
-            foundImage = true;
-          }
+          foundImage = true;
         }
-        else if(id < NUM_SCSIID && lun < NUM_SCSILUN) {
-          logmsg("-- Opening ", fullname, " for id:", id, " lun:", lun);
+      }
+      else if(id < NUM_SCSIID && lun < NUM_SCSILUN) {
+        logmsg("-- Opening ", fullname, " for id:", id, " lun:", lun);
 
-          if (g_scsi_settings.getDevicePreset(id) != DEV_PRESET_NONE)
-          {
-              logmsg("---- Using device preset: ", g_scsi_settings.getDevicePresetName(id));
-          }
+        if (g_scsi_settings.getDevicePreset(id) != DEV_PRESET_NONE)
+        {
+            logmsg("---- Using device preset: ", g_scsi_settings.getDevicePresetName(id));
+        }
 
-          imageReady = scsiDiskOpenHDDImage(id, fullname, lun, blk, type, use_prefix);
-          if(imageReady)
-          {
-            foundImage = true;
-          }
-          else
-          {
-            logmsg("---- Failed to load image");
-          }
-        } else {
-          logmsg("-- Invalid lun or id for image ", fullname);
+        imageReady = scsiDiskOpenHDDImage(id, fullname, lun, blk, type, use_prefix);
+        if(imageReady)
+        {
+          foundImage = true;
         }
+        else
+        {
+          logmsg("---- Failed to load image");
+        }
+      } else {
+        logmsg("-- Invalid lun or id for image ", fullname);
       }
     }
   }
@@ -549,6 +571,7 @@ bool findHDDImages()
     logmsg("Some images did not specify a SCSI ID. Last file will be used at ID ", usedDefaultId);
   }
   root.close();
+  dirIndexEnd();
 
   g_romdrive_active = scsiDiskActivateRomDrive();
 
@@ -657,7 +680,9 @@ static bool mountSDCard()
   // When switching between FAT and exFAT cards the pointers
   // are invalidated and accessing old files results in crash.
   invalidate_ini_cache();
+  toolboxInvalidateIndex();
   g_logfile.close();
+  scsiTraceClose();
   scsiDiskCloseSDCardImages();
 
   // Check for the common case, FAT filesystem as first partition
@@ -889,6 +914,8 @@ extern "C" void zuluscsi_setup(void)
   {
     check_mass_storage = false;
     
+    zuluscsi_msc_init_luns();
+
     // perform checks to see if a computer is attached and return true if we should enter MSC mode.
     if (platform_sense_msc())
     {
@@ -899,6 +926,8 @@ extern "C" void zuluscsi_setup(void)
   }
 #endif
 
+  sdWorkerInit();
+
   logmsg("Initialization complete!");
 }
 
@@ -906,6 +935,8 @@ extern "C" void zuluscsi_main_loop(void)
 {
   static uint32_t sd_card_check_time = 0;
   static uint32_t last_request_time = 0;
+  static uint32_t last_log_save_time = 0;
+  static uint8_t last_cmd_count = 0;
 
   platform_reset_watchdog();
   platform_poll();
@@ -926,19 +957,32 @@ extern "C" void zuluscsi_main_loop(void)
   {
     scsiPoll();
     scsiDiskPoll();
+    tapePoll();
+    cdromPoll();
     scsiLogPhaseChange(scsiDev.phase);
+    scsiTraceSave();
 
-    // Save log periodically during status phase if there are new messages.
-    // In debug mode, also save every 2 seconds if no SCSI requests come in.
-    // SD card writing takes a while, during which the code can't handle new
-    // SCSI requests, so normally we only want to save during a phase where
-    // the host is waiting for us. But for debugging issues where no requests
-    // come through or a request hangs, it's useful to force saving of log.
-    if (scsiDev.phase == STATUS || (g_log_debug && (uint32_t)(millis() - last_request_time) > 2000))
+    if (scsiDev.phase != BUS_FREE || scsiDev.cmdCount != last_cmd_count)
     {
-      save_logfile();
+      last_cmd_count = scsiDev.cmdCount;
       last_request_time = millis();
     }
+
+    // SD card writing takes a while, during which the code can't handle new
+    // SCSI requests. Normally the log is saved only after the bus has been
+    // idle for LogSaveIdleMs, so that a waiting host is not delayed.
+    // If messages come in faster than that, save during status phase before
+    // the log buffer overflows. For debugging issues where a request hangs,
+    // debug mode also forces saving every 2 seconds.
+    bool bus_idle = scsiDev.phase == BUS_FREE &&
+        (uint32_t)(millis() - last_request_time) >= g_scsi_settings.getSystem()->logSaveIdleMs;
+    if (bus_idle ||
+        (scsiDev.phase == STATUS && log_buffer_filling()) ||
+        (g_log_debug && (uint32_t)(millis() - last_log_save_time) > 2000))
+    {
+      save_logfile(!bus_idle);
+      last_log_save_time = millis();
+    }
   }
 
   if (g_sdcard_present)
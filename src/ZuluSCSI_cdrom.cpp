@@ -33,6 +33,7 @@
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_settings.h"
 #include <CUEParser.h>
+#include <CDECC.h>
 #include <assert.h>
 #include <minIni.h>
 #ifdef ENABLE_AUDIO_OUTPUT
@@ -45,6 +46,188 @@ extern "C" {
 
 static const uint16_t AUDIO_CD_SECTOR_LEN = 2352;
 
+/******************************************/
+/* Track files of multi-file cue sheets   */
+/******************************************/
+
+// The first FILE in the cue sheet is the image file itself.
+// Any further files are opened when the image is loaded and kept open,
+// so that accessing another track does not need a file open or FAT walk.
+struct cdrom_trackfile_t
+{
+    image_config_t *owner; // NULL if entry is free
+    int file_index;
+    uint64_t size; // Size of data, after decoding for audio files
+    bool contiguous;
+    uint32_t begin;
+    uint32_t end;
+    FsFile file;
+};
+
+static cdrom_trackfile_t g_cdrom_trackfiles[CDROM_MAX_TRACK_FILES];
+
+// Backing stores used for accessing the track files.
+// Audio playback has its own, as it continues in the background.
+struct cdrom_trackstore_t
+{
+    cdrom_trackfile_t *source;
+    ImageBackingStore store;
+};
+
+static cdrom_trackstore_t g_cdrom_readstore;
+static cdrom_trackstore_t g_cdrom_audiostore;
+
+#ifdef ENABLE_AUDIO_OUTPUT
+// Playback that continues in the next track file once the current one ends
+static image_config_t *g_audio_next_img;
+static uint32_t g_audio_next_lba;
+static uint32_t g_audio_next_length;
+static uint64_t g_audio_segment_end;
+
+// LBA that corresponds to the start of the file being played
+static uint32_t g_audio_lba_base;
+#endif
+
+static cdrom_trackfile_t *findTrackFile(image_config_t &img, int file_index)
+{
+    for (int i = 0; i < CDROM_MAX_TRACK_FILES; i++)
+    {
+        if (g_cdrom_trackfiles[i].owner == &img && g_cdrom_trackfiles[i].file_index == file_index)
+        {
+            return &g_cdrom_trackfiles[i];
+        }
+    }
+    return NULL;
+}
+
+void cdromCloseTrackFiles(image_config_t &img)
+{
+#ifdef ENABLE_AUDIO_OUTPUT
+    if (g_cdrom_audiostore.source && g_cdrom_audiostore.source->owner == &img)
+    {
+        audio_stop(img.scsiId & 7);
+    }
+
+    if (g_audio_next_img == &img)
+    {
+        g_audio_next_img = NULL;
+    }
+#endif
+
+    for (int i = 0; i < CDROM_MAX_TRACK_FILES; i++)
+    {
+        cdrom_trackfile_t &tf = g_cdrom_trackfiles[i];
+        if (tf.owner != &img) continue;
+
+        if (g_cdrom_readstore.source == &tf)
+        {
+            g_cdrom_readstore.source = NULL;
+            g_cdrom_readstore.store = ImageBackingStore();
+        }
+
+        if (g_cdrom_audiostore.source == &tf)
+        {
+            g_cdrom_audiostore.source = NULL;
+            g_cdrom_audiostore.store = ImageBackingStore();
+        }
+
+        tf.file.close();
+        tf.owner = NULL;
+    }
+}
+
+// Open a file referenced from the cue sheet, relative to the image directory
+static bool openTrackFile(image_config_t &img, const char *imagepath, const CUETrackInfo *track)
+{
+    char path[MAX_FILE_PATH + 1];
+    const char *slash = strrchr(imagepath, '/');
+    size_t dirlen = slash ? (slash - imagepath + 1) : 0;
+    if (dirlen + strlen(track->filename) > MAX_FILE_PATH)
+    {
+        logmsg("---- Track file path is too long: ", track->filename);
+        return false;
+    }
+    memcpy(path, imagepath, dirlen);
+    strcpy(path + dirlen, track->filename);
+
+    cdrom_trackfile_t *tf = NULL;
+    for (int i = 0; i < CDROM_MAX_TRACK_FILES; i++)
+    {
+        if (!g_cdrom_trackfiles[i].owner)
+        {
+            tf = &g_cdrom_trackfiles[i];
+            break;
+        }
+    }
+
+    if (!tf)
+    {
+        logmsg("---- Too many files in cue sheets, maximum is ", (int)CDROM_MAX_TRACK_FILES);
+        return false;
+    }
+
+    tf->file = SD.open(path, O_RDONLY);
+    if (!tf->file.isOpen())
+    {
+        logmsg("---- Could not open track file ", path);
+        return false;
+    }
+
+    tf->contiguous = tf->file.contiguousRange(&tf->begin, &tf->end);
+
+    ImageBackingStore store(tf->file, path, img.bytesPerSector, tf->contiguous, tf->begin, tf->end);
+    if (!store.isOpen())
+    {
+        tf->file.close();
+        return false;
+    }
+
+    tf->size = store.size();
+    tf->file_index = track->file_index;
+    tf->owner = &img;
+    dbgmsg("---- Opened track file ", path, ", size ", (int)tf->size,
+           tf->contiguous ? ", contiguous" : ", fragmented");
+    return true;
+}
+
+// Get backing store for accessing the file that contains the track.
+// Returns NULL if the file is not open.
+static ImageBackingStore *getTrackFile(image_config_t &img, const CUETrackInfo &track, cdrom_trackstore_t &ts)
+{
+    if (track.file_index == 0)
+    {
+        return &img.file;
+    }
+
+    cdrom_trackfile_t *tf = findTrackFile(img, track.file_index);
+    if (!tf)
+    {
+        return NULL;
+    }
+
+    if (ts.source != tf)
+    {
+        ts.store = ImageBackingStore(tf->file, track.filename, img.bytesPerSector,
+                                     tf->contiguous, tf->begin, tf->end);
+        ts.source = tf;
+    }
+
+    return &ts.store;
+}
+
+// Callback for CUEParser to find where each file starts on the disc
+static uint64_t getCueFileSize(void *context, int file_index, const char *filename)
+{
+    image_config_t *img = (image_config_t*)context;
+    if (file_index == 0)
+    {
+        return img->file.size();
+    }
+
+    cdrom_trackfile_t *tf = findTrackFile(*img, file_index);
+    return tf ? tf->size : 0;
+}
+
 /******************************************/
 /* Basic TOC generation without cue sheet */
 /******************************************/
@@ -269,7 +452,8 @@ static uint32_t getLeadOutLBA(const CUETrackInfo* lasttrack)
     if (lasttrack != nullptr && lasttrack->track_number != 0)
     {
         image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-        uint32_t lastTrackBlocks = (img.file.size() - lasttrack->file_offset)
+        uint64_t filesize = getCueFileSize(&img, lasttrack->file_index, lasttrack->filename);
+        uint32_t lastTrackBlocks = (filesize - lasttrack->file_offset)
                 / lasttrack->sector_length;
         return lasttrack->track_start + lastTrackBlocks;
     }
@@ -541,6 +725,7 @@ static bool loadCueSheet(image_config_t &img, CUEParser &parser)
 
     cuebuf[len] = '\0';
     parser = CUEParser(cuebuf);
+    parser.set_file_size_callback(getCueFileSize, &img);
     return true;
 }
 
@@ -1117,8 +1302,10 @@ void doGetConfiguration(uint8_t rt, uint16_t startFeature, uint16_t allocationLe
 /* CUE sheet check at image load time   */
 /****************************************/
 
-bool cdromValidateCueSheet(image_config_t &img)
+bool cdromValidateCueSheet(image_config_t &img, const char *imagepath)
 {
+    cdromCloseTrackFiles(img);
+
     CUEParser parser;
     if (!loadCueSheet(img, parser))
     {
@@ -1127,10 +1314,22 @@ bool cdromValidateCueSheet(image_config_t &img)
 
     const CUETrackInfo *trackinfo;
     int trackcount = 0;
+    int filecount = 1;
     while ((trackinfo = parser.next_track()) != NULL)
     {
         trackcount++;
 
+        if (trackinfo->file_index > 0 && !findTrackFile(img, trackinfo->file_index))
+        {
+            // Open the file now, the parser needs its size when it reaches the next file
+            if (!openTrackFile(img, imagepath, trackinfo))
+            {
+                cdromCloseTrackFiles(img);
+                return false;
+            }
+            filecount++;
+        }
+
         if (trackinfo->track_mode != CUETrack_AUDIO &&
             trackinfo->track_mode != CUETrack_MODE1_2048 &&
             trackinfo->track_mode != CUETrack_MODE1_2352)
@@ -1138,7 +1337,15 @@ bool cdromValidateCueSheet(image_config_t &img)
             logmsg("---- Warning: track ", trackinfo->track_number, " has unsupported mode ", (int)trackinfo->track_mode);
         }
 
-        if (trackinfo->file_mode != CUEFile_BINARY)
+        if (trackinfo->file_mode == CUEFile_WAVE || trackinfo->file_mode == CUEFile_FLAC)
+        {
+            // Audio files are decoded by the image backing store
+            if (trackinfo->track_mode != CUETrack_AUDIO)
+            {
+                logmsg("---- Warning: track ", trackinfo->track_number, " is a data track in an audio file");
+            }
+        }
+        else if (trackinfo->file_mode != CUEFile_BINARY)
         {
             logmsg("---- Unsupported CUE data file mode ", (int)trackinfo->file_mode);
         }
@@ -1147,10 +1354,18 @@ bool cdromValidateCueSheet(image_config_t &img)
     if (trackcount == 0)
     {
         logmsg("---- Opened cue sheet but no valid tracks found");
+        cdromCloseTrackFiles(img);
         return false;
     }
 
-    logmsg("---- Cue sheet loaded with ", (int)trackcount, " tracks");
+    if (filecount > 1)
+    {
+        logmsg("---- Cue sheet loaded with ", (int)trackcount, " tracks in ", filecount, " files");
+    }
+    else
+    {
+        logmsg("---- Cue sheet loaded with ", (int)trackcount, " tracks");
+    }
     return true;
 }
 
@@ -1278,30 +1493,92 @@ void cdromGetAudioPlaybackStatus(uint8_t *status, uint32_t *current_lba, bool cu
             *status = (uint8_t) audio_get_status_code(target);
         }
     }
-    *current_lba = audio_get_file_position() / 2352;
+    *current_lba = g_audio_lba_base + audio_get_file_position() / AUDIO_CD_SECTOR_LEN;
 #else
     if (status) *status = 0; // audio status code for 'unsupported/invalid' and not-playing indicator
 #endif
     
 }
 
+#ifdef ENABLE_AUDIO_OUTPUT
+// Start playback from the file containing the track.
+// If the range continues past the end of the file, the rest is played
+// from the next file by cdromPoll().
+static bool startAudioPlayback(image_config_t &img, const CUETrackInfo &trackinfo, uint32_t lba, uint32_t length)
+{
+    ImageBackingStore *file = getTrackFile(img, trackinfo, g_cdrom_audiostore);
+    if (!file)
+    {
+        logmsg("ERROR: Track file for track ", trackinfo.track_number, " is not open");
+        return false;
+    }
+
+    uint64_t offset = trackinfo.file_offset
+            + trackinfo.sector_length * (lba - trackinfo.track_start);
+    uint64_t end = offset + length * trackinfo.sector_length;
+
+    g_audio_next_img = NULL;
+    if (end > file->size() && findTrackFile(img, trackinfo.file_index + 1))
+    {
+        uint32_t sectors = (file->size() - offset) / trackinfo.sector_length;
+        g_audio_next_img = &img;
+        g_audio_next_lba = lba + sectors;
+        g_audio_next_length = length - sectors;
+        end = offset + sectors * trackinfo.sector_length;
+    }
+
+    g_audio_segment_end = end;
+    g_audio_lba_base = lba - offset / trackinfo.sector_length;
+    return audio_play(img.scsiId & 7, file, offset, end, false);
+}
+#endif
+
+void cdromPoll()
+{
+#ifdef ENABLE_AUDIO_OUTPUT
+    image_config_t *img = g_audio_next_img;
+    if (img && scsiDev.phase == BUS_FREE && !audio_is_playing(img->scsiId & 7))
+    {
+        g_audio_next_img = NULL;
+
+        if (audio_get_file_position() < g_audio_segment_end)
+        {
+            // Playback was stopped before reaching end of file
+            return;
+        }
+
+        CUEParser parser;
+        if (!loadCueSheet(*img, parser)) return;
+
+        CUETrackInfo trackinfo = {};
+        getTrackFromLBA(parser, g_audio_next_lba, &trackinfo);
+        if (trackinfo.track_mode != CUETrack_AUDIO) return;
+
+        dbgmsg("------ Continuing audio playback at ", (int)g_audio_next_lba,
+               " from track ", trackinfo.track_number);
+        startAudioPlayback(*img, trackinfo, g_audio_next_lba, g_audio_next_length);
+    }
+#endif
+}
+
 static void doPlayAudio(uint32_t lba, uint32_t length)
 {
 #ifdef ENABLE_AUDIO_OUTPUT
     dbgmsg("------ CD-ROM Play Audio request at ", lba, " for ", length, " sectors");
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    uint8_t target_id = img.scsiId & 7;
 
     // Per Annex C terminate playback immediately if already in progress on
     // the current target. Non-current targets may also get their audio
     // interrupted later due to hardware limitations
     audio_stop(img.scsiId & 7);
+    g_audio_next_img = NULL;
 
     // if transfer length is zero no audio playback happens.
     // don't treat as an error per SCSI-2; handle via short-circuit
 
     if (length == 0)
     {
+        g_audio_lba_base = 0;
         audio_set_file_position(lba);
         scsiDev.status = 0;
         scsiDev.phase = STATUS;
@@ -1318,7 +1595,7 @@ static void doPlayAudio(uint32_t lba, uint32_t length)
         if (lba == 0xFFFFFFFF)
         {
             // request to start playback from 'current position'
-            lba = audio_get_file_position() / AUDIO_CD_SECTOR_LEN;
+            lba = g_audio_lba_base + audio_get_file_position() / AUDIO_CD_SECTOR_LEN;
         }
 
         uint64_t offset = trackinfo.file_offset
@@ -1338,8 +1615,7 @@ static void doPlayAudio(uint32_t lba, uint32_t length)
 
         // playback request appears to be sane, so perform it
         // see earlier note for context on the block length below
-        if (!audio_play(target_id, &(img.file), offset,
-                offset + length * trackinfo.sector_length, false))
+        if (!startAudioPlayback(img, trackinfo, lba, length))
         {
             // Underlying data/media error? Fake a disk scratch, which should
             // be a condition most CD-DA players are expecting
@@ -1409,6 +1685,7 @@ static void doStopAudio()
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     uint8_t target_id = img.scsiId & 7;
     audio_stop(target_id);
+    g_audio_next_img = NULL;
 #endif
 }
 
@@ -1467,6 +1744,8 @@ static void doReadCD(uint32_t lba, uint32_t length, uint8_t sector_type,
 
     // Figure out the data offset in the file
     uint64_t offset;
+    ImageBackingStore *file = &img.file;
+    bool multifile = false;
     if (sector_type == SECTOR_TYPE_VENDOR_PLEXTOR &&
          g_scsi_settings.getDevice(img.scsiId & 0x7)->vendorExtensions & VENDOR_EXTENSION_OPTICAL_PLEXTOR)
     {
@@ -1505,13 +1784,41 @@ static void doReadCD(uint32_t lba, uint32_t length, uint8_t sector_type,
             ", track number ", trackinfo.track_number, ", sector size ", (int)trackinfo.sector_length,
             ", main channel ", main_channel, ", sub channel ", sub_channel,
             ", data offset in file ", (int)offset);
+
+        file = getTrackFile(img, trackinfo, g_cdrom_readstore);
+        if (!file)
+        {
+            logmsg("ERROR: Track file for track ", trackinfo.track_number, " is not open");
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = MEDIUM_ERROR;
+            scsiDev.target->sense.asc = 0x1106; // CIRC UNRECOVERED ERROR
+            scsiDev.phase = STATUS;
+            return;
+        }
+
+        // Check if the read continues past the end of the file into the next one
+        uint64_t readend = offset + trackinfo.sector_length * length;
+        if (readend > file->size())
+        {
+            const CUETrackInfo *tmptrack;
+            CUETrackInfo lasttrack = {};
+            parser.restart();
+            while ((tmptrack = parser.next_track()) != NULL)
+            {
+                lasttrack = *tmptrack;
+            }
+
+            multifile = (lasttrack.file_index != trackinfo.file_index &&
+                         lba + length <= getLeadOutLBA(&lasttrack));
+        }
     }
+
     // Ensure read is not out of range of the image
     uint64_t readend = offset + trackinfo.sector_length * length;
-    if (readend > img.file.size())
+    if (readend > file->size() && !multifile)
     {
         logmsg("WARNING: Host attempted CD read at sector ", lba, "+", length,
-              ", exceeding image size ", img.file.size());
+              ", exceeding image size ", file->size());
         scsiDev.status = CHECK_CONDITION;
         scsiDev.target->sense.code = ILLEGAL_REQUEST;
         scsiDev.target->sense.asc = LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
@@ -1576,10 +1883,10 @@ static void doReadCD(uint32_t lba, uint32_t length, uint8_t sector_type,
     }
     else if (trackinfo.track_mode == CUETrack_MODE1_2048 && (main_channel & 0xB8) == 0xB8)
     {
-        // Transfer 2048 bytes of data from file and fake the headers
+        // Transfer 2048 bytes of data from file and generate the headers, EDC and ECC
         sector_length = 2048;
         add_fake_headers = true;
-        dbgmsg("------ Host requested ECC data but image file lacks it, replacing with zeros");
+        dbgmsg("------ Host requested ECC data but image file lacks it, generating it");
     }
     else if (trackinfo.track_mode == CUETrack_MODE1_2352 && main_channel == 0x10)
     {
@@ -1638,13 +1945,40 @@ static void doReadCD(uint32_t lba, uint32_t length, uint8_t sector_type,
     uint8_t *buf0 = scsiDev.data;
     uint8_t *buf1 = scsiDev.data + result_length;
 
+    // Sector where reading moves to the next track file
+    uint32_t file_end_lba = 0xFFFFFFFF;
+    if (multifile)
+    {
+        file_end_lba = trackinfo.track_start
+            + (file->size() - trackinfo.file_offset) / trackinfo.sector_length;
+    }
+
     // Format the sectors for transfer
+    uint32_t file_idx = 0;
     for (uint32_t idx = 0; idx < length; idx++)
     {
         platform_poll();
         diskEjectButtonUpdate(false);
 
-        img.file.seek(offset + idx * trackinfo.sector_length + skip_begin);
+        if (lba + idx >= file_end_lba)
+        {
+            // Continue from the start of the next file
+            parser.restart();
+            getTrackFromLBA(parser, lba + idx, &trackinfo);
+            file = getTrackFile(img, trackinfo, g_cdrom_readstore);
+            if (!file)
+            {
+                logmsg("ERROR: Track file for track ", trackinfo.track_number, " is not open");
+                break;
+            }
+
+            offset = trackinfo.file_offset + trackinfo.sector_length * (lba + idx - trackinfo.track_start);
+            file_end_lba = trackinfo.track_start
+                + (file->size() - trackinfo.file_offset) / trackinfo.sector_length;
+            file_idx = idx;
+        }
+
+        file->seek(offset + (idx - file_idx) * trackinfo.sector_length + skip_begin);
 
         // Verify that previous write using this buffer has finished
         uint8_t *buf = ((idx & 1) ? buf1 : buf0);
@@ -1666,7 +2000,7 @@ static void doReadCD(uint32_t lba, uint32_t length, uint8_t sector_type,
             if (sector_length > 0)
             {
                 // User data
-                img.file.read(buf, sector_length);
+                file->read(buf, sector_length);
                 buf += sector_length;
             }
         }
@@ -1691,14 +2025,15 @@ static void doReadCD(uint32_t lba, uint32_t length, uint8_t sector_type,
             if (sector_length > 0)
             {
                 // User data
-                img.file.read(buf, sector_length);
+                file->read(buf, sector_length);
                 buf += sector_length;
             }
 
             if (add_fake_headers)
             {
-                // 288 bytes of ECC
-                memset(buf, 0, 288);
+                // 4 bytes of EDC, 8 bytes of zero and 276 bytes of ECC
+                // This runs while the previous sector is being transferred.
+                cdecc_encode_mode1(bufstart);
                 buf += 288;
             }
 
@@ -2075,7 +2410,7 @@ extern "C" int scsiCDRomCommand()
         {
             // request to start playback from 'current position'
 #ifdef ENABLE_AUDIO_OUTPUT
-            lba = audio_get_file_position() / AUDIO_CD_SECTOR_LEN;
+            lba = g_audio_lba_base + audio_get_file_position() / AUDIO_CD_SECTOR_LEN;
 #endif
         }
 
@@ -22,8 +22,16 @@ void cdromPerformEject(image_config_t &img);
 void cdromReinsertFirstImage(image_config_t &img);
 
 // Check if the currently loaded cue sheet for the image can be parsed
-// and print warnings about unsupported track types
-bool cdromValidateCueSheet(image_config_t &img);
+// and print warnings about unsupported track types.
+// Opens any other files referenced from the cue sheet, from the same
+// directory as the image.
+bool cdromValidateCueSheet(image_config_t &img, const char *imagepath);
+
+// Close the track files opened by cdromValidateCueSheet()
+void cdromCloseTrackFiles(image_config_t &img);
+
+// Continue audio playback in the next track file, called from main loop
+void cdromPoll();
 
 // Audio playback status
 // boolean flag is true if just basic mechanism status (playback true/false)
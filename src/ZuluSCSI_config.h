@@ -38,6 +38,9 @@
 #define CONFIGFILE  "zuluscsi.ini"
 #define LOGFILE     "zululog.txt"
 #define CRASHFILE   "zuluerr.txt"
+#define TRACEFILE   "zulutrace.bin"
+#define INDEXFILE   "zuluidx.bin"
+#define SETTINGSCACHEFILE "zulucfg.bin"
 
 // Prefix for command file to create new image (case-insensitive)
 #define CREATEFILE "create"
@@ -48,6 +51,42 @@
 #endif
 #define LOG_SAVE_INTERVAL_MS 1000
 
+// Log is written to SD card after the bus has been idle for this time
+#ifndef LOG_SAVE_IDLE_MS
+#define LOG_SAVE_IDLE_MS 100
+#endif
+
+// Size of contiguous space reserved for log file at boot, 0 to disable
+#ifndef LOG_PREALLOCATE_SIZE
+#define LOG_PREALLOCATE_SIZE (1024 * 1024)
+#endif
+
+// Binary trace ring buffer, number of entries must be a power of two.
+// Each entry takes 12 bytes of RAM, 0 leaves the binary trace out of the build.
+#ifndef TRACE_RING_ENTRIES
+#define TRACE_RING_ENTRIES 512
+#endif
+
+// Boot-time image directory index, see ZuluSCSI_dirindex.h
+#ifndef DIRINDEX_MAX_DIRS
+#define DIRINDEX_MAX_DIRS 10
+#endif
+#ifndef DIRINDEX_MAX_FILES
+#define DIRINDEX_MAX_FILES 32
+#endif
+
+// Toolbox directory index, 4 bytes of RAM per file.
+// Files beyond the index are still listed, but found by scanning the directory.
+#ifndef TOOLBOX_INDEX_MAX_FILES
+#define TOOLBOX_INDEX_MAX_FILES 2048
+#endif
+
+// Files referenced from CD-ROM cue sheets in addition to the image itself.
+// Shared between all CD-ROM drives, each entry takes about 80 bytes of RAM.
+#ifndef CDROM_MAX_TRACK_FILES
+#define CDROM_MAX_TRACK_FILES 32
+#endif
+
 // Watchdog timeout
 // Watchdog will first issue a bus reset and if that does not help, crashdump.
 #define WATCHDOG_BUS_RESET_TIMEOUT 15000
@@ -115,6 +154,23 @@
 #define PREFETCH_BUFFER_SIZE 8192
 #endif
 
+// Tape read-ahead and write-behind buffer, shared by all tape targets.
+// Multiple of SD sector size, platforms with less RAM use a smaller buffer.
+#ifndef TAPE_STREAM_BUFFER_SIZE
+#define TAPE_STREAM_BUFFER_SIZE 16384
+#endif
+
+// Number of .tap tape images that keep their position index in RAM, about 4 kB each.
+// With more tape drives the index of the least recently used one is rebuilt on access.
+#ifndef TAPE_INDEX_SLOTS
+#define TAPE_INDEX_SLOTS 2
+#endif
+
+// Buffered tape writes are stored on SD card after this idle time
+#ifndef TAPE_WRITE_BEHIND_IDLE_MS
+#define TAPE_WRITE_BEHIND_IDLE_MS 250
+#endif
+
 // Masks for buttons
 #define EJECT_BTN_MASK (1|2)
 #define USER_BTN_MASK  (4)
@@ -0,0 +1,503 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2024 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_dirindex.h"
+#include "ZuluSCSI_config.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_settings.h"
+#include <SdFat.h>
+#include <crc32.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+extern SdFs SD;
+
+#define DIRINDEX_MAGIC 0x5844495A // "ZIDX"
+#define DIRINDEX_VERSION 1
+
+#define DIRINDEX_FLAG_RANGE_KNOWN 1
+#define DIRINDEX_FLAG_CONTIGUOUS  2
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t dir_count;
+    uint8_t file_count;
+    uint32_t sector_count; // Identifies the SD card together with cluster_count
+    uint32_t cluster_count;
+    uint32_t crc; // CRC of the directory and file tables
+} dirindex_header_t;
+
+typedef struct {
+    char path[MAX_FILE_PATH];
+    uint32_t hash;
+    uint8_t first_file;
+    uint8_t file_count;
+    bool rescan; // Directory changed during scan, don't save
+    bool scanned; // Hash must be computed before saving
+} dirindex_dir_t;
+
+typedef struct {
+    char name[MAX_FILE_PATH + 1];
+    uint8_t flags;
+    uint64_t size;
+    uint32_t begin;
+    uint32_t end;
+} dirindex_file_t;
+
+static struct {
+    bool active;
+    bool dirty;
+    int cur_dir; // Index to dirs[] or -1 if directory is not cached
+    int cur_pos; // Next file in cached list
+    bool cur_cached;
+    dirindex_header_t hdr;
+    dirindex_dir_t dirs[DIRINDEX_MAX_DIRS];
+    dirindex_file_t files[DIRINDEX_MAX_FILES];
+} g_dirindex;
+
+// Only files with these prefixes can be images, must match findHDDImages()
+static bool isCandidateName(const char *name)
+{
+    static const char prefixes[][3] = {"hd", "cd", "fd", "mo", "re", "tp", "zp", "ne"};
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+    {
+        if (strncasecmp(name, prefixes[i], 2) == 0) return true;
+    }
+
+    return strcasecmp(name, "CLEAR_ROM") == 0 ||
+           strncasecmp(name, CREATEFILE, strlen(CREATEFILE)) == 0;
+}
+
+// Files written by firmware itself (log, trace, index) start with "zu"
+// and are left out of the hash so that it stays the same between boots.
+static bool isFirmwareFile(uint8_t c1, uint8_t c2)
+{
+    return toupper(c1) == 'Z' && toupper(c2) == 'U';
+}
+
+// Compute hash of the raw directory entries.
+// Unused entries and firmware files are skipped.
+static bool hashDirectory(const char *path, uint32_t *hash)
+{
+    FsFile dir = SD.open(path, O_RDONLY);
+    if (!dir.isOpen() || !dir.isDir())
+    {
+        return false;
+    }
+
+    bool exfat = (SD.fatType() == FAT_TYPE_EXFAT);
+    uint32_t result = 0;
+    uint32_t group = 0; // Hash of the entries belonging to one file
+    int remaining = 0; // exFAT secondary entries left in current set
+    bool skip = false;
+    bool have_name = false;
+    uint8_t e[32];
+
+    while (dir.read(e, sizeof(e)) == sizeof(e))
+    {
+        if (e[0] == 0x00)
+        {
+            // End of directory
+            break;
+        }
+
+        if (!exfat)
+        {
+            if (e[0] == 0xE5)
+            {
+                // Deleted entry, also discards preceding long name entries
+                group = 0;
+                continue;
+            }
+
+            group = crc32_update(group, e, sizeof(e));
+            if ((e[11] & 0x3F) == 0x0F)
+            {
+                // Long file name entry, followed by the short name entry
+                continue;
+            }
+
+            if (!isFirmwareFile(e[0], e[1]))
+            {
+                result = crc32_update(result, &group, sizeof(group));
+            }
+            group = 0;
+        }
+        else
+        {
+            if (!(e[0] & 0x80))
+            {
+                // Unused entry
+                remaining = 0;
+                continue;
+            }
+
+            if (e[0] == 0x85)
+            {
+                // File directory entry, followed by stream and name entries
+                group = crc32_update(0, e, sizeof(e));
+                remaining = e[1];
+                skip = false;
+                have_name = false;
+            }
+            else if (remaining > 0)
+            {
+                group = crc32_update(group, e, sizeof(e));
+                remaining--;
+
+                if (e[0] == 0xC1 && !have_name)
+                {
+                    // First file name entry, UTF-16 characters start at offset 2
+                    skip = isFirmwareFile(e[2], e[4]);
+                    have_name = true;
+                }
+            }
+            else
+            {
+                // Volume label, allocation bitmap and other primary entries
+                result = crc32_update(result, e, sizeof(e));
+                continue;
+            }
+
+            if (remaining == 0 && !skip)
+            {
+                result = crc32_update(result, &group, sizeof(group));
+            }
+        }
+    }
+
+    *hash = result;
+    return true;
+}
+
+static bool pathEqual(const char *a, size_t alen, const char *b, size_t blen)
+{
+    // Ignore trailing slashes
+    while (alen > 0 && a[alen - 1] == '/') alen--;
+    while (blen > 0 && b[blen - 1] == '/') blen--;
+    return alen == blen && strncmp(a, b, alen) == 0;
+}
+
+static int findDir(const char *path, size_t len)
+{
+    for (int i = 0; i < g_dirindex.hdr.dir_count; i++)
+    {
+        const char *p = g_dirindex.dirs[i].path;
+        if (pathEqual(p, strlen(p), path, len))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static dirindex_file_t *findFile(const char *filename)
+{
+    if (!g_dirindex.active) return nullptr;
+
+    const char *sep = strrchr(filename, '/');
+    const char *name = sep ? sep + 1 : filename;
+    int d = findDir(filename, sep ? sep - filename : 0);
+    if (d < 0) return nullptr;
+
+    dirindex_dir_t *dir = &g_dirindex.dirs[d];
+    for (int i = dir->first_file; i < dir->first_file + dir->file_count; i++)
+    {
+        if (strcmp(g_dirindex.files[i].name, name) == 0)
+        {
+            return &g_dirindex.files[i];
+        }
+    }
+
+    return nullptr;
+}
+
+// Remove directory and its files from the tables
+static void removeDir(int d)
+{
+    dirindex_dir_t *dir = &g_dirindex.dirs[d];
+    int first = dir->first_file;
+    int count = dir->file_count;
+    int total = g_dirindex.hdr.file_count;
+
+    memmove(&g_dirindex.files[first], &g_dirindex.files[first + count],
+            (total - first - count) * sizeof(dirindex_file_t));
+    g_dirindex.hdr.file_count -= count;
+
+    for (int i = 0; i < g_dirindex.hdr.dir_count; i++)
+    {
+        if (g_dirindex.dirs[i].first_file > first)
+        {
+            g_dirindex.dirs[i].first_file -= count;
+        }
+    }
+
+    memmove(&g_dirindex.dirs[d], &g_dirindex.dirs[d + 1],
+            (g_dirindex.hdr.dir_count - d - 1) * sizeof(dirindex_dir_t));
+    g_dirindex.hdr.dir_count--;
+}
+
+static uint32_t tableCrc()
+{
+    uint32_t crc = crc32(g_dirindex.dirs, g_dirindex.hdr.dir_count * sizeof(dirindex_dir_t));
+    return crc32_update(crc, g_dirindex.files, g_dirindex.hdr.file_count * sizeof(dirindex_file_t));
+}
+
+void dirIndexBegin()
+{
+    memset(&g_dirindex, 0, sizeof(g_dirindex));
+    g_dirindex.cur_dir = -1;
+
+    if (!g_scsi_settings.getSystem()->enableDirIndex)
+    {
+        return;
+    }
+
+    g_dirindex.active = true;
+    g_dirindex.hdr.magic = DIRINDEX_MAGIC;
+    g_dirindex.hdr.version = DIRINDEX_VERSION;
+    g_dirindex.hdr.sector_count = SD.card()->sectorCount();
+    g_dirindex.hdr.cluster_count = SD.clusterCount();
+
+    FsFile file = SD.open(INDEXFILE, O_RDONLY);
+    if (!file.isOpen())
+    {
+        g_dirindex.dirty = true;
+        return;
+    }
+
+    dirindex_header_t hdr;
+    bool ok = (file.read(&hdr, sizeof(hdr)) == sizeof(hdr) &&
+               hdr.magic == DIRINDEX_MAGIC &&
+               hdr.version == DIRINDEX_VERSION &&
+               hdr.sector_count == g_dirindex.hdr.sector_count &&
+               hdr.cluster_count == g_dirindex.hdr.cluster_count &&
+               hdr.dir_count <= DIRINDEX_MAX_DIRS &&
+               hdr.file_count <= DIRINDEX_MAX_FILES);
+
+    if (ok)
+    {
+        size_t dirbytes = hdr.dir_count * sizeof(dirindex_dir_t);
+        size_t filebytes = hdr.file_count * sizeof(dirindex_file_t);
+        g_dirindex.hdr.dir_count = hdr.dir_count;
+        g_dirindex.hdr.file_count = hdr.file_count;
+        ok = (file.read(g_dirindex.dirs, dirbytes) == (int)dirbytes &&
+              file.read(g_dirindex.files, filebytes) == (int)filebytes &&
+              tableCrc() == hdr.crc);
+    }
+    file.close();
+
+    if (!ok)
+    {
+        logmsg("Directory index " INDEXFILE " is not valid for this SD card, rebuilding");
+        g_dirindex.hdr.dir_count = 0;
+        g_dirindex.hdr.file_count = 0;
+        g_dirindex.dirty = true;
+    }
+}
+
+void dirIndexOpenDir(const char *path, FsBaseFile &dir)
+{
+    g_dirindex.cur_dir = -1;
+    g_dirindex.cur_pos = 0;
+    g_dirindex.cur_cached = false;
+
+    if (!g_dirindex.active || !dir.isOpen())
+    {
+        return;
+    }
+
+    int d = findDir(path, strlen(path));
+    uint32_t hash;
+    if (d >= 0 && !g_dirindex.dirs[d].scanned && hashDirectory(path, &hash) && hash == g_dirindex.dirs[d].hash)
+    {
+        dbgmsg("---- Directory ", path, " unchanged, using cached file list");
+        g_dirindex.cur_dir = d;
+        g_dirindex.cur_pos = g_dirindex.dirs[d].first_file;
+        g_dirindex.cur_cached = true;
+        return;
+    }
+
+    // Directory has changed, scan it again
+    if (d >= 0)
+    {
+        removeDir(d);
+    }
+
+    g_dirindex.dirty = true;
+    if (g_dirindex.hdr.dir_count < DIRINDEX_MAX_DIRS && strlen(path) < MAX_FILE_PATH)
+    {
+        d = g_dirindex.hdr.dir_count++;
+        dirindex_dir_t *entry = &g_dirindex.dirs[d];
+        memset(entry, 0, sizeof(*entry));
+        strncpy(entry->path, path, MAX_FILE_PATH - 1);
+        entry->first_file = g_dirindex.hdr.file_count;
+        entry->scanned = true;
+        g_dirindex.cur_dir = d;
+    }
+}
+
+bool dirIndexNextFile(FsBaseFile &dir, char *name, size_t namelen)
+{
+    if (g_dirindex.cur_cached)
+    {
+        dirindex_dir_t *entry = &g_dirindex.dirs[g_dirindex.cur_dir];
+        if (g_dirindex.cur_pos >= entry->first_file + entry->file_count)
+        {
+            return false;
+        }
+
+        strncpy(name, g_dirindex.files[g_dirindex.cur_pos++].name, namelen - 1);
+        name[namelen - 1] = '\0';
+        return true;
+    }
+
+    SdFile file;
+    while (file.openNext(&dir, O_READ))
+    {
+        if (file.isDir())
+        {
+            file.close();
+            continue;
+        }
+
+        file.getName(name, namelen);
+        file.close();
+
+        if (!isCandidateName(name))
+        {
+            continue;
+        }
+
+        if (g_dirindex.cur_dir >= 0)
+        {
+            // Record the file name, contiguity is filled in when the image is opened
+            dirindex_dir_t *entry = &g_dirindex.dirs[g_dirindex.cur_dir];
+            if (g_dirindex.hdr.file_count < DIRINDEX_MAX_FILES && strlen(name) <= MAX_FILE_PATH)
+            {
+                dirindex_file_t *f = &g_dirindex.files[g_dirindex.hdr.file_count++];
+                memset(f, 0, sizeof(*f));
+                strncpy(f->name, name, MAX_FILE_PATH);
+                entry->file_count++;
+            }
+            else
+            {
+                // Too many files to cache
+                entry->rescan = true;
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void dirIndexInvalidateDir()
+{
+    if (g_dirindex.cur_dir >= 0)
+    {
+        g_dirindex.dirs[g_dirindex.cur_dir].rescan = true;
+    }
+}
+
+bool dirIndexGetRange(const char *filename, uint64_t size, bool *contiguous, uint32_t *begin, uint32_t *end)
+{
+    dirindex_file_t *f = findFile(filename);
+    if (!f || !(f->flags & DIRINDEX_FLAG_RANGE_KNOWN) || f->size != size)
+    {
+        return false;
+    }
+
+    *contiguous = (f->flags & DIRINDEX_FLAG_CONTIGUOUS);
+    *begin = f->begin;
+    *end = f->end;
+    return true;
+}
+
+void dirIndexSetRange(const char *filename, uint64_t size, bool contiguous, uint32_t begin, uint32_t end)
+{
+    dirindex_file_t *f = findFile(filename);
+    if (!f) return;
+
+    uint8_t flags = DIRINDEX_FLAG_RANGE_KNOWN | (contiguous ? DIRINDEX_FLAG_CONTIGUOUS : 0);
+    if (!contiguous) begin = end = 0;
+    if (f->flags != flags || f->size != size || f->begin != begin || f->end != end)
+    {
+        f->flags = flags;
+        f->size = size;
+        f->begin = begin;
+        f->end = end;
+        g_dirindex.dirty = true;
+    }
+}
+
+void dirIndexEnd()
+{
+    if (!g_dirindex.active)
+    {
+        return;
+    }
+
+    // Lookups are only valid during the boot-time scan, files may change later.
+    g_dirindex.active = false;
+    g_dirindex.cur_cached = false;
+    g_dirindex.cur_dir = -1;
+
+    if (!g_dirindex.dirty)
+    {
+        return;
+    }
+
+    // Drop directories that must be scanned again on next boot,
+    // and hash the directories that were scanned now.
+    for (int i = g_dirindex.hdr.dir_count - 1; i >= 0; i--)
+    {
+        dirindex_dir_t *dir = &g_dirindex.dirs[i];
+        if (dir->rescan || (dir->scanned && !hashDirectory(dir->path, &dir->hash)))
+        {
+            removeDir(i);
+        }
+        else
+        {
+            dir->scanned = false;
+        }
+    }
+
+    g_dirindex.hdr.crc = tableCrc();
+
+    FsFile file = SD.open(INDEXFILE, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file.isOpen())
+    {
+        logmsg("Failed to write directory index " INDEXFILE);
+        return;
+    }
+
+    file.write(&g_dirindex.hdr, sizeof(g_dirindex.hdr));
+    file.write(g_dirindex.dirs, g_dirindex.hdr.dir_count * sizeof(dirindex_dir_t));
+    file.write(g_dirindex.files, g_dirindex.hdr.file_count * sizeof(dirindex_file_t));
+    file.attrib(FS_ATTRIB_HIDDEN);
+    file.close();
+    dbgmsg("Saved directory index with ", (int)g_dirindex.hdr.dir_count, " directories and ",
+           (int)g_dirindex.hdr.file_count, " files");
+}
@@ -0,0 +1,57 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2024 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Boot-time index of image directories, stored in INDEXFILE.
+//
+// For each directory it records the list of candidate image file names,
+// and for each image the file size and the result of the contiguity check.
+// The index is validated by hashing the raw directory entries, which
+// include the name, size, first cluster and modification time of every file.
+// Any change to the directory causes that directory to be scanned again.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Load index from SD card, called at start of findHDDImages().
+void dirIndexBegin();
+
+// Start listing directory, uses cached file list if directory is unchanged.
+class FsBaseFile;
+void dirIndexOpenDir(const char *path, FsBaseFile &dir);
+
+// Get next candidate image file name in the directory.
+// Returns false at the end of directory.
+bool dirIndexNextFile(FsBaseFile &dir, char *name, size_t namelen);
+
+// Current directory was modified during the scan and should not be cached.
+void dirIndexInvalidateDir();
+
+// Get cached result of contiguity check for the image file.
+// Returns false if the result is not known.
+bool dirIndexGetRange(const char *filename, uint64_t size, bool *contiguous, uint32_t *begin, uint32_t *end);
+
+// Store result of contiguity check for the image file.
+void dirIndexSetRange(const char *filename, uint64_t size, bool contiguous, uint32_t begin, uint32_t end);
+
+// Save index if it has changed, called at end of findHDDImages().
+void dirIndexEnd();
@@ -35,6 +35,8 @@
 #include "ZuluSCSI_audio.h"
 #endif
 #include "ZuluSCSI_cdrom.h"
+#include "ZuluSCSI_tape.h"
+#include "ZuluSCSI_sdworker.h"
 #include "ImageBackingStore.h"
 #include "ROMDrive.h"
 #include "QuirksCheck.h"
@@ -171,6 +173,7 @@ void scsiDiskResetImages()
 {
     for (int i = 0; i < S2S_MAX_TARGETS; i++)
     {
+        cdromCloseTrackFiles(g_DiskImages[i]);
         g_DiskImages[i].clear();
     }
 }
@@ -183,6 +186,8 @@ void image_config_t::clear()
 
 void scsiDiskCloseSDCardImages()
 {
+    tapeFlush();
+
     for (int i = 0; i < S2S_MAX_TARGETS; i++)
     {
         if (!g_DiskImages[i].file.isRom())
@@ -191,6 +196,7 @@ void scsiDiskCloseSDCardImages()
         }
 
         g_DiskImages[i].cuesheetfile.close();
+        cdromCloseTrackFiles(g_DiskImages[i]);
     }
 }
 
@@ -267,7 +273,9 @@ static void scsiDiskSetImageConfig(uint8_t target_idx)
 bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, int blocksize, S2S_CFG_TYPE type, bool use_prefix)
 {
     image_config_t &img = g_DiskImages[target_idx];
+    tapeFlush();
     img.cuesheetfile.close();
+    cdromCloseTrackFiles(img);
     scsiDiskSetImageConfig(target_idx);
     img.file = ImageBackingStore(filename, blocksize);
 
@@ -278,7 +286,10 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, in
         img.scsiId = target_idx | S2S_CFG_TARGET_ENABLED;
         img.sdSectorStart = 0;
 
-        if (type != S2S_CFG_NETWORK && img.scsiSectors == 0)
+        // Record structured tape images may start out empty
+        bool is_tap_image = (type == S2S_CFG_SEQUENTIAL && strlen(filename) > 4 &&
+                             strncasecmp(filename + strlen(filename) - 4, ".tap", 4) == 0);
+        if (type != S2S_CFG_NETWORK && !is_tap_image && img.scsiSectors == 0)
         {
             logmsg("---- Error: image file ", filename, " is empty");
             img.file.close();
@@ -385,18 +396,21 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, in
             logmsg("---- Read prefetch disabled");
         }
 
-        if (img.deviceType == S2S_CFG_OPTICAL &&
-            strncasecmp(filename + strlen(filename) - 4, ".bin", 4) == 0)
+        const char *extension = strrchr(filename, '.');
+        if (img.deviceType == S2S_CFG_OPTICAL && extension &&
+            (strcasecmp(extension, ".bin") == 0 ||
+             strcasecmp(extension, ".wav") == 0 ||
+             strcasecmp(extension, ".flac") == 0))
         {
             char cuesheetname[MAX_FILE_PATH + 1] = {0};
-            strncpy(cuesheetname, filename, strlen(filename) - 4);
+            strncpy(cuesheetname, filename, extension - filename);
             strlcat(cuesheetname, ".cue", sizeof(cuesheetname));
             img.cuesheetfile = SD.open(cuesheetname, O_RDONLY);
 
             if (img.cuesheetfile.isOpen())
             {
                 logmsg("---- Found CD-ROM CUE sheet at ", cuesheetname);
-                if (!cdromValidateCueSheet(img))
+                if (!cdromValidateCueSheet(img, filename))
                 {
                     logmsg("---- Failed to parse cue sheet, using as plain binary image");
                     img.cuesheetfile.close();
@@ -407,6 +421,12 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, in
                 logmsg("---- No CUE sheet found at ", cuesheetname, ", using as plain binary image");
             }
         }
+
+        if (img.deviceType == S2S_CFG_SEQUENTIAL)
+        {
+            tapeLoadImage(img, filename);
+        }
+
         img.use_prefix = use_prefix;
         img.file.getFilename(img.current_image, sizeof(img.current_image));
         return true;
@@ -1576,6 +1596,10 @@ void diskDataOut()
     g_disk_transfer.sd_transfer_start = 0;
     g_disk_transfer.parityError = 0;
 
+    // With the SD worker, bytes_sd counts finished writes and
+    // bytes_sd_queued also includes writes still running on second core.
+    uint32_t bytes_sd_queued = 0;
+
     while (g_disk_transfer.bytes_sd < g_disk_transfer.bytes_scsi
            && scsiDev.phase == DATA_OUT
            && !scsiDev.resetFlag)
@@ -1583,13 +1607,34 @@ void diskDataOut()
         platform_poll();
         diskEjectButtonUpdate(false);
 
+        uint32_t sd_progress = 0;
+        if (sdWorkerPending() > 0)
+        {
+            bool sd_ok;
+            if (sdWorkerPoll(&sd_progress, &sd_ok))
+            {
+                sdWorkerRelease();
+                if (!sd_ok)
+                {
+                    logmsg("SD card write failed: ", SD.sdErrorCode());
+                    scsiDev.status = CHECK_CONDITION;
+                    scsiDev.target->sense.code = MEDIUM_ERROR;
+                    scsiDev.target->sense.asc = WRITE_ERROR_AUTO_REALLOCATION_FAILED;
+                    scsiDev.phase = STATUS;
+                    break;
+                }
+                g_disk_transfer.bytes_sd += sd_progress;
+                continue;
+            }
+        }
+
         // Figure out how many contiguous bytes are available for writing to SD card.
         uint32_t bufsize = sizeof(scsiDev.data);
-        uint32_t start = g_disk_transfer.bytes_sd % bufsize;
+        uint32_t start = bytes_sd_queued % bufsize;
         uint32_t len = 0;
 
         // How much data until buffer edge wrap?
-        uint32_t available = g_disk_transfer.bytes_scsi_started - g_disk_transfer.bytes_sd;
+        uint32_t available = g_disk_transfer.bytes_scsi_started - bytes_sd_queued;
         if (start + available > bufsize)
             available = bufsize - start;
 
@@ -1618,7 +1663,7 @@ void diskDataOut()
             len = PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE;
         }
 
-        uint32_t remain_in_transfer = g_disk_transfer.bytes_scsi - g_disk_transfer.bytes_sd;
+        uint32_t remain_in_transfer = g_disk_transfer.bytes_scsi - bytes_sd_queued;
         if (len < bufsize - start && len < remain_in_transfer)
         {
             // Use large write blocks in middle of transfer and smaller at the end of transfer.
@@ -1635,10 +1680,10 @@ void diskDataOut()
             }
         }
 
-        if (len == 0)
+        if (len == 0 || sdWorkerPending() >= SD_WORKER_QUEUE_SIZE)
         {
             // Nothing ready to transfer, check if we can read more from SCSI bus
-            diskDataOut_callback(0);
+            diskDataOut_callback(sd_progress);
         }
         else
         {
@@ -1655,9 +1700,18 @@ void diskDataOut()
                 break;
             }
 
+            uint8_t *buf = &scsiDev.data[start];
+            bytes_sd_queued += len;
+            if (sdWorkerEnabled())
+            {
+                // Second core writes to SD card while this loop keeps
+                // receiving data from SCSI bus.
+                sdWorkerQueueWrite(&img.file, buf, len);
+                continue;
+            }
+
             // Start writing to SD card and simultaneously start new SCSI transfers
             // when buffer space is freed.
-            uint8_t *buf = &scsiDev.data[start];
             g_disk_transfer.sd_transfer_start = start;
             // dbgmsg("SD write ", (int)start, " + ", (int)len, " ", bytearray(buf, len));
             platform_set_sd_callback(&diskDataOut_callback, buf);
@@ -1674,6 +1728,9 @@ void diskDataOut()
         }
     }
 
+    // Writes may still be running after errors or bus reset
+    sdWorkerWaitIdle();
+
     // Release SCSI bus
     scsiFinishRead(NULL, 0, &g_disk_transfer.parityError);
 
@@ -1846,6 +1903,86 @@ static void start_dataInTransfer(uint8_t *buffer, uint32_t count)
     diskEjectButtonUpdate(false);
 }
 
+// Data in transfer with SD card reads running on second core.
+// Reads are queued alternately to the two halves of the buffer,
+// so that the next half is read while the previous one is sent to SCSI bus.
+// Returns when the whole transfer has been read from SD card.
+static void diskDataIn_sdworker()
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
+    uint32_t maxblocks_half = sizeof(scsiDev.data) / bytesPerSector / 2;
+    uint32_t half_bytes = maxblocks_half * bytesPerSector;
+
+    uint32_t count[2] = {0, 0};
+    int next_half = 0;
+    int oldest_half = 0;
+    g_disk_transfer.bytes_scsi = 0;
+
+    uint32_t start = millis();
+    while (!scsiDev.resetFlag && scsiDev.phase == DATA_IN)
+    {
+        platform_poll();
+        diskEjectButtonUpdate(false);
+
+        // Queue next read when the previous transfer from that half has finished
+        uint32_t remain = transfer.blocks - transfer.currentBlock;
+        if (remain > 0 && sdWorkerPending() < 2)
+        {
+            uint8_t *buf = &scsiDev.data[next_half * half_bytes];
+            uint32_t transfer_blocks = std::min(remain, maxblocks_half);
+            uint32_t transfer_bytes = transfer_blocks * bytesPerSector;
+            if (scsiIsWriteFinished(buf + transfer_bytes - 1))
+            {
+                sdWorkerQueueRead(&img.file, buf, transfer_bytes);
+                count[next_half] = transfer_bytes;
+                next_half ^= 1;
+                transfer.currentBlock += transfer_blocks;
+                start = millis();
+            }
+            else if ((uint32_t)(millis() - start) > 5000)
+            {
+                logmsg("diskDataIn_sdworker() timeout waiting for previous to finish");
+                scsiDev.resetFlag = 1;
+                break;
+            }
+        }
+
+        if (sdWorkerPending() == 0)
+        {
+            if (transfer.currentBlock == transfer.blocks) break;
+            continue;
+        }
+
+        // Send the part of oldest request that has been read to SCSI bus
+        uint32_t bytes_done;
+        bool sd_ok;
+        bool finished = sdWorkerPoll(&bytes_done, &sd_ok);
+        if (finished && !sd_ok)
+        {
+            logmsg("SD card read failed: ", SD.sdErrorCode());
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = MEDIUM_ERROR;
+            scsiDev.target->sense.asc = UNRECOVERED_READ_ERROR;
+            scsiDev.phase = STATUS;
+            break;
+        }
+
+        g_disk_transfer.buffer = &scsiDev.data[oldest_half * half_bytes];
+        g_disk_transfer.bytes_sd = count[oldest_half];
+        diskDataIn_callback(bytes_done);
+
+        if (finished)
+        {
+            sdWorkerRelease();
+            oldest_half ^= 1;
+            g_disk_transfer.bytes_scsi = 0;
+        }
+    }
+
+    sdWorkerWaitIdle();
+}
+
 static void diskDataIn()
 {
     // Figure out how many blocks we can fit in buffer
@@ -1853,26 +1990,33 @@ static void diskDataIn()
     uint32_t maxblocks = sizeof(scsiDev.data) / bytesPerSector;
     uint32_t maxblocks_half = maxblocks / 2;
 
-    // Start transfer in first half of buffer
-    // Waits for the previous first half transfer to finish first.
-    uint32_t remain = (transfer.blocks - transfer.currentBlock);
-    if (remain > 0)
+    if (sdWorkerEnabled())
     {
-        uint32_t transfer_blocks = std::min(remain, maxblocks_half);
-        uint32_t transfer_bytes = transfer_blocks * bytesPerSector;
-        start_dataInTransfer(&scsiDev.data[0], transfer_bytes);
-        transfer.currentBlock += transfer_blocks;
+        diskDataIn_sdworker();
     }
-
-    // Start transfer in second half of buffer
-    // Waits for the previous second half transfer to finish first
-    remain = (transfer.blocks - transfer.currentBlock);
-    if (remain > 0)
+    else
     {
-        uint32_t transfer_blocks = std::min(remain, maxblocks_half);
-        uint32_t transfer_bytes = transfer_blocks * bytesPerSector;
-        start_dataInTransfer(&scsiDev.data[maxblocks_half * bytesPerSector], transfer_bytes);
-        transfer.currentBlock += transfer_blocks;
+        // Start transfer in first half of buffer
+        // Waits for the previous first half transfer to finish first.
+        uint32_t remain = (transfer.blocks - transfer.currentBlock);
+        if (remain > 0)
+        {
+            uint32_t transfer_blocks = std::min(remain, maxblocks_half);
+            uint32_t transfer_bytes = transfer_blocks * bytesPerSector;
+            start_dataInTransfer(&scsiDev.data[0], transfer_bytes);
+            transfer.currentBlock += transfer_blocks;
+        }
+
+        // Start transfer in second half of buffer
+        // Waits for the previous second half transfer to finish first
+        remain = (transfer.blocks - transfer.currentBlock);
+        if (remain > 0)
+        {
+            uint32_t transfer_blocks = std::min(remain, maxblocks_half);
+            uint32_t transfer_bytes = transfer_blocks * bytesPerSector;
+            start_dataInTransfer(&scsiDev.data[maxblocks_half * bytesPerSector], transfer_bytes);
+            transfer.currentBlock += transfer_blocks;
+        }
     }
 
     if (transfer.currentBlock == transfer.blocks)
@@ -1895,6 +2039,52 @@ static void diskDataIn()
             prefetch_sectors = img_sector_count - g_scsi_prefetch.sector;
         }
 
+        if (sdWorkerEnabled())
+        {
+            // Queue prefetch reads to second core while SCSI transfer is still running
+            uint32_t queued = 0;
+            while (!scsiDev.resetFlag)
+            {
+                platform_poll();
+                diskEjectButtonUpdate(false);
+
+                uint32_t bytes_done;
+                bool sd_ok;
+                if (sdWorkerPending() > 0 && sdWorkerPoll(&bytes_done, &sd_ok))
+                {
+                    sdWorkerRelease();
+                    if (!sd_ok)
+                    {
+                        logmsg("Prefetch read failed");
+                        prefetch_sectors = 0;
+                        break;
+                    }
+                    g_scsi_prefetch.bytes += bytes_done;
+                    continue;
+                }
+
+                bool scsi_busy = !scsiIsWriteFinished(NULL);
+                if (scsi_busy && prefetch_sectors > 0 && sdWorkerPending() < 2)
+                {
+                    // Check if prefetch buffer is free
+                    uint8_t *buf = g_scsi_prefetch.buffer + queued;
+                    if (scsiIsWriteFinished(buf) && scsiIsWriteFinished(buf + bytesPerSector - 1))
+                    {
+                        sdWorkerQueueRead(&img.file, buf, bytesPerSector);
+                        queued += bytesPerSector;
+                        prefetch_sectors--;
+                    }
+                }
+                else if (sdWorkerPending() == 0 && (!scsi_busy || prefetch_sectors == 0))
+                {
+                    break;
+                }
+            }
+
+            // Results of reads queued after a failure are discarded
+            sdWorkerWaitIdle();
+        }
+
         while (!scsiIsWriteFinished(NULL) && prefetch_sectors > 0 && !scsiDev.resetFlag)
         {
             platform_poll();
@@ -41,6 +41,13 @@ extern "C" {
 #include <scsi.h>
 }
 
+#ifndef PLATFORM_SCSIPHY_HAS_NONBLOCKING_READ
+// Blocking fallbacks for platforms without non-blocking read from SCSI bus
+void scsiStartRead(uint8_t* data, uint32_t count, int *parityError);
+void scsiFinishRead(uint8_t* data, uint32_t count, int *parityError);
+bool scsiIsReadFinished(const uint8_t *data);
+#endif
+
 // Extended configuration stored alongside the normal SCSI2SD target information
 struct image_config_t: public S2S_TargetCfg
 {
@@ -61,6 +68,11 @@ struct image_config_t: public S2S_TargetCfg
     // For tape drive emulation, current position in blocks
     uint32_t tape_pos;
 
+    // For tape drive emulation with record structured .tap image,
+    // byte offset of the record or filemark at tape_pos.
+    bool tape_tap_format;
+    uint64_t tape_offset;
+
     // True if there is a subdirectory of images for this target
     bool image_directory;
 
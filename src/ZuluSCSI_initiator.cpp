@@ -28,6 +28,7 @@
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_log_trace.h"
 #include "ZuluSCSI_initiator.h"
+#include "ZuluSCSI_sha256.h"
 #include <ZuluSCSI_platform.h>
 #include <minIni.h>
 #include "SdFat.h"
@@ -35,6 +36,7 @@
 #include <scsi2sd.h>
 extern "C" {
 #include <scsi.h>
+#include <crc32.h>
 }
 
 #ifndef PLATFORM_HAS_INITIATOR_MODE
@@ -74,6 +76,11 @@ static struct {
     // Is imaging a drive in progress, or are we scanning?
     bool imaging;
 
+    // Is the transfer direction from image file to drive?
+    bool restoring;
+    bool restore_from_special_file;
+    uint32_t transfer_start_time;
+
     // Information about currently selected drive
     int target_id;
     uint32_t sectorsize;
@@ -95,9 +102,78 @@ static struct {
 
     uint32_t removable_count[8];
 
+    // Optional verification pass that reads the drive again and compares to image file
+    bool verify;
+    bool verifying;
+    uint32_t verify_sectors_done;
+    uint32_t verify_mismatch_count;
+    uint32_t verify_unreadable_count;
+
+    char target_filename[MAX_FILE_PATH + 1];
     FsFile target_file;
 } g_initiator_state;
 
+// Checksum of the imaged data, computed while the data is being transferred
+enum initiator_hash_type_t {
+    INITIATOR_HASH_NONE = 0,
+    INITIATOR_HASH_CRC32 = 1,
+    INITIATOR_HASH_SHA256 = 2
+};
+
+static struct {
+    initiator_hash_type_t type;
+    uint32_t crc;
+    sha256_ctx_t sha;
+} g_initiator_hash;
+
+// When InitiatorParallel is enabled, all fixed drives found during a scan pass
+// are imaged at the same time. Each READ command is sent with disconnect privilege,
+// so that the target can release the bus while it is seeking. Meanwhile commands
+// are started on the other drives, and data is received from whichever target
+// reselects us first.
+
+// Time to wait for a disconnected target to reselect before resetting the bus
+#define INITIATOR_RESELECT_TIMEOUT_MS 30000
+
+struct initiator_drive_t {
+    bool active;
+    bool disconnected;
+
+    uint32_t sectorsize;
+    uint32_t sectorcount;
+    uint32_t sectorcount_all;
+    uint32_t sectors_done;
+    uint32_t max_sector_per_transfer;
+    uint32_t bad_sector_count;
+    uint8_t ansi_version;
+    int retrycount;
+    uint32_t failposition;
+    uint32_t transfer_start_time;
+
+    // Currently executing READ command
+    uint32_t cmd_sectors;
+    uint32_t cmd_bytes_done;
+    uint32_t cmd_bytes_saved; // Data pointer from last SAVE DATA POINTER message
+    uint32_t disconnect_time;
+
+    // Checksum state at the saved data pointer and at the start of current command
+    uint32_t crc;
+    sha256_ctx_t sha;
+    uint32_t crc_cmd_start;
+    sha256_ctx_t sha_cmd_start;
+
+    char filename[MAX_FILE_PATH + 1];
+    FsFile file;
+};
+
+static struct {
+    bool enabled;
+    bool running;
+    int active_count;
+    int next_target;
+    initiator_drive_t drives[8];
+} g_initiator_parallel;
+
 extern SdFs SD;
 
 // Initialization of initiator mode
@@ -116,11 +192,27 @@ void scsiInitiatorInit()
         logmsg("InitiatorID set to ID ", g_initiator_state.initiator_id);
     }
     g_initiator_state.max_retry_count = ini_getl("SCSI", "InitiatorMaxRetry", 5, CONFIGFILE);
+    g_initiator_state.verify = ini_getbool("SCSI", "InitiatorVerify", false, CONFIGFILE);
+
+    g_initiator_parallel.running = false;
+    g_initiator_parallel.active_count = 0;
+    g_initiator_parallel.next_target = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        g_initiator_parallel.drives[i].active = false;
+    }
+    g_initiator_parallel.enabled = ini_getbool("SCSI", "InitiatorParallel", false, CONFIGFILE);
+    if (g_initiator_parallel.enabled && g_initiator_state.verify)
+    {
+        logmsg("InitiatorParallel cannot be combined with InitiatorVerify, imaging drives one at a time");
+        g_initiator_parallel.enabled = false;
+    }
 
     // treat initiator id as already imaged drive so it gets skipped
     g_initiator_state.drives_imaged = 1 << g_initiator_state.initiator_id;
 
     g_initiator_state.imaging = false;
+    g_initiator_state.restoring = false;
     g_initiator_state.target_id = -1;
     g_initiator_state.sectorsize = 0;
     g_initiator_state.sectorcount = 0;
@@ -133,8 +225,78 @@ void scsiInitiatorInit()
     g_initiator_state.device_type = SCSI_DEVICE_TYPE_DIRECT_ACCESS;
     g_initiator_state.removable = false;
     g_initiator_state.eject_when_done = false;
+    g_initiator_state.verifying = false;
     memset(g_initiator_state.removable_count, 0, sizeof(g_initiator_state.removable_count));
 
+    int hash_type = ini_getl("SCSI", "InitiatorImageHash", 0, CONFIGFILE);
+    if (hash_type < INITIATOR_HASH_NONE || hash_type > INITIATOR_HASH_SHA256)
+    {
+        logmsg("InitiatorImageHash is set to, ", hash_type, ", which is invalid, disabling image checksum");
+        hash_type = INITIATOR_HASH_NONE;
+    }
+    g_initiator_hash.type = (initiator_hash_type_t)hash_type;
+}
+
+static void initiatorHashReset()
+{
+    g_initiator_hash.crc = 0;
+    sha256_init(&g_initiator_hash.sha);
+}
+
+static void initiatorHashUpdate(const uint8_t *buf, uint32_t len)
+{
+    if (g_initiator_hash.type == INITIATOR_HASH_CRC32)
+    {
+        g_initiator_hash.crc = crc32_update(g_initiator_hash.crc, buf, len);
+    }
+    else if (g_initiator_hash.type == INITIATOR_HASH_SHA256)
+    {
+        sha256_update(&g_initiator_hash.sha, buf, len);
+    }
+}
+
+// Write checksum of the completed image to a sidecar file, in the format used by sha256sum / crc32 tools
+static void initiatorHashWriteFile()
+{
+    char hex[SHA256_DIGEST_SIZE * 2 + 1] = {0};
+    const char *extension;
+
+    if (g_initiator_hash.type == INITIATOR_HASH_CRC32)
+    {
+        extension = ".crc32";
+        snprintf(hex, sizeof(hex), "%08lx", (unsigned long)g_initiator_hash.crc);
+    }
+    else if (g_initiator_hash.type == INITIATOR_HASH_SHA256)
+    {
+        extension = ".sha256";
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        sha256_final(&g_initiator_hash.sha, digest);
+        for (int i = 0; i < SHA256_DIGEST_SIZE; i++)
+        {
+            snprintf(hex + i * 2, 3, "%02x", digest[i]);
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    char hashname[sizeof(g_initiator_state.target_filename) + 8];
+    snprintf(hashname, sizeof(hashname), "%s%s", g_initiator_state.target_filename, extension);
+    logmsg("Image checksum ", hex, ", saving to ", hashname);
+
+    FsFile hashfile = SD.open(hashname, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!hashfile.isOpen())
+    {
+        logmsg("Failed to open file for writing: ", hashname);
+        return;
+    }
+
+    hashfile.write(hex, strlen(hex));
+    hashfile.write("  ", 2);
+    hashfile.write(g_initiator_state.target_filename, strlen(g_initiator_state.target_filename));
+    hashfile.write("\n", 1);
+    hashfile.close();
 }
 
 // Update progress bar LED during transfers
@@ -143,7 +305,8 @@ static void scsiInitiatorUpdateLed()
     // Update status indicator, the led blinks every 5 seconds and is on the longer the more data has been transferred
     const int period = 256;
     int phase = (millis() % period);
-    int duty = g_initiator_state.sectors_done * period / g_initiator_state.sectorcount;
+    uint32_t done = g_initiator_state.verifying ? g_initiator_state.verify_sectors_done : g_initiator_state.sectors_done;
+    int duty = done * period / g_initiator_state.sectorcount;
 
     // Minimum and maximum time to verify that the blink is visible
     if (duty < 50) duty = 50;
@@ -193,6 +356,102 @@ static int scsiTypeToIniType(int scsi_type, bool removable)
     return ini_type;
 }
 
+static bool scsiInitiatorStartVerify();
+static void scsiInitiatorVerifyStep();
+static void scsiInitiatorParallelAdd();
+static void scsiInitiatorParallelAbortAll();
+static void scsiInitiatorParallelStep();
+
+// Check if there is an image that should be written to the drive instead of reading it.
+// The image can be set with InitiatorRestoreImage in [SCSIx] section of the ini file,
+// or by a file named e.g. "RESTORE3.hda" in the root directory for SCSI ID 3.
+// Returns true if restore was started or if the drive should be skipped.
+static bool scsiInitiatorCheckRestore()
+{
+    int target_id = g_initiator_state.target_id;
+    char section[6] = "SCSI0";
+    section[4] += target_id;
+    char filename[MAX_FILE_PATH + 1] = {0};
+    bool special_file = false;
+
+    ini_gets(section, "InitiatorRestoreImage", "", filename, sizeof(filename), CONFIGFILE);
+
+    if (filename[0] == '\0')
+    {
+        char prefix[9] = "RESTORE0";
+        prefix[7] += target_id;
+
+        FsFile root;
+        FsFile file;
+        root.open("/");
+        while (file.openNext(&root, O_RDONLY))
+        {
+            char name[MAX_FILE_PATH + 1];
+            file.getName(name, sizeof(name));
+            bool is_dir = file.isDir();
+            file.close();
+
+            const char *suffix = strrchr(name, '_');
+            if (!is_dir && strncasecmp(name, prefix, strlen(prefix)) == 0 &&
+                !(suffix && strcasecmp(suffix, "_restored") == 0))
+            {
+                strncpy(filename, name, sizeof(filename));
+                special_file = true;
+                break;
+            }
+        }
+        root.close();
+    }
+
+    if (filename[0] == '\0')
+    {
+        return false;
+    }
+
+    if (g_initiator_state.device_type == SCSI_DEVICE_TYPE_CD)
+    {
+        logmsg("Restore image ", filename, " found for SCSI ID ", target_id, " but it is a CD-ROM drive, skipping");
+        g_initiator_state.drives_imaged |= (1 << target_id);
+        return true;
+    }
+
+    g_initiator_state.target_file = SD.open(filename, O_RDONLY);
+    if (!g_initiator_state.target_file.isOpen())
+    {
+        logmsg("Failed to open restore image ", filename);
+        g_initiator_state.drives_imaged |= (1 << target_id);
+        return true;
+    }
+
+    uint64_t filesize = g_initiator_state.target_file.size();
+    uint64_t drivesize = (uint64_t)g_initiator_state.sectorcount_all * g_initiator_state.sectorsize;
+    if (filesize > drivesize)
+    {
+        logmsg("Restore image ", filename, " is ", (int)(filesize / 1024), " kB, larger than drive size ",
+               (int)(drivesize / 1024), " kB on SCSI ID ", target_id, ", skipping");
+        g_initiator_state.target_file.close();
+        g_initiator_state.drives_imaged |= (1 << target_id);
+        return true;
+    }
+
+    if (filesize % g_initiator_state.sectorsize != 0)
+    {
+        logmsg("Restore image size is not a multiple of ", (int)g_initiator_state.sectorsize,
+               " bytes, last partial sector will not be written");
+    }
+
+    strncpy(g_initiator_state.target_filename, filename, sizeof(g_initiator_state.target_filename));
+    g_initiator_state.sectorcount = filesize / g_initiator_state.sectorsize;
+    g_initiator_state.restore_from_special_file = special_file;
+    g_initiator_state.restoring = true;
+    g_initiator_state.imaging = true;
+    g_initiator_state.transfer_start_time = millis();
+
+    logmsg("Starting to restore ", filename, " to SCSI ID ", target_id, ", ",
+           (int)g_initiator_state.sectorcount, " sectors");
+    return true;
+}
+
 // High level logic of the initiator mode
 void scsiInitiatorMainLoop()
 {
@@ -200,6 +459,15 @@ void scsiInitiatorMainLoop()
     {
         logmsg("Executing BUS RESET after aborted command");
         scsiHostPhyReset();
+        scsiInitiatorParallelAbortAll();
+    }
+
+    // Drives queued for parallel imaging are processed after each full scan pass
+    if (!g_initiator_state.imaging && g_initiator_parallel.active_count > 0 &&
+        (g_initiator_parallel.running || g_initiator_state.target_id == 7))
+    {
+        scsiInitiatorParallelStep();
+        return;
     }
 
     if (!g_initiator_state.imaging)
@@ -212,7 +480,8 @@ void scsiInitiatorMainLoop()
         g_initiator_state.bad_sector_count = 0;
         g_initiator_state.eject_when_done = false;
 
-        if (!(g_initiator_state.drives_imaged & (1 << g_initiator_state.target_id)))
+        if (!(g_initiator_state.drives_imaged & (1 << g_initiator_state.target_id)) &&
+            !g_initiator_parallel.drives[g_initiator_state.target_id].active)
         {
             delay_with_poll(1000);
 
@@ -333,6 +602,11 @@ void scsiInitiatorMainLoop()
                 g_initiator_state.removable_count[g_initiator_state.target_id] = 1;
             }
 
+            if (g_initiator_state.sectorcount > 0 && readcapok && scsiInitiatorCheckRestore())
+            {
+                return;
+            }
+
             if (g_initiator_state.sectorcount > 0)
             {
                 char filename[32] = {0};
@@ -440,8 +714,19 @@ void scsiInitiatorMainLoop()
                     g_initiator_state.target_file.preAllocate((uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize);
                 }
 
+                strncpy(g_initiator_state.target_filename, filename, sizeof(g_initiator_state.target_filename));
+                initiatorHashReset();
+
+                if (g_initiator_parallel.enabled && !g_initiator_state.eject_when_done)
+                {
+                    // Removable media drives are still imaged one at a time
+                    scsiInitiatorParallelAdd();
+                    return;
+                }
+
                 logmsg("Starting to copy drive data to ", filename);
                 g_initiator_state.imaging = true;
+                g_initiator_state.transfer_start_time = millis();
             }
         }
     }
@@ -450,10 +735,74 @@ void scsiInitiatorMainLoop()
         // Copy sectors from SCSI drive to file
         if (g_initiator_state.sectors_done >= g_initiator_state.sectorcount)
         {
+            if (!g_initiator_state.verifying)
+            {
+                g_initiator_state.target_file.close();
+
+                uint32_t elapsed = millis() - g_initiator_state.transfer_start_time;
+                uint64_t total_bytes = (uint64_t)g_initiator_state.sectors_done * g_initiator_state.sectorsize;
+                logmsg("Transferred ", (int)(total_bytes / 1024), " kB in ", (int)(elapsed / 1000),
+                       " s, average speed ", (int)(total_bytes / (elapsed + 1)), " kB/s");
+
+                if (!g_initiator_state.restoring)
+                {
+                    initiatorHashWriteFile();
+                }
+
+                if (g_initiator_state.verify && scsiInitiatorStartVerify())
+                {
+                    return;
+                }
+            }
+            else if (g_initiator_state.verify_sectors_done < g_initiator_state.sectorcount)
+            {
+                scsiInitiatorVerifyStep();
+                return;
+            }
+            else
+            {
+                g_initiator_state.verifying = false;
+                if (g_initiator_state.verify_mismatch_count == 0 && g_initiator_state.verify_unreadable_count == 0)
+                {
+                    logmsg("Verification passed, image matches the data on SCSI ID ", g_initiator_state.target_id);
+                }
+                else
+                {
+                    logmsg("Verification FAILED: ", (int)g_initiator_state.verify_mismatch_count, " sectors differ and ",
+                        (int)g_initiator_state.verify_unreadable_count, " sectors could not be re-read");
+                }
+            }
+
             scsiStartStopUnit(g_initiator_state.target_id, false);
-            logmsg("Finished imaging drive with id ", g_initiator_state.target_id);
             LED_OFF();
 
+            if (g_initiator_state.restoring)
+            {
+                logmsg("Finished restoring ", g_initiator_state.target_filename, " to drive with id ", g_initiator_state.target_id);
+
+                if (g_initiator_state.bad_sector_count != 0)
+                {
+                    logmsg("NOTE: There were ",  (int) g_initiator_state.bad_sector_count, " sectors that could not be written to this drive.");
+                }
+
+                if (g_initiator_state.restore_from_special_file)
+                {
+                    // Rename the file so that the drive is not overwritten again on next boot
+                    char newname[MAX_FILE_PATH + 1];
+                    snprintf(newname, sizeof(newname), "%s_restored", g_initiator_state.target_filename);
+                    logmsg("Renaming ", g_initiator_state.target_filename, " to ", newname);
+                    SD.rename(g_initiator_state.target_filename, newname);
+                }
+
+                g_initiator_state.drives_imaged |= (1 << g_initiator_state.target_id);
+                g_initiator_state.restoring = false;
+                g_initiator_state.imaging = false;
+                g_initiator_state.target_file.close();
+                return;
+            }
+
+            logmsg("Finished imaging drive with id ", g_initiator_state.target_id);
+
             if (g_initiator_state.sectorcount != g_initiator_state.sectorcount_all)
             {
                 logmsg("NOTE: Image size was limited to first 4 GiB due to SD card filesystem limit");
@@ -488,9 +837,19 @@ void scsiInitiatorMainLoop()
             numtoread = 1;
 
         uint32_t time_start = millis();
-        bool status = scsiInitiatorReadDataToFile(g_initiator_state.target_id,
-            g_initiator_state.sectors_done, numtoread, g_initiator_state.sectorsize,
-            g_initiator_state.target_file);
+        bool status;
+        if (g_initiator_state.restoring)
+        {
+            status = scsiInitiatorWriteDataFromFile(g_initiator_state.target_id,
+                g_initiator_state.sectors_done, numtoread, g_initiator_state.sectorsize,
+                g_initiator_state.target_file);
+        }
+        else
+        {
+            status = scsiInitiatorReadDataToFile(g_initiator_state.target_id,
+                g_initiator_state.sectors_done, numtoread, g_initiator_state.sectorsize,
+                g_initiator_state.target_file);
+        }
 
         if (!status)
         {
@@ -513,9 +872,24 @@ void scsiInitiatorMainLoop()
                     g_initiator_state.failposition = g_initiator_state.sectors_done + numtoread;
                 }
             }
+            else if (g_initiator_state.restoring)
+            {
+                logmsg("Retry limit exceeded, skipping one sector");
+                g_initiator_state.retrycount = 0;
+                g_initiator_state.sectors_done++;
+                g_initiator_state.bad_sector_count++;
+                g_initiator_state.target_file.seek((uint64_t)g_initiator_state.sectors_done * g_initiator_state.sectorsize);
+            }
             else
             {
                 logmsg("Retry limit exceeded, skipping one sector");
+
+                // Fill the skipped sector with zeros so that image and checksum stay consistent
+                memset(scsiDev.data, 0, g_initiator_state.sectorsize);
+                g_initiator_state.target_file.seek((uint64_t)g_initiator_state.sectors_done * g_initiator_state.sectorsize);
+                g_initiator_state.target_file.write(scsiDev.data, g_initiator_state.sectorsize);
+                initiatorHashUpdate(scsiDev.data, g_initiator_state.sectorsize);
+
                 g_initiator_state.retrycount = 0;
                 g_initiator_state.sectors_done++;
                 g_initiator_state.bad_sector_count++;
@@ -526,10 +900,14 @@ void scsiInitiatorMainLoop()
         {
             g_initiator_state.retrycount = 0;
             g_initiator_state.sectors_done += numtoread;
-            g_initiator_state.target_file.flush();
+            if (!g_initiator_state.restoring)
+            {
+                g_initiator_state.target_file.flush();
+            }
 
-            int speed_kbps = numtoread * g_initiator_state.sectorsize / (millis() - time_start);
-            logmsg("SCSI read succeeded, sectors done: ",
+            int speed_kbps = numtoread * g_initiator_state.sectorsize / (millis() - time_start + 1);
+            logmsg(g_initiator_state.restoring ? "SCSI write succeeded" : "SCSI read succeeded",
+                  ", sectors done: ",
                   (int)g_initiator_state.sectors_done, " / ", (int)g_initiator_state.sectorcount,
                   " speed ", speed_kbps, " kB/s - ", 
                   (int)(100 * g_initiator_state.sectors_done / g_initiator_state.sectorcount), "%");
@@ -548,7 +926,7 @@ int scsiInitiatorRunCommand(int target_id,
                             bool returnDataPhase)
 {
 
-    if (!scsiHostPhySelect(target_id, g_initiator_state.initiator_id))
+    if (!scsiHostPhySelect(target_id, g_initiator_state.initiator_id, false))
     {
 #ifndef ZULUSCSI_NETWORK
         dbgmsg("------ Target ", target_id, " did not respond");
@@ -785,10 +1163,17 @@ static struct {
 
     uint32_t bytes_per_sector;
     bool all_ok;
+
+    // Target is allowed to end the data phase early, e.g. to disconnect
+    bool allow_partial;
+    bool phase_ended;
 } g_initiator_transfer;
 
 static void initiatorReadSDCallback(uint32_t bytes_complete)
 {
+    if (g_initiator_transfer.phase_ended)
+        return;
+
     if (g_initiator_transfer.bytes_scsi_done < g_initiator_transfer.bytes_scsi)
     {
         // How many bytes remaining in the transfer?
@@ -840,11 +1225,25 @@ static void initiatorReadSDCallback(uint32_t bytes_complete)
             return;
 
         // dbgmsg("SCSI read ", (int)start, " + ", (int)len, ", sd ready cnt ", (int)sd_ready_cnt, " ", (int)bytes_complete, ", scsi done ", (int)g_initiator_transfer.bytes_scsi_done);
-        if (scsiHostRead(&scsiDev.data[start], len) != len)
+        uint32_t got = scsiHostRead(&scsiDev.data[start], len);
+        if (got != len && g_initiator_transfer.allow_partial)
+        {
+            // Target ended the data phase, keep the bytes that were received.
+            // Caller checks the total byte count when the command completes.
+            g_initiator_transfer.phase_ended = true;
+            len = got;
+            initiatorHashUpdate(&scsiDev.data[start], len);
+        }
+        else if (got != len)
         {
             logmsg("Read failed at byte ", (int)g_initiator_transfer.bytes_scsi_done);
             g_initiator_transfer.all_ok = false;
         }
+        else
+        {
+            // Checksum calculation runs while the SD card write is in progress
+            initiatorHashUpdate(&scsiDev.data[start], len);
+        }
         g_initiator_transfer.bytes_scsi_done += len;
     }
 }
@@ -880,67 +1279,92 @@ static void scsiInitiatorWriteDataToSd(FsFile &file, bool use_callback)
     g_initiator_transfer.bytes_sd += len;
 }
 
-bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
-                                 FsFile &file)
+// Handle the remaining MESSAGE and STATUS phases after data transfer and release the bus.
+// Returns the status byte received from target, or the passed in value if there was none.
+static int scsiInitiatorFinishCommand(int status)
 {
-    int status = -1;
+    SCSI_PHASE phase;
+    while ((phase = (SCSI_PHASE)scsiHostPhyGetPhase()) != BUS_FREE)
+    {
+        platform_poll();
+
+        if (phase == MESSAGE_IN)
+        {
+            uint8_t dummy = 0;
+            scsiHostRead(&dummy, 1);
+        }
+        else if (phase == MESSAGE_OUT)
+        {
+            uint8_t identify_msg = 0x80;
+            scsiHostWrite(&identify_msg, 1);
+        }
+        else if (phase == STATUS)
+        {
+            uint8_t tmp = 0;
+            scsiHostRead(&tmp, 1);
+            status = tmp;
+            dbgmsg("------ STATUS: ", tmp);
+        }
+    }
+
+    scsiHostPhyRelease();
+    return status;
+}
 
+// Build READ6/READ10 or WRITE6/WRITE10 command for the given range, returns command length
+static size_t scsiInitiatorBuildRWCommand(uint8_t command[10], uint32_t start_sector, uint32_t sectorcount,
+                                          bool write)
+{
     // Read6 command supports 21 bit LBA - max of 0x1FFFFF
     // ref: https://www.seagate.com/files/staticfiles/support/docs/manual/Interface%20manuals/100293068j.pdf pg 134
     if (g_initiator_state.ansi_version < 0x02 || (start_sector < 0x1FFFFF && sectorcount <= 256))
     {
-        // Use READ6 command for compatibility with old SCSI1 drives
-        uint8_t command[6] = {0x08,
-            (uint8_t)(start_sector >> 16),
-            (uint8_t)(start_sector >> 8),
-            (uint8_t)start_sector,
-            (uint8_t)sectorcount,
-            0x00
-        };
-
-        // Start executing command, return in data phase
-        status = scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, NULL, 0, true);
+        // Use 6-byte command for compatibility with old SCSI1 drives
+        command[0] = write ? 0x0A : 0x08;
+        command[1] = (uint8_t)(start_sector >> 16);
+        command[2] = (uint8_t)(start_sector >> 8);
+        command[3] = (uint8_t)start_sector;
+        command[4] = (uint8_t)sectorcount;
+        command[5] = 0x00;
+        return 6;
     }
     else
     {
-        // Use READ10 command for larger number of blocks
-        uint8_t command[10] = {0x28, 0x00,
-            (uint8_t)(start_sector >> 24), (uint8_t)(start_sector >> 16),
-            (uint8_t)(start_sector >> 8), (uint8_t)start_sector,
-            0x00,
-            (uint8_t)(sectorcount >> 8), (uint8_t)(sectorcount),
-            0x00
-        };
-
-        // Start executing command, return in data phase
-        status = scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, NULL, 0, true);
+        // Use 10-byte command for larger number of blocks
+        command[0] = write ? 0x2A : 0x28;
+        command[1] = 0x00;
+        command[2] = (uint8_t)(start_sector >> 24);
+        command[3] = (uint8_t)(start_sector >> 16);
+        command[4] = (uint8_t)(start_sector >> 8);
+        command[5] = (uint8_t)start_sector;
+        command[6] = 0x00;
+        command[7] = (uint8_t)(sectorcount >> 8);
+        command[8] = (uint8_t)(sectorcount);
+        command[9] = 0x00;
+        return 10;
     }
+}
 
-
-    if (status != 0)
-    {
-        uint8_t sense_key;
-        scsiRequestSense(target_id, &sense_key);
-
-        logmsg("scsiInitiatorReadDataToFile: READ failed: ", status, " sense key ", sense_key);
-        scsiHostPhyRelease();
-        return false;
-    }
-
-    SCSI_PHASE phase;
-
-    g_initiator_transfer.bytes_scsi = sectorcount * sectorsize;
+// Receive data from target in DATA_IN phase and write it to file.
+// SCSI reads run in the SD card callback so that both transfers overlap.
+// If allow_partial is true, the target may end the data phase before all bytes are sent.
+// Returns number of bytes written to file.
+static uint32_t scsiInitiatorReceiveDataToFile(FsFile &file, uint32_t bytes, uint32_t sectorsize, bool allow_partial)
+{
+    g_initiator_transfer.bytes_scsi = bytes;
     g_initiator_transfer.bytes_per_sector = sectorsize;
     g_initiator_transfer.bytes_sd = 0;
     g_initiator_transfer.bytes_sd_scheduled = 0;
     g_initiator_transfer.bytes_scsi_done = 0;
     g_initiator_transfer.all_ok = true;
+    g_initiator_transfer.allow_partial = allow_partial;
+    g_initiator_transfer.phase_ended = false;
 
-    while (true)
+    while (!g_initiator_transfer.phase_ended)
     {
         platform_poll();
 
-        phase = (SCSI_PHASE)scsiHostPhyGetPhase();
+        SCSI_PHASE phase = (SCSI_PHASE)scsiHostPhyGetPhase();
         if (phase != DATA_IN && phase != BUS_BUSY)
         {
             break;
@@ -966,27 +1390,350 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
         scsiInitiatorWriteDataToSd(file, false);
     }
 
-    if (g_initiator_transfer.bytes_sd != g_initiator_transfer.bytes_scsi)
+    g_initiator_transfer.allow_partial = false;
+    return g_initiator_transfer.bytes_sd;
+}
+
+bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
+                                 FsFile &file)
+{
+    uint8_t command[10];
+    size_t cmdlen = scsiInitiatorBuildRWCommand(command, start_sector, sectorcount, false);
+
+    // Start executing command, return in data phase
+    int status = scsiInitiatorRunCommand(target_id, command, cmdlen, NULL, 0, NULL, 0, true);
+
+    if (status != 0)
+    {
+        uint8_t sense_key;
+        scsiRequestSense(target_id, &sense_key);
+
+        logmsg("scsiInitiatorReadDataToFile: READ failed: ", status, " sense key ", sense_key);
+        scsiHostPhyRelease();
+        return false;
+    }
+
+    // Checksum is updated as data arrives, restore it if the transfer has to be retried
+    sha256_ctx_t sha_checkpoint = g_initiator_hash.sha;
+    uint32_t crc_checkpoint = g_initiator_hash.crc;
+
+    uint32_t bytes = sectorcount * sectorsize;
+    uint32_t received = scsiInitiatorReceiveDataToFile(file, bytes, sectorsize, false);
+    if (received != bytes)
     {
         logmsg("SCSI read from sector ", (int)start_sector, " was incomplete: expected ",
-             (int)g_initiator_transfer.bytes_scsi, " got ", (int)g_initiator_transfer.bytes_sd, " bytes");
+             (int)bytes, " got ", (int)received, " bytes");
+        g_initiator_transfer.all_ok = false;
+    }
+
+    status = scsiInitiatorFinishCommand(status);
+
+    if (status != 0 || !g_initiator_transfer.all_ok)
+    {
+        g_initiator_hash.sha = sha_checkpoint;
+        g_initiator_hash.crc = crc_checkpoint;
+        return false;
+    }
+
+    return true;
+}
+
+// Called by SD card driver during file read, sends completed sectors to SCSI bus
+static void initiatorWriteSDCallback(uint32_t bytes_complete)
+{
+    if (!g_initiator_transfer.all_ok)
+        return;
+
+    // Send data in whole sectors, except for the final part of the buffer
+    uint32_t bytesPerSector = g_initiator_transfer.bytes_per_sector;
+    if (bytes_complete < g_initiator_transfer.bytes_sd_scheduled)
+    {
+        bytes_complete -= bytes_complete % bytesPerSector;
+    }
+
+    if (bytes_complete > g_initiator_transfer.bytes_scsi_done)
+    {
+        uint32_t len = bytes_complete - g_initiator_transfer.bytes_scsi_done;
+        if (scsiHostWrite(&scsiDev.data[g_initiator_transfer.bytes_scsi_done], len) != len)
+        {
+            logmsg("Write failed at byte ", (int)(g_initiator_transfer.bytes_sd + g_initiator_transfer.bytes_scsi_done));
+            g_initiator_transfer.all_ok = false;
+        }
+        g_initiator_transfer.bytes_scsi_done += len;
+    }
+}
+
+bool scsiInitiatorWriteDataFromFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
+                                    FsFile &file)
+{
+    uint8_t command[10];
+    size_t cmdlen = scsiInitiatorBuildRWCommand(command, start_sector, sectorcount, true);
+
+    // Start executing command, return in data phase
+    int status = scsiInitiatorRunCommand(target_id, command, cmdlen, NULL, 0, NULL, 0, true);
+
+    if (status != 0)
+    {
+        uint8_t sense_key;
+        scsiRequestSense(target_id, &sense_key);
+
+        logmsg("scsiInitiatorWriteDataFromFile: WRITE failed: ", status, " sense key ", sense_key);
+        scsiHostPhyRelease();
+        return false;
+    }
+
+    // Data is read from SD card in chunks that fill scsiDev.data.
+    // The SD callback sends each completed sector to the SCSI bus while the rest of the chunk is still being read.
+    // bytes_sd counts bytes of previous chunks, bytes_scsi_done counts bytes sent from current chunk.
+    uint32_t total_bytes = sectorcount * sectorsize;
+    uint32_t maxchunk = sizeof(scsiDev.data) - sizeof(scsiDev.data) % sectorsize;
+    g_initiator_transfer.bytes_per_sector = sectorsize;
+    g_initiator_transfer.bytes_sd = 0;
+    g_initiator_transfer.all_ok = true;
+
+    while (g_initiator_transfer.bytes_sd < total_bytes && g_initiator_transfer.all_ok)
+    {
+        platform_poll();
+
+        SCSI_PHASE phase = (SCSI_PHASE)scsiHostPhyGetPhase();
+        if (phase != DATA_OUT && phase != BUS_BUSY)
+        {
+            break;
+        }
+
+        scsiInitiatorUpdateLed();
+
+        uint32_t len = total_bytes - g_initiator_transfer.bytes_sd;
+        if (len > maxchunk) len = maxchunk;
+
+        g_initiator_transfer.bytes_sd_scheduled = len;
+        g_initiator_transfer.bytes_scsi_done = 0;
+        platform_set_sd_callback(&initiatorWriteSDCallback, scsiDev.data);
+        if (file.read(scsiDev.data, len) != (int)len)
+        {
+            logmsg("scsiInitiatorWriteDataFromFile: SD card read failed");
+            g_initiator_transfer.all_ok = false;
+        }
+        platform_set_sd_callback(NULL, NULL);
+
+        // Send rest of the chunk
+        initiatorWriteSDCallback(len);
+        g_initiator_transfer.bytes_sd += g_initiator_transfer.bytes_scsi_done;
+    }
+
+    if (g_initiator_transfer.bytes_sd != total_bytes)
+    {
+        logmsg("SCSI write to sector ", (int)start_sector, " was incomplete: expected ",
+             (int)total_bytes, " sent ", (int)g_initiator_transfer.bytes_sd, " bytes");
         g_initiator_transfer.all_ok = false;
     }
 
+    status = scsiInitiatorFinishCommand(status);
+    return status == 0 && g_initiator_transfer.all_ok;
+}
+
+/*************************************
+ * Parallel imaging of many drives   *
+ *************************************/
+
+// Shared helpers such as scsiInitiatorBuildRWCommand() and initiatorHashWriteFile()
+// use g_initiator_state, so copy the relevant information there.
+static void scsiInitiatorParallelLoad(int target_id)
+{
+    initiator_drive_t *drive = &g_initiator_parallel.drives[target_id];
+    g_initiator_state.target_id = target_id;
+    g_initiator_state.sectorsize = drive->sectorsize;
+    g_initiator_state.sectorcount = drive->sectorcount;
+    g_initiator_state.sectors_done = drive->sectors_done;
+    g_initiator_state.ansi_version = drive->ansi_version;
+    g_initiator_state.eject_when_done = false;
+    strncpy(g_initiator_state.target_filename, drive->filename, sizeof(g_initiator_state.target_filename));
+    g_initiator_hash.crc = drive->crc;
+    g_initiator_hash.sha = drive->sha;
+}
+
+// Move the drive that was just scanned from g_initiator_state to a parallel imaging slot
+static void scsiInitiatorParallelAdd()
+{
+    int target_id = g_initiator_state.target_id;
+    initiator_drive_t *drive = &g_initiator_parallel.drives[target_id];
+    drive->active = true;
+    drive->disconnected = false;
+    drive->sectorsize = g_initiator_state.sectorsize;
+    drive->sectorcount = g_initiator_state.sectorcount;
+    drive->sectorcount_all = g_initiator_state.sectorcount_all;
+    drive->sectors_done = 0;
+    drive->max_sector_per_transfer = g_initiator_state.max_sector_per_transfer;
+    drive->bad_sector_count = 0;
+    drive->ansi_version = g_initiator_state.ansi_version;
+    drive->retrycount = 0;
+    drive->failposition = 0;
+    drive->crc = 0;
+    sha256_init(&drive->sha);
+    strncpy(drive->filename, g_initiator_state.target_filename, sizeof(drive->filename));
+
+    // Hand the open file over to drive->file. The copy has its own file state,
+    // so the original handle is closed and only the copy is used from now on.
+    drive->file = g_initiator_state.target_file;
+    g_initiator_state.target_file.close();
+
+    g_initiator_parallel.active_count++;
+    logmsg("SCSI ID ", target_id, " queued for parallel imaging to ", drive->filename);
+}
+
+// Handle failed READ command on drive, same retry logic as in the single drive mode
+static void scsiInitiatorParallelFailed(int target_id)
+{
+    initiator_drive_t *drive = &g_initiator_parallel.drives[target_id];
+    drive->disconnected = false;
+    drive->crc = drive->crc_cmd_start;
+    drive->sha = drive->sha_cmd_start;
+
+    logmsg("Failed to transfer ", (int)drive->cmd_sectors, " sectors starting at ", (int)drive->sectors_done,
+           " from SCSI ID ", target_id);
+
+    if (drive->retrycount < g_initiator_state.max_retry_count)
+    {
+        logmsg("Retrying.. ", drive->retrycount + 1, "/", (int)g_initiator_state.max_retry_count);
+        drive->retrycount++;
+
+        if (drive->retrycount > 1 && drive->cmd_sectors > 1)
+        {
+            logmsg("Multiple failures, retrying sector-by-sector");
+            drive->failposition = drive->sectors_done + drive->cmd_sectors;
+        }
+    }
+    else
+    {
+        logmsg("Retry limit exceeded, skipping one sector");
+
+        // Fill the skipped sector with zeros so that image and checksum stay consistent
+        memset(scsiDev.data, 0, drive->sectorsize);
+        drive->file.seek((uint64_t)drive->sectors_done * drive->sectorsize);
+        drive->file.write(scsiDev.data, drive->sectorsize);
+        scsiInitiatorParallelLoad(target_id);
+        initiatorHashUpdate(scsiDev.data, drive->sectorsize);
+        drive->crc = g_initiator_hash.crc;
+        drive->sha = g_initiator_hash.sha;
+
+        drive->retrycount = 0;
+        drive->sectors_done++;
+        drive->bad_sector_count++;
+    }
+}
+
+// Bus reset aborts the commands of all disconnected targets
+static void scsiInitiatorParallelAbortAll()
+{
+    for (int i = 0; i < 8; i++)
+    {
+        if (g_initiator_parallel.drives[i].active && g_initiator_parallel.drives[i].disconnected)
+        {
+            scsiInitiatorParallelFailed(i);
+        }
+    }
+}
+
+// Handle bus phases while target is connected, until it disconnects or completes the command.
+static void scsiInitiatorParallelService(int target_id, const uint8_t *command, size_t cmdlen)
+{
+    initiator_drive_t *drive = &g_initiator_parallel.drives[target_id];
+    uint32_t cmd_bytes = drive->cmd_sectors * drive->sectorsize;
+    uint64_t cmd_offset = (uint64_t)drive->sectors_done * drive->sectorsize;
+    bool command_complete = false;
+    bool disconnecting = false;
+    bool failed = false;
+    int status = -1;
+
+    scsiInitiatorParallelLoad(target_id);
+
+    SCSI_PHASE phase;
     while ((phase = (SCSI_PHASE)scsiHostPhyGetPhase()) != BUS_FREE)
     {
         platform_poll();
 
         if (phase == MESSAGE_IN)
         {
-            uint8_t dummy = 0;
-            scsiHostRead(&dummy, 1);
+            uint8_t msg = 0;
+            scsiHostRead(&msg, 1);
+
+            if (msg == 0x00)
+            {
+                // COMMAND COMPLETE
+                command_complete = true;
+            }
+            else if (msg == 0x01)
+            {
+                // Extended message, not supported so just skip it
+                uint8_t extmsg[256];
+                uint8_t len = 0;
+                scsiHostRead(&len, 1);
+                scsiHostRead(extmsg, len);
+            }
+            else if (msg == 0x02)
+            {
+                // SAVE DATA POINTER
+                drive->cmd_bytes_saved = drive->cmd_bytes_done;
+                drive->crc = g_initiator_hash.crc;
+                drive->sha = g_initiator_hash.sha;
+            }
+            else if (msg == 0x03)
+            {
+                // RESTORE POINTERS
+                drive->cmd_bytes_done = drive->cmd_bytes_saved;
+                g_initiator_hash.crc = drive->crc;
+                g_initiator_hash.sha = drive->sha;
+            }
+            else if (msg == 0x04)
+            {
+                // DISCONNECT
+                disconnecting = true;
+            }
+            else if (msg & 0x80)
+            {
+                // IDENTIFY after reselection, implies RESTORE POINTERS
+                drive->cmd_bytes_done = drive->cmd_bytes_saved;
+                g_initiator_hash.crc = drive->crc;
+                g_initiator_hash.sha = drive->sha;
+            }
         }
         else if (phase == MESSAGE_OUT)
         {
-            uint8_t identify_msg = 0x80;
+            // IDENTIFY with disconnect privilege.
+            // ATN is released before the last byte of the message.
+            uint8_t identify_msg = 0xC0;
+            scsiHostPhySetATN(false);
             scsiHostWrite(&identify_msg, 1);
         }
+        else if (phase == COMMAND)
+        {
+            if (command == NULL)
+            {
+                logmsg("SCSI ID ", target_id, " requested command after reselection");
+                failed = true;
+                break;
+            }
+            scsiHostWrite(command, cmdlen);
+        }
+        else if (phase == DATA_IN)
+        {
+            if (drive->cmd_bytes_done >= cmd_bytes)
+            {
+                logmsg("SCSI ID ", target_id, " is sending more data than requested");
+                failed = true;
+                break;
+            }
+
+            drive->file.seek(cmd_offset + drive->cmd_bytes_done);
+            drive->cmd_bytes_done += scsiInitiatorReceiveDataToFile(drive->file,
+                cmd_bytes - drive->cmd_bytes_done, drive->sectorsize, true);
+
+            if (!g_initiator_transfer.all_ok)
+            {
+                failed = true;
+                break;
+            }
+        }
         else if (phase == STATUS)
         {
             uint8_t tmp = 0;
@@ -994,11 +1741,323 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
             status = tmp;
             dbgmsg("------ STATUS: ", tmp);
         }
+        else if (phase == DATA_OUT)
+        {
+            logmsg("SCSI ID ", target_id, " entered unexpected DATA_OUT phase");
+            failed = true;
+            break;
+        }
+    }
+
+    if (failed)
+    {
+        // Target may still be holding the bus
+        scsiHostPhyReset();
+        scsiInitiatorParallelAbortAll();
+        scsiInitiatorParallelFailed(target_id);
+        return;
     }
 
     scsiHostPhyRelease();
 
-    return status == 0 && g_initiator_transfer.all_ok;
+    if (disconnecting && !command_complete)
+    {
+        drive->disconnected = true;
+        drive->disconnect_time = millis();
+        return;
+    }
+
+    if (command_complete && status == 0 && drive->cmd_bytes_done == cmd_bytes)
+    {
+        drive->crc = g_initiator_hash.crc;
+        drive->sha = g_initiator_hash.sha;
+        drive->retrycount = 0;
+        drive->sectors_done += drive->cmd_sectors;
+        drive->file.flush();
+
+        dbgmsg("SCSI ID ", target_id, " read succeeded, sectors done: ",
+               (int)drive->sectors_done, " / ", (int)drive->sectorcount);
+        return;
+    }
+
+    if (status == 2)
+    {
+        uint8_t sense_key;
+        scsiRequestSense(target_id, &sense_key);
+        logmsg("SCSI ID ", target_id, " READ failed, sense key ", sense_key);
+    }
+    else if (command_complete && status == 0)
+    {
+        logmsg("SCSI ID ", target_id, " READ was incomplete: expected ",
+               (int)cmd_bytes, " got ", (int)drive->cmd_bytes_done, " bytes");
+    }
+
+    scsiInitiatorParallelFailed(target_id);
+}
+
+// Send next READ command to drive, target may disconnect after receiving it
+static void scsiInitiatorParallelStartRead(int target_id)
+{
+    initiator_drive_t *drive = &g_initiator_parallel.drives[target_id];
+
+    uint32_t numtoread = drive->sectorcount - drive->sectors_done;
+    if (numtoread > drive->max_sector_per_transfer)
+        numtoread = drive->max_sector_per_transfer;
+
+    // Retry sector-by-sector after failure
+    if (drive->sectors_done < drive->failposition)
+        numtoread = 1;
+
+    drive->cmd_sectors = numtoread;
+    drive->cmd_bytes_done = 0;
+    drive->cmd_bytes_saved = 0;
+    drive->crc_cmd_start = drive->crc;
+    drive->sha_cmd_start = drive->sha;
+
+    scsiInitiatorParallelLoad(target_id);
+
+    uint8_t command[10];
+    size_t cmdlen = scsiInitiatorBuildRWCommand(command, drive->sectors_done, numtoread, false);
+
+    if (!scsiHostPhySelect(target_id, g_initiator_state.initiator_id, true))
+    {
+        dbgmsg("------ Target ", target_id, " did not respond");
+        scsiHostPhyRelease();
+        scsiInitiatorParallelFailed(target_id);
+        delay_with_poll(200);
+        return;
+    }
+
+    scsiInitiatorParallelService(target_id, command, cmdlen);
+}
+
+// Close the image file and report results after all sectors have been read
+static void scsiInitiatorParallelFinish(int target_id)
+{
+    initiator_drive_t *drive = &g_initiator_parallel.drives[target_id];
+    drive->file.close();
+
+    uint32_t elapsed = millis() - drive->transfer_start_time;
+    uint64_t total_bytes = (uint64_t)drive->sectors_done * drive->sectorsize;
+    logmsg("Transferred ", (int)(total_bytes / 1024), " kB from SCSI ID ", target_id, " in ", (int)(elapsed / 1000),
+           " s, average speed ", (int)(total_bytes / (elapsed + 1)), " kB/s");
+
+    scsiInitiatorParallelLoad(target_id);
+    initiatorHashWriteFile();
+    scsiStartStopUnit(target_id, false);
+
+    logmsg("Finished imaging drive with id ", target_id);
+
+    if (drive->sectorcount != drive->sectorcount_all)
+    {
+        logmsg("NOTE: Image size was limited to first 4 GiB due to SD card filesystem limit");
+        logmsg("Please reformat the SD card with exFAT format to image this drive fully");
+    }
+
+    if (drive->bad_sector_count != 0)
+    {
+        logmsg("NOTE: There were ",  (int) drive->bad_sector_count, " bad sectors that could not be read off this drive.");
+    }
+
+    logmsg("Marking SCSI ID, ", target_id, ", as imaged, wont ask it again.");
+    g_initiator_state.drives_imaged |= (1 << target_id);
+    drive->active = false;
+    g_initiator_parallel.active_count--;
+
+    if (g_initiator_parallel.active_count == 0)
+    {
+        logmsg("Parallel imaging finished");
+        g_initiator_parallel.running = false;
+        LED_OFF();
+    }
+}
+
+// Run one step of parallel imaging: either service a target that reconnects,
+// or start a new command on the next idle drive.
+static void scsiInitiatorParallelStep()
+{
+    if (!g_initiator_parallel.running)
+    {
+        logmsg("Starting parallel imaging of ", g_initiator_parallel.active_count, " drives");
+        g_initiator_parallel.running = true;
+        for (int i = 0; i < 8; i++)
+        {
+            g_initiator_parallel.drives[i].transfer_start_time = millis();
+        }
+    }
+
+    int target_id = scsiHostPhyReselect(g_initiator_state.initiator_id);
+    if (target_id >= 0)
+    {
+        if (!g_initiator_parallel.drives[target_id].active ||
+            !g_initiator_parallel.drives[target_id].disconnected)
+        {
+            logmsg("Unexpected reselection by SCSI ID ", target_id, ", resetting bus");
+            scsiHostPhyReset();
+            scsiInitiatorParallelAbortAll();
+            return;
+        }
+
+        g_initiator_parallel.drives[target_id].disconnected = false;
+        scsiInitiatorParallelService(target_id, NULL, 0);
+        return;
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        initiator_drive_t *drive = &g_initiator_parallel.drives[i];
+        if (drive->active && drive->disconnected)
+        {
+            if ((uint32_t)(millis() - drive->disconnect_time) > INITIATOR_RESELECT_TIMEOUT_MS)
+            {
+                logmsg("SCSI ID ", i, " did not reselect within timeout, resetting bus");
+                scsiHostPhyReset();
+                scsiInitiatorParallelAbortAll();
+                return;
+            }
+        }
+    }
+
+    // Start next command in round-robin order.
+    // If all drives are disconnected, keep polling for reselection.
+    for (int n = 0; n < 8; n++)
+    {
+        int i = (g_initiator_parallel.next_target + n) % 8;
+        initiator_drive_t *drive = &g_initiator_parallel.drives[i];
+        if (drive->active && !drive->disconnected)
+        {
+            g_initiator_parallel.next_target = (i + 1) % 8;
+
+            if (drive->sectors_done >= drive->sectorcount)
+            {
+                scsiInitiatorParallelFinish(i);
+            }
+            else
+            {
+                scsiInitiatorParallelStartRead(i);
+                scsiInitiatorUpdateLed();
+            }
+            return;
+        }
+    }
+}
+
+/*************************************
+ * Verification of completed image   *
+ *************************************/
+
+// Reopen the image file for reading and prepare to compare it against the drive.
+// Returns false if verification cannot be done.
+static bool scsiInitiatorStartVerify()
+{
+    uint32_t half = sizeof(scsiDev.data) / 2;
+    if (g_initiator_state.sectorsize == 0 || g_initiator_state.sectorsize > half)
+    {
+        logmsg("Sector size ", (int)g_initiator_state.sectorsize, " is too large for verification, skipping");
+        return false;
+    }
+
+    g_initiator_state.target_file = SD.open(g_initiator_state.target_filename, O_RDONLY);
+    if (!g_initiator_state.target_file.isOpen())
+    {
+        logmsg("Failed to open file for verification: ", g_initiator_state.target_filename);
+        return false;
+    }
+
+    logmsg("Verifying ", g_initiator_state.target_filename, " against SCSI ID ", g_initiator_state.target_id);
+    g_initiator_state.verifying = true;
+    g_initiator_state.verify_sectors_done = 0;
+    g_initiator_state.verify_mismatch_count = 0;
+    g_initiator_state.verify_unreadable_count = 0;
+    g_initiator_state.retrycount = 0;
+    g_initiator_state.failposition = 0;
+    return true;
+}
+
+// Read one batch of sectors from the drive and compare against the image file.
+// Drive data goes to the first half of scsiDev.data and file data to the second half.
+static void scsiInitiatorVerifyStep()
+{
+    uint32_t half = sizeof(scsiDev.data) / 2;
+    uint32_t sectorsize = g_initiator_state.sectorsize;
+    uint32_t start_sector = g_initiator_state.verify_sectors_done;
+
+    uint32_t numtoread = g_initiator_state.sectorcount - start_sector;
+    if (numtoread > half / sectorsize)
+        numtoread = half / sectorsize;
+    if (numtoread > g_initiator_state.max_sector_per_transfer)
+        numtoread = g_initiator_state.max_sector_per_transfer;
+    if (start_sector < g_initiator_state.failposition)
+        numtoread = 1;
+
+    scsiInitiatorUpdateLed();
+
+    uint8_t *drivebuf = &scsiDev.data[0];
+    uint8_t *filebuf = &scsiDev.data[half];
+    uint32_t bytes = numtoread * sectorsize;
+
+    uint8_t command[10];
+    size_t cmdlen = scsiInitiatorBuildRWCommand(command, start_sector, numtoread, false);
+    uint32_t time_start = millis();
+    int status = scsiInitiatorRunCommand(g_initiator_state.target_id, command, cmdlen,
+                                         drivebuf, bytes, NULL, 0);
+
+    if (status != 0)
+    {
+        if (status == 2)
+        {
+            uint8_t sense_key;
+            scsiRequestSense(g_initiator_state.target_id, &sense_key);
+        }
+
+        if (g_initiator_state.retrycount < g_initiator_state.max_retry_count)
+        {
+            logmsg("Verify read failed at sector ", (int)start_sector, ", retrying.. ",
+                   g_initiator_state.retrycount + 1, "/", (int)g_initiator_state.max_retry_count);
+            g_initiator_state.retrycount++;
+            if (g_initiator_state.retrycount > 1 && numtoread > 1)
+            {
+                g_initiator_state.failposition = start_sector + numtoread;
+            }
+            delay_with_poll(200);
+        }
+        else
+        {
+            logmsg("Verify read failed at sector ", (int)start_sector, ", skipping one sector");
+            g_initiator_state.retrycount = 0;
+            g_initiator_state.verify_unreadable_count++;
+            g_initiator_state.verify_sectors_done++;
+        }
+        return;
+    }
+
+    g_initiator_state.retrycount = 0;
+    g_initiator_state.target_file.seek((uint64_t)start_sector * sectorsize);
+    if (g_initiator_state.target_file.read(filebuf, bytes) != (int)bytes)
+    {
+        logmsg("Verify: failed to read image file at sector ", (int)start_sector);
+        memset(filebuf, 0, bytes);
+    }
+
+    for (uint32_t i = 0; i < numtoread; i++)
+    {
+        if (memcmp(drivebuf + i * sectorsize, filebuf + i * sectorsize, sectorsize) != 0)
+        {
+            if (g_initiator_state.verify_mismatch_count < 10)
+            {
+                logmsg("Verify: sector ", (int)(start_sector + i), " differs from image file");
+            }
+            g_initiator_state.verify_mismatch_count++;
+        }
+    }
+
+    g_initiator_state.verify_sectors_done += numtoread;
+
+    int speed_kbps = bytes / (millis() - time_start + 1);
+    logmsg("SCSI verify succeeded, sectors done: ",
+            (int)g_initiator_state.verify_sectors_done, " / ", (int)g_initiator_state.sectorcount,
+            " speed ", speed_kbps, " kB/s - ",
+            (int)(100 * (uint64_t)g_initiator_state.verify_sectors_done / g_initiator_state.sectorcount), "%");
 }
 
 
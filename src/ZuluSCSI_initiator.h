@@ -60,3 +60,7 @@ bool scsiTestUnitReady(int target_id);
 class FsFile;
 bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
                                  FsFile &file);
+
+// Read a block of data from file on SD card and write to SCSI device
+bool scsiInitiatorWriteDataFromFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
+                                    FsFile &file);
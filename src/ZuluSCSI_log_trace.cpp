@@ -24,13 +24,17 @@
 
 #include "ZuluSCSI_log_trace.h"
 #include "ZuluSCSI_log.h"
+#include "ZuluSCSI_settings.h"
 #include <scsi2sd.h>
+#include <SdFat.h>
 
 extern "C" {
 #include <scsi.h>
 #include <scsiPhy.h>
 }
 
+extern SdFs SD;
+
 static bool g_LogData = false;
 static bool g_LogInitiatorCommand = false;
 static int g_InByteCount = 0;
@@ -112,6 +116,11 @@ static const char *getCommandName(uint8_t cmd)
         case 0xD8: return "Vendor 0xD8 Command (Toolbox set next CD/Apple/Plextor)";
         case 0xD9: return "Vendor 0xD9 Command (Toolbox list devices/Apple)";
         case 0xDA: return "Vendor 0xDA Command (Toolbox count CDs)";
+        case 0xDB: return "Vendor 0xDB Command (Toolbox list files paged)";
+        case 0xDC: return "Vendor 0xDC Command (Toolbox count files 16-bit)";
+        case 0xDD: return "Vendor 0xDD Command (Toolbox get file block)";
+        case 0xDE: return "Vendor 0xDE Command (Toolbox send file block)";
+        case 0xDF: return "Vendor 0xDF Command (Toolbox get block size)";
         case 0xE0: return "Xebec RAM Diagnostic";
         case 0xE4: return "Xebec Drive Diagnostic";              
         default:   return "Unknown";
@@ -212,6 +221,164 @@ static void printNewPhase(int phase, bool initiator = false)
     }
 }
 
+/*********************/
+/* Binary event trace */
+/*********************/
+
+#if TRACE_RING_ENTRIES > 0
+
+bool g_trace_enabled;
+uint32_t g_trace_head;
+scsi_trace_entry_t g_trace_ring[TRACE_RING_ENTRIES];
+
+static FsFile g_trace_file;
+static uint32_t g_trace_saved;
+static uint32_t g_trace_prev_save;
+
+static_assert((TRACE_RING_ENTRIES & (TRACE_RING_ENTRIES - 1)) == 0, "TRACE_RING_ENTRIES must be a power of two");
+static_assert(sizeof(scsi_trace_entry_t) == 12, "Trace file format expects 12 byte entries");
+
+// Record command with the LBA decoded from 6 and 10/12 byte CDBs.
+// The first 6 bytes of the CDB have been received at this point.
+static void traceCommand(const uint8_t *cdb)
+{
+    if (!g_trace_enabled)
+        return;
+
+    uint32_t lba = 0;
+    uint8_t group = cdb[0] >> 5;
+    if (group == 0)
+    {
+        lba = ((uint32_t)(cdb[1] & 0x1F) << 16) | ((uint32_t)cdb[2] << 8) | cdb[3];
+    }
+    else if (group == 1 || group == 2 || group == 5)
+    {
+        lba = ((uint32_t)cdb[2] << 24) | ((uint32_t)cdb[3] << 16) | ((uint32_t)cdb[4] << 8) | cdb[5];
+    }
+
+    // scsiDev.lun is only updated after the whole CDB has been received.
+    // Use the IDENTIFY message LUN if there was one, otherwise the CDB
+    // LUN field, in the same order as process_Command().
+    uint8_t lun;
+    if (scsiDev.lun >= 0)
+        lun = scsiDev.lun;
+    else if (cdb[0] == 0xE0 || cdb[0] == 0xE4)
+        lun = 0;
+    else
+        lun = cdb[1] >> 5;
+
+    uint16_t id = scsiDev.target ? scsiDev.target->targetId : 0xFF;
+    scsiTrace(TRACE_COMMAND, cdb[0], id | ((uint16_t)lun << 8), lba);
+}
+
+void scsiTraceInit()
+{
+    static bool first_open_after_boot = true;
+
+    g_trace_enabled = false;
+    if (!g_scsi_settings.getSystem()->enableBinaryTrace)
+        return;
+
+    int flags = O_WRONLY | O_CREAT | (first_open_after_boot ? O_TRUNC : O_APPEND);
+    g_trace_file = SD.open(TRACEFILE, flags);
+    if (!g_trace_file.isOpen())
+    {
+        logmsg("Failed to open trace file: ", SD.sdErrorCode());
+        return;
+    }
+
+    if (g_trace_file.size() == 0)
+    {
+        // Header: magic, format version, entry size, counter ticks per second, ring size
+        uint8_t header[16] = {'Z', 'T', 'R', 'C', 1, 0, sizeof(scsi_trace_entry_t), 0};
+        uint32_t tps = PLATFORM_TRACE_TICKS_PER_SEC;
+        memcpy(&header[8], &tps, 4);
+        uint32_t entries = TRACE_RING_ENTRIES;
+        memcpy(&header[12], &entries, 4);
+        g_trace_file.write(header, sizeof(header));
+        g_trace_file.flush();
+    }
+
+    logmsg("Binary SCSI trace enabled, saving to ", TRACEFILE);
+    first_open_after_boot = false;
+    g_trace_saved = g_trace_head;
+    g_trace_prev_save = millis();
+    g_trace_enabled = true;
+}
+
+void scsiTraceClose()
+{
+    g_trace_enabled = false;
+    g_trace_file.close();
+}
+
+void scsiTraceSave()
+{
+    if (!g_trace_enabled)
+        return;
+
+    uint32_t pending = g_trace_head - g_trace_saved;
+    if (pending == 0)
+        return;
+
+    if (scsiDev.phase == BUS_FREE)
+    {
+        // Save when there is a reasonable amount of data, or periodically
+        if (pending < TRACE_RING_ENTRIES / 8 &&
+            (uint32_t)(millis() - g_trace_prev_save) < LOG_SAVE_INTERVAL_MS)
+            return;
+    }
+    else if (scsiDev.phase != STATUS || pending < TRACE_RING_ENTRIES / 2)
+    {
+        return;
+    }
+
+    // Timestamp counter can wrap around in less than a minute,
+    // millisecond clock lets the decoder count the wraps.
+    scsiTrace(TRACE_CLOCK, 0, 0, millis());
+    pending = g_trace_head - g_trace_saved;
+
+    if (pending > TRACE_RING_ENTRIES)
+    {
+        scsi_trace_entry_t lost = {};
+        lost.ticks = g_trace_ring[(g_trace_head - TRACE_RING_ENTRIES) & (TRACE_RING_ENTRIES - 1)].ticks;
+        lost.event = TRACE_OVERFLOW;
+        lost.arg32 = pending - TRACE_RING_ENTRIES;
+        g_trace_file.write(&lost, sizeof(lost));
+        g_trace_saved = g_trace_head - TRACE_RING_ENTRIES;
+    }
+
+    // Ring buffer contents are written in at most two parts
+    while (g_trace_saved != g_trace_head)
+    {
+        uint32_t start = g_trace_saved & (TRACE_RING_ENTRIES - 1);
+        uint32_t count = g_trace_head - g_trace_saved;
+        if (count > TRACE_RING_ENTRIES - start) count = TRACE_RING_ENTRIES - start;
+        g_trace_file.write(&g_trace_ring[start], count * sizeof(scsi_trace_entry_t));
+        g_trace_saved += count;
+    }
+
+    g_trace_file.flush();
+    g_trace_prev_save = millis();
+}
+
+#else
+
+static void traceCommand(const uint8_t *cdb) {}
+
+void scsiTraceInit()
+{
+    if (g_scsi_settings.getSystem()->enableBinaryTrace)
+    {
+        logmsg("Binary SCSI trace is not available in this firmware build");
+    }
+}
+
+void scsiTraceClose() {}
+void scsiTraceSave() {}
+
+#endif
+
 void scsiLogPhaseChange(int new_phase)
 {
     static int old_scsi_id = 0;
@@ -262,6 +429,10 @@ void scsiLogPhaseChange(int new_phase)
             }
         }
 
+        if (new_phase == STATUS && scsiDev.target)
+            scsiTrace(TRACE_STATUS, scsiDev.status, scsiDev.target->sense.asc, scsiDev.target->sense.code);
+        scsiTrace(TRACE_PHASE, (uint8_t)new_phase, scsiDev.target ? scsiDev.target->targetId : 0xFF, 0);
+
         printNewPhase(new_phase);
         old_phase = new_phase;
         old_sync_period = scsiDev.target->syncPeriod;
@@ -282,6 +453,7 @@ void scsiLogInitiatorPhaseChange(int new_phase)
         g_InByteCount = g_OutByteCount = 0;
         g_DataChecksum = 0;
 
+        scsiTrace(TRACE_INITIATOR_PHASE, (uint8_t)new_phase, 0, 0);
         printNewPhase(new_phase, true);
         old_phase = new_phase;
     }
@@ -289,6 +461,8 @@ void scsiLogInitiatorPhaseChange(int new_phase)
 
 void scsiLogDataIn(const uint8_t *buf, uint32_t length)
 {
+    scsiTrace(TRACE_DATA_IN, 0, 0, length);
+
     if (g_LogData)
     {
         dbgmsg("------ IN: ", bytearray(buf, length));
@@ -309,6 +483,15 @@ void scsiLogDataIn(const uint8_t *buf, uint32_t length)
 
 void scsiLogDataOut(const uint8_t *buf, uint32_t length)
 {
+    if (buf == scsiDev.cdb)
+    {
+        traceCommand(buf);
+    }
+    else
+    {
+        scsiTrace(TRACE_DATA_OUT, 0, 0, length);
+    }
+
     if (buf == scsiDev.cdb || g_LogInitiatorCommand)
     {
         dbgmsg("---- COMMAND: ", getCommandName(buf[0]));
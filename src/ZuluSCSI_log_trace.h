@@ -30,4 +30,69 @@
 void scsiLogPhaseChange(int new_phase);
 void scsiLogInitiatorPhaseChange(int new_phase);
 void scsiLogDataIn(const uint8_t *buf, uint32_t length);
-void scsiLogDataOut(const uint8_t *buf, uint32_t length);
\ No newline at end of file
+void scsiLogDataOut(const uint8_t *buf, uint32_t length);
+
+// Binary trace of SCSI events, enabled with BinaryTrace = 1 in ini file.
+// Events are stored in a RAM ring buffer with a timestamp from a free
+// running platform counter, which takes only a few cycles per event.
+// scsiTraceSave() appends them to TRACEFILE from the main loop when the
+// bus is free. utils/decode_trace.py reconstructs timelines from the file.
+#include "ZuluSCSI_config.h"
+#include "ZuluSCSI_platform.h"
+
+#ifndef PLATFORM_TRACE_TICKS_PER_SEC
+#define PLATFORM_TRACE_TICKS_PER_SEC 1000
+static inline uint32_t platform_trace_ticks() { return millis(); }
+#endif
+
+enum scsi_trace_event_t {
+    TRACE_PHASE = 1,        // arg8: new phase, arg16: target id
+    TRACE_COMMAND = 2,      // arg8: opcode, arg16: target id | lun << 8, arg32: LBA
+    TRACE_DATA_IN = 3,      // arg32: byte count
+    TRACE_DATA_OUT = 4,     // arg32: byte count
+    TRACE_STATUS = 5,       // arg8: status, arg16: sense ASC, arg32: sense key
+    TRACE_INITIATOR_PHASE = 6, // arg8: new phase
+    TRACE_CLOCK = 7,        // arg32: millis(), used by decoder to resolve counter wraparound
+    TRACE_OVERFLOW = 8,     // arg32: number of events lost
+    TRACE_USER = 0x80       // Free for temporary debug events
+};
+
+struct scsi_trace_entry_t {
+    uint32_t ticks;
+    uint8_t event;
+    uint8_t arg8;
+    uint16_t arg16;
+    uint32_t arg32;
+};
+
+#if TRACE_RING_ENTRIES > 0
+extern bool g_trace_enabled;
+extern uint32_t g_trace_head;
+extern scsi_trace_entry_t g_trace_ring[TRACE_RING_ENTRIES];
+
+static inline void scsiTrace(uint8_t event, uint8_t arg8, uint16_t arg16, uint32_t arg32)
+{
+    if (g_trace_enabled)
+    {
+        scsi_trace_entry_t *e = &g_trace_ring[g_trace_head++ & (TRACE_RING_ENTRIES - 1)];
+        e->ticks = platform_trace_ticks();
+        e->event = event;
+        e->arg8 = arg8;
+        e->arg16 = arg16;
+        e->arg32 = arg32;
+    }
+}
+#else
+// Binary trace is not included in this build
+static inline void scsiTrace(uint8_t event, uint8_t arg8, uint16_t arg16, uint32_t arg32) {}
+#endif
+
+// Open trace file if enabled in settings, called after SD card is mounted
+void scsiTraceInit();
+
+// Close trace file before SD card is unmounted
+void scsiTraceClose();
+
+// Write recorded events to SD card when the bus is free,
+// or during status phase if the ring buffer is getting full.
+void scsiTraceSave();
@@ -25,6 +25,13 @@
 #include "ZuluSCSI_platform.h"
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_msc.h"
+#include "ZuluSCSI_disk.h"
+#include "ZuluSCSI_settings.h"
+#include <stdio.h>
+
+extern "C" {
+#include <scsi.h>
+}
 
 // external global SD variable
 extern SdFs SD;
@@ -32,6 +39,261 @@ extern SdFs SD;
 // public globals
 volatile MSC_LEDState MSC_LEDMode;
 
+// Drives presented to host in card reader mode.
+// LUN 0 is the whole SD card, with USBMassStorageImages enabled the
+// image files follow as their own LUNs. Image LUNs map directly to the
+// contiguous sector range of the file on the card.
+#define MSC_MAX_LUNS (1 + S2S_MAX_TARGETS)
+
+static struct {
+  uint32_t first_sector;
+  uint32_t sector_count;
+  bool writable;
+  char name[17];
+} g_msc_luns[MSC_MAX_LUNS];
+static uint8_t g_msc_lun_count;
+
+// Sector cache between USB transfers and the SD card.
+// SCSI emulation is not running in card reader mode, so the SCSI data
+// buffer is free to use. The buffer holds either read-ahead data or
+// consecutive written sectors that have not yet been stored.
+#define MSC_CACHE_SECTORS (sizeof(scsiDev.data) / SD_SECTOR_SIZE)
+
+static struct {
+  uint32_t lba; // First sector in buffer
+  uint32_t count; // Number of valid sectors in buffer
+  uint32_t next_lba; // Sector following the previous access
+  bool dirty; // Buffer contains sectors not yet written to SD card
+  bool write_failed; // Storing the dirty sectors failed, not yet reported to host
+  volatile bool busy; // Main loop is flushing the buffer
+} g_msc_cache;
+
+static bool msc_cache_write_out()
+{
+  if (!g_msc_cache.dirty)
+    return true;
+
+  if (!SD.card()->writeSectors(g_msc_cache.lba, scsiDev.data, g_msc_cache.count))
+  {
+    // The host has already been given GOOD status for these sectors.
+    // Keep them dirty for a retry and fail the next command.
+    logmsg("MSC: SD card write failed at sector ", g_msc_cache.lba, ", count ", g_msc_cache.count);
+    g_msc_cache.write_failed = true;
+    return false;
+  }
+
+  // Written data remains valid for reads
+  g_msc_cache.dirty = false;
+  g_msc_cache.write_failed = false;
+  return true;
+}
+
+// Report a failed deferred write once, later commands retry it
+static bool msc_cache_check_failed()
+{
+  if (!g_msc_cache.write_failed)
+    return false;
+
+  g_msc_cache.write_failed = false;
+  return true;
+}
+
+static int32_t msc_cache_read(uint32_t lba, uint8_t *buf, uint32_t sectors, uint32_t readahead)
+{
+  if (g_msc_cache.busy)
+    return 0;
+
+  if (msc_cache_check_failed())
+    return -1;
+
+  if (g_msc_cache.dirty && !msc_cache_write_out())
+    return -1;
+
+  bool sequential = (lba == g_msc_cache.next_lba);
+  g_msc_cache.next_lba = lba + sectors;
+
+  if (lba >= g_msc_cache.lba && lba + sectors <= g_msc_cache.lba + g_msc_cache.count)
+  {
+    memcpy(buf, &scsiDev.data[(lba - g_msc_cache.lba) * SD_SECTOR_SIZE], sectors * SD_SECTOR_SIZE);
+    return sectors;
+  }
+
+  if (sectors >= MSC_CACHE_SECTORS)
+  {
+    // Too large to benefit from the cache
+    return SD.card()->readSectors(lba, buf, sectors) ? (int32_t)sectors : -1;
+  }
+
+  // Read the requested sectors and, for sequential access, as much more as fits in the buffer.
+  uint32_t count = sequential ? MSC_CACHE_SECTORS : sectors;
+  if (readahead > count) count = readahead;
+  if (count > MSC_CACHE_SECTORS) count = MSC_CACHE_SECTORS;
+  uint32_t card_sectors = g_msc_luns[0].sector_count;
+  if (lba < card_sectors && count > card_sectors - lba)
+    count = card_sectors - lba;
+  if (count < sectors) count = sectors;
+
+  g_msc_cache.count = 0;
+  if (!SD.card()->readSectors(lba, scsiDev.data, count))
+    return -1;
+
+  g_msc_cache.lba = lba;
+  g_msc_cache.count = count;
+  memcpy(buf, scsiDev.data, sectors * SD_SECTOR_SIZE);
+  return sectors;
+}
+
+static int32_t msc_cache_write(uint32_t lba, const uint8_t *buf, uint32_t sectors)
+{
+  if (g_msc_cache.busy)
+    return 0;
+
+  if (msc_cache_check_failed())
+    return -1;
+
+  g_msc_cache.next_lba = lba + sectors;
+
+  if (g_msc_cache.dirty && lba == g_msc_cache.lba + g_msc_cache.count
+      && g_msc_cache.count + sectors <= MSC_CACHE_SECTORS)
+  {
+    // Continues the previous write
+    memcpy(&scsiDev.data[g_msc_cache.count * SD_SECTOR_SIZE], buf, sectors * SD_SECTOR_SIZE);
+    g_msc_cache.count += sectors;
+  }
+  else
+  {
+    if (!msc_cache_write_out())
+      return -1;
+
+    g_msc_cache.count = 0;
+    if (sectors >= MSC_CACHE_SECTORS)
+    {
+      return SD.card()->writeSectors(lba, buf, sectors) ? (int32_t)sectors : -1;
+    }
+
+    memcpy(scsiDev.data, buf, sectors * SD_SECTOR_SIZE);
+    g_msc_cache.lba = lba;
+    g_msc_cache.count = sectors;
+    g_msc_cache.dirty = true;
+  }
+
+  if (g_msc_cache.count == MSC_CACHE_SECTORS && !msc_cache_write_out())
+    return -1;
+
+  return sectors;
+}
+
+bool msc_cache_flush()
+{
+  if (msc_cache_check_failed())
+    return false;
+
+  return msc_cache_write_out();
+}
+
+void zuluscsi_msc_init_luns()
+{
+  g_msc_lun_count = 1;
+  g_msc_luns[0].first_sector = 0;
+  g_msc_luns[0].sector_count = SD.card()->sectorCount();
+  g_msc_luns[0].writable = true;
+  strcpy(g_msc_luns[0].name, "SD card");
+
+  if (!g_scsi_settings.getSystem()->usbMassStorageImages)
+    return;
+
+  for (int i = 0; i < S2S_MAX_TARGETS; i++)
+  {
+    image_config_t &img = scsiDiskGetImageConfig(i);
+    if (!img.file.isOpen() || img.file.isRom())
+      continue;
+
+    int id = img.scsiId & S2S_CFG_TARGET_ID_BITS;
+    uint32_t bgn, end;
+    uint32_t count = img.file.size() / SD_SECTOR_SIZE;
+    if (!img.file.contiguousRange(&bgn, &end) || count == 0 || end < bgn + count - 1)
+    {
+      logmsg("---- Image for ID ", id, " is not contiguous on SD card, not presented as USB drive");
+      continue;
+    }
+
+    char filename[MAX_FILE_PATH + 1];
+    if (img.file.getFilename(filename, sizeof(filename)) == 0)
+      snprintf(filename, sizeof(filename), "SCSI ID %d", id);
+
+    uint8_t lun = g_msc_lun_count++;
+    g_msc_luns[lun].first_sector = bgn;
+    g_msc_luns[lun].sector_count = count;
+    g_msc_luns[lun].writable = img.file.isWritable() && img.deviceType != S2S_CFG_OPTICAL;
+    strncpy(g_msc_luns[lun].name, filename, sizeof(g_msc_luns[lun].name) - 1);
+    g_msc_luns[lun].name[sizeof(g_msc_luns[lun].name) - 1] = '\0';
+
+    logmsg("---- USB drive ", (int)lun, ": ", filename, ", ", (int)count, " sectors",
+           g_msc_luns[lun].writable ? "" : ", read-only");
+  }
+
+  if (g_msc_lun_count > 1)
+  {
+    // Writes to the filesystem could move or delete an image while the host
+    // has it mounted through the direct sector mapping.
+    g_msc_luns[0].writable = false;
+    logmsg("---- SD card is presented read-only while image files are USB drives");
+  }
+}
+
+uint8_t msc_lun_count()
+{
+  return g_msc_lun_count;
+}
+
+uint32_t msc_lun_sectors(uint8_t lun)
+{
+  return (lun < g_msc_lun_count) ? g_msc_luns[lun].sector_count : 0;
+}
+
+bool msc_lun_writable(uint8_t lun)
+{
+  return lun < g_msc_lun_count && g_msc_luns[lun].writable;
+}
+
+const char *msc_lun_name(uint8_t lun)
+{
+  return (lun < g_msc_lun_count) ? g_msc_luns[lun].name : "";
+}
+
+int32_t msc_lun_read(uint8_t lun, uint32_t lba, uint8_t *buf, uint32_t sectors, uint32_t readahead)
+{
+  if (lun >= g_msc_lun_count || lba + sectors > g_msc_luns[lun].sector_count)
+    return -1;
+
+  uint32_t left = g_msc_luns[lun].sector_count - lba;
+  if (readahead > left) readahead = left;
+
+  return msc_cache_read(g_msc_luns[lun].first_sector + lba, buf, sectors, readahead);
+}
+
+int32_t msc_lun_write(uint8_t lun, uint32_t lba, const uint8_t *buf, uint32_t sectors)
+{
+  if (lun >= g_msc_lun_count || !g_msc_luns[lun].writable
+      || lba + sectors > g_msc_luns[lun].sector_count)
+    return -1;
+
+  return msc_cache_write(g_msc_luns[lun].first_sector + lba, buf, sectors);
+}
+
+// Flush from main loop while USB callbacks may interrupt.
+// Callbacks return busy while the flag is set and are retried by the USB stack.
+static bool msc_cache_flush_idle()
+{
+  if (!g_msc_cache.dirty)
+    return true;
+
+  g_msc_cache.busy = true;
+  bool status = msc_cache_write_out();
+  g_msc_cache.busy = false;
+  return status;
+}
+
 // card reader operation loop
 // assumption that SD card was enumerated and is working
 void zuluscsi_msc_loop() {
@@ -78,6 +340,8 @@ void zuluscsi_msc_loop() {
         // sync sd card ~ 500ms after writes stop
         if (syncCounter && (++syncCounter > 8)) {
           syncCounter = 0;
+          // On failure the next host command gets MEDIUM ERROR
+          msc_cache_flush_idle();
           SD.card()->syncDevice();
         }
     }
@@ -94,6 +358,12 @@ void zuluscsi_msc_loop() {
   logmsg("USB Mass Storage mode exited: resuming standard functionality.");
   platform_exit_msc();
   
+  if (!msc_cache_flush())
+    logmsg("MSC: Buffered writes could not be stored to SD card, data lost");
+  g_msc_cache.dirty = false;
+  g_msc_cache.write_failed = false;
+  g_msc_cache.count = 0;
+  g_msc_cache.next_lba = 0;
   SD.card()->syncDevice();
 
   // leave the LED off for a moment, before any blinks from the main firmware occur
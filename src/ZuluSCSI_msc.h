@@ -34,4 +34,26 @@ extern volatile enum MSC_LEDState MSC_LEDMode;
 // run cardreader main loop (blocking)
 void zuluscsi_msc_loop();
 
+// Set up the drives presented to host, called before entering card reader mode.
+// LUN 0 is the SD card, with USBMassStorageImages enabled each image file
+// stored contiguously on the card is its own LUN.
+void zuluscsi_msc_init_luns();
+uint8_t msc_lun_count();
+uint32_t msc_lun_sectors(uint8_t lun);
+bool msc_lun_writable(uint8_t lun);
+const char *msc_lun_name(uint8_t lun);
+
+// Access LUN sectors through the sector cache, used by the platform USB callbacks.
+// Reads are done in larger parts when access is sequential, readahead gives
+// the number of sectors the host is known to request next.
+// Consecutive writes are collected and stored when the buffer fills, on
+// non-contiguous access and on msc_cache_flush().
+// Return number of sectors, 0 if busy and the call should be retried later,
+// or -1 on error.
+int32_t msc_lun_read(uint8_t lun, uint32_t lba, uint8_t *buf, uint32_t sectors, uint32_t readahead);
+int32_t msc_lun_write(uint8_t lun, uint32_t lba, const uint8_t *buf, uint32_t sectors);
+
+// Write any buffered sectors to SD card, returns false on error
+bool msc_cache_flush();
+
 #endif
\ No newline at end of file
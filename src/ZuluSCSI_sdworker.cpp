@@ -0,0 +1,216 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2024 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_sdworker.h"
+#include "ZuluSCSI_platform.h"
+#include "ZuluSCSI_settings.h"
+#include "ZuluSCSI_log.h"
+
+#ifdef PLATFORM_HAS_SD_WORKER
+
+struct sd_worker_request_t {
+    ImageBackingStore *file;
+    uint8_t *buf;
+    uint32_t count;
+    bool write;
+    bool ok;
+    volatile uint32_t progress; // Bytes transferred so far, written by core1
+};
+
+// Counters increase forever, slot index is counter modulo queue size.
+// head is only written by core0, done only by core1.
+static struct {
+    bool enabled;
+    sd_worker_request_t slots[SD_WORKER_QUEUE_SIZE];
+    volatile uint32_t head; // Number of requests queued
+    volatile uint32_t done; // Number of requests finished
+    uint32_t released; // Number of requests released by core0
+    sd_worker_request_t *current; // Request being processed by core1
+} g_sdworker;
+
+static void sdWorkerProgress(uint32_t bytes_complete)
+{
+    g_sdworker.current->progress = bytes_complete;
+}
+
+// Main loop of core1
+static void sdWorkerLoop()
+{
+    while (true)
+    {
+        uint32_t idx = g_sdworker.done;
+        if (idx == g_sdworker.head)
+        {
+            continue;
+        }
+
+        // Make sure request contents are read after head
+        __sync_synchronize();
+
+        sd_worker_request_t *req = &g_sdworker.slots[idx % SD_WORKER_QUEUE_SIZE];
+        g_sdworker.current = req;
+        platform_set_sd_callback(&sdWorkerProgress, req->buf);
+
+        ssize_t status;
+        if (req->write)
+            status = req->file->write(req->buf, req->count);
+        else
+            status = req->file->read(req->buf, req->count);
+
+        platform_set_sd_callback(NULL, NULL);
+        req->ok = (status == (ssize_t)req->count);
+
+        // Publish result and data before advancing the counter
+        __sync_synchronize();
+        g_sdworker.done = idx + 1;
+    }
+}
+
+void sdWorkerInit()
+{
+    if (g_sdworker.enabled || !g_scsi_settings.getSystem()->enableDualCoreSD)
+    {
+        return;
+    }
+
+    logmsg("SD card transfers run on second CPU core");
+    g_sdworker.enabled = true;
+    platform_start_sd_worker(sdWorkerLoop);
+}
+
+bool sdWorkerEnabled()
+{
+    return g_sdworker.enabled;
+}
+
+static bool sdWorkerQueue(ImageBackingStore *file, uint8_t *buf, uint32_t count, bool write)
+{
+    uint32_t idx = g_sdworker.head;
+    if (idx - g_sdworker.released >= SD_WORKER_QUEUE_SIZE)
+    {
+        return false;
+    }
+
+    sd_worker_request_t *req = &g_sdworker.slots[idx % SD_WORKER_QUEUE_SIZE];
+    req->file = file;
+    req->buf = buf;
+    req->count = count;
+    req->write = write;
+    req->ok = false;
+    req->progress = 0;
+
+    // Request contents must be visible before core1 sees the new head
+    __sync_synchronize();
+    g_sdworker.head = idx + 1;
+    return true;
+}
+
+bool sdWorkerQueueRead(ImageBackingStore *file, uint8_t *buf, uint32_t count)
+{
+    return sdWorkerQueue(file, buf, count, false);
+}
+
+bool sdWorkerQueueWrite(ImageBackingStore *file, const uint8_t *buf, uint32_t count)
+{
+    return sdWorkerQueue(file, (uint8_t*)buf, count, true);
+}
+
+uint32_t sdWorkerPending()
+{
+    return g_sdworker.head - g_sdworker.released;
+}
+
+bool sdWorkerPoll(uint32_t *bytes_done, bool *ok)
+{
+    uint32_t idx = g_sdworker.released;
+    if (idx == g_sdworker.head)
+    {
+        *bytes_done = 0;
+        *ok = true;
+        return true;
+    }
+
+    if (idx != g_sdworker.done)
+    {
+        // Finished, read the result only after the counter
+        __sync_synchronize();
+        sd_worker_request_t *req = &g_sdworker.slots[idx % SD_WORKER_QUEUE_SIZE];
+        *bytes_done = req->count;
+        *ok = req->ok;
+        return true;
+    }
+    else
+    {
+        // In progress or not yet started. The counter is per slot and
+        // cleared when queued, so it never shows another request's bytes.
+        sd_worker_request_t *req = &g_sdworker.slots[idx % SD_WORKER_QUEUE_SIZE];
+        *bytes_done = req->progress;
+        return false;
+    }
+}
+
+void sdWorkerRelease()
+{
+    if (g_sdworker.released != g_sdworker.head)
+    {
+        g_sdworker.released++;
+    }
+}
+
+bool sdWorkerWaitIdle()
+{
+    bool all_ok = true;
+    while (sdWorkerPending() > 0)
+    {
+        uint32_t bytes_done;
+        bool ok;
+        if (sdWorkerPoll(&bytes_done, &ok))
+        {
+            if (!ok) all_ok = false;
+            sdWorkerRelease();
+        }
+    }
+    return all_ok;
+}
+
+#else
+
+void sdWorkerInit()
+{
+    if (g_scsi_settings.getSystem()->enableDualCoreSD)
+    {
+#ifdef PLATFORM_SD_AUDIO_CORE1
+        logmsg("CD audio samples are read on second CPU core");
+#else
+        logmsg("DualCoreSD is not supported on this platform");
+#endif
+    }
+}
+
+bool sdWorkerEnabled() { return false; }
+bool sdWorkerQueueRead(ImageBackingStore *file, uint8_t *buf, uint32_t count) { return false; }
+bool sdWorkerQueueWrite(ImageBackingStore *file, const uint8_t *buf, uint32_t count) { return false; }
+uint32_t sdWorkerPending() { return 0; }
+bool sdWorkerPoll(uint32_t *bytes_done, bool *ok) { *bytes_done = 0; *ok = true; return true; }
+void sdWorkerRelease() {}
+bool sdWorkerWaitIdle() { return true; }
+
+#endif // PLATFORM_HAS_SD_WORKER
@@ -0,0 +1,67 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2024 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Runs SD card reads and writes for SCSI data transfers on a second CPU core.
+//
+// Core0 queues requests into a single-producer single-consumer ring and
+// keeps servicing the SCSI bus while core1 waits for the SD card.
+// Requests are executed in order, continuing from the current file position.
+// Core1 publishes the number of bytes transferred so far for the oldest
+// request, so that data can be streamed to SCSI before the request finishes.
+//
+// Core0 must not access the SD card while requests are pending.
+// The disk code waits for the worker to become idle before returning
+// from each data phase, so other code is not affected.
+
+#pragma once
+
+#include <stdint.h>
+#include "ImageBackingStore.h"
+
+// Maximum number of queued requests
+#ifndef SD_WORKER_QUEUE_SIZE
+#define SD_WORKER_QUEUE_SIZE 4
+#endif
+
+// Start the worker if enabled by DualCoreSD setting and supported by platform
+void sdWorkerInit();
+
+// Returns true if disk transfers should go through the worker
+bool sdWorkerEnabled();
+
+// Queue a read or write. Returns false if queue is full.
+bool sdWorkerQueueRead(ImageBackingStore *file, uint8_t *buf, uint32_t count);
+bool sdWorkerQueueWrite(ImageBackingStore *file, const uint8_t *buf, uint32_t count);
+
+// Number of requests queued and not yet released
+uint32_t sdWorkerPending();
+
+// Check status of the oldest pending request.
+// bytes_done receives the number of bytes transferred so far.
+// Returns true when the request has finished, ok is then set to the result.
+bool sdWorkerPoll(uint32_t *bytes_done, bool *ok);
+
+// Release the oldest request after it has finished
+void sdWorkerRelease();
+
+// Wait for all pending requests to finish and release them.
+// Returns false if any of them failed.
+bool sdWorkerWaitIdle();
@@ -29,6 +29,9 @@
 #include <strings.h>
 #include <minIni.h>
 #include <minIni_cache.h>
+#include <crc32.h>
+#include <stddef.h>
+#include <ctype.h>
 
 // SCSI system and device settings
 ZuluSCSISettings g_scsi_settings;
@@ -83,6 +86,295 @@ static void formatDriveInfoField(char *field, int fieldsize, bool align_right)
     }
 }
 
+// Settings from CONFIGFILE are parsed in a single pass into the same
+// structs that hold the active settings. A bit in the mask is set for each
+// key found in the file. The result is cached in SETTINGSCACHEFILE and
+// reused as long as the size and modification time of CONFIGFILE match.
+typedef enum { INI_LONG, INI_BOOL, INI_STRING } ini_field_type_t;
+
+typedef struct {
+    const char *key;
+    uint8_t type;
+    uint8_t offset;
+    uint8_t size;
+} ini_field_t;
+
+#define SYS_FIELD(key, type, field) {key, type, offsetof(scsi_system_settings_t, field), sizeof(((scsi_system_settings_t*)0)->field)}
+#define DEV_FIELD(key, type, field) {key, type, offsetof(scsi_device_settings_t, field), sizeof(((scsi_device_settings_t*)0)->field)}
+
+static const ini_field_t g_ini_sys_fields[] = {
+    SYS_FIELD("Quirks", INI_LONG, quirks),
+    SYS_FIELD("SelectionDelay", INI_LONG, selectionDelay),
+    SYS_FIELD("MaxSyncSpeed", INI_LONG, maxSyncSpeed),
+    SYS_FIELD("InitPreDelay", INI_LONG, initPreDelay),
+    SYS_FIELD("InitPostDelay", INI_LONG, initPostDelay),
+    SYS_FIELD("PhyMode", INI_LONG, phyMode),
+    SYS_FIELD("EnableUnitAttention", INI_BOOL, enableUnitAttention),
+    SYS_FIELD("EnableSCSI2", INI_BOOL, enableSCSI2),
+    SYS_FIELD("EnableSelLatch", INI_BOOL, enableSelLatch),
+    SYS_FIELD("MapLunsToIDs", INI_BOOL, mapLunsToIDs),
+    SYS_FIELD("EnableParity", INI_BOOL, enableParity),
+    SYS_FIELD("UseFATAllocSize", INI_BOOL, useFATAllocSize),
+    SYS_FIELD("EnableCDAudio", INI_BOOL, enableCDAudio),
+    SYS_FIELD("EnableUSBMassStorage", INI_BOOL, enableUSBMassStorage),
+    SYS_FIELD("USBMassStorageImages", INI_BOOL, usbMassStorageImages),
+    SYS_FIELD("BinaryTrace", INI_BOOL, enableBinaryTrace),
+    SYS_FIELD("LogSaveIdleMs", INI_LONG, logSaveIdleMs),
+    SYS_FIELD("DirIndex", INI_BOOL, enableDirIndex),
+    SYS_FIELD("DualCoreSD", INI_BOOL, enableDualCoreSD),
+};
+
+// "Type" is only read from the device specific sections
+#define INI_DEV_TYPE_BIT 1
+static const ini_field_t g_ini_dev_fields[] = {
+    DEV_FIELD("Type", INI_LONG, deviceType),
+    DEV_FIELD("TypeModifier", INI_LONG, deviceTypeModifier),
+    DEV_FIELD("SectorsPerTrack", INI_LONG, sectorsPerTrack),
+    DEV_FIELD("HeadsPerCylinder", INI_LONG, headsPerCylinder),
+    DEV_FIELD("PrefetchBytes", INI_LONG, prefetchBytes),
+    DEV_FIELD("EjectButton", INI_LONG, ejectButton),
+    DEV_FIELD("CDAVolume", INI_LONG, vol),
+    DEV_FIELD("NameFromImage", INI_BOOL, nameFromImage),
+    DEV_FIELD("RightAlignStrings", INI_BOOL, rightAlignStrings),
+    DEV_FIELD("ReinsertCDOnInquiry", INI_BOOL, reinsertOnInquiry),
+    DEV_FIELD("ReinsertAfterEject", INI_BOOL, reinsertAfterEject),
+    DEV_FIELD("DisableMacSanityCheck", INI_BOOL, disableMacSanityCheck),
+    DEV_FIELD("SectorSDBegin", INI_LONG, sectorSDBegin),
+    DEV_FIELD("SectorSDEnd", INI_LONG, sectorSDEnd),
+    DEV_FIELD("VendorExtensions", INI_LONG, vendorExtensions),
+    DEV_FIELD("BlockSize", INI_LONG, blockSize),
+    DEV_FIELD("Vendor", INI_STRING, vendor),
+    DEV_FIELD("Product", INI_STRING, prodId),
+    DEV_FIELD("Version", INI_STRING, revision),
+    DEV_FIELD("Serial", INI_STRING, serial),
+};
+
+#define INI_FIELD_COUNT(table) (sizeof(table) / sizeof(table[0]))
+static_assert(INI_FIELD_COUNT(g_ini_sys_fields) <= 32, "Too many fields for mask");
+static_assert(INI_FIELD_COUNT(g_ini_dev_fields) <= 32, "Too many fields for mask");
+
+// Section index 0-7 is [SCSI0]..[SCSI7] and SCSI_SETTINGS_SYS_IDX is [SCSI]
+typedef struct {
+    uint32_t sys_mask;
+    uint32_t dev_mask[9];
+    scsi_system_settings_t sys;
+    scsi_device_settings_t dev[9];
+    char device_preset[8][32];
+} ini_compiled_t;
+
+typedef struct {
+    char magic[4];
+    char version[16]; // Firmware version, field tables may change between versions
+    uint32_t ini_size;
+    uint16_t ini_date;
+    uint16_t ini_time;
+    uint32_t compiled_size;
+    uint32_t ini_crc; // CRC32 of the ini file contents
+    uint32_t crc;
+} ini_compiled_header_t;
+
+static struct {
+    bool valid;
+    ini_compiled_header_t hdr;
+    ini_compiled_t data;
+
+    // Used only while parsing
+    int section;
+    char section_name[8];
+    uint16_t done_sections;
+    uint32_t sys_seen_mask;
+    uint32_t seen_mask[9];
+    uint8_t preset_seen;
+} g_ini_compiled;
+
+static int iniSectionIndex(const char *section)
+{
+    if (strncasecmp(section, "SCSI", 4) != 0) return -1;
+    if (section[4] == '\0') return SCSI_SETTINGS_SYS_IDX;
+    if (section[4] >= '0' && section[4] <= '7' && section[5] == '\0') return section[4] - '0';
+    return -1;
+}
+
+// Parse value the same way as ini_getl(), ini_getbool() and ini_gets().
+// Returns false if the value would be ignored and the default used instead.
+static bool iniParseField(const ini_field_t *field, const char *value, void *base)
+{
+    uint8_t *dst = (uint8_t*)base + field->offset;
+    if (field->type == INI_BOOL)
+    {
+        char c = toupper(value[0]);
+        if (c == 'Y' || c == '1' || c == 'T')
+            *dst = 1;
+        else if (c == 'N' || c == '0' || c == 'F')
+            *dst = 0;
+        else
+            return false;
+    }
+    else if (field->type == INI_LONG)
+    {
+        if (value[0] == '\0') return false;
+        long v = (strlen(value) >= 2 && toupper(value[1]) == 'X') ? strtol(value, NULL, 16) : strtol(value, NULL, 10);
+        if (field->size == 1) *dst = (uint8_t)v;
+        else if (field->size == 2) { uint16_t v16 = v; memcpy(dst, &v16, 2); }
+        else { uint32_t v32 = v; memcpy(dst, &v32, 4); }
+    }
+    else
+    {
+        if (value[0] == '\0') return false;
+        memset(dst, 0, field->size);
+        strncpy((char*)dst, value, field->size);
+    }
+    return true;
+}
+
+static int iniCompileCallback(const char *section, const char *key, const char *value, void *userdata)
+{
+    // Like ini_gets(), only the first occurrence of a section or key is used
+    if (strcasecmp(section, g_ini_compiled.section_name) != 0)
+    {
+        if (g_ini_compiled.section >= 0)
+            g_ini_compiled.done_sections |= (1 << g_ini_compiled.section);
+
+        strncpy(g_ini_compiled.section_name, section, sizeof(g_ini_compiled.section_name) - 1);
+        g_ini_compiled.section = iniSectionIndex(section);
+        if (g_ini_compiled.section >= 0 && (g_ini_compiled.done_sections & (1 << g_ini_compiled.section)))
+            g_ini_compiled.section = -1;
+    }
+
+    int idx = g_ini_compiled.section;
+    if (idx < 0) return 1;
+
+    ini_compiled_t &data = g_ini_compiled.data;
+    if (idx < SCSI_SETTINGS_SYS_IDX && strcasecmp(key, "Device") == 0)
+    {
+        if (!(g_ini_compiled.preset_seen & (1 << idx)))
+        {
+            g_ini_compiled.preset_seen |= (1 << idx);
+            strncpy(data.device_preset[idx], value, sizeof(data.device_preset[idx]) - 1);
+        }
+        return 1;
+    }
+
+    if (idx == SCSI_SETTINGS_SYS_IDX)
+    {
+        for (uint32_t i = 0; i < INI_FIELD_COUNT(g_ini_sys_fields); i++)
+        {
+            if (strcasecmp(key, g_ini_sys_fields[i].key) == 0)
+            {
+                if (!(g_ini_compiled.sys_seen_mask & (1UL << i)))
+                {
+                    g_ini_compiled.sys_seen_mask |= (1UL << i);
+                    if (iniParseField(&g_ini_sys_fields[i], value, &data.sys))
+                        data.sys_mask |= (1UL << i);
+                }
+                return 1;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < INI_FIELD_COUNT(g_ini_dev_fields); i++)
+    {
+        if (strcasecmp(key, g_ini_dev_fields[i].key) == 0)
+        {
+            if (!(g_ini_compiled.seen_mask[idx] & (1UL << i)))
+            {
+                g_ini_compiled.seen_mask[idx] |= (1UL << i);
+                if (iniParseField(&g_ini_dev_fields[i], value, &data.dev[idx]))
+                    data.dev_mask[idx] |= (1UL << i);
+            }
+            return 1;
+        }
+    }
+
+    return 1;
+}
+
+static void iniApplyFields(const ini_field_t *fields, size_t count, uint32_t mask, const void *src, void *dst)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (mask & (1UL << i))
+        {
+            memcpy((uint8_t*)dst + fields[i].offset, (const uint8_t*)src + fields[i].offset, fields[i].size);
+        }
+    }
+}
+
+// Load compiled settings from cache or parse CONFIGFILE if it has changed
+static void iniCompile()
+{
+    ini_compiled_header_t hdr = {};
+    memcpy(hdr.magic, "ZCFG", 4);
+    strncpy(hdr.version, ZULU_FW_VERSION, sizeof(hdr.version) - 1);
+    hdr.compiled_size = sizeof(ini_compiled_t);
+
+    FsFile config = SD.open(CONFIGFILE, O_RDONLY);
+    if (!config.isOpen())
+    {
+        // No config file, all settings use defaults
+        memset(&g_ini_compiled, 0, sizeof(g_ini_compiled));
+        return;
+    }
+    hdr.ini_size = config.size();
+    bool have_time = config.getModifyDateTime(&hdr.ini_date, &hdr.ini_time) && hdr.ini_date != 0;
+
+    // Size and modification time do not catch every edit, for example
+    // within the 2 second FAT timestamp resolution or by a device without
+    // a clock. The file is small, so its contents are checked as well.
+    uint8_t buf[128];
+    int len;
+    hdr.ini_crc = 0;
+    while ((len = config.read(buf, sizeof(buf))) > 0)
+    {
+        hdr.ini_crc = crc32_update(hdr.ini_crc, buf, len);
+    }
+    config.close();
+
+    // Same file as on previous mount
+    if (have_time && g_ini_compiled.valid &&
+        memcmp(&hdr, &g_ini_compiled.hdr, offsetof(ini_compiled_header_t, crc)) == 0)
+    {
+        return;
+    }
+
+    memset(&g_ini_compiled, 0, sizeof(g_ini_compiled));
+
+    if (have_time)
+    {
+        FsFile cache = SD.open(SETTINGSCACHEFILE, O_RDONLY);
+        if (cache.isOpen() &&
+            cache.read(&g_ini_compiled.hdr, sizeof(hdr)) == sizeof(hdr) &&
+            memcmp(&hdr, &g_ini_compiled.hdr, offsetof(ini_compiled_header_t, crc)) == 0 &&
+            cache.read(&g_ini_compiled.data, sizeof(ini_compiled_t)) == sizeof(ini_compiled_t) &&
+            crc32(&g_ini_compiled.data, sizeof(ini_compiled_t)) == g_ini_compiled.hdr.crc)
+        {
+            g_ini_compiled.valid = true;
+            return;
+        }
+        cache.close();
+        memset(&g_ini_compiled, 0, sizeof(g_ini_compiled));
+    }
+
+    g_ini_compiled.section = -1;
+    ini_browse(iniCompileCallback, NULL, CONFIGFILE);
+
+    hdr.crc = crc32(&g_ini_compiled.data, sizeof(ini_compiled_t));
+    g_ini_compiled.hdr = hdr;
+    g_ini_compiled.valid = true;
+
+    if (have_time)
+    {
+        FsFile cache = SD.open(SETTINGSCACHEFILE, O_WRONLY | O_CREAT | O_TRUNC);
+        if (cache.isOpen())
+        {
+            cache.write(&hdr, sizeof(hdr));
+            cache.write(&g_ini_compiled.data, sizeof(ini_compiled_t));
+            cache.attrib(FS_ATTRIB_HIDDEN);
+            cache.close();
+        }
+    }
+}
+
 const char **ZuluSCSISettings::deviceInitST32430N(uint8_t scsiId)
 {
     static const char *st32430n[4] = {"SEAGATE", devicePresetName[DEV_PRESET_ST32430N], PLATFORM_REVISION, ""};
@@ -96,9 +388,6 @@ const char **ZuluSCSISettings::deviceInitST32430N(uint8_t scsiId)
 
 void ZuluSCSISettings::setDefaultDriveInfo(uint8_t scsiId, const char *presetName, S2S_CFG_TYPE type)
 {
-    char section[6] = "SCSI0";
-    section[4] += scsiId;
-
     scsi_device_settings_t &cfgDev = m_dev[scsiId];
     scsi_device_settings_t &cfgDefault = m_dev[SCSI_SETTINGS_SYS_IDX];
     
@@ -163,7 +452,10 @@ void ZuluSCSISettings::setDefaultDriveInfo(uint8_t scsiId, const char *presetNam
     if (m_devPreset[scsiId] == DEV_PRESET_NONE)
     {
         cfgDev.deviceType = type;
-        cfgDev.deviceType = ini_getl(section, "Type", cfgDev.deviceType, CONFIGFILE);
+        if (g_ini_compiled.data.dev_mask[scsiId] & INI_DEV_TYPE_BIT)
+        {
+            cfgDev.deviceType = g_ini_compiled.data.dev[scsiId].deviceType;
+        }
         
         if (cfgSys.quirks == S2S_CFG_QUIRKS_APPLE)
         {
@@ -210,69 +502,22 @@ void ZuluSCSISettings::setDefaultDriveInfo(uint8_t scsiId, const char *presetNam
         strncpy(cfgDev.serial, driveinfo[3], sizeof(cfgDev.serial));
 }
 
-// Read device settings
-static void readIniSCSIDeviceSetting(scsi_device_settings_t &cfg, const char *section)
+// Read device settings, idx is SCSI ID or SCSI_SETTINGS_SYS_IDX for [SCSI] section
+static void readIniSCSIDeviceSetting(scsi_device_settings_t &cfg, int idx)
 {
-    cfg.deviceTypeModifier = ini_getl(section, "TypeModifier", cfg.deviceTypeModifier, CONFIGFILE);
-    cfg.sectorsPerTrack = ini_getl(section, "SectorsPerTrack", cfg.sectorsPerTrack, CONFIGFILE);
-    cfg.headsPerCylinder = ini_getl(section, "HeadsPerCylinder", cfg.headsPerCylinder, CONFIGFILE);
-    cfg.prefetchBytes = ini_getl(section, "PrefetchBytes", cfg.prefetchBytes, CONFIGFILE);
-    cfg.ejectButton = ini_getl(section, "EjectButton", cfg.ejectButton, CONFIGFILE);
-
-    cfg.vol = ini_getl(section, "CDAVolume", cfg.vol, CONFIGFILE) & 0xFF;
-
-    cfg.nameFromImage = ini_getbool(section, "NameFromImage", cfg.nameFromImage, CONFIGFILE);
-    cfg.rightAlignStrings = ini_getbool(section, "RightAlignStrings", cfg.rightAlignStrings , CONFIGFILE);
-    cfg.reinsertOnInquiry = ini_getbool(section, "ReinsertCDOnInquiry", cfg.reinsertOnInquiry, CONFIGFILE);
-    cfg.reinsertAfterEject = ini_getbool(section, "ReinsertAfterEject", cfg.reinsertAfterEject, CONFIGFILE);
-    cfg.disableMacSanityCheck = ini_getbool(section, "DisableMacSanityCheck", cfg.disableMacSanityCheck, CONFIGFILE);
-
-    cfg.sectorSDBegin = ini_getl(section, "SectorSDBegin", cfg.sectorSDBegin, CONFIGFILE);
-    cfg.sectorSDEnd = ini_getl(section, "SectorSDEnd", cfg.sectorSDEnd, CONFIGFILE);
-
-    cfg.vendorExtensions = ini_getl(section, "VendorExtensions", cfg.vendorExtensions, CONFIGFILE);
-
-    cfg.blockSize = ini_getl(section, "BlockSize", cfg.blockSize, CONFIGFILE);
-
-    char tmp[32];
-    ini_gets(section, "Vendor", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0])
-    {
-        memset(cfg.vendor, 0, sizeof(cfg.vendor));
-        strncpy(cfg.vendor, tmp, sizeof(cfg.vendor));
-    }
-    memset(tmp, 0, sizeof(tmp));
-
-    ini_gets(section, "Product", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0])
-    {
-        memset(cfg.prodId, 0, sizeof(cfg.prodId));
-        strncpy(cfg.prodId, tmp, sizeof(cfg.prodId));
-
-    }
-    memset(tmp, 0, sizeof(tmp));
-
-    ini_gets(section, "Version", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0])
-    {
-        memset(cfg.revision, 0, sizeof(cfg.revision));
-        strncpy(cfg.revision, tmp, sizeof(cfg.revision));
-    }
-    memset(tmp, 0, sizeof(tmp));
-
-    ini_gets(section, "Serial", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0])
-    {
-        memset(cfg.serial, 0, sizeof(cfg.serial));
-        strncpy(cfg.serial, tmp, sizeof(cfg.serial));
-    }
-
+    const ini_compiled_t &ini = g_ini_compiled.data;
+    iniApplyFields(g_ini_dev_fields, INI_FIELD_COUNT(g_ini_dev_fields),
+                   ini.dev_mask[idx] & ~INI_DEV_TYPE_BIT, &ini.dev[idx], &cfg);
+    cfg.vol &= 0xFF;
 }
 
 scsi_system_settings_t *ZuluSCSISettings::initSystem(const char *presetName)
 {
     scsi_system_settings_t &cfgSys = m_sys;
     scsi_device_settings_t &cfgDev = m_dev[SCSI_SETTINGS_SYS_IDX];
+
+    iniCompile();
+
     // This is a hack to figure out if apple quirks is on via a dip switch
     S2S_TargetCfg img;
 
@@ -297,6 +542,11 @@ scsi_system_settings_t *ZuluSCSISettings::initSystem(const char *presetName)
     cfgSys.useFATAllocSize = false;
     cfgSys.enableCDAudio = false;
     cfgSys.enableUSBMassStorage = false;
+    cfgSys.usbMassStorageImages = false;
+    cfgSys.enableBinaryTrace = false;
+    cfgSys.logSaveIdleMs = LOG_SAVE_IDLE_MS;
+    cfgSys.enableDirIndex = true;
+    cfgSys.enableDualCoreSD = false;
     
     // setting set for all or specific devices
     cfgDev.deviceType = S2S_CFG_NOT_SET;
@@ -373,26 +623,12 @@ scsi_system_settings_t *ZuluSCSISettings::initSystem(const char *presetName)
     memset(cfgDev.serial, 0, sizeof(cfgDev.serial));
 
     // Read default setting overrides from ini file for each SCSI device
-    readIniSCSIDeviceSetting(cfgDev, "SCSI");
+    readIniSCSIDeviceSetting(cfgDev, SCSI_SETTINGS_SYS_IDX);
 
     // Read settings from ini file that apply to all SCSI device
-    cfgSys.quirks = ini_getl("SCSI", "Quirks", cfgSys.quirks, CONFIGFILE);
-    cfgSys.selectionDelay = ini_getl("SCSI", "SelectionDelay", cfgSys.selectionDelay, CONFIGFILE);
-    cfgSys.maxSyncSpeed = ini_getl("SCSI", "MaxSyncSpeed", cfgSys.maxSyncSpeed, CONFIGFILE);
-    cfgSys.initPreDelay = ini_getl("SCSI", "InitPreDelay", cfgSys.initPreDelay, CONFIGFILE);
-    cfgSys.initPostDelay = ini_getl("SCSI", "InitPostDelay", cfgSys.initPostDelay, CONFIGFILE);
-    cfgSys.phyMode = ini_getl("SCSI", "PhyMode", cfgSys.phyMode, CONFIGFILE);
-
-    cfgSys.enableUnitAttention = ini_getbool("SCSI", "EnableUnitAttention", cfgSys.enableUnitAttention, CONFIGFILE);
-    cfgSys.enableSCSI2 = ini_getbool("SCSI", "EnableSCSI2", cfgSys.enableSCSI2, CONFIGFILE);
-    cfgSys.enableSelLatch = ini_getbool("SCSI", "EnableSelLatch", cfgSys.enableSelLatch, CONFIGFILE);
-    cfgSys.mapLunsToIDs = ini_getbool("SCSI", "MapLunsToIDs", cfgSys.mapLunsToIDs, CONFIGFILE);
-    cfgSys.enableParity =  ini_getbool("SCSI", "EnableParity", cfgSys.enableParity, CONFIGFILE);
-    cfgSys.useFATAllocSize = ini_getbool("SCSI", "UseFATAllocSize", cfgSys.useFATAllocSize, CONFIGFILE);
-    cfgSys.enableCDAudio = ini_getbool("SCSI", "EnableCDAudio", cfgSys.enableCDAudio, CONFIGFILE);
-
-    cfgSys.enableUSBMassStorage = ini_getbool("SCSI", "EnableUSBMassStorage", cfgSys.enableUSBMassStorage, CONFIGFILE);
-    
+    iniApplyFields(g_ini_sys_fields, INI_FIELD_COUNT(g_ini_sys_fields),
+                   g_ini_compiled.data.sys_mask, &g_ini_compiled.data.sys, &cfgSys);
+
     return &cfgSys;
 }
 
@@ -400,8 +636,6 @@ scsi_device_settings_t* ZuluSCSISettings::initDevice(uint8_t scsiId, S2S_CFG_TYP
 {
     scsi_device_settings_t& cfg = m_dev[scsiId];
     char presetName[32] = {};
-    char section[6] = "SCSI0";
-    section[4] = '0' + scsiId;
 
 #ifdef ZULUSCSI_HARDWARE_CONFIG
     const char *hwDevicePresetName = g_scsi_settings.getDevicePresetName(scsiId);
@@ -415,14 +649,14 @@ scsi_device_settings_t* ZuluSCSISettings::initDevice(uint8_t scsiId, S2S_CFG_TYP
     else
 #endif
     {
-        ini_gets(section, "Device", "", presetName, sizeof(presetName), CONFIGFILE);
+        strncpy(presetName, g_ini_compiled.data.device_preset[scsiId], sizeof(presetName) - 1);
     }
 
 
     // Write default configuration from system setting initialization
     memcpy(&cfg, &m_dev[SCSI_SETTINGS_SYS_IDX], sizeof(cfg));
     setDefaultDriveInfo(scsiId, presetName, type);
-    readIniSCSIDeviceSetting(cfg, section);
+    readIniSCSIDeviceSetting(cfg, scsiId);
 
     if (cfg.serial[0] == '\0')
     {
@@ -66,6 +66,11 @@ typedef struct __attribute__((__packed__)) scsi_system_settings_t
     bool useFATAllocSize;
     bool enableCDAudio;
     bool enableUSBMassStorage;
+    bool usbMassStorageImages;
+    bool enableBinaryTrace;
+    uint16_t logSaveIdleMs;
+    bool enableDirIndex;
+    bool enableDualCoreSD;
 } scsi_system_settings_t;
 
 // This struct should only have new setting added to the end
@@ -23,14 +23,1324 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "ZuluSCSI_tape.h"
 #include "ZuluSCSI_disk.h"
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_config.h"
+#include <ZuluSCSI_platform.h>
+#include <strings.h>
+#include <SdFat.h>
+
+extern SdFs SD;
 
 extern "C" {
 #include <scsi.h>
 }
 
+static void tapeSetSense(uint8_t code, uint16_t asc, uint8_t flags, uint32_t info)
+{
+    scsiDev.status = CHECK_CONDITION;
+    scsiDev.target->sense.code = code;
+    scsiDev.target->sense.asc = asc;
+    scsiDev.target->sense.flags = flags;
+    scsiDev.target->sense.info = info;
+    scsiDev.phase = STATUS;
+}
+
+/*****************************************/
+/* Streaming buffer for sequential access */
+/*****************************************/
+
+// Tape access is sequential, so a buffer in front of the image file keeps
+// reading ahead between READ commands and collects written data until a
+// filemark, a position change or idle time. This way the SD card access
+// latency does not stall the SCSI bus at every command boundary.
+// The buffer is shared by all tape targets.
+static struct {
+    image_config_t *img;  // Image the buffer contents belong to
+    uint64_t start;       // Image offset of buffer[0]
+    uint32_t valid;       // Read-ahead: bytes of image data in buffer
+    bool writing;         // Write-behind: buffer collects data to write at start
+    bool end_marker;      // Write .tap end of medium marker after the data
+    bool write_error;     // Delayed write failed, reported on next command
+    uint32_t dirty;       // Write-behind: bytes waiting to be written
+    uint32_t last_access; // millis() of last use
+    uint8_t buffer[TAPE_STREAM_BUFFER_SIZE];
+} g_tape_stream;
+
+static_assert(TAPE_STREAM_BUFFER_SIZE % SD_SECTOR_SIZE == 0, "TAPE_STREAM_BUFFER_SIZE must be a multiple of SD sector size");
+
+// Streaming is used for images on SD card, ROM and raw access need aligned transfers
+static bool tapeStreamEnabled(image_config_t &img)
+{
+    return !img.file.isRom() && !img.file.isRaw();
+}
+
+static void tapeStream_sd_callback(uint32_t bytes_complete)
+{
+    // Provide a chance for polling SCSI transfers
+    scsiIsWriteFinished(NULL);
+}
+
+// Write pending data to SD card.
+// If final is false, only the full buffer is written and more data will follow.
+static void tapeStreamWriteOut(bool final)
+{
+    image_config_t *img = g_tape_stream.img;
+    if (!img || !g_tape_stream.writing) return;
+
+    bool ok = img->file.seek(g_tape_stream.start);
+    if (ok && g_tape_stream.dirty > 0)
+    {
+        platform_set_sd_callback(&tapeStream_sd_callback, g_tape_stream.buffer);
+        ok = (img->file.write(g_tape_stream.buffer, g_tape_stream.dirty) == (ssize_t)g_tape_stream.dirty);
+        platform_set_sd_callback(NULL, NULL);
+    }
+
+    if (ok && final && g_tape_stream.end_marker)
+    {
+        static const uint8_t eom[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+        ok = (img->file.write(eom, 4) == 4);
+    }
+
+    if (!ok)
+    {
+        logmsg("Tape image write failed at offset ", (uint32_t)g_tape_stream.start, ", SD card error ", SD.sdErrorCode());
+        g_tape_stream.write_error = true;
+    }
+
+    g_tape_stream.start += g_tape_stream.dirty;
+    g_tape_stream.dirty = 0;
+
+    if (final)
+    {
+        img->file.flush();
+        g_tape_stream.writing = false;
+        g_tape_stream.end_marker = false;
+    }
+}
+
+void tapeFlush()
+{
+    tapeStreamWriteOut(true);
+    g_tape_stream.img = NULL;
+    g_tape_stream.valid = 0;
+}
+
+// Copy data from image through the read-ahead buffer
+static bool tapeStreamRead(image_config_t &img, uint64_t offset, uint8_t *dst, uint32_t len)
+{
+    if (g_tape_stream.img != &img || g_tape_stream.writing)
+    {
+        tapeFlush();
+        g_tape_stream.img = &img;
+    }
+    g_tape_stream.last_access = millis();
+
+    uint64_t size = img.file.size();
+    if (offset + len > size) return false;
+
+    while (len > 0)
+    {
+        if (offset < g_tape_stream.start || offset >= g_tape_stream.start + g_tape_stream.valid)
+        {
+            // Refill buffer starting at the requested position
+            g_tape_stream.start = offset & ~(uint64_t)(SD_SECTOR_SIZE - 1);
+            uint32_t count = sizeof(g_tape_stream.buffer);
+            if (size - g_tape_stream.start < count) count = size - g_tape_stream.start;
+
+            g_tape_stream.valid = 0;
+            platform_set_sd_callback(&tapeStream_sd_callback, g_tape_stream.buffer);
+            bool ok = img.file.seek(g_tape_stream.start) &&
+                      img.file.read(g_tape_stream.buffer, count) == (ssize_t)count;
+            platform_set_sd_callback(NULL, NULL);
+            if (!ok)
+            {
+                logmsg("Tape image read failed at offset ", (uint32_t)g_tape_stream.start, ", SD card error ", SD.sdErrorCode());
+                return false;
+            }
+            g_tape_stream.valid = count;
+        }
+
+        uint32_t pos = offset - g_tape_stream.start;
+        uint32_t n = g_tape_stream.valid - pos;
+        if (n > len) n = len;
+        memcpy(dst, g_tape_stream.buffer + pos, n);
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+// Continue reading ahead from the position where the host will read next.
+// Reads at most max_bytes, returns false if there was nothing to do.
+static bool tapeStreamReadAhead(image_config_t &img, uint64_t offset, uint32_t max_bytes)
+{
+    if (g_tape_stream.img != &img || g_tape_stream.writing) return false;
+    if (offset < g_tape_stream.start || offset > g_tape_stream.start + g_tape_stream.valid) return false;
+
+    uint64_t size = img.file.size();
+    uint64_t end = g_tape_stream.start + g_tape_stream.valid;
+    if (end >= size) return false;
+
+    // Drop the data that has already been consumed
+    uint32_t consumed = (offset - g_tape_stream.start) & ~(SD_SECTOR_SIZE - 1);
+    if (g_tape_stream.valid == sizeof(g_tape_stream.buffer) && consumed == 0) return false;
+    if (consumed > 0)
+    {
+        memmove(g_tape_stream.buffer, g_tape_stream.buffer + consumed, g_tape_stream.valid - consumed);
+        g_tape_stream.start += consumed;
+        g_tape_stream.valid -= consumed;
+    }
+
+    uint32_t count = sizeof(g_tape_stream.buffer) - g_tape_stream.valid;
+    if (count > max_bytes) count = max_bytes;
+    if (size - end < count) count = size - end;
+
+    uint8_t *dst = g_tape_stream.buffer + g_tape_stream.valid;
+    platform_set_sd_callback(&tapeStream_sd_callback, dst);
+    bool ok = img.file.seek(end) && img.file.read(dst, count) == (ssize_t)count;
+    platform_set_sd_callback(NULL, NULL);
+    if (ok)
+    {
+        g_tape_stream.valid += count;
+    }
+    return ok;
+}
+
+// Start collecting written data at given image offset
+static void tapeStreamSeekWrite(image_config_t &img, uint64_t offset)
+{
+    if (g_tape_stream.img != &img || !g_tape_stream.writing ||
+        g_tape_stream.start + g_tape_stream.dirty != offset)
+    {
+        tapeFlush();
+        g_tape_stream.img = &img;
+        g_tape_stream.start = offset;
+        g_tape_stream.writing = true;
+    }
+    g_tape_stream.last_access = millis();
+}
+
+// Add data after the previously written data
+static void tapeStreamAppend(const uint8_t *src, uint32_t len)
+{
+    while (len > 0)
+    {
+        uint32_t n = sizeof(g_tape_stream.buffer) - g_tape_stream.dirty;
+        if (n > len) n = len;
+        memcpy(g_tape_stream.buffer + g_tape_stream.dirty, src, n);
+        g_tape_stream.dirty += n;
+        src += n;
+        len -= n;
+
+        if (g_tape_stream.dirty == sizeof(g_tape_stream.buffer))
+        {
+            tapeStreamWriteOut(false);
+        }
+    }
+}
+
+// Discard written data after offset and mark the end of data there
+static void tapeStreamSetEnd(image_config_t &img, uint64_t offset)
+{
+    if (g_tape_stream.img == &img && g_tape_stream.writing &&
+        offset >= g_tape_stream.start && offset <= g_tape_stream.start + g_tape_stream.dirty)
+    {
+        g_tape_stream.dirty = offset - g_tape_stream.start;
+    }
+    else
+    {
+        tapeStreamSeekWrite(img, offset);
+    }
+    g_tape_stream.end_marker = true;
+}
+
+void tapePoll()
+{
+    image_config_t *img = g_tape_stream.img;
+    if (!img || scsiDev.phase != BUS_FREE) return;
+
+    if (g_tape_stream.writing)
+    {
+        if ((uint32_t)(millis() - g_tape_stream.last_access) > TAPE_WRITE_BEHIND_IDLE_MS)
+        {
+            dbgmsg("------ Tape idle, writing buffered data");
+            tapeStreamWriteOut(true);
+        }
+    }
+    else if (img->tape_pos > 0)
+    {
+        // Small steps to keep selection response time short
+        tapeStreamReadAhead(*img, img->tape_tap_format ? img->tape_offset :
+            (uint64_t)img->tape_pos * img->bytesPerSector, 4096);
+    }
+}
+
+/***********************************************/
+/* SCSI side of streaming reads and writes     */
+/***********************************************/
+
+// For reads, scsiDev.data is divided in two halves. One is filled from the
+// stream buffer while the other is being sent to SCSI bus.
+static struct {
+    uint32_t idx;
+    uint32_t fill;
+    uint32_t sent[2];
+} g_tape_datain;
+
+static void tapeDataInBegin()
+{
+    g_tape_datain.idx = 0;
+    g_tape_datain.fill = 0;
+    g_tape_datain.sent[0] = 0;
+    g_tape_datain.sent[1] = 0;
+}
+
+static void tapeDataInSend()
+{
+    if (g_tape_datain.fill > 0)
+    {
+        uint32_t half = sizeof(scsiDev.data) / 2;
+        scsiEnterPhase(DATA_IN);
+        scsiStartWrite(&scsiDev.data[g_tape_datain.idx * half], g_tape_datain.fill);
+        g_tape_datain.sent[g_tape_datain.idx] = g_tape_datain.fill;
+        g_tape_datain.fill = 0;
+        g_tape_datain.idx ^= 1;
+    }
+}
+
+// Send len bytes from image offset to SCSI bus
+static bool tapeDataIn(image_config_t &img, uint64_t offset, uint32_t len)
+{
+    uint32_t half = sizeof(scsiDev.data) / 2;
+    while (len > 0 && !scsiDev.resetFlag)
+    {
+        uint8_t *buf = &scsiDev.data[g_tape_datain.idx * half];
+        if (g_tape_datain.fill == 0 && g_tape_datain.sent[g_tape_datain.idx] > 0)
+        {
+            // Wait for previous transfer from this half to finish
+            const uint8_t *last = buf + g_tape_datain.sent[g_tape_datain.idx] - 1;
+            while (!scsiIsWriteFinished(last) && !scsiDev.resetFlag)
+            {
+                platform_poll();
+            }
+        }
+
+        uint32_t n = half - g_tape_datain.fill;
+        if (n > len) n = len;
+        if (!tapeStreamRead(img, offset, buf + g_tape_datain.fill, n))
+        {
+            return false;
+        }
+
+        g_tape_datain.fill += n;
+        offset += n;
+        len -= n;
+        if (g_tape_datain.fill == half)
+        {
+            tapeDataInSend();
+        }
+    }
+
+    return true;
+}
+
+// Send remaining data and read ahead while waiting for the transfer to finish
+static void tapeDataInEnd(image_config_t &img, uint64_t next_offset)
+{
+    tapeDataInSend();
+
+    while (!scsiIsWriteFinished(NULL) && !scsiDev.resetFlag)
+    {
+        if (!tapeStreamReadAhead(img, next_offset, sizeof(g_tape_stream.buffer)))
+        {
+            platform_poll();
+        }
+    }
+
+    scsiFinishWrite();
+}
+
+// Receive data from SCSI bus in parts that are multiple of unit bytes.
+// Next part is received to the other half of scsiDev.data while the
+// consume function stores the previous one.
+static bool tapeDataOut(image_config_t &img, uint32_t len, uint32_t unit,
+                        bool (*consume)(image_config_t &img, const uint8_t *data, uint32_t len))
+{
+    uint32_t half = sizeof(scsiDev.data) / 2;
+    uint32_t chunk = (unit <= half) ? half - half % unit : half;
+    int parityError = 0;
+    bool ok = true;
+
+    scsiEnterPhase(DATA_OUT);
+
+    uint32_t idx = 0;
+    uint32_t cur = (len < chunk) ? len : chunk;
+    scsiStartRead(&scsiDev.data[0], cur, &parityError);
+
+    while (len > 0 && !scsiDev.resetFlag)
+    {
+        uint8_t *buf = &scsiDev.data[idx * half];
+        scsiFinishRead(buf, cur, &parityError);
+        if (parityError)
+        {
+            tapeSetSense(ABORTED_COMMAND, SCSI_PARITY_ERROR, 0, 0);
+            ok = false;
+            break;
+        }
+
+        len -= cur;
+        uint32_t next = (len < chunk) ? len : chunk;
+        if (next > 0)
+        {
+            scsiStartRead(&scsiDev.data[(idx ^ 1) * half], next, &parityError);
+        }
+
+        if (!consume(img, buf, cur))
+        {
+            ok = false;
+            break;
+        }
+
+        cur = next;
+        idx ^= 1;
+    }
+
+    // Release SCSI bus
+    scsiFinishRead(NULL, 0, &parityError);
+    return ok && !scsiDev.resetFlag;
+}
+
+/*********************************************/
+/* SIMH .tap record structured image format  */
+/*********************************************/
+
+// Each record is stored as a 32-bit little-endian length, the data padded
+// to even length and the length repeated. Length 0 is a filemark and
+// 0xFFFFFFFF marks end of medium. Bit 31 flags a record that had an error
+// on the original tape, its data is returned normally.
+#define TAP_MARKER_FILEMARK 0x00000000
+#define TAP_MARKER_EOM      0xFFFFFFFF
+#define TAP_MARKER_ERROR    0x80000000
+#define TAP_LENGTH_MASK     0x00FFFFFF
+
+// Size of the position index of one tape image.
+// Checkpoints are spread out over the whole image, filemarks after
+// the first TAPE_INDEX_MAX_FILEMARKS are found by scanning.
+// The index takes about 4 kB of RAM, TAPE_INDEX_SLOTS images are
+// kept indexed at the same time.
+#ifndef TAPE_INDEX_MAX_CHECKPOINTS
+#define TAPE_INDEX_MAX_CHECKPOINTS 256
+#endif
+
+#ifndef TAPE_INDEX_MAX_FILEMARKS
+#define TAPE_INDEX_MAX_FILEMARKS 512
+#endif
+
+enum tap_object_t {
+    TAP_RECORD,
+    TAP_FILEMARK,
+    TAP_EOD
+};
+
+// Both records and filemarks count as one block in tape position.
+// checkpoints[i] is the byte offset of block i * interval. The interval
+// is doubled whenever the table fills up, so the spacing scales with the
+// amount of data on the tape.
+typedef struct {
+    image_config_t *img;
+    uint32_t last_use;
+    uint32_t interval;
+    uint32_t checkpoint_count;
+    uint64_t checkpoints[TAPE_INDEX_MAX_CHECKPOINTS];
+    uint32_t filemark_count;
+    bool filemarks_truncated;
+    uint32_t filemarks[TAPE_INDEX_MAX_FILEMARKS]; // Block numbers in ascending order
+    uint32_t eod_block;
+    uint64_t eod_offset;
+} tap_index_t;
+
+static tap_index_t g_tape_index_slots[TAPE_INDEX_SLOTS];
+static uint32_t g_tape_index_use;
+
+// Index of the image that is being accessed, selected by tapIndexCheck()
+static tap_index_t *g_tape_index = &g_tape_index_slots[0];
+
+// Read the 4-byte length field at given offset.
+// Skipping over records only needs the length fields, so they are taken from
+// the stream buffer if it already has them and otherwise read directly. A direct
+// read of 4 bytes goes through the SdFat sector cache, so consecutive small
+// records cost one SD sector read instead of refilling the whole stream buffer.
+static bool tapReadMarker(image_config_t &img, uint64_t offset, uint32_t *marker)
+{
+    uint8_t hdr[4];
+    if (offset + 4 > img.file.size()) return false;
+
+    if (g_tape_stream.img == &img && g_tape_stream.writing)
+    {
+        // Written data must be in the file before reading it back
+        tapeFlush();
+    }
+
+    if (g_tape_stream.img == &img && offset >= g_tape_stream.start &&
+        offset + 4 <= g_tape_stream.start + g_tape_stream.valid)
+    {
+        memcpy(hdr, g_tape_stream.buffer + (offset - g_tape_stream.start), 4);
+    }
+    else if (!img.file.seek(offset) || img.file.read(hdr, 4) != 4)
+    {
+        logmsg("Tape image read failed at offset ", (uint32_t)offset, ", SD card error ", SD.sdErrorCode());
+        return false;
+    }
+
+    *marker = hdr[0] | ((uint32_t)hdr[1] << 8) | ((uint32_t)hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+    return true;
+}
+
+// Parse the record or filemark at given offset
+static tap_object_t tapReadObject(image_config_t &img, uint64_t offset, uint32_t *length, uint64_t *next)
+{
+    uint32_t marker;
+    *length = 0;
+    *next = offset;
+
+    if (!tapReadMarker(img, offset, &marker))
+    {
+        return TAP_EOD;
+    }
+
+    if (marker == TAP_MARKER_FILEMARK)
+    {
+        *next = offset + 4;
+        return TAP_FILEMARK;
+    }
+    else if ((marker & ~(TAP_MARKER_ERROR | TAP_LENGTH_MASK)) != 0)
+    {
+        // End of medium or a reserved marker
+        return TAP_EOD;
+    }
+
+    uint32_t len = marker & TAP_LENGTH_MASK;
+    uint64_t end = offset + 4 + ((len + 1) & ~1) + 4;
+    if (end > img.file.size())
+    {
+        dbgmsg("------ Tape record at ", (uint32_t)offset, " is truncated");
+        return TAP_EOD;
+    }
+
+    *length = len;
+    *next = end;
+    return TAP_RECORD;
+}
+
+// Parse the record or filemark that ends at given offset, using the length
+// that is repeated after the record data. Returns TAP_EOD at beginning of tape.
+static tap_object_t tapReadObjectBefore(image_config_t &img, uint64_t offset, uint64_t *prev)
+{
+    uint32_t marker;
+    *prev = offset;
+
+    if (offset < 4 || !tapReadMarker(img, offset - 4, &marker))
+    {
+        return TAP_EOD;
+    }
+
+    if (marker == TAP_MARKER_FILEMARK)
+    {
+        *prev = offset - 4;
+        return TAP_FILEMARK;
+    }
+    else if ((marker & ~(TAP_MARKER_ERROR | TAP_LENGTH_MASK)) != 0)
+    {
+        return TAP_EOD;
+    }
+
+    uint32_t len = marker & TAP_LENGTH_MASK;
+    uint64_t size = 4 + ((len + 1) & ~1) + 4;
+    if (size > offset)
+    {
+        return TAP_EOD;
+    }
+
+    *prev = offset - size;
+    return TAP_RECORD;
+}
+
+// Find the index slot of an image, returns NULL if it has not been indexed
+static tap_index_t *tapIndexFind(image_config_t &img)
+{
+    for (int i = 0; i < TAPE_INDEX_SLOTS; i++)
+    {
+        if (g_tape_index_slots[i].img == &img)
+        {
+            return &g_tape_index_slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void tapIndexReset(image_config_t &img)
+{
+    tap_index_t *slot = tapIndexFind(img);
+    if (!slot)
+    {
+        // Use a free slot, or the least recently used one
+        slot = &g_tape_index_slots[0];
+        for (int i = 0; i < TAPE_INDEX_SLOTS; i++)
+        {
+            tap_index_t *candidate = &g_tape_index_slots[i];
+            if (!candidate->img)
+            {
+                slot = candidate;
+                break;
+            }
+            else if (g_tape_index_use - candidate->last_use > g_tape_index_use - slot->last_use)
+            {
+                slot = candidate;
+            }
+        }
+    }
+
+    g_tape_index = slot;
+    g_tape_index->img = &img;
+    g_tape_index->last_use = ++g_tape_index_use;
+    g_tape_index->interval = 1;
+    g_tape_index->checkpoint_count = 1;
+    g_tape_index->checkpoints[0] = 0;
+    g_tape_index->filemark_count = 0;
+    g_tape_index->filemarks_truncated = false;
+    g_tape_index->eod_block = 0;
+    g_tape_index->eod_offset = 0;
+}
+
+// Add an object at end of data, next_offset is the position after it
+static void tapIndexAppend(tap_object_t type, uint64_t next_offset)
+{
+    uint32_t block = g_tape_index->eod_block;
+    if (type == TAP_FILEMARK)
+    {
+        if (g_tape_index->filemark_count < TAPE_INDEX_MAX_FILEMARKS)
+            g_tape_index->filemarks[g_tape_index->filemark_count++] = block;
+        else
+            g_tape_index->filemarks_truncated = true;
+    }
+
+    block++;
+    g_tape_index->eod_block = block;
+    g_tape_index->eod_offset = next_offset;
+
+    if (block % g_tape_index->interval == 0)
+    {
+        if (g_tape_index->checkpoint_count == TAPE_INDEX_MAX_CHECKPOINTS)
+        {
+            // Table is full, keep every other checkpoint
+            for (uint32_t i = 0; i < TAPE_INDEX_MAX_CHECKPOINTS / 2; i++)
+            {
+                g_tape_index->checkpoints[i] = g_tape_index->checkpoints[i * 2];
+            }
+            g_tape_index->checkpoint_count = TAPE_INDEX_MAX_CHECKPOINTS / 2;
+            g_tape_index->interval *= 2;
+        }
+
+        if (block % g_tape_index->interval == 0 &&
+            block / g_tape_index->interval == g_tape_index->checkpoint_count)
+        {
+            g_tape_index->checkpoints[g_tape_index->checkpoint_count++] = next_offset;
+        }
+    }
+}
+
+// Number of indexed filemarks before given block
+static uint32_t tapFilemarksBefore(uint32_t block)
+{
+    uint32_t lo = 0, hi = g_tape_index->filemark_count;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (g_tape_index->filemarks[mid] < block)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Drop everything at and after given block, called before writing
+static void tapIndexTruncate(uint32_t block, uint64_t offset)
+{
+    if (block >= g_tape_index->eod_block) return;
+
+    uint32_t fm = tapFilemarksBefore(block);
+    if (fm < g_tape_index->filemark_count)
+    {
+        // The filemarks that did not fit in index were after this point
+        g_tape_index->filemarks_truncated = false;
+    }
+    g_tape_index->filemark_count = fm;
+    g_tape_index->checkpoint_count = block / g_tape_index->interval + 1;
+    g_tape_index->eod_block = block;
+    g_tape_index->eod_offset = offset;
+}
+
+static void tapBuildIndex(image_config_t &img)
+{
+    tapIndexReset(img);
+
+    uint64_t offset = 0;
+    uint32_t length;
+    uint64_t next;
+    tap_object_t type;
+    while ((type = tapReadObject(img, offset, &length, &next)) != TAP_EOD)
+    {
+        tapIndexAppend(type, next);
+        offset = next;
+
+        if ((g_tape_index->eod_block & 1023) == 0)
+        {
+            platform_reset_watchdog();
+        }
+    }
+}
+
+// Select the index of the image, rebuild it if it was dropped to make room for another one
+static void tapIndexCheck(image_config_t &img)
+{
+    tap_index_t *slot = tapIndexFind(img);
+    if (slot)
+    {
+        g_tape_index = slot;
+        g_tape_index->last_use = ++g_tape_index_use;
+    }
+    else
+    {
+        dbgmsg("------ Rebuilding tape index");
+        tapBuildIndex(img);
+    }
+}
+
+// Move to given block, which must not be past end of data
+static void tapSeekBlock(image_config_t &img, uint32_t block)
+{
+    if (block >= g_tape_index->eod_block)
+    {
+        img.tape_pos = g_tape_index->eod_block;
+        img.tape_offset = g_tape_index->eod_offset;
+        return;
+    }
+
+    // Start from the nearest known position before or after the block:
+    // the checkpoints on either side, end of data or the current position
+    uint32_t idx = block / g_tape_index->interval;
+    uint32_t pos = idx * g_tape_index->interval;
+    uint64_t offset = g_tape_index->checkpoints[idx];
+    uint32_t after_pos = g_tape_index->eod_block;
+    uint64_t after_offset = g_tape_index->eod_offset;
+    if (idx + 1 < g_tape_index->checkpoint_count)
+    {
+        after_pos = (idx + 1) * g_tape_index->interval;
+        after_offset = g_tape_index->checkpoints[idx + 1];
+    }
+
+    if (img.tape_pos <= block && img.tape_pos > pos)
+    {
+        pos = img.tape_pos;
+        offset = img.tape_offset;
+    }
+    else if (img.tape_pos > block && img.tape_pos < after_pos)
+    {
+        after_pos = img.tape_pos;
+        after_offset = img.tape_offset;
+    }
+
+    if (after_pos - block < block - pos)
+    {
+        // Scan backward using the length fields after each record
+        uint64_t prev;
+        while (after_pos > block && tapReadObjectBefore(img, after_offset, &prev) != TAP_EOD)
+        {
+            after_offset = prev;
+            after_pos--;
+        }
+
+        if (after_pos == block)
+        {
+            img.tape_pos = after_pos;
+            img.tape_offset = after_offset;
+            return;
+        }
+    }
+
+    while (pos < block)
+    {
+        uint32_t length;
+        uint64_t next;
+        if (tapReadObject(img, offset, &length, &next) == TAP_EOD) break;
+        offset = next;
+        pos++;
+    }
+
+    img.tape_pos = pos;
+    img.tape_offset = offset;
+}
+
+// Space forward by reading every object, used beyond the filemarks in index
+static void tapSpaceScan(image_config_t &img, bool filemarks, uint32_t count)
+{
+    uint32_t done = 0;
+    while (done < count)
+    {
+        uint32_t length;
+        uint64_t next;
+        tap_object_t type = tapReadObject(img, img.tape_offset, &length, &next);
+        if (type == TAP_EOD)
+        {
+            tapeSetSense(BLANK_CHECK, END_OF_DATA_DETECTED, SENSE_FLAG_INFO, count - done);
+            return;
+        }
+
+        img.tape_pos++;
+        img.tape_offset = next;
+
+        if (type == TAP_FILEMARK && !filemarks)
+        {
+            tapeSetSense(NO_SENSE, FILEMARK_DETECTED, SENSE_FLAG_FILEMARK | SENSE_FLAG_INFO, count - done);
+            return;
+        }
+        else if (type == TAP_FILEMARK || !filemarks)
+        {
+            done++;
+        }
+    }
+}
+
+// Space backward by reading the length field after every object,
+// used where filemarks may be missing from the index
+static void tapSpaceScanBackward(image_config_t &img, bool filemarks, uint32_t count)
+{
+    uint32_t done = 0;
+    while (done < count)
+    {
+        if (img.tape_pos == 0)
+        {
+            tapeSetSense(NO_SENSE, BEGINNING_OF_PARTITION_MEDIUM_DETECTED, SENSE_FLAG_EOM | SENSE_FLAG_INFO, count - done);
+            return;
+        }
+
+        uint64_t prev;
+        tap_object_t type = tapReadObjectBefore(img, img.tape_offset, &prev);
+        if (type == TAP_EOD)
+        {
+            dbgmsg("------ Tape record before offset ", (uint32_t)img.tape_offset, " is not valid");
+            tapeSetSense(MEDIUM_ERROR, UNRECOVERED_READ_ERROR, 0, 0);
+            return;
+        }
+
+        img.tape_pos--;
+        img.tape_offset = prev;
+
+        if (type == TAP_FILEMARK && !filemarks)
+        {
+            // Stop on the beginning-of-tape side of the filemark
+            tapeSetSense(NO_SENSE, FILEMARK_DETECTED, SENSE_FLAG_FILEMARK | SENSE_FLAG_INFO, count - done);
+            return;
+        }
+        else if (type == TAP_FILEMARK || !filemarks)
+        {
+            done++;
+        }
+    }
+}
+
+static void tapSpaceBlocks(image_config_t &img, int32_t count)
+{
+    uint32_t pos = img.tape_pos;
+    if (count >= 0)
+    {
+        uint32_t target = pos + count;
+        uint32_t fm_idx = tapFilemarksBefore(pos);
+        bool fm_found = (fm_idx < g_tape_index->filemark_count);
+        if (fm_found && g_tape_index->filemarks[fm_idx] < target)
+        {
+            uint32_t fm = g_tape_index->filemarks[fm_idx];
+            tapSeekBlock(img, fm + 1);
+            tapeSetSense(NO_SENSE, FILEMARK_DETECTED, SENSE_FLAG_FILEMARK | SENSE_FLAG_INFO, count - (fm - pos));
+        }
+        else if (!fm_found && g_tape_index->filemarks_truncated)
+        {
+            tapSpaceScan(img, false, count);
+        }
+        else if (target > g_tape_index->eod_block)
+        {
+            tapSeekBlock(img, g_tape_index->eod_block);
+            tapeSetSense(BLANK_CHECK, END_OF_DATA_DETECTED, SENSE_FLAG_INFO, count - (g_tape_index->eod_block - pos));
+        }
+        else
+        {
+            tapSeekBlock(img, target);
+        }
+    }
+    else
+    {
+        uint32_t n = -count;
+        uint32_t fm_idx = tapFilemarksBefore(pos);
+        if (fm_idx == g_tape_index->filemark_count && g_tape_index->filemarks_truncated)
+        {
+            // Filemarks after the last indexed one are not known
+            tapSpaceScanBackward(img, false, n);
+        }
+        else if (fm_idx > 0 && g_tape_index->filemarks[fm_idx - 1] + n >= pos)
+        {
+            // Stop on the beginning-of-tape side of the filemark
+            uint32_t fm = g_tape_index->filemarks[fm_idx - 1];
+            tapSeekBlock(img, fm);
+            tapeSetSense(NO_SENSE, FILEMARK_DETECTED, SENSE_FLAG_FILEMARK | SENSE_FLAG_INFO, n - (pos - fm - 1));
+        }
+        else if (n > pos)
+        {
+            tapSeekBlock(img, 0);
+            tapeSetSense(NO_SENSE, BEGINNING_OF_PARTITION_MEDIUM_DETECTED, SENSE_FLAG_EOM | SENSE_FLAG_INFO, n - pos);
+        }
+        else
+        {
+            tapSeekBlock(img, pos - n);
+        }
+    }
+}
+
+static void tapSpaceFilemarks(image_config_t &img, int32_t count)
+{
+    uint32_t fm_idx = tapFilemarksBefore(img.tape_pos);
+    if (count >= 0)
+    {
+        uint32_t target = fm_idx + count;
+        if (count == 0)
+        {
+            // Nothing to do
+        }
+        else if (target <= g_tape_index->filemark_count)
+        {
+            tapSeekBlock(img, g_tape_index->filemarks[target - 1] + 1);
+        }
+        else if (g_tape_index->filemarks_truncated)
+        {
+            tapSpaceScan(img, true, count);
+        }
+        else
+        {
+            tapSeekBlock(img, g_tape_index->eod_block);
+            tapeSetSense(BLANK_CHECK, END_OF_DATA_DETECTED, SENSE_FLAG_INFO, target - g_tape_index->filemark_count);
+        }
+    }
+    else
+    {
+        uint32_t n = -count;
+        if (fm_idx == g_tape_index->filemark_count && g_tape_index->filemarks_truncated)
+        {
+            // Filemarks after the last indexed one are not known
+            tapSpaceScanBackward(img, true, n);
+        }
+        else if (n <= fm_idx)
+        {
+            tapSeekBlock(img, g_tape_index->filemarks[fm_idx - n]);
+        }
+        else
+        {
+            tapSeekBlock(img, 0);
+            tapeSetSense(NO_SENSE, BEGINNING_OF_PARTITION_MEDIUM_DETECTED, SENSE_FLAG_EOM | SENSE_FLAG_INFO, n - fm_idx);
+        }
+    }
+}
+
+// Read one variable length record, or 'length' records of fixed block size
+static void tapRead(image_config_t &img, bool fixed, bool supress_invalid_length, uint32_t length)
+{
+    uint32_t blocklen = scsiDev.target->liveCfg.bytesPerSector;
+    uint32_t count = fixed ? length : 1;
+
+    if (length == 0)
+    {
+        // Zero length read does not move the tape
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    tapeDataInBegin();
+    for (uint32_t i = 0; i < count && scsiDev.phase != STATUS && !scsiDev.resetFlag; i++)
+    {
+        uint32_t reclen;
+        uint64_t next;
+        tap_object_t type = tapReadObject(img, img.tape_offset, &reclen, &next);
+
+        if (type == TAP_EOD)
+        {
+            tapeSetSense(BLANK_CHECK, END_OF_DATA_DETECTED, SENSE_FLAG_INFO, fixed ? (count - i) : length);
+            break;
+        }
+        else if (type == TAP_FILEMARK)
+        {
+            img.tape_pos++;
+            img.tape_offset = next;
+            tapeSetSense(NO_SENSE, FILEMARK_DETECTED, SENSE_FLAG_FILEMARK | SENSE_FLAG_INFO, fixed ? (count - i) : length);
+            break;
+        }
+
+        uint32_t wanted = fixed ? blocklen : length;
+        if (!tapeDataIn(img, img.tape_offset + 4, (reclen < wanted) ? reclen : wanted))
+        {
+            tapeSetSense(MEDIUM_ERROR, UNRECOVERED_READ_ERROR, 0, 0);
+            break;
+        }
+
+        img.tape_pos++;
+        img.tape_offset = next;
+
+        if (reclen != wanted && (fixed || reclen > length || !supress_invalid_length))
+        {
+            dbgmsg("------ Tape record length ", (int)reclen, " bytes, requested ", (int)wanted);
+            tapeSetSense(NO_SENSE, NO_ADDITIONAL_SENSE_INFORMATION, SENSE_FLAG_ILI | SENSE_FLAG_INFO,
+                         fixed ? (count - i) : (length - reclen));
+        }
+    }
+
+    tapeDataInEnd(img, img.tape_offset);
+    scsiDev.phase = STATUS;
+}
+
+static void tapAppendMarker(uint32_t marker)
+{
+    uint8_t buf[4] = {(uint8_t)marker, (uint8_t)(marker >> 8), (uint8_t)(marker >> 16), (uint8_t)(marker >> 24)};
+    tapeStreamAppend(buf, 4);
+}
+
+static bool tapCheckWritable(image_config_t &img)
+{
+    if (!img.file.isWritable())
+    {
+        tapeSetSense(DATA_PROTECT, WRITE_PROTECTED, 0, 0);
+        return false;
+    }
+    return true;
+}
+
+// Add fixed size records received from SCSI bus
+static bool tapConsumeRecords(image_config_t &img, const uint8_t *data, uint32_t len)
+{
+    uint32_t blocklen = scsiDev.target->liveCfg.bytesPerSector;
+    for (uint32_t pos = 0; pos < len; pos += blocklen)
+    {
+        tapAppendMarker(blocklen);
+        tapeStreamAppend(data + pos, blocklen);
+        if (blocklen & 1) tapeStreamAppend((const uint8_t*)"", 1);
+        tapAppendMarker(blocklen);
+
+        img.tape_pos++;
+        img.tape_offset += 8 + ((blocklen + 1) & ~1);
+        tapIndexAppend(TAP_RECORD, img.tape_offset);
+    }
+    return true;
+}
+
+// Add part of a variable length record received from SCSI bus
+static bool tapConsumeData(image_config_t &img, const uint8_t *data, uint32_t len)
+{
+    tapeStreamAppend(data, len);
+    return true;
+}
+
+// Write one variable length record, or 'length' records of fixed block size.
+// Data goes to the streaming buffer and is written to SD card when it fills up.
+static void tapWrite(image_config_t &img, bool fixed, uint32_t length)
+{
+    uint32_t blocklen = scsiDev.target->liveCfg.bytesPerSector;
+    uint32_t count = fixed ? length : 1;
+    uint32_t reclen = fixed ? blocklen : length;
+
+    if (!tapCheckWritable(img)) return;
+
+    if (count == 0 || reclen == 0)
+    {
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    // Writing discards everything after the current position
+    tapIndexTruncate(img.tape_pos, img.tape_offset);
+    tapeStreamSeekWrite(img, img.tape_offset);
+
+    if (fixed && blocklen <= sizeof(scsiDev.data) / 2)
+    {
+        tapeDataOut(img, count * blocklen, blocklen, &tapConsumeRecords);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count && scsiDev.phase != STATUS && !scsiDev.resetFlag; i++)
+        {
+            tapAppendMarker(reclen);
+            if (!tapeDataOut(img, reclen, 1, &tapConsumeData))
+            {
+                break;
+            }
+            if (reclen & 1) tapeStreamAppend((const uint8_t*)"", 1);
+            tapAppendMarker(reclen);
+
+            img.tape_pos++;
+            img.tape_offset += 8 + ((reclen + 1) & ~1);
+            tapIndexAppend(TAP_RECORD, img.tape_offset);
+        }
+    }
+
+    // A partially received record is hidden by the end of data marker
+    tapeStreamSetEnd(img, img.tape_offset);
+    scsiDev.phase = STATUS;
+}
+
+// Filemarks are written to SD card immediately, so that
+// completed backup sets are stored even if power is lost.
+static void tapWriteFilemarks(image_config_t &img, uint32_t count)
+{
+    if (!tapCheckWritable(img)) return;
+
+    if (count > 0)
+    {
+        tapIndexTruncate(img.tape_pos, img.tape_offset);
+        tapeStreamSeekWrite(img, img.tape_offset);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            tapAppendMarker(TAP_MARKER_FILEMARK);
+            img.tape_pos++;
+            img.tape_offset += 4;
+            tapIndexAppend(TAP_FILEMARK, img.tape_offset);
+        }
+
+        tapeStreamSetEnd(img, img.tape_offset);
+    }
+
+    tapeFlush();
+    scsiDev.phase = STATUS;
+}
+
+// Handle commands that differ for record structured tape images.
+// Returns 0 for commands that are handled the same way for all images.
+static int tapCommand(image_config_t &img)
+{
+    tapIndexCheck(img);
+
+    uint8_t command = scsiDev.cdb[0];
+    uint32_t length =
+        (((uint32_t) scsiDev.cdb[2]) << 16) +
+        (((uint32_t) scsiDev.cdb[3]) << 8) +
+        scsiDev.cdb[4];
+    bool fixed = scsiDev.cdb[1] & 1;
+    if (img.quirks == S2S_CFG_QUIRKS_OMTI)
+    {
+        fixed = true;
+    }
+
+    if (command == 0x08)
+    {
+        // READ6
+        bool supress_invalid_length = scsiDev.cdb[1] & 2;
+        tapRead(img, fixed, supress_invalid_length, length);
+    }
+    else if (command == 0x0A)
+    {
+        // WRITE6
+        tapWrite(img, fixed, length);
+    }
+    else if (command == 0x10)
+    {
+        // WRITE FILEMARKS
+        tapWriteFilemarks(img, length);
+    }
+    else if (command == 0x11)
+    {
+        // SPACE
+        uint8_t code = scsiDev.cdb[1] & 7;
+        int32_t count = (int32_t)(length << 8) >> 8; // Sign extend 24 bits
+
+        scsiDev.status = GOOD;
+        scsiDev.phase = STATUS;
+        if (code == 0)
+        {
+            tapSpaceBlocks(img, count);
+        }
+        else if (code == 1)
+        {
+            tapSpaceFilemarks(img, count);
+        }
+        else if (code == 3)
+        {
+            tapSeekBlock(img, g_tape_index->eod_block);
+        }
+        else
+        {
+            tapeSetSense(ILLEGAL_REQUEST, INVALID_FIELD_IN_CDB, 0, 0);
+        }
+    }
+    else if (command == 0x13)
+    {
+        // VERIFY, without byte compare this only moves over the records
+        if (scsiDev.cdb[1] & 2)
+        {
+            dbgmsg("------ Verify with byte compare is not implemented");
+            tapeSetSense(ILLEGAL_REQUEST, INVALID_FIELD_IN_CDB, 0, 0);
+        }
+        else
+        {
+            scsiDev.status = GOOD;
+            scsiDev.phase = STATUS;
+            tapSpaceBlocks(img, fixed ? length : 1);
+        }
+    }
+    else if (command == 0x19)
+    {
+        // ERASE, discards data after current position
+        if (tapCheckWritable(img))
+        {
+            tapIndexTruncate(img.tape_pos, img.tape_offset);
+            tapeStreamSetEnd(img, img.tape_offset);
+            tapeFlush();
+            scsiDev.phase = STATUS;
+        }
+    }
+    else if (command == 0x2B)
+    {
+        // Seek/Locate 10
+        uint32_t lba =
+            (((uint32_t) scsiDev.cdb[3]) << 24) +
+            (((uint32_t) scsiDev.cdb[4]) << 16) +
+            (((uint32_t) scsiDev.cdb[5]) << 8) +
+            scsiDev.cdb[6];
+
+        dbgmsg("------ Locate tape to block ", (int)lba);
+        tapSeekBlock(img, lba);
+        scsiDev.status = GOOD;
+        scsiDev.phase = STATUS;
+        if (lba > g_tape_index->eod_block)
+        {
+            tapeSetSense(BLANK_CHECK, END_OF_DATA_DETECTED, 0, 0);
+        }
+    }
+    else if (command == 0x05)
+    {
+        // READ BLOCK LIMITS, records can be any size
+        scsiDev.data[0] = 0; // Reserved
+        scsiDev.data[1] = (TAP_LENGTH_MASK >> 16) & 0xFF; // Maximum block length (MSB)
+        scsiDev.data[2] = (TAP_LENGTH_MASK >>  8) & 0xFF;
+        scsiDev.data[3] = (TAP_LENGTH_MASK >>  0) & 0xFF; // Maximum block length (LSB)
+        scsiDev.data[4] = 0; // Minimum block length (MSB)
+        scsiDev.data[5] = 1; // Minimum block length (LSB)
+        scsiDev.dataLen = 6;
+        scsiDev.phase = DATA_IN;
+    }
+    else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+void tapeLoadImage(image_config_t &img, const char *filename)
+{
+    img.tape_pos = 0;
+    img.tape_offset = 0;
+
+    size_t len = strlen(filename);
+    img.tape_tap_format = (len > 4 && strncasecmp(filename + len - 4, ".tap", 4) == 0);
+    if (!img.tape_tap_format)
+    {
+        return;
+    }
+
+    if (img.file.isRom() || img.file.isRaw())
+    {
+        logmsg("---- Record structured .tap format needs an image file on SD card, using fixed blocks");
+        img.tape_tap_format = false;
+        return;
+    }
+
+    tapBuildIndex(img);
+    logmsg("---- Record structured .tap tape image, ", (int)(g_tape_index->eod_block - g_tape_index->filemark_count),
+           " records and ", (int)g_tape_index->filemark_count, " filemarks");
+    if (g_tape_index->filemarks_truncated)
+    {
+        logmsg("---- Tape image has more than ", TAPE_INDEX_MAX_FILEMARKS, " filemarks, spacing past them requires scanning");
+    }
+}
+
+/*********************************/
+/* Fixed block tape image access */
+/*********************************/
+
+static bool tapeFlatCheckRange(image_config_t &img, uint32_t blocks)
+{
+    uint32_t blocklen = scsiDev.target->liveCfg.bytesPerSector;
+    if ((uint64_t)blocks * blocklen > 0xFFFFFFFF)
+    {
+        // Transfer length does not fit the 32-bit data phase length
+        logmsg("WARNING: Host attempted tape transfer of ", (int)blocks, " blocks of ", (int)blocklen,
+               " bytes, exceeding 4 GB");
+        tapeSetSense(ILLEGAL_REQUEST, INVALID_FIELD_IN_CDB, 0, 0);
+        return false;
+    }
+
+    uint32_t capacity = img.file.size() / blocklen;
+    if ((uint64_t)img.tape_pos + blocks > capacity)
+    {
+        logmsg("WARNING: Host attempted tape access at block ", (int)img.tape_pos, "+", (int)blocks,
+               ", exceeding image size ", (int)capacity, " blocks");
+        tapeSetSense(ILLEGAL_REQUEST, LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE, 0, 0);
+        return false;
+    }
+    return true;
+}
+
+static void tapeFlatRead(image_config_t &img, uint32_t blocks)
+{
+    uint32_t blocklen = scsiDev.target->liveCfg.bytesPerSector;
+    if (!tapeFlatCheckRange(img, blocks)) return;
+
+    uint64_t offset = (uint64_t)img.tape_pos * blocklen;
+    img.tape_pos += blocks;
+
+    tapeDataInBegin();
+    if (!tapeDataIn(img, offset, (uint32_t)((uint64_t)blocks * blocklen)))
+    {
+        tapeSetSense(MEDIUM_ERROR, UNRECOVERED_READ_ERROR, 0, 0);
+    }
+    tapeDataInEnd(img, (uint64_t)img.tape_pos * blocklen);
+    scsiDev.phase = STATUS;
+}
+
+static bool tapeFlatConsume(image_config_t &img, const uint8_t *data, uint32_t len)
+{
+    tapeStreamAppend(data, len);
+    return true;
+}
+
+static void tapeFlatWrite(image_config_t &img, uint32_t blocks)
+{
+    uint32_t blocklen = scsiDev.target->liveCfg.bytesPerSector;
+    if (!img.file.isWritable())
+    {
+        tapeSetSense(DATA_PROTECT, WRITE_PROTECTED, 0, 0);
+        return;
+    }
+    if (!tapeFlatCheckRange(img, blocks)) return;
+
+    tapeStreamSeekWrite(img, (uint64_t)img.tape_pos * blocklen);
+    img.tape_pos += blocks;
+
+    uint32_t unit = (blocklen <= sizeof(scsiDev.data) / 2) ? blocklen : 1;
+    tapeDataOut(img, (uint32_t)((uint64_t)blocks * blocklen), unit, &tapeFlatConsume);
+    scsiDev.phase = STATUS;
+}
+
 static void doSeek(uint32_t lba)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
@@ -61,6 +1371,30 @@ extern "C" int scsiTapeCommand()
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     int commandHandled = 1;
 
+    // Filemark, EOM and ILI information is only valid for the previous command
+    scsiDev.target->sense.flags = 0;
+
+    uint8_t cmd = scsiDev.cdb[0];
+    if (g_tape_stream.write_error &&
+        (cmd == 0x01 || cmd == 0x08 || cmd == 0x0A || cmd == 0x10 || cmd == 0x11 || cmd == 0x19 || cmd == 0x2B))
+    {
+        // Data buffered by an earlier WRITE could not be stored
+        g_tape_stream.write_error = false;
+        tapeSetSense(MEDIUM_ERROR, WRITE_ERROR_AUTO_REALLOCATION_FAILED, 0, 0);
+        return 1;
+    }
+
+    if (cmd == 0x01 || cmd == 0x1B)
+    {
+        // Write buffered data before REWIND and LOAD/UNLOAD
+        tapeFlush();
+    }
+
+    if (img.tape_tap_format && tapCommand(img))
+    {
+        return 1;
+    }
+
     uint8_t command = scsiDev.cdb[0];
     if (command == 0x08)
     {
@@ -100,7 +1434,11 @@ extern "C" int scsiTapeCommand()
         }
 
 
-        if (blocks_to_read > 0)
+        if (blocks_to_read > 0 && tapeStreamEnabled(img))
+        {
+            tapeFlatRead(img, blocks_to_read);
+        }
+        else if (blocks_to_read > 0)
         {
             scsiDiskStartRead(img.tape_pos, blocks_to_read);
             img.tape_pos += blocks_to_read;
@@ -140,7 +1478,11 @@ extern "C" int scsiTapeCommand()
             }
         }
 
-        if (blocks_to_write > 0)
+        if (blocks_to_write > 0 && tapeStreamEnabled(img))
+        {
+            tapeFlatWrite(img, blocks_to_write);
+        }
+        else if (blocks_to_write > 0)
         {
             scsiDiskStartWrite(img.tape_pos, blocks_to_write);
             img.tape_pos += blocks_to_write;
@@ -194,6 +1536,7 @@ extern "C" int scsiTapeCommand()
         // REWIND
         // Set tape position back to 0.
         img.tape_pos = 0;
+        img.tape_offset = 0;
     }
     else if (command == 0x05)
     {
@@ -278,7 +1621,7 @@ extern "C" int scsiTapeCommand()
         uint32_t lba = img.tape_pos;
         scsiDev.data[0] = 0x00;
         if (lba == 0) scsiDev.data[0] |= 0x80;
-        if (lba >= img.scsiSectors) scsiDev.data[0] |= 0x40;
+        if (!img.tape_tap_format && lba >= img.scsiSectors) scsiDev.data[0] |= 0x40;
         scsiDev.data[1] = 0x00;
         scsiDev.data[2] = 0x00;
         scsiDev.data[3] = 0x00;
@@ -3,4 +3,19 @@
 
 #pragma once
 
-extern "C" int scsiTapeCommand();
\ No newline at end of file
+#include "ZuluSCSI_disk.h"
+
+extern "C" int scsiTapeCommand();
+
+// Called when a tape image is loaded.
+// Images with .tap extension use the SIMH record structured format,
+// for them this builds the index of records and filemarks.
+void tapeLoadImage(image_config_t &img, const char *filename);
+
+// Write buffered tape data to SD card and drop read-ahead data.
+// Called before image files are closed or replaced.
+void tapeFlush();
+
+// Called from main loop, writes buffered data after the bus has been idle
+// for a while and otherwise continues reading ahead.
+void tapePoll();
@@ -0,0 +1,167 @@
+#!/usr/bin/python3
+
+'''
+  ZuluSCSI™ - Copyright (c) 2024 Rabbit Hole Computing™
+
+  ZuluSCSI™ file is licensed under the GPL version 3 or any later version.
+
+  https://www.gnu.org/licenses/gpl-3.0.html
+  ----
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+'''
+
+'''This script decodes the zulutrace.bin file recorded with BinaryTrace = 1.
+It prints a timeline of bus phases and commands, and with --summary
+the per-command latency statistics.'''
+
+import sys
+import struct
+
+PHASES = {
+    255: "BUS_FREE", 254: "BUS_BUSY", 253: "ARBITRATION", 252: "SELECTION", 251: "RESELECTION",
+    0: "DATA_OUT", 2: "COMMAND", 3: "MESSAGE_OUT", 4: "DATA_IN", 6: "STATUS", 7: "MESSAGE_IN"
+}
+
+COMMANDS = {
+    0x00: "TestUnitReady", 0x01: "RezeroUnit/Rewind", 0x03: "RequestSense", 0x04: "FormatUnit",
+    0x05: "ReadBlockLimits", 0x08: "Read6", 0x0A: "Write6", 0x0B: "Seek6", 0x10: "WriteFilemarks",
+    0x11: "Space", 0x12: "Inquiry", 0x15: "ModeSelect6", 0x1A: "ModeSense", 0x1B: "StartStopUnit",
+    0x1E: "PreventAllowMediumRemoval", 0x25: "ReadCapacity", 0x28: "Read10", 0x2A: "Write10",
+    0x2B: "Seek10", 0x2F: "Verify", 0x34: "PreFetch/ReadPosition", 0x35: "SynchronizeCache",
+    0x3B: "WriteBuffer", 0x3C: "ReadBuffer", 0x42: "ReadSubChannel", 0x43: "ReadTOC",
+    0x44: "ReadHeader", 0x45: "PlayAudio10", 0x47: "PlayAudioMSF", 0x4A: "GetEventStatusNotification",
+    0x4B: "PauseResume", 0x51: "ReadDiscInformation", 0x55: "ModeSelect10", 0x5A: "ModeSense10",
+    0xA8: "Read12", 0xAA: "Write12", 0xBE: "ReadCD",
+}
+
+TRACE_PHASE = 1
+TRACE_COMMAND = 2
+TRACE_DATA_IN = 3
+TRACE_DATA_OUT = 4
+TRACE_STATUS = 5
+TRACE_INITIATOR_PHASE = 6
+TRACE_CLOCK = 7
+TRACE_OVERFLOW = 8
+
+def read_events(path):
+    '''Yields (time_us, event, arg8, arg16, arg32) with wraparound of the
+    hardware counter resolved using the periodic millisecond clock events.'''
+    data = open(path, "rb").read()
+    magic, version, _, entrysize, _, ticks_per_sec, ring = struct.unpack_from("<4sBBBBII", data, 0)
+    if magic != b"ZTRC" or version != 1 or entrysize != 12:
+        raise ValueError("Not a ZuluSCSI trace file, or unsupported version")
+
+    wrap = 1 << 32
+    base = 0  # Accumulated counter wraps, in ticks
+    prev_ticks = None
+    prev_clock = None  # (ms, total ticks) of previous clock event
+
+    for pos in range(16, len(data) - 11, 12):
+        ticks, event, arg8, arg16, arg32 = struct.unpack_from("<IBBHI", data, pos)
+
+        if prev_ticks is not None and ticks < prev_ticks and event != TRACE_OVERFLOW:
+            base += wrap
+        if event != TRACE_OVERFLOW:
+            prev_ticks = ticks
+        total = base + ticks
+
+        if event == TRACE_CLOCK:
+            if prev_clock is not None:
+                # Counter may have wrapped several times while the bus was idle
+                expected = (arg32 - prev_clock[0]) % wrap * ticks_per_sec / 1000
+                missing = round((expected - (total - prev_clock[1])) / wrap)
+                if missing > 0:
+                    base += missing * wrap
+                    total += missing * wrap
+            prev_clock = (arg32, total)
+
+        yield (total * 1000000 / ticks_per_sec, event, arg8, arg16, arg32)
+
+def format_event(event, arg8, arg16, arg32):
+    if event == TRACE_PHASE:
+        return "%-12s ID %d" % (PHASES.get(arg8, str(arg8)), arg16)
+    elif event == TRACE_INITIATOR_PHASE:
+        return "%-12s (initiator)" % PHASES.get(arg8, str(arg8))
+    elif event == TRACE_COMMAND:
+        return "COMMAND      ID %d LUN %d %s (0x%02X) LBA %d" % (
+            arg16 & 0xFF, arg16 >> 8, COMMANDS.get(arg8, "Unknown"), arg8, arg32)
+    elif event == TRACE_DATA_IN:
+        return "  data in    %d bytes" % arg32
+    elif event == TRACE_DATA_OUT:
+        return "  data out   %d bytes" % arg32
+    elif event == TRACE_STATUS:
+        return "  status     %d, sense key %d ASC 0x%04X" % (arg8, arg32, arg16)
+    elif event == TRACE_CLOCK:
+        return "  clock      %d ms" % arg32
+    elif event == TRACE_OVERFLOW:
+        return "*** %d events lost, trace buffer overflow ***" % arg32
+    else:
+        return "  event 0x%02X %d %d %d" % (event, arg8, arg16, arg32)
+
+def print_timeline(events):
+    prev = None
+    for t, event, arg8, arg16, arg32 in events:
+        delta = 0 if prev is None else t - prev
+        prev = t
+        print("%14.1f us %+10.1f  %s" % (t, delta, format_event(event, arg8, arg16, arg32)))
+
+def print_summary(events):
+    '''Latency from COMMAND to BUS_FREE, and time spent in data phases.'''
+    stats = {}
+    current = None
+    data_start = None
+
+    for t, event, arg8, arg16, arg32 in events:
+        if event == TRACE_COMMAND:
+            current = {"opcode": arg8, "start": t, "bytes": 0, "data_time": 0.0}
+        elif event == TRACE_OVERFLOW:
+            current = None
+        elif current is None:
+            continue
+        elif event in (TRACE_DATA_IN, TRACE_DATA_OUT):
+            current["bytes"] += arg32
+        elif event == TRACE_PHASE:
+            phase = PHASES.get(arg8)
+            if data_start is not None:
+                current["data_time"] += t - data_start
+                data_start = None
+            if phase in ("DATA_IN", "DATA_OUT"):
+                data_start = t
+            elif phase == "BUS_FREE":
+                s = stats.setdefault(current["opcode"], [])
+                s.append((t - current["start"], current["data_time"], current["bytes"]))
+                current = None
+
+    print("%-28s %7s %10s %10s %10s %10s %10s" % ("Command", "Count", "Min us", "Avg us", "Max us", "Data us", "kB/s"))
+    for opcode in sorted(stats):
+        s = stats[opcode]
+        latencies = [x[0] for x in s]
+        data_time = sum(x[1] for x in s)
+        total_bytes = sum(x[2] for x in s)
+        total_time = sum(latencies)
+        speed = total_bytes / total_time * 1000000 / 1024 if total_time > 0 else 0
+        name = "%s (0x%02X)" % (COMMANDS.get(opcode, "Unknown"), opcode)
+        print("%-28s %7d %10.1f %10.1f %10.1f %10.1f %10.0f" % (
+            name, len(s), min(latencies), total_time / len(s), max(latencies), data_time / len(s), speed))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: decode_trace.py zulutrace.bin [--summary]")
+        sys.exit(1)
+
+    events = list(read_events(sys.argv[1]))
+    if "--summary" in sys.argv[2:]:
+        print_summary(events)
+    else:
+        print_timeline(events)